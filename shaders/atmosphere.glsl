@@ -0,0 +1,136 @@
+#pragma once
+
+// Samples the atmosphere's precomputed scattering tables. All lengths are in
+// globe units. The table layout must match atmosphere.cxx.
+
+// x: ground radius, y: top radius, z: kilometers per unit, w: Mie asymmetry.
+uniform vec4 u_AtmosphereParameters;
+// The direction towards the sun, in globe space.
+uniform vec3 u_SunDirection;
+uniform sampler2D u_TransmittanceTex;
+uniform sampler3D u_RayleighTex;
+uniform sampler3D u_MieTex;
+
+#define ATMOSPHERE_TRANSMITTANCE_MU_SIZE 256.0
+#define ATMOSPHERE_TRANSMITTANCE_R_SIZE 64.0
+#define ATMOSPHERE_R_SIZE 32.0
+#define ATMOSPHERE_MU_SIZE 128.0
+#define ATMOSPHERE_MU_S_SIZE 32.0
+#define ATMOSPHERE_NU_SIZE 8.0
+#define SUN_INTENSITY 20.0
+
+float atmosphereRadiusCoordinate(float r) {
+  return sqrt(clamp((r - u_AtmosphereParameters.x) /
+                        (u_AtmosphereParameters.y - u_AtmosphereParameters.x),
+                    0, 1));
+}
+
+/** Maps a coordinate in [0, 1] onto the centers of a table's texels. */
+float texelCoordinate(float coordinate, float size) {
+  return (clamp(coordinate, 0, 1) * (size - 1) + 0.5) / size;
+}
+
+/** The transmittance from radius r along mu to the top of the atmosphere. */
+vec3 transmittance(float r, float mu) {
+  vec2 uv = vec2(
+      texelCoordinate((mu + 1) / 2, ATMOSPHERE_TRANSMITTANCE_MU_SIZE),
+      texelCoordinate(atmosphereRadiusCoordinate(r),
+                      ATMOSPHERE_TRANSMITTANCE_R_SIZE));
+  return texture(u_TransmittanceTex, uv).rgb;
+}
+
+/** The transmittance between two points within the atmosphere. */
+vec3 transmittanceBetween(vec3 from, vec3 to) {
+  vec3 direction = normalize(to - from);
+  float r = length(from);
+  float mu = dot(from, direction) / r;
+  float rTo = length(to);
+  float muTo = dot(to, direction) / rTo;
+  // Look upwards from whichever end is lower, so neither ray hits the ground.
+  vec3 result = mu > 0
+      ? transmittance(r, mu) / max(transmittance(rTo, muTo), vec3(1e-6))
+      : transmittance(rTo, -muTo) / max(transmittance(r, -mu), vec3(1e-6));
+  return min(result, vec3(1));
+}
+
+/**
+ * Looks up the light scattered towards a point at radius r, looking along mu,
+ * with the sun at mu_s, and nu between the view and sun directions.
+ */
+void inscatter(float r, float mu, float muS, float nu, out vec3 rayleigh,
+               out vec3 mie) {
+  float uR = texelCoordinate(atmosphereRadiusCoordinate(r), ATMOSPHERE_R_SIZE);
+  float uMu = texelCoordinate((mu + 1) / 2, ATMOSPHERE_MU_SIZE);
+  float muSTexel = clamp((muS + 1) / 2, 0, 1) * (ATMOSPHERE_MU_S_SIZE - 1);
+  float nuSlice = clamp((nu + 1) / 2, 0, 1) * (ATMOSPHERE_NU_SIZE - 1);
+  float nuFloor = min(floor(nuSlice), ATMOSPHERE_NU_SIZE - 2);
+  float nuBlend = nuSlice - nuFloor;
+  // Hardware filtering covers mu_s within a nu slice, and nu is blended here.
+  float width = ATMOSPHERE_MU_S_SIZE * ATMOSPHERE_NU_SIZE;
+  vec3 uvw0 = vec3(
+      (nuFloor * ATMOSPHERE_MU_S_SIZE + muSTexel + 0.5) / width, uMu, uR);
+  vec3 uvw1 = uvw0 + vec3(ATMOSPHERE_MU_S_SIZE / width, 0, 0);
+  rayleigh = mix(texture(u_RayleighTex, uvw0).rgb,
+                 texture(u_RayleighTex, uvw1).rgb, nuBlend);
+  mie = mix(texture(u_MieTex, uvw0).rgb, texture(u_MieTex, uvw1).rgb, nuBlend);
+}
+
+float rayleighPhase(float nu) {
+  return 3.0 / (16.0 * PI) * (1 + nu * nu);
+}
+
+float miePhase(float nu) {
+  float g = u_AtmosphereParameters.w;
+  return 3.0 / (8.0 * PI) * ((1 - g * g) * (1 + nu * nu)) /
+         ((2 + g * g) * pow(1 + g * g - 2 * g * nu, 1.5));
+}
+
+/**
+ * Moves the given camera position along the view direction to where it
+ * enters the atmosphere, if outside it.
+ * Returns false if the view ray misses the atmosphere entirely.
+ */
+bool enterAtmosphere(inout vec3 position, vec3 direction) {
+  float topRadius = u_AtmosphereParameters.y;
+  float r = length(position);
+  if (r <= topRadius) {
+    return true;
+  }
+  float rMu = dot(position, direction);
+  float discriminant = rMu * rMu - r * r + topRadius * topRadius;
+  if (rMu > 0 || discriminant < 0) {
+    return false;
+  }
+  position += (-rMu - sqrt(discriminant)) * direction;
+  return true;
+}
+
+/** The sunlight scattered towards a point, looking in the given direction. */
+vec3 scatteredLight(vec3 position, vec3 direction) {
+  float r = length(position);
+  float nu = dot(direction, u_SunDirection);
+  vec3 rayleigh;
+  vec3 mie;
+  inscatter(r, dot(position, direction) / r, dot(position, u_SunDirection) / r,
+            nu, rayleigh, mie);
+  return SUN_INTENSITY * (rayleigh * rayleighPhase(nu) + mie * miePhase(nu));
+}
+
+/**
+ * Applies the atmosphere between the camera and a surface point to the
+ * surface's color.
+ */
+vec3 aerialPerspective(vec3 surfaceColor, vec3 camera, vec3 surface) {
+  vec3 direction = normalize(surface - camera);
+  if (!enterAtmosphere(camera, direction)) {
+    return surfaceColor;
+  }
+  // Keep the surface within the tables, since the seafloor dips below the
+  // ground radius.
+  surface *= max(1, u_AtmosphereParameters.x / length(surface));
+  vec3 attenuation = transmittanceBetween(camera, surface);
+  vec3 inscattered = max(vec3(0), scatteredLight(camera, direction) -
+                                      attenuation *
+                                          scatteredLight(surface, direction));
+  return surfaceColor * attenuation + inscattered;
+}
@@ -0,0 +1,22 @@
+#version 430
+
+#pragma include "common.glsl"
+
+uniform sampler2D u_VisibilityTex;
+uniform vec4 u_CoastlineColor;
+
+// Input from vertex shader
+in vec3 v_Position;
+
+out vec4 p3d_FragColor;
+
+void main() {
+  // Only draw the coast where it has ever been seen, like the globe itself.
+  vec2 uv = sphericalUVFromCartesian(v_Position);
+  float totalVisibility = texture(u_VisibilityTex, uv).r;
+  if (totalVisibility <= 0.0) {
+    discard;
+  }
+  p3d_FragColor =
+      vec4(u_CoastlineColor.rgb, u_CoastlineColor.a * totalVisibility);
+}
@@ -7,6 +7,13 @@
 #define TWO_PI 6.283185308
 
 uniform float u_LandMaskCutoff;
+// The height of the sea's surface, from the globe's center.
+uniform float u_SeaLevel;
+
+// The heights the height maps span, where the land mask charts the coast.
+#define SHORE_HEIGHT 0.95
+#define SEA_FLOOR_HEIGHT 0.94
+#define PEAK_HEIGHT 1.0
 
 // The fade for sight visibility around the boat.
 #define VISIBILITY_FADE_START 0.07
@@ -52,18 +59,32 @@ float unitSphereDistance(vec2 s1, vec2 s2) {
   // Find the angle between the two, when in cartesian.
   vec3 v1 = cartesianCoordsFromSpherical(vec3(s1, 1));
   vec3 v2 = cartesianCoordsFromSpherical(vec3(s2, 1));
-  float dotProduct = dot(v1, v2);
-  // acos starts going haywire when the vectors are really close together.
-  // TODO: estimate a better metric than this.
-  if (dotProduct <= 0.00001) return FLOAT_MAX;
-  if (dotProduct >= 0.99999) return 0;
-  return acos(dotProduct);
+  // Unlike acos of the dot product, this stays accurate for vectors that are
+  // really close together, or really far apart.
+  return atan(length(cross(v1, v2)), dot(v1, v2));
 }
 
 float inverseMix(float from, float to, float value) {
   return clamp((value - from) / (to - from), 0, 1);
 }
 
+/**
+ * Returns how much of a point is under water at u_SeaLevel, where a raised
+ * sea floods the land below it, and a lowered one lays bare the sea bed
+ * above it. At the charted sea level this is just the land mask.
+ */
+float waterCoverage(float landMask, float topology, float bathymetry) {
+  if (u_SeaLevel > SHORE_HEIGHT) {
+    float groundHeight = mix(SHORE_HEIGHT, PEAK_HEIGHT, topology);
+    return max(landMask, 1 - step(u_SeaLevel, groundHeight));
+  }
+  if (u_SeaLevel < SHORE_HEIGHT) {
+    float seaFloorHeight = mix(SHORE_HEIGHT, SEA_FLOOR_HEIGHT, 1 - bathymetry);
+    return min(landMask, 1 - step(u_SeaLevel, seaFloorHeight));
+  }
+  return landMask;
+}
+
 vec3 calculateLightViewDirection(vec3 fragmentViewPosition,
                                  vec4 lightViewPosition) {
   return normalize(lightViewPosition.xyz -
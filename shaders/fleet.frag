@@ -0,0 +1,33 @@
+#version 430
+
+#pragma include "common.glsl"
+
+uniform sampler2D p3d_Texture0;
+
+uniform struct { vec4 ambient; } p3d_LightModel;
+uniform struct p3d_LightSourceParameters {
+  vec4 color;
+  vec4 position;
+} p3d_LightSource[1];
+
+// Input from vertex shader
+in vec4 v_ViewPosition;
+in vec3 v_ViewNormal;
+in vec2 v_TexCoord0;
+
+out vec4 p3d_FragColor;
+
+void main() {
+  vec4 albedo = texture(p3d_Texture0, v_TexCoord0);
+  vec3 normal = normalize(v_ViewNormal);
+  vec3 diffuseColor = vec3(0);
+  for (int i = 0; i < p3d_LightSource.length(); ++i) {
+    vec3 lightViewDirection = calculateLightViewDirection(
+        v_ViewPosition.xyz, p3d_LightSource[i].position);
+    float diffuseIntensity = max(dot(normal, lightViewDirection), 0.0);
+    diffuseColor +=
+        albedo.rgb * p3d_LightSource[i].color.rgb * diffuseIntensity;
+  }
+  vec3 ambientColor = p3d_LightModel.ambient.rgb * albedo.rgb;
+  p3d_FragColor = vec4(clamp(diffuseColor + ambientColor, 0, 1), albedo.a);
+}
@@ -0,0 +1,52 @@
+#version 430
+
+// Uniform inputs
+uniform mat4 p3d_ModelViewMatrix;
+uniform mat4 p3d_ProjectionMatrix;
+uniform mat3 p3d_NormalMatrix;
+
+// Per instance transforms, as four consecutive rows per instance, as of the
+// latest step in the first half, and of the previous step in the second.
+uniform samplerBuffer u_InstanceTransforms;
+// The fraction of the way from the previous step to the latest.
+uniform float u_InterpolationFactor;
+
+// Vertex inputs
+in vec4 p3d_Vertex;
+in vec3 p3d_Normal;
+in vec2 p3d_MultiTexCoord0;
+
+// Output to fragment shader
+out vec4 v_ViewPosition;
+out vec3 v_ViewNormal;
+out vec2 v_TexCoord0;
+
+// Panda's matrices are row major, so the rows become the GLSL columns.
+mat4 fetchTransform(int row) {
+  return mat4(texelFetch(u_InstanceTransforms, row + 0),
+              texelFetch(u_InstanceTransforms, row + 1),
+              texelFetch(u_InstanceTransforms, row + 2),
+              texelFetch(u_InstanceTransforms, row + 3));
+}
+
+void main() {
+  int row = gl_InstanceID * 4;
+  int previousRow = row + (textureSize(u_InstanceTransforms) / 2);
+  // Blend between the steps, keeping the axes unit length. A step turns a
+  // ship by little, so the axes stay all but perpendicular.
+  mat4 instanceTransform = mat4(0);
+  mat4 previousTransform = fetchTransform(previousRow);
+  mat4 latestTransform = fetchTransform(row);
+  for (int i = 0; i < 4; i++) {
+    instanceTransform[i] = mix(previousTransform[i], latestTransform[i],
+                               u_InterpolationFactor);
+  }
+  for (int i = 0; i < 3; i++) {
+    instanceTransform[i].xyz = normalize(instanceTransform[i].xyz);
+  }
+  v_ViewPosition = p3d_ModelViewMatrix * (instanceTransform * p3d_Vertex);
+  v_ViewNormal =
+      normalize(p3d_NormalMatrix * (mat3(instanceTransform) * p3d_Normal));
+  v_TexCoord0 = p3d_MultiTexCoord0;
+  gl_Position = p3d_ProjectionMatrix * v_ViewPosition;
+}
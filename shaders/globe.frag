@@ -1,6 +1,7 @@
 #version 430
 
 #pragma include "common.glsl"
+#pragma include "atmosphere.glsl"
 
 uniform sampler2D p3d_Texture0;  // topology
 uniform sampler2D p3d_Texture1;  // bathymetry
@@ -9,8 +10,13 @@ uniform sampler2D p3d_Texture3;  // albedo
 uniform sampler2D p3d_Texture4;  // normal
 uniform sampler2D p3d_Texture5;  // visibility
 uniform sampler2D p3d_Texture6;  // incognita
+// Terrain horizon angles, for 8 azimuths starting east, counter-clockwise.
+uniform sampler2DArray u_HorizonTex;
+// Added to the mip level the surface textures are sampled at.
+uniform float u_LodBias;
 
 uniform mat3 p3d_NormalMatrix;
+uniform mat4 p3d_ModelViewMatrixInverse;
 uniform struct { vec4 ambient; } p3d_LightModel;
 uniform struct p3d_LightSourceParameters {
   vec4 color;
@@ -23,26 +29,76 @@ in vec4 v_Position;
 
 out vec4 p3d_FragColor;
 
+// The angle over which the sun fades out as it sets behind terrain.
+#define TERRAIN_SHADOW_SOFTNESS 0.02
+// The color of sea bed laid bare by a lowered sea.
+#define SEA_BED_COLOR vec3(0.76, 0.70, 0.50)
+
+/**
+ * Returns how much of a light in the given model space direction reaches the
+ * terrain at the given UV, by comparing its elevation against the baked
+ * horizon in its azimuth.
+ */
+float terrainShadow(vec2 uv, vec3 up, vec3 lightDirection) {
+  vec3 east = cross(vec3(0, 0, 1), up);
+  if (length(east) < 0.0001) {
+    return 1;
+  }
+  east = normalize(east);
+  vec3 north = cross(up, east);
+  float lightElevation = asin(clamp(dot(lightDirection, up), -1, 1));
+  float lightAzimuth =
+      atan(dot(lightDirection, north), dot(lightDirection, east));
+  if (lightAzimuth < 0) {
+    lightAzimuth += TWO_PI;
+  }
+  vec4 horizons0 = texture(u_HorizonTex, vec3(uv, 0));
+  vec4 horizons1 = texture(u_HorizonTex, vec3(uv, 1));
+  float horizons[8] = float[8](horizons0.r, horizons0.g, horizons0.b,
+                               horizons0.a, horizons1.r, horizons1.g,
+                               horizons1.b, horizons1.a);
+  float direction = lightAzimuth / TWO_PI * 8;
+  int direction0 = int(floor(direction)) % 8;
+  int direction1 = (direction0 + 1) % 8;
+  float horizon = PI_OVER_TWO * mix(horizons[direction0], horizons[direction1],
+                                    fract(direction));
+  return smoothstep(horizon - TERRAIN_SHADOW_SOFTNESS,
+                    horizon + TERRAIN_SHADOW_SOFTNESS, lightElevation);
+}
+
 void main() {
   // UVs need to be calculated here, and not passed in via vertex data since
   // otherwise when u goes back from 1 to 0, the texture is quickly lerped,
   // instead of discontinued.
   vec2 uv = sphericalUVFromCartesian(v_Position.xyz);
-  float topology = texture(p3d_Texture0, uv).r;
-  float bathymetry = texture(p3d_Texture1, uv).r;
-  float landMask = texture(p3d_Texture2, uv).r;
-  vec3 albedo = texture(p3d_Texture3, uv).rgb;
-  vec3 normal = texture(p3d_Texture4, uv).rgb;
+  // Take the gradients with the wrap of u removed, since the jump from 1 back
+  // to 0 would otherwise pick the smallest mip along the seam, and scale them
+  // to apply the bias.
+  vec2 uvDx = dFdx(uv);
+  vec2 uvDy = dFdy(uv);
+  uvDx.x -= round(uvDx.x);
+  uvDy.x -= round(uvDy.x);
+  float lodScale = exp2(u_LodBias);
+  uvDx *= lodScale;
+  uvDy *= lodScale;
+  float topology = textureGrad(p3d_Texture0, uv, uvDx, uvDy).r;
+  float bathymetry = textureGrad(p3d_Texture1, uv, uvDx, uvDy).r;
+  float landMask = textureGrad(p3d_Texture2, uv, uvDx, uvDy).r;
+  vec3 albedo = textureGrad(p3d_Texture3, uv, uvDx, uvDy).rgb;
+  vec3 normal = textureGrad(p3d_Texture4, uv, uvDx, uvDy).rgb;
   float totalVisibility = texture(p3d_Texture5, uv).r;
   float immediateVisibility = texture(p3d_Texture5, uv).g;
   vec3 incognitaColor = texture(p3d_Texture6, 4 * uv).rgb;
 
   float waterDepth = 1 - bathymetry;
   vec3 waterColor = mix(vec3(0, 0.5, 1), vec3(0, 0, 0.5), waterDepth);
-  vec3 earthUnlitColor = mix(albedo, waterColor, landMask);
+  float water = waterCoverage(landMask, topology, bathymetry);
+  // Sea bed laid bare by a lowered sea has no albedo of its own.
+  vec3 groundColor = mix(albedo, SEA_BED_COLOR, max(0, landMask - water));
+  vec3 earthUnlitColor = mix(groundColor, waterColor, water);
   vec3 flatNormal = cartesianFromSphericalUV(uv);
   // Use a flat, smooth surface normal for water
-  normal = mix(normal, flatNormal, landMask);
+  normal = mix(normal, flatNormal, water);
 
   vec3 fragmentViewPosition = v_ViewPosition.xyz;
   vec3 fragmentViewNormal = normalize(p3d_NormalMatrix * normal);
@@ -55,6 +111,11 @@ void main() {
     if (diffuseIntensity < 0.0) {
       continue;
     }
+    // The normal matrix is a scaled rotation, so its transpose takes view
+    // directions back into model space.
+    vec3 lightModelDirection =
+        normalize(transpose(p3d_NormalMatrix) * lightViewDirection);
+    diffuseIntensity *= terrainShadow(uv, flatNormal, lightModelDirection);
     diffuseEarthColor +=
         clamp(earthUnlitColor * p3d_LightSource[i].color.rgb * diffuseIntensity,
               0, 1);
@@ -64,6 +125,8 @@ void main() {
   vec3 ambientEarthColor = p3d_LightModel.ambient.rgb * earthUnlitColor;
 
   vec3 earthColor = diffuseEarthColor + ambientEarthColor;
+  vec3 cameraPosition = (p3d_ModelViewMatrixInverse * vec4(0, 0, 0, 1)).xyz;
+  earthColor = aerialPerspective(earthColor, cameraPosition, v_Position.xyz);
   vec3 obscuredEarthColor = mix(earthColor, incognitaColor, 0.5);
   vec3 incongitaEarthColor =
       mix(incognitaColor, obscuredEarthColor, totalVisibility);
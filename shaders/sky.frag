@@ -0,0 +1,22 @@
+#version 430
+
+#pragma include "common.glsl"
+#pragma include "atmosphere.glsl"
+
+uniform mat4 p3d_ModelViewMatrixInverse;
+
+// Input from vertex shader
+in vec3 v_Position;
+
+out vec4 p3d_FragColor;
+
+void main() {
+  // Only the far side of the shell is drawn, so that every pixel covered by
+  // the atmosphere is shaded once, whether the camera is inside or outside.
+  vec3 camera = (p3d_ModelViewMatrixInverse * vec4(0, 0, 0, 1)).xyz;
+  vec3 direction = normalize(v_Position - camera);
+  if (!enterAtmosphere(camera, direction)) {
+    discard;
+  }
+  p3d_FragColor = vec4(scatteredLight(camera, direction), 1);
+}
@@ -0,0 +1,15 @@
+#version 430
+
+// Uniform inputs
+uniform mat4 p3d_ModelViewProjectionMatrix;
+
+// Vertex inputs
+in vec4 p3d_Vertex;
+
+// Output to fragment shader
+out vec3 v_Position;
+
+void main() {
+  gl_Position = p3d_ModelViewProjectionMatrix * p3d_Vertex;
+  v_Position = p3d_Vertex.xyz;
+}
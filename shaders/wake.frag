@@ -0,0 +1,15 @@
+#version 430
+
+uniform vec4 u_WakeColor;
+
+// Input from vertex shader
+in float v_Age;
+
+out vec4 p3d_FragColor;
+
+void main() {
+  if (v_Age > 1.0) {
+    discard;
+  }
+  p3d_FragColor = vec4(u_WakeColor.rgb, u_WakeColor.a * (1.0 - v_Age));
+}
@@ -0,0 +1,24 @@
+#version 430
+
+// Uniform inputs
+uniform mat4 p3d_ModelViewProjectionMatrix;
+// The newest segment's slot, the number of segments written, and capacity.
+uniform ivec3 u_TrailState;
+
+// Vertex inputs
+in vec4 p3d_Vertex;
+
+// Output to fragment shader
+out float v_Age;
+
+void main() {
+  int head = u_TrailState.x;
+  int count = u_TrailState.y;
+  int capacity = u_TrailState.z;
+  // Each segment owns two consecutive vertices of the ring buffer.
+  int slot = gl_VertexID / 2;
+  int age = (head - slot + capacity) % capacity;
+  // Slots not yet written are pushed past the oldest age, and discarded.
+  v_Age = age < count ? float(age) / float(capacity) : 2.0;
+  gl_Position = p3d_ModelViewProjectionMatrix * p3d_Vertex;
+}
@@ -1,55 +1,90 @@
 #include "app.h"
 
+#include <iostream>
+#include <sstream>
+
 #include "debug_axes.h"
 #include "filename.h"
 #include "globe.h"
 #include "panda3d/ambientLight.h"
 #include "panda3d/asyncTaskManager.h"
 #include "panda3d/boundingBox.h"
+#include "panda3d/camera.h"
 #include "panda3d/clockObject.h"
-#include "panda3d/collisionNode.h"
-#include "panda3d/collisionSphere.h"
 #include "panda3d/computeNode.h"
 #include "panda3d/directionalLight.h"
 #include "panda3d/geomLines.h"
 #include "panda3d/geomTriangles.h"
 #include "panda3d/graphicsPipe.h"
+#include "panda3d/lens.h"
 #include "panda3d/mouseAndKeyboard.h"
 #include "panda3d/pandaFramework.h"
 #include "panda3d/pandaSystem.h"
 #include "panda3d/shader.h"
 #include "panda3d/texturePool.h"
+#include "panda3d/thread.h"
 #include "panda3d/windowFramework.h"
 #include "panda3d/windowProperties.h"
+#include "parallel.h"
 #include "quaternion.h"
 #include "typedefs.h"
 
 namespace earth_world {
 
 const bool kEnableDebugAxes = false;
-const int kGlobeVerticesPerEdge = 100;
+/** Start on the tier matching the old fixed quality, and adapt from there. */
+const int kInitialQualityTier = 2;
+const double kTargetFrameTime = 1.0 / 60;
+/** The time left at the end of each frame, after any background work. */
+const double kBackgroundReservedTime = 0.002;
+/** The priority of catching collision up with the sea level. */
+const int kCoastUpdatePriority = 1;
 const PN_stdfloat kAxesScale = 40.f;
-const PN_stdfloat kGlobeScale = 20.f;
 const PN_stdfloat kBoatScale = 0.05f;
-const PN_stdfloat kBoatSpeed = 0.07f;
-const PN_stdfloat kCameraDistanceMin = 7.f;
-const PN_stdfloat kCameraDistanceMax = 20.f;
-const PN_stdfloat kCameraZoomSpeed = 5.f;
-const std::string kTagCityId = "city_id";
+const int kWakeCapacity = 256;
+const PN_stdfloat kWakeSpacing = 0.1f;
+/** Lifts the wake just above the water, so it isn't hidden by the surface. */
+const PN_stdfloat kWakeLift = 1.001f;
+const PN_stdfloat kFleetDrawDistance = 30.f;
+/** The change in sea level per key press, a hundredth of the land's range. */
+const PN_stdfloat kSeaLevelStep = 0.0005f;
+/** How close, in radians, a pick must land to a city to pick it. */
+const PN_stdfloat kCityPickAngle = 0.01f;
+const PN_stdfloat kEarthRadiusKilometers = 6371.f;
 const LColor kClearColor(0, 0, 0, 1);
 
 App::App(PT<WindowFramework> window)
     : framework_{window->get_panda_framework()},
       window_{window},
-      collision_handler_queue_{new CollisionHandlerQueue},
       globe_{window->get_graphics_output()},
-      globe_view_{window->get_graphics_output(), globe_, kGlobeVerticesPerEdge},
-      minimap_view_{globe_},
+      globe_view_{window->get_graphics_output(), globe_,
+                  QualityGovernor::getPresetTier(kInitialQualityTier)
+                      .globe_vertices_per_edge},
+      coastline_view_{globe_},
+      atmosphere_view_{atmosphere_},
+      minimap_view_{window->get_graphics_output(), globe_},
+      scaled_scene_view_{window},
+      quality_governor_{kTargetFrameTime, kInitialQualityTier},
+      background_scheduler_{kTargetFrameTime, kBackgroundReservedTime},
+      coast_update_job_{0},
+      cities_{buildCities(globe_)},
+      city_labels_view_{cities_},
+      city_horizon_culler_{getCityPositions(cities_),
+                           kGlobeWaterSurfaceHeight},
+      city_index_{getCityPositions(cities_)},
+      globe_picker_{globe_, city_index_},
+      sea_route_planner_{globe_.getLandMaskImage(), globe_.getLandMaskCutoff(),
+                         globe_.getSourceHash()},
+      reached_city_id_{-1},
       input_{0},
       last_window_size_{0},
-      camera_distance_{kCameraDistanceMin},
-      boat_unit_sphere_position_{/* azimuthal= */ 0, /* polar= */ 0},
-      boat_heading_{0.f} {
+      simulation_thread_{globe_,
+                         Simulation(globe_, kSimulationStepDuration,
+                                    kFleetSize)},
+      boat_wake_{kWakeCapacity, kWakeSpacing},
+      fleet_view_{window, kFleetSize, kBoatScale},
+      fleet_step_count_{0},
+      fleet_radius_{0} {
   window_->get_display_region_3d()->set_clear_color(kClearColor);
 
   if (kEnableDebugAxes) {
@@ -73,48 +108,48 @@ App::App(PT<WindowFramework> window)
   globe_view_.getPath().set_scale(kGlobeScale);
   globe_view_.getMeshPath().set_light(directional_light_path);
   globe_view_.getMeshPath().set_light(ambient_light_path);
+  AtmosphereView::setShaderInputs(globe_view_.getMeshPath(), atmosphere_);
+  atmosphere_view_.getPath().reparent_to(globe_view_.getPath());
+  coastline_view_.getPath().reparent_to(globe_view_.getPath());
+  const SimulationState &initial_state =
+      simulation_thread_.read().simulation.getState();
+  globe_view_.getPath().set_shader_input("u_SunDirection",
+                                         initial_state.boat_unit_position);
 
-  // Create the collection of cities, and place them.
-  cities_.reserve(kDefaultCities.size());
-  for (std::vector<CityStaticData>::size_type i = 0; i < kDefaultCities.size();
-       i++) {
-    const CityStaticData &city_static_data = kDefaultCities[i];
-    PN_stdfloat height =
-        globe_.getHeightAtPoint(city_static_data.getLocation());
-    City city(city_static_data, i, height);
-    cities_.push_back(std::move(city));
-  }
   city_views_.reserve(cities_.size());
   for (std::vector<City>::size_type i = 0; i < cities_.size(); i++) {
     const City &city = cities_[i];
     CityView city_view(window_, city);
     city_view.getPath().reparent_to(globe_view_.getPath());
-    city_view.getPath().set_tag(kTagCityId, std::to_string(i));
     city_views_.push_back(std::move(city_view));
   }
+  city_labels_view_.getPath().reparent_to(globe_view_.getPath());
 
   boat_path_ = window_->load_model(framework_->get_models(),
                                    filename::forModel("boat/S_Boat.bam"));
   boat_path_.reparent_to(window_->get_render());
   boat_path_.set_scale(kBoatScale);
 
+  boat_wake_.getPath().reparent_to(window_->get_render());
+
+  fleet_view_.getPath().reparent_to(window_->get_render());
+  fleet_view_.getPath().set_light(directional_light_path);
+  fleet_view_.getPath().set_light(ambient_light_path);
+
   directional_light_path.reparent_to(boat_path_);
   directional_light_path.set_quat(
       quaternion::fromLookAt(LVector3::down(), LVector3::forward()));
 
-  PT<CollisionSphere> boat_collider = new CollisionSphere(0, 0, 0, 3);
-  PT<CollisionNode> boat_collider_node = new CollisionNode("BoatCollider");
-  boat_collider_node->add_solid(boat_collider);
-  boat_collider_path_ = boat_path_.attach_new_node(boat_collider_node);
-  collision_traverser_.add_collider(boat_collider_path_,
-                                    collision_handler_queue_);
-
   camera_path_ = window_->get_camera_group();
-  camera_path_.set_pos((kGlobeScale + camera_distance_) * LVector3::right());
+  camera_path_.set_pos((kGlobeScale + initial_state.camera_distance) *
+                       LVector3::right());
   camera_path_.set_quat(
       quaternion::fromLookAt(LVector3::left(), LVector3::up()));
 
   minimap_view_.getPath().reparent_to(window->get_pixel_2d());
+  scaled_scene_view_.getPath().reparent_to(window->get_render_2d());
+  status_view_.getPath().reparent_to(window->get_pixel_2d());
+  applyQualityTier(quality_governor_.getTier());
 
   PT<GenericAsyncTask> update_task =
       new GenericAsyncTask("Update", &App::onUpdate, /* app= */ this);
@@ -129,23 +164,108 @@ App::App(PT<WindowFramework> window)
                 &App::onInputRight, &App::onInputLeft);
   defineAxisKey("e", "q", "Zoom In", "Zoom Out", &App::onInputZoomIn,
                 &App::onInputZoomOut);
+  framework_->define_key("mouse1", "Pick", &App::onPick, /* app= */ this);
+  framework_->define_key("page_up", "Raise sea level", &App::onRaiseSeaLevel,
+                         /* app= */ this);
+  framework_->define_key("page_down", "Lower sea level",
+                         &App::onLowerSeaLevel, /* app= */ this);
 }
 
 App::~App() {
   framework_->get_task_mgr().remove_task_chain("Update");
   minimap_view_.getPath().remove_node();
   camera_path_.remove_node();
-  collision_traverser_.remove_collider(boat_collider_path_);
   boat_path_.remove_node();
   globe_view_.getPath().remove_node();
 }
 
+std::vector<City> App::buildCities(const Globe &globe) {
+  // Sample the heights across all cores, then place the cities in order.
+  std::vector<PN_stdfloat> heights(kDefaultCities.size());
+  parallel::forRange(
+      0, static_cast<int>(kDefaultCities.size()),
+      [&](int city_begin, int city_end) {
+        for (int i = city_begin; i < city_end; i++) {
+          std::size_t index = static_cast<std::size_t>(i);
+          heights[index] =
+              globe.getHeightAtPoint(kDefaultCities[index].getLocation());
+        }
+      });
+  std::vector<City> cities;
+  cities.reserve(kDefaultCities.size());
+  for (std::vector<CityStaticData>::size_type i = 0; i < kDefaultCities.size();
+       i++) {
+    City city(kDefaultCities[i], i, heights[i]);
+    cities.push_back(std::move(city));
+  }
+  return cities;
+}
+
+std::vector<LVector3> App::getCityPositions(const std::vector<City> &cities) {
+  std::vector<LVector3> positions;
+  positions.reserve(cities.size());
+  for (const City &city : cities) {
+    positions.push_back(city.getLocation().toCartesian());
+  }
+  return positions;
+}
+
+void App::applyQualityTier(const QualityTier &tier) {
+  globe_view_.setVerticesPerEdge(window_->get_graphics_output(), globe_,
+                                 tier.globe_vertices_per_edge);
+  globe_view_.getMeshPath().set_shader_input("u_LodBias",
+                                             LVector2(tier.lod_bias, 0));
+  scaled_scene_view_.setRenderScale(tier.render_scale);
+}
+
+void App::record(const Filename &filename) {
+  recording_filename_ = filename;
+  simulation_thread_.record();
+}
+
+bool App::replay(const Filename &filename) {
+  InputLog input_log(kSimulationStepDuration);
+  if (!input_log.read(filename)) {
+    return false;
+  }
+  simulation_thread_.replay(input_log);
+  return true;
+}
+
 int App::run() {
+  simulation_thread_.start();
   framework_->main_loop();
+  writeRecording();
   framework_->close_framework();
   return 0;
 }
 
+int App::runFrames(int frame_count, const Filename &screenshot_filename) {
+  // Advance the simulation by a frame's time before every frame, rather than
+  // in real time, so that the saved frame is the same on every run.
+  for (int i = 0; i < frame_count; i++) {
+    simulation_thread_.advance(kTargetFrameTime);
+    framework_->do_frame(Thread::get_current_thread());
+  }
+  // Let the cull and draw threads finish the last frame before saving it.
+  framework_->get_graphics_engine()->sync_frame();
+  bool saved =
+      window_->get_graphics_output()->save_screenshot(screenshot_filename);
+  writeRecording();
+  framework_->close_framework();
+  return saved ? 0 : 1;
+}
+
+void App::writeRecording() {
+  if (recording_filename_.empty()) {
+    return;
+  }
+  if (!simulation_thread_.getRecording().write(recording_filename_)) {
+    std::cout << "Could not write input log to " << recording_filename_
+              << "." << std::endl;
+  }
+}
+
 void App::defineAxisKey(
     const std::string &positive_key_name, const std::string &negative_key_name,
     const std::string &positive_name, const std::string &negative_name,
@@ -172,112 +292,218 @@ void App::onInputChange(LVector3 input_delta) {
              std::min(1.f, std::max(-1.f, input_.get_z())));
 }
 
-AsyncTask::DoneStatus App::onUpdate(GenericAsyncTask *task) {
-  ClockObject *clock = ClockObject::get_global_clock();
-  if (window_.is_null() || clock == nullptr) {
-    return AsyncTask::DS_exit;
+void App::onSeaLevelChange(int direction) {
+  // The simulation reads the sea level, so it waits while it changes.
+  simulation_thread_.pause();
+  globe_.setSeaLevel(globe_.getSeaLevel() +
+                     (static_cast<PN_stdfloat>(direction) * kSeaLevelStep));
+  simulation_thread_.resume();
+  globe_view_.getMeshPath().set_shader_input(
+      "u_SeaLevel", LVector2(globe_.getSeaLevel(), 0));
+  if (globe_.isCoastStale() &&
+      !background_scheduler_.isPending(coast_update_job_)) {
+    coast_update_job_ = background_scheduler_.add(
+        kCoastUpdatePriority, [this] { return stepCoastUpdate(); });
+  }
+}
+
+bool App::stepCoastUpdate() {
+  if (globe_.stepCoastUpdate()) {
+    // The simulation sails on the coast field, so it waits while a band of
+    // it is swapped in.
+    simulation_thread_.pause();
+    globe_.applyCoastUpdate();
+    simulation_thread_.resume();
   }
+  return !globe_.isCoastStale();
+}
+
+void App::onPick() {
   GraphicsWindow *graphics_window = window_->get_graphics_window();
   if (graphics_window == nullptr) {
+    return;
+  }
+  MouseData pointer = graphics_window->get_pointer(0);
+  LVector2i window_size = graphics_window->get_size();
+  if (!pointer.get_in_window() || window_size.get_x() <= 0 ||
+      window_size.get_y() <= 0) {
+    return;
+  }
+
+  // Cast a ray from the camera through the pointer, relative to the globe.
+  PN_stdfloat pointer_u =
+      static_cast<PN_stdfloat>(pointer.get_x() / window_size.get_x());
+  PN_stdfloat pointer_v =
+      static_cast<PN_stdfloat>(pointer.get_y() / window_size.get_y());
+  LPoint2 film_point((2 * pointer_u) - 1, 1 - (2 * pointer_v));
+  LPoint3 near_point;
+  LPoint3 far_point;
+  if (!window_->get_camera(0)->get_lens()->extrude(film_point, near_point,
+                                                   far_point)) {
+    return;
+  }
+  NodePath globe_path = globe_view_.getPath();
+  LPoint3 origin = globe_path.get_relative_point(camera_path_, near_point);
+  LVector3 direction =
+      globe_path.get_relative_point(camera_path_, far_point) - origin;
+
+  GlobePick pick;
+  if (!globe_picker_.pick(origin, direction, kCityPickAngle, pick)) {
+    return;
+  }
+  std::ostringstream status;
+  status.setf(std::ios::fixed);
+  status.precision(2);
+  if (pick.city_id >= 0) {
+    const City &city = cities_[static_cast<std::size_t>(pick.city_id)];
+    status << city.getName() << ", " << city.getCountryName() << "\n";
+    SeaRoute route;
+    const Simulation &simulation = simulation_thread_.read().simulation;
+    if (sea_route_planner_.findRoute(simulation.getState().boat_unit_position,
+                                     city.getLocation().toCartesian(),
+                                     route)) {
+      status.precision(0);
+      status << "Sea route of " << route.length * kEarthRadiusKilometers
+             << "km, through " << route.waypoints.size() << " waypoints";
+    } else {
+      status << "No sea route";
+    }
+  } else {
+    status << pick.point.getLatitude() << ", " << pick.point.getLongitude();
+    const CountryMap &country_map = globe_.getCountryMap();
+    int country_id = country_map.getCountryId(pick.point);
+    if (country_id != 0) {
+      status << " in " << country_map.getCountryName(country_id);
+    }
+  }
+  status_view_.setText(status.str());
+}
+
+AsyncTask::DoneStatus App::onUpdate(GenericAsyncTask *task) {
+  ClockObject *clock = ClockObject::get_global_clock();
+  if (window_.is_null() || clock == nullptr) {
     return AsyncTask::DS_exit;
   }
+  // The output is a window, or an offscreen buffer for render tests.
   GraphicsOutput *graphics_output = window_->get_graphics_output();
   if (graphics_output == nullptr) {
     return AsyncTask::DS_exit;
   }
 
   // 0. Reposition UI if the window size has changed.
-  LVector2i new_window_size = graphics_window->get_size();
+  LVector2i new_window_size = graphics_output->get_size();
   if (new_window_size != last_window_size_) {
     last_window_size_ = new_window_size;
     minimap_view_.onWindowResize(new_window_size);
+    scaled_scene_view_.onWindowResize(new_window_size);
   }
 
-  // 1. Determine the velocity, by using the input in the camera's basis.
-  CPT<TransformState> camera_xform = camera_path_.get_net_transform();
-  LVector3 camera_right = camera_xform->get_quat().get_right();
-  LVector3 camera_up = camera_xform->get_quat().get_up();
-  LVector2 normalized_input = input_.get_xy().normalized();
-  LVector3 heading =
-      (camera_right * input_.get_x()) + (camera_up * input_.get_y());
-  heading.normalize();
-  LVector3 position_delta = heading * kBoatSpeed * clock->get_dt();
-
-  // 2. Update the boat's position in cartesian space and snap onto sphere.
-  LVector3 old_boat_unit_position = boat_unit_sphere_position_.toCartesian();
-  LVector3 new_boat_unit_position =
-      (old_boat_unit_position + position_delta).normalized();
-  SpherePoint2 new_boat_unit_sphere_position =
-      SpherePoint2::fromCartesian(new_boat_unit_position);
-  LVector3 old_boat_position =
-      kGlobeWaterSurfaceHeight * kGlobeScale * old_boat_unit_position;
-  LVector3 new_boat_position =
-      kGlobeWaterSurfaceHeight * kGlobeScale * new_boat_unit_position;
-
-  // 3. See if intended destination would be land, and withhold update if so.
-  if (globe_.isLandAtPoint(new_boat_unit_sphere_position)) {
-    // Roll back the proposed update.
-    new_boat_unit_position = old_boat_unit_position;
-    new_boat_unit_sphere_position = boat_unit_sphere_position_;
-    new_boat_position = old_boat_position;
-  } else {
-    boat_unit_sphere_position_ = new_boat_unit_sphere_position;
-    boat_path_.set_pos(new_boat_position);
+  // 1. Hand the input to the simulation, and take its latest steps, without
+  // waiting on it.
+  simulation_thread_.setInput(input_);
+  const SimulationSnapshot &snapshot = simulation_thread_.read();
+  const Simulation &simulation = snapshot.simulation;
+  const SimulationState &state = simulation.getState();
+  PN_stdfloat interpolation_factor =
+      SimulationThread::getInterpolationFactor(snapshot);
+
+  // 2. Update the visible portion of the globe, from where the boat is.
+  if (clock->get_frame_count() %
+          quality_governor_.getTier().visibility_update_interval ==
+      0) {
+    globe_.updateVisibility(
+        graphics_output, SpherePoint2::fromCartesian(state.boat_unit_position));
   }
-
-  // 4. Update the visible portion of the globe.
-  globe_.updateVisibility(graphics_output, boat_unit_sphere_position_);
-
-  // 5. Update the heading if the input was non zero.
-  if (!IS_NEARLY_ZERO(input_.get_x()) || !IS_NEARLY_ZERO(input_.get_y())) {
-    PN_stdfloat new_heading =
-        atan2f(normalized_input.get_y(), normalized_input.get_x());
-    if (new_heading < 0) {
-      new_heading += 2 * MathNumbers::pi;
-    }
-    boat_heading_ = new_heading;
+  minimap_view_.update(globe_);
+
+  // Tell when the boat reaches a city, once per visit.
+  int city_id = city_index_.getNearest(
+      state.boat_unit_position,
+      kCityReachDistance / (globe_.getSeaLevel() * kGlobeScale));
+  if (city_id >= 0 && city_id != reached_city_id_) {
+    const City &city = cities_[static_cast<std::size_t>(city_id)];
+    status_view_.setText("Reached " + city.getName() + ", " +
+                         city.getCountryName());
   }
-
-  // 6. Transform the heading into a world rotation.
-  LVector3 boat_right = LVector3::up().cross(new_boat_unit_position);
-  LVector3 boat_up = new_boat_unit_position.cross(boat_right);
-  LVector3 boat_heading =
-      (cosf(boat_heading_) * boat_right) + (sinf(boat_heading_) * boat_up);
+  reached_city_id_ = city_id;
+
+  // 3. Draw the boat between the last two steps, so that it moves smoothly
+  // whatever the step rate.
+  SimulationState drawn_state =
+      simulation.getInterpolatedState(interpolation_factor);
+  LVector3 boat_unit_position = drawn_state.boat_unit_position;
+  LVector3 boat_position =
+      globe_.getSeaLevel() * kGlobeScale * boat_unit_position;
+  boat_path_.set_pos(boat_position);
+
+  // 4. Transform the heading into a world rotation.
+  LVector3 boat_right = LVector3::up().cross(boat_unit_position);
+  LVector3 boat_up = boat_unit_position.cross(boat_right);
+  LVector3 boat_heading = (cosf(drawn_state.boat_heading) * boat_right) +
+                          (sinf(drawn_state.boat_heading) * boat_up);
   boat_heading.normalize();
-  LQuaternion new_boat_rotation =
-      quaternion::fromLookAt(boat_heading, new_boat_unit_position);
-  boat_path_.set_quat(new_boat_rotation);
-
-  collision_traverser_.traverse(window_->get_render());
-  if (collision_handler_queue_->get_num_entries() > 0) {
-    CollisionEntry *entry = collision_handler_queue_->get_entry(0);
-    bool into_city =
-        entry->has_into() && entry->get_into_node_path().has_parent() &&
-        entry->get_into_node_path().get_parent().has_tag(kTagCityId);
-    if (into_city) {
-      std::vector<City>::size_type city_id = std::stoul(
-          entry->get_into_node_path().get_parent().get_tag(kTagCityId));
-      if (city_id < cities_.size()) {
-        City &city = cities_[city_id];
-        // TODO: Allow interaction with city
+  LQuaternion boat_rotation =
+      quaternion::fromLookAt(boat_heading, boat_unit_position);
+  boat_path_.set_quat(boat_rotation);
+  // The sun shines straight down onto the boat.
+  globe_view_.getPath().set_shader_input("u_SunDirection", boat_unit_position);
+  boat_wake_.update(kWakeLift * boat_path_.get_pos());
+
+  // 5. Float the camera above the boat and look at it.
+  LVector3 camera_position =
+      boat_position + (drawn_state.camera_distance * boat_unit_position);
+  LQuaternion camera_rotation =
+      quaternion::fromLookAt(-boat_unit_position, LVector3::up());
+  camera_path_.set_pos(camera_position);
+  camera_path_.set_quat(camera_rotation);
+
+  // 6. Draw the fleet around the camera, between the last two steps too.
+  // Its transforms are only uploaded once per step, and blended on the GPU.
+  PN_stdfloat fleet_radius = globe_.getSeaLevel() * kGlobeScale;
+  if (simulation.getStepCount() != fleet_step_count_ ||
+      fleet_radius != fleet_radius_) {
+    fleet_step_count_ = simulation.getStepCount();
+    fleet_radius_ = fleet_radius;
+    simulation.getFleet().getTransforms(/* t= */ 0, fleet_radius,
+                                        previous_fleet_transforms_);
+    simulation.getFleet().getTransforms(/* t= */ 1, fleet_radius,
+                                        fleet_transforms_);
+    fleet_view_.update(previous_fleet_transforms_, fleet_transforms_,
+                       camera_path_.get_pos(window_->get_render()),
+                       kFleetDrawDistance);
+  }
+  fleet_view_.setInterpolationFactor(interpolation_factor);
+
+  // 7. Hide cities beyond the horizon, which would show through the globe.
+  if (city_horizon_culler_.update(
+          camera_path_.get_pos(globe_view_.getPath()))) {
+    const std::vector<uint8_t> &visibility =
+        city_horizon_culler_.getVisibility();
+    for (CityView &city_view : city_views_) {
+      NodePath city_path = city_view.getPath();
+      bool visible =
+          visibility[static_cast<std::size_t>(city_view.getCityId())] != 0;
+      if (visible && city_path.is_hidden()) {
+        city_path.show();
+      } else if (!visible && !city_path.is_hidden()) {
+        city_path.hide();
       }
     }
   }
 
-  // 7. Update the camera distance.
-  PN_stdfloat camera_distance_delta =
-      input_.get_z() * clock->get_dt() * kCameraZoomSpeed;
-  camera_distance_ = std::max(
-      kCameraDistanceMin,
-      std::min(kCameraDistanceMax, camera_distance_ + camera_distance_delta));
-
-  // 8. Float the camera above the boat and look at it.
-  LVector3 new_camera_position =
-      new_boat_position + (camera_distance_ * new_boat_unit_position);
-  LQuaternion new_camera_rotation =
-      quaternion::fromLookAt(-new_boat_unit_position, LVector3::up());
-  camera_path_.set_pos(new_camera_position);
-  camera_path_.set_quat(new_camera_rotation);
+  // 8. Hide city labels which would overlap higher priority ones.
+  city_labels_view_.declutter(camera_path_,
+                              window_->get_camera(0)->get_lens(),
+                              new_window_size,
+                              city_horizon_culler_.getVisibility());
+
+  // 9. Adapt the quality to the measured frame time.
+  if (quality_governor_.update(clock->get_dt())) {
+    applyQualityTier(quality_governor_.getTier());
+  }
+
+  // 10. Spend whatever time the frame has left on background work.
+  background_scheduler_.run(clock->get_real_time() - clock->get_frame_time());
 
   return AsyncTask::DoneStatus::DS_cont;
 }
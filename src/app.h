@@ -3,24 +3,40 @@
 
 #include <vector>
 
+#include "atmosphere.h"
+#include "atmosphere_view.h"
+#include "background_scheduler.h"
 #include "city.h"
+#include "city_labels_view.h"
 #include "city_view.h"
+#include "coastline_view.h"
+#include "fleet_view.h"
 #include "globe.h"
+#include "globe_picker.h"
 #include "globe_view.h"
+#include "horizon_culler.h"
+#include "input_log.h"
 #include "minimap_view.h"
 #include "panda3d/asyncTask.h"
 #include "panda3d/clockObject.h"
-#include "panda3d/collisionHandlerQueue.h"
-#include "panda3d/collisionTraverser.h"
 #include "panda3d/event.h"
+#include "panda3d/filename.h"
 #include "panda3d/genericAsyncTask.h"
 #include "panda3d/graphicsEngine.h"
 #include "panda3d/graphicsOutput.h"
 #include "panda3d/graphicsStateGuardian.h"
 #include "panda3d/pandaFramework.h"
 #include "panda3d/windowFramework.h"
+#include "quality_governor.h"
+#include "scaled_scene_view.h"
+#include "sea_route_planner.h"
+#include "simulation.h"
+#include "simulation_thread.h"
+#include "sphere_index.h"
 #include "sphere_point.h"
+#include "status_view.h"
 #include "typedefs.h"
+#include "wake_trail.h"
 
 namespace earth_world {
 /** The entry point of the simulation. */
@@ -33,24 +49,68 @@ class App {
   App(PT<WindowFramework> window);
   ~App();
 
+  /**
+   * Records the user's input over the run, and writes it out once the run
+   * ends. Only to be called before running.
+   * @param filename The file to write the input log to.
+   */
+  void record(const Filename &filename);
+
+  /**
+   * Replays recorded input over the run, in place of the user's, until the
+   * log ends. Only to be called before running.
+   * @param filename The input log to replay.
+   * @return True if the log was read, and was recorded with the app's step
+   *     duration.
+   */
+  bool replay(const Filename &filename);
+
   /**
    * Starts the app's event loop, until terminated by the user.
    * @return The app's exit status.
    */
   int run();
 
+  /**
+   * Draws a fixed number of frames, then saves the last one, for render
+   * tests on an offscreen buffer. The simulation advances by a fixed time
+   * per frame, rather than in real time, so that every run saves the same
+   * frame.
+   * @param frame_count The number of frames to draw.
+   * @param screenshot_filename Where to save the last frame.
+   * @return The app's exit status, nonzero if the frame couldn't be saved.
+   */
+  int runFrames(int frame_count, const Filename &screenshot_filename);
+
  protected:
   PandaFramework *framework_;
   PT<WindowFramework> window_;
-  CollisionTraverser collision_traverser_;
-  PT<CollisionHandlerQueue> collision_handler_queue_;
 
   Globe globe_;
   GlobeView globe_view_;
+  CoastlineView coastline_view_;
+  Atmosphere atmosphere_;
+  AtmosphereView atmosphere_view_;
   MinimapView minimap_view_;
+  ScaledSceneView scaled_scene_view_;
+  /** Tells what the user last picked, or the boat last reached. */
+  StatusView status_view_;
+  QualityGovernor quality_governor_;
+  /** Runs work which isn't urgent in the time left over in each frame. */
+  BackgroundScheduler background_scheduler_;
+  /** The job catching the coast field up with the sea level, if pending. */
+  unsigned long coast_update_job_;
 
   std::vector<City> cities_;
   std::vector<CityView> city_views_;
+  CityLabelsView city_labels_view_;
+  HorizonCuller city_horizon_culler_;
+  /** Finds the cities near a point, by their ids. */
+  SphereIndex city_index_;
+  GlobePicker globe_picker_;
+  SeaRoutePlanner sea_route_planner_;
+  /** The id of the city the boat is at, or -1 if none. */
+  int reached_city_id_;
 
   /**
    * The user's input, where the X axis is horizontal motion, the Y axis is
@@ -59,13 +119,42 @@ class App {
   LVector3 input_;
   LVector2i last_window_size_;
 
+  /**
+   * Moves the boat, the camera and the fleet, at a fixed rate on a thread of
+   * its own, apart from drawing.
+   */
+  SimulationThread simulation_thread_;
+  /** Where to write the input recorded over the run, if recording. */
+  Filename recording_filename_;
+
   NodePath camera_path_;
-  PN_stdfloat camera_distance_;
 
   NodePath boat_path_;
-  NodePath boat_collider_path_;
-  SpherePoint2 boat_unit_sphere_position_;
-  PN_stdfloat boat_heading_;
+  WakeTrail boat_wake_;
+
+  FleetView fleet_view_;
+  /**
+   * The transforms of every ship in the fleet, relative to the render, as of
+   * the previous and the latest step uploaded.
+   */
+  std::vector<LMatrix4f> previous_fleet_transforms_;
+  std::vector<LMatrix4f> fleet_transforms_;
+  /** The step and the radius the fleet was last uploaded at. */
+  unsigned long fleet_step_count_;
+  PN_stdfloat fleet_radius_;
+
+  /** Creates the default cities, resting on the globe's surface. */
+  static std::vector<City> buildCities(const Globe &globe);
+
+  /** @return The positions of the given cities, relative to the globe. */
+  static std::vector<LVector3> getCityPositions(
+      const std::vector<City> &cities);
+
+  /** Writes out the input recorded over the run, if recording. */
+  void writeRecording();
+
+  /** Applies the given quality tier's settings to the views. */
+  void applyQualityTier(const QualityTier &tier);
 
   /**
    * Registers event callbacks for the given keys, treating them as an axis.
@@ -90,6 +179,27 @@ class App {
    */
   void onInputChange(LVector3 input_delta);
 
+  /**
+   * Raises or lowers the sea by a step, and shows the globe at the new sea
+   * level. Collision catches up in the background.
+   * @param direction +1 to raise the sea, or -1 to lower it.
+   */
+  void onSeaLevelChange(int direction);
+
+  /**
+   * Takes a step toward catching the coast field up with the sea level, for
+   * the background scheduler.
+   * @return True once caught up.
+   */
+  bool stepCoastUpdate();
+
+  /**
+   * Picks the point on the globe under the mouse, and any city near it, in
+   * which case the sea route there from the boat is planned, or otherwise
+   * the country the point belongs to.
+   */
+  void onPick();
+
   /**
    * Handles updating for a single frame.
    * @param task The task for this update loop.
@@ -101,6 +211,9 @@ class App {
   static AsyncTask::DoneStatus onUpdate(GenericAsyncTask *task, void *app) {
     return (static_cast<App *>(app))->onUpdate(task);
   }
+  static void onPick(const Event *event, void *app) {
+    (static_cast<App *>(app))->onPick();
+  }
   static void onInputUp(const Event *event, void *app) {
     (static_cast<App *>(app))->onInputChange(LVector3(0, +1, 0));
   }
@@ -119,6 +232,12 @@ class App {
   static void onInputZoomIn(const Event *event, void *app) {
     (static_cast<App *>(app))->onInputChange(LVector3(0, 0, -1));
   }
+  static void onRaiseSeaLevel(const Event *event, void *app) {
+    (static_cast<App *>(app))->onSeaLevelChange(+1);
+  }
+  static void onLowerSeaLevel(const Event *event, void *app) {
+    (static_cast<App *>(app))->onSeaLevelChange(-1);
+  }
 };
 }  // namespace earth_world
 
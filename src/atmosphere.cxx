@@ -0,0 +1,351 @@
+#include "atmosphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cache.h"
+#include "globe.h"
+#include "panda3d/samplerState.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+// Physical constants are in kilometers. The atmosphere is exaggerated in
+// thickness, since at its true scale it would be thinner than a pixel from
+// the camera, and its scattering is thinned out by the same factor to keep
+// the same optical depth.
+const float kExaggeration = 4.f;
+const float kGroundRadius = 6360.f;
+const float kTopRadius = kGroundRadius + (60.f * kExaggeration);
+const float kRayleighScaleHeight = 8.f * kExaggeration;
+const float kMieScaleHeight = 1.2f * kExaggeration;
+const LVecBase3f kRayleighScattering =
+    LVecBase3f(5.8e-3f, 13.5e-3f, 33.1e-3f) / kExaggeration;
+const float kMieScattering = 4e-3f / kExaggeration;
+const float kMieExtinction = kMieScattering / 0.9f;
+const float kMieAsymmetry = 0.8f;
+/** The ground radius lines up with the globe's water surface. */
+const float kKilometersPerUnit = kGroundRadius / kGlobeWaterSurfaceHeight;
+
+// Table dimensions, which must match atmosphere.glsl.
+const int kTransmittanceMuSize = 256;
+const int kTransmittanceRSize = 64;
+const int kInscatterRSize = 32;
+const int kInscatterMuSize = 128;
+const int kInscatterMuSSize = 32;
+const int kInscatterNuSize = 8;
+const int kTransmittanceSteps = 500;
+const int kInscatterSteps = 50;
+
+const uint32_t kCacheVersion = 1;
+const std::string kCacheName = "atmosphere_tables.bin";
+/** Panda keeps RGBA texels in BGRA order. */
+const int kChannelOffsets[4] = {2, 1, 0, 3};
+
+/**
+ * @return The hash of the constants the tables are computed from, and of
+ *     their sizes, so that changing any of them recomputes the tables.
+ */
+static uint64_t hashConstants() {
+  const float physical_constants[] = {
+      kGroundRadius,          kTopRadius,
+      kRayleighScaleHeight,   kMieScaleHeight,
+      kRayleighScattering[0], kRayleighScattering[1],
+      kRayleighScattering[2], kMieScattering,
+      kMieExtinction,         kMieAsymmetry};
+  const int table_sizes[] = {
+      kTransmittanceMuSize, kTransmittanceRSize, kInscatterRSize,
+      kInscatterMuSize,     kInscatterMuSSize,   kInscatterNuSize,
+      kTransmittanceSteps,  kInscatterSteps};
+  uint64_t hash = cache::hashBytes(
+      physical_constants, sizeof(physical_constants), cache::kNoInputHash);
+  return cache::hashBytes(table_sizes, sizeof(table_sizes), hash);
+}
+
+/** @return The radius for the given table coordinate in [0, 1]. */
+static float radiusFromCoordinate(float coordinate) {
+  return kGroundRadius +
+         (coordinate * coordinate * (kTopRadius - kGroundRadius));
+}
+
+/** @return The table coordinate in [0, 1] for the given radius. */
+static float coordinateFromRadius(float r) {
+  return sqrtf(std::max(0.f, std::min(1.f, (r - kGroundRadius) /
+                                               (kTopRadius - kGroundRadius))));
+}
+
+/** @return Whether a ray from radius r along mu hits the ground. */
+static bool hitsGround(float r, float mu) {
+  float discriminant =
+      (r * r * ((mu * mu) - 1)) + (kGroundRadius * kGroundRadius);
+  return mu < 0 && discriminant >= 0;
+}
+
+/** @return The distance from radius r along mu to the top of the atmosphere. */
+static float distanceToTop(float r, float mu) {
+  float discriminant = (r * r * ((mu * mu) - 1)) + (kTopRadius * kTopRadius);
+  return std::max(0.f, (-r * mu) + sqrtf(std::max(0.f, discriminant)));
+}
+
+/** @return The distance from radius r along mu to the ground. */
+static float distanceToGround(float r, float mu) {
+  float discriminant =
+      (r * r * ((mu * mu) - 1)) + (kGroundRadius * kGroundRadius);
+  return std::max(0.f, (-r * mu) - sqrtf(std::max(0.f, discriminant)));
+}
+
+static void writeTexel(std::vector<float> &rgba, std::size_t texel,
+                       const LVecBase3f &color) {
+  rgba[(texel * 4) + static_cast<std::size_t>(kChannelOffsets[0])] = color[0];
+  rgba[(texel * 4) + static_cast<std::size_t>(kChannelOffsets[1])] = color[1];
+  rgba[(texel * 4) + static_cast<std::size_t>(kChannelOffsets[2])] = color[2];
+  rgba[(texel * 4) + static_cast<std::size_t>(kChannelOffsets[3])] = 1;
+}
+
+Atmosphere::Atmosphere() {
+  std::size_t transmittance_size = static_cast<std::size_t>(
+      kTransmittanceMuSize * kTransmittanceRSize * 4);
+  std::size_t inscatter_size = static_cast<std::size_t>(
+      kInscatterNuSize * kInscatterMuSSize * kInscatterMuSize *
+      kInscatterRSize * 4);
+  std::vector<float> rayleigh;
+  std::vector<float> mie;
+
+  std::vector<unsigned char> data;
+  std::size_t data_size =
+      (transmittance_size + (2 * inscatter_size)) * sizeof(float);
+  uint64_t input_hash = hashConstants();
+  if (cache::read(kCacheName, kCacheVersion, input_hash, data) &&
+      data.size() == data_size) {
+    const unsigned char *cursor = data.data();
+    transmittance_.resize(transmittance_size);
+    rayleigh.resize(inscatter_size);
+    mie.resize(inscatter_size);
+    for (std::vector<float> *table : {&transmittance_, &rayleigh, &mie}) {
+      std::memcpy(table->data(), cursor, table->size() * sizeof(float));
+      cursor += table->size() * sizeof(float);
+    }
+  } else {
+    computeTransmittance();
+    computeInscatter(rayleigh, mie);
+    data.resize(data_size);
+    unsigned char *cursor = data.data();
+    for (const std::vector<float> *table : {&transmittance_, &rayleigh, &mie}) {
+      std::memcpy(cursor, table->data(), table->size() * sizeof(float));
+      cursor += table->size() * sizeof(float);
+    }
+    cache::write(kCacheName, kCacheVersion, input_hash, data.data(),
+                 data.size());
+  }
+
+  transmittance_texture_ =
+      buildTexture("AtmosphereTransmittance", kTransmittanceMuSize,
+                   kTransmittanceRSize, 1, transmittance_);
+  rayleigh_texture_ = buildTexture("AtmosphereRayleigh",
+                                   kInscatterNuSize * kInscatterMuSSize,
+                                   kInscatterMuSize, kInscatterRSize, rayleigh);
+  mie_texture_ =
+      buildTexture("AtmosphereMie", kInscatterNuSize * kInscatterMuSSize,
+                   kInscatterMuSize, kInscatterRSize, mie);
+}
+
+PT<Texture> Atmosphere::getTransmittanceTexture() {
+  return transmittance_texture_;
+}
+
+PT<Texture> Atmosphere::getRayleighTexture() { return rayleigh_texture_; }
+
+PT<Texture> Atmosphere::getMieTexture() { return mie_texture_; }
+
+LVecBase4 Atmosphere::getShaderParameters() const {
+  return LVecBase4(kGroundRadius / kKilometersPerUnit,
+                   kTopRadius / kKilometersPerUnit, kKilometersPerUnit,
+                   kMieAsymmetry);
+}
+
+PN_stdfloat Atmosphere::getTopRadius() const {
+  return kTopRadius / kKilometersPerUnit;
+}
+
+void Atmosphere::computeTransmittance() {
+  transmittance_.assign(
+      static_cast<std::size_t>(kTransmittanceMuSize * kTransmittanceRSize * 4),
+      0);
+  parallel::forRange(0, kTransmittanceRSize, [&](int row_begin, int row_end) {
+    for (int y = row_begin; y < row_end; y++) {
+      float r = radiusFromCoordinate(static_cast<float>(y) /
+                                     (kTransmittanceRSize - 1));
+      for (int x = 0; x < kTransmittanceMuSize; x++) {
+        float mu = ((2.f * x) / (kTransmittanceMuSize - 1)) - 1;
+        // Rays into the ground are integrated straight through it, with the
+        // density clamped at ground level, so that they blend smoothly into
+        // the rays just above the horizon when filtered.
+        float distance = distanceToTop(r, mu);
+        float dt = distance / kTransmittanceSteps;
+        float rayleigh_depth = 0;
+        float mie_depth = 0;
+        for (int step = 0; step <= kTransmittanceSteps; step++) {
+          float t = step * dt;
+          float r_t = sqrtf((r * r) + (t * t) + (2 * r * mu * t));
+          float altitude = std::max(0.f, r_t - kGroundRadius);
+          float weight = (step == 0 || step == kTransmittanceSteps) ? 0.5f : 1;
+          rayleigh_depth += weight * expf(-altitude / kRayleighScaleHeight);
+          mie_depth += weight * expf(-altitude / kMieScaleHeight);
+        }
+        LVecBase3f optical_depth =
+            ((kRayleighScattering * rayleigh_depth) +
+             (LVecBase3f(kMieExtinction) * mie_depth)) *
+            dt;
+        writeTexel(transmittance_,
+                   static_cast<std::size_t>((y * kTransmittanceMuSize) + x),
+                   LVecBase3f(expf(-optical_depth[0]), expf(-optical_depth[1]),
+                              expf(-optical_depth[2])));
+      }
+    }
+  });
+}
+
+void Atmosphere::computeInscatter(std::vector<float> &rayleigh,
+                                  std::vector<float> &mie) const {
+  const int x_size = kInscatterNuSize * kInscatterMuSSize;
+  std::size_t table_size = static_cast<std::size_t>(
+      x_size * kInscatterMuSize * kInscatterRSize * 4);
+  rayleigh.assign(table_size, 0);
+  mie.assign(table_size, 0);
+  parallel::forRange(
+      0, kInscatterRSize * kInscatterMuSize, [&](int row_begin, int row_end) {
+        for (int row = row_begin; row < row_end; row++) {
+          int z = row / kInscatterMuSize;
+          int y = row % kInscatterMuSize;
+          float r = radiusFromCoordinate(static_cast<float>(z) /
+                                         (kInscatterRSize - 1));
+          float mu = ((2.f * y) / (kInscatterMuSize - 1)) - 1;
+          bool ground = hitsGround(r, mu);
+          float distance =
+              ground ? distanceToGround(r, mu) : distanceToTop(r, mu);
+          float dt = distance / kInscatterSteps;
+          for (int x = 0; x < x_size; x++) {
+            float mu_s = ((2.f * (x % kInscatterMuSSize)) /
+                          (kInscatterMuSSize - 1)) -
+                         1;
+            float nu = ((2.f * (x / kInscatterMuSSize)) /
+                        (kInscatterNuSize - 1)) -
+                       1;
+            // Not every nu is possible for a given mu and mu_s.
+            float spread = sqrtf(std::max(0.f, (1 - (mu * mu)) *
+                                                   (1 - (mu_s * mu_s))));
+            nu = std::max((mu * mu_s) - spread,
+                          std::min((mu * mu_s) + spread, nu));
+
+            LVecBase3f rayleigh_sum(0);
+            LVecBase3f mie_sum(0);
+            for (int step = 0; step <= kInscatterSteps; step++) {
+              float t = step * dt;
+              float r_t = std::max(
+                  kGroundRadius,
+                  std::min(kTopRadius,
+                           sqrtf((r * r) + (t * t) + (2 * r * mu * t))));
+              float mu_s_t =
+                  std::max(-1.f, std::min(1.f, ((r * mu_s) + (t * nu)) / r_t));
+              if (hitsGround(r_t, mu_s_t)) {
+                continue;
+              }
+              LVecBase3f transmittance =
+                  transmittanceAlongRay(r, mu, t);
+              LVecBase3f sun_transmittance = sampleTransmittance(r_t, mu_s_t);
+              LVecBase3f light(transmittance[0] * sun_transmittance[0],
+                               transmittance[1] * sun_transmittance[1],
+                               transmittance[2] * sun_transmittance[2]);
+              float altitude = r_t - kGroundRadius;
+              float weight =
+                  (step == 0 || step == kInscatterSteps) ? 0.5f : 1;
+              rayleigh_sum +=
+                  light * (weight * expf(-altitude / kRayleighScaleHeight));
+              mie_sum += light * (weight * expf(-altitude / kMieScaleHeight));
+            }
+            std::size_t texel = static_cast<std::size_t>(
+                (((z * kInscatterMuSize) + y) * x_size) + x);
+            writeTexel(rayleigh, texel,
+                       LVecBase3f(rayleigh_sum[0] * kRayleighScattering[0],
+                                  rayleigh_sum[1] * kRayleighScattering[1],
+                                  rayleigh_sum[2] * kRayleighScattering[2]) *
+                           dt);
+            writeTexel(mie, texel, mie_sum * (kMieScattering * dt));
+          }
+        }
+      });
+}
+
+LVecBase3f Atmosphere::sampleTransmittance(float r, float mu) const {
+  float x = std::max(0.f, std::min(1.f, (mu + 1) / 2)) *
+            (kTransmittanceMuSize - 1);
+  float y = coordinateFromRadius(r) * (kTransmittanceRSize - 1);
+  int x0 = std::min(static_cast<int>(x), kTransmittanceMuSize - 2);
+  int y0 = std::min(static_cast<int>(y), kTransmittanceRSize - 2);
+  float fx = x - x0;
+  float fy = y - y0;
+  LVecBase3f result(0);
+  for (int corner = 0; corner < 4; corner++) {
+    int dx = corner & 1;
+    int dy = corner >> 1;
+    float weight = (dx != 0 ? fx : 1 - fx) * (dy != 0 ? fy : 1 - fy);
+    std::size_t texel = static_cast<std::size_t>(
+        ((y0 + dy) * kTransmittanceMuSize) + x0 + dx);
+    for (int channel = 0; channel < 3; channel++) {
+      result[channel] +=
+          weight *
+          transmittance_[(texel * 4) +
+                         static_cast<std::size_t>(kChannelOffsets[channel])];
+    }
+  }
+  return result;
+}
+
+LVecBase3f Atmosphere::transmittanceAlongRay(float r, float mu,
+                                             float t) const {
+  float r_t = sqrtf((r * r) + (t * t) + (2 * r * mu * t));
+  float mu_t = ((r * mu) + t) / r_t;
+  // Divide the transmittances of two rays to the top of the atmosphere,
+  // looking upwards from whichever end is lower, so that neither ray can hit
+  // the ground.
+  LVecBase3f near;
+  LVecBase3f far;
+  if (mu > 0) {
+    near = sampleTransmittance(r, mu);
+    far = sampleTransmittance(r_t, mu_t);
+  } else {
+    near = sampleTransmittance(r_t, -mu_t);
+    far = sampleTransmittance(r, -mu);
+  }
+  LVecBase3f result;
+  for (int channel = 0; channel < 3; channel++) {
+    result[channel] =
+        far[channel] > 0 ? std::min(1.f, near[channel] / far[channel]) : 0;
+  }
+  return result;
+}
+
+PT<Texture> Atmosphere::buildTexture(const std::string &name, int x_size,
+                                     int y_size, int z_size,
+                                     const std::vector<float> &rgba) {
+  PT<Texture> texture = new Texture(name);
+  if (z_size > 1) {
+    texture->setup_3d_texture(x_size, y_size, z_size, Texture::T_float,
+                              Texture::F_rgba16);
+  } else {
+    texture->setup_2d_texture(x_size, y_size, Texture::T_float,
+                              Texture::F_rgba16);
+  }
+  PTA_uchar ram_image = PTA_uchar::empty_array(rgba.size() * sizeof(float));
+  std::memcpy(ram_image.p(), rgba.data(), rgba.size() * sizeof(float));
+  texture->set_ram_image(ram_image);
+  texture->set_wrap_u(SamplerState::WM_clamp);
+  texture->set_wrap_v(SamplerState::WM_clamp);
+  texture->set_wrap_w(SamplerState::WM_clamp);
+  texture->set_minfilter(SamplerState::FT_linear);
+  texture->set_magfilter(SamplerState::FT_linear);
+  return texture;
+}
+
+}  // namespace earth_world
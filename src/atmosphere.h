@@ -0,0 +1,81 @@
+#ifndef EARTH_WORLD_ATMOSPHERE_H
+#define EARTH_WORLD_ATMOSPHERE_H
+
+#include <string>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/texture.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * Models the scattering of sunlight in the atmosphere, as lookup tables
+ * precomputed on the CPU once and cached on disk, so that shaders can render
+ * the sky and aerial perspective with a few texture fetches.
+ *
+ * Follows Bruneton and Neyret's precomputed single scattering, with a
+ * simpler parameterization: radii are mapped by the square root of their
+ * altitude fraction, and cosines linearly. The 4D in-scatter tables are
+ * packed into 3D textures, with the sun-view cosine nu split into slices
+ * along the x axis. The layout must match atmosphere.glsl.
+ */
+class Atmosphere {
+ public:
+  Atmosphere();
+  Atmosphere(const Atmosphere &) = delete;
+  Atmosphere(Atmosphere &&) = delete;
+  Atmosphere &operator=(const Atmosphere &) = delete;
+  Atmosphere &operator=(Atmosphere &&) = delete;
+  ~Atmosphere() = default;
+
+  /** @return Transmittance to the top of the atmosphere, by (mu, r). */
+  PT<Texture> getTransmittanceTexture();
+  /** @return Rayleigh in-scatter without its phase, by (nu mu_s, mu, r). */
+  PT<Texture> getRayleighTexture();
+  /** @return Mie in-scatter without its phase, by (nu mu_s, mu, r). */
+  PT<Texture> getMieTexture();
+
+  /**
+   * @return The ground radius, top radius, kilometers per model unit, and
+   *     Mie asymmetry, as passed to the shaders.
+   */
+  LVecBase4 getShaderParameters() const;
+
+  /** @return The radius of the top of the atmosphere, relative to the globe. */
+  PN_stdfloat getTopRadius() const;
+
+ protected:
+  PT<Texture> transmittance_texture_;
+  PT<Texture> rayleigh_texture_;
+  PT<Texture> mie_texture_;
+
+  /** The CPU copy of the transmittance table, as BGRA texels. */
+  std::vector<float> transmittance_;
+
+  /** Integrates the transmittance table. */
+  void computeTransmittance();
+
+  /** Integrates single scattering into the given tables, as RGBA. */
+  void computeInscatter(std::vector<float> &rayleigh,
+                        std::vector<float> &mie) const;
+
+  /** Bilinearly samples the transmittance table. */
+  LVecBase3f sampleTransmittance(float r, float mu) const;
+
+  /**
+   * @return The transmittance between a point at radius r looking along mu,
+   *     and the point a distance t along that ray.
+   */
+  LVecBase3f transmittanceAlongRay(float r, float mu, float t) const;
+
+  /** Builds a float RGBA texture of the given dimensions from the data. */
+  static PT<Texture> buildTexture(const std::string &name, int x_size,
+                                  int y_size, int z_size,
+                                  const std::vector<float> &rgba);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_ATMOSPHERE_H
@@ -0,0 +1,102 @@
+#include "atmosphere_view.h"
+
+#include "panda3d/colorBlendAttrib.h"
+#include "panda3d/cullFaceAttrib.h"
+#include "panda3d/geomNode.h"
+#include "panda3d/geomTriangles.h"
+#include "panda3d/geomVertexData.h"
+#include "panda3d/geomVertexFormat.h"
+#include "panda3d/geomVertexWriter.h"
+#include "panda3d/mathNumbers.h"
+#include "panda3d/shader.h"
+#include "shader_cache.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+const int kShellSegments = 64;
+
+AtmosphereView::AtmosphereView(Atmosphere &atmosphere) : path_{"Atmosphere"} {
+  NodePath shell = buildShell(atmosphere.getTopRadius(), kShellSegments);
+  shell.reparent_to(path_);
+
+  PT<Shader> shader = shader_cache::load("sky.vert", "sky.frag");
+  path_.set_shader(shader);
+  setShaderInputs(path_, atmosphere);
+  // Draw only the far side of the shell, after the globe so that the globe
+  // hides the sky behind it, and add the scattered light onto the background.
+  path_.set_attrib(CullFaceAttrib::make_reverse());
+  path_.set_attrib(ColorBlendAttrib::make(ColorBlendAttrib::M_add,
+                                          ColorBlendAttrib::O_one,
+                                          ColorBlendAttrib::O_one));
+  path_.set_depth_write(false);
+  path_.set_bin("fixed", 0);
+  path_.set_light_off();
+}
+
+AtmosphereView::AtmosphereView(AtmosphereView &&other) noexcept
+    : path_{other.path_} {
+  other.path_.clear();
+}
+
+AtmosphereView &AtmosphereView::operator=(AtmosphereView &&other) noexcept {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  path_.remove_node();
+  path_ = other.path_;
+  other.path_.clear();
+  return *this;
+}
+
+AtmosphereView::~AtmosphereView() { path_.remove_node(); }
+
+NodePath AtmosphereView::getPath() const { return path_; }
+
+void AtmosphereView::setShaderInputs(NodePath path, Atmosphere &atmosphere) {
+  path.set_shader_input("u_AtmosphereParameters",
+                        atmosphere.getShaderParameters());
+  path.set_shader_input("u_TransmittanceTex",
+                        atmosphere.getTransmittanceTexture());
+  path.set_shader_input("u_RayleighTex", atmosphere.getRayleighTexture());
+  path.set_shader_input("u_MieTex", atmosphere.getMieTexture());
+}
+
+NodePath AtmosphereView::buildShell(PN_stdfloat radius, int segments) {
+  int rings = segments / 2;
+  PT<GeomVertexData> vertex_data = new GeomVertexData(
+      "AtmosphereShell", GeomVertexFormat::get_v3(), Geom::UH_static);
+  vertex_data->set_num_rows((segments + 1) * (rings + 1));
+  GeomVertexWriter vertex_writer(vertex_data, "vertex");
+  for (int ring = 0; ring <= rings; ring++) {
+    PN_stdfloat polar =
+        ((static_cast<PN_stdfloat>(ring) / rings) - 0.5f) * MathNumbers::pi;
+    for (int segment = 0; segment <= segments; segment++) {
+      PN_stdfloat azimuth =
+          (static_cast<PN_stdfloat>(segment) / segments) * 2 * MathNumbers::pi;
+      vertex_writer.add_data3(radius * cosf(polar) * cosf(azimuth),
+                              radius * cosf(polar) * sinf(azimuth),
+                              radius * sinf(polar));
+    }
+  }
+
+  PT<GeomTriangles> triangles = new GeomTriangles(Geom::UH_static);
+  for (int ring = 0; ring < rings; ring++) {
+    for (int segment = 0; segment < segments; segment++) {
+      int v0 = (ring * (segments + 1)) + segment;
+      int v1 = v0 + 1;
+      int v2 = v0 + segments + 1;
+      int v3 = v2 + 1;
+      triangles->add_vertices(v0, v1, v3);
+      triangles->add_vertices(v0, v3, v2);
+    }
+  }
+
+  PT<Geom> geom = new Geom(vertex_data);
+  geom->add_primitive(triangles);
+  PT<GeomNode> node = new GeomNode("AtmosphereShell");
+  node->add_geom(geom);
+  return NodePath(node);
+}
+
+}  // namespace earth_world
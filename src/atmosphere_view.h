@@ -0,0 +1,43 @@
+#ifndef EARTH_WORLD_ATMOSPHERE_VIEW_H
+#define EARTH_WORLD_ATMOSPHERE_VIEW_H
+
+#include "atmosphere.h"
+#include "panda3d/nodePath.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * A view of the sky around the globe, drawn as a shell at the top of the
+ * atmosphere which adds the light scattered along every view ray.
+ */
+class AtmosphereView {
+ public:
+  /** @param atmosphere The atmosphere whose scattering tables to render. */
+  explicit AtmosphereView(Atmosphere &atmosphere);
+  AtmosphereView(const AtmosphereView &) = delete;
+  AtmosphereView(AtmosphereView &&) noexcept;
+  AtmosphereView &operator=(const AtmosphereView &) = delete;
+  AtmosphereView &operator=(AtmosphereView &&) noexcept;
+  ~AtmosphereView();
+
+  NodePath getPath() const;
+
+  /**
+   * Sets the inputs shaders including atmosphere.glsl need, other than the
+   * sun direction, on the given path.
+   * @param path The path to set the inputs on.
+   * @param atmosphere The atmosphere to sample.
+   */
+  static void setShaderInputs(NodePath path, Atmosphere &atmosphere);
+
+ protected:
+  NodePath path_;
+
+  /** Builds a sphere of the given radius, with triangles facing outwards. */
+  static NodePath buildShell(PN_stdfloat radius, int segments);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_ATMOSPHERE_VIEW_H
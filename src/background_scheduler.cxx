@@ -0,0 +1,133 @@
+#include "background_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace earth_world {
+
+/** The frames a job waits to gain a level of priority. */
+const int kAgingFrames = 30;
+/**
+ * The frames a job waits at most, after which it takes a step even if it
+ * isn't expected to fit, since its expected step time only falls once it
+ * takes steps again.
+ */
+const int kMaxWaitedFrames = 60;
+/** How long the first step of a job is expected to take, in seconds. */
+const double kInitialStepTimeEstimate = 0.001;
+/**
+ * How quickly the expected step time falls toward shorter steps. It rises to
+ * a longer step at once, so that a slow step isn't soon forgotten.
+ */
+const double kStepTimeEstimateDecay = 0.1;
+
+BackgroundScheduler::BackgroundScheduler(double target_frame_time,
+                                         double reserved_time)
+    : target_frame_time_{target_frame_time},
+      reserved_time_{reserved_time},
+      next_id_{1} {}
+
+unsigned long BackgroundScheduler::add(int priority, const Step &step) {
+  Job job = {next_id_, priority, step, 0, kInitialStepTimeEstimate};
+  jobs_.push_back(job);
+  return next_id_++;
+}
+
+bool BackgroundScheduler::isPending(unsigned long id) const {
+  return std::any_of(jobs_.begin(), jobs_.end(),
+                     [id](const Job &job) { return job.id == id; });
+}
+
+void BackgroundScheduler::cancel(unsigned long id) {
+  jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(),
+                             [id](const Job &job) { return job.id == id; }),
+              jobs_.end());
+}
+
+int BackgroundScheduler::run(double frame_elapsed_time) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  double time_budget = target_frame_time_ - reserved_time_ - frame_elapsed_time;
+  std::vector<unsigned long> stepped_ids;
+  int step_count = 0;
+  while (true) {
+    double time_used = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    int index = pickJob(time_budget - time_used);
+    if (index < 0 && step_count == 0) {
+      index = pickStarvedJob();
+    }
+    if (index < 0) {
+      break;
+    }
+    unsigned long id = jobs_[static_cast<std::size_t>(index)].id;
+    // Copied, as the step may add or cancel jobs.
+    Step step = jobs_[static_cast<std::size_t>(index)].step;
+    std::chrono::steady_clock::time_point step_start =
+        std::chrono::steady_clock::now();
+    bool done = step();
+    double step_time = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - step_start)
+                           .count();
+    step_count++;
+    std::vector<Job>::iterator found =
+        std::find_if(jobs_.begin(), jobs_.end(),
+                     [id](const Job &job) { return job.id == id; });
+    if (found == jobs_.end()) {
+      continue;
+    }
+    if (done) {
+      jobs_.erase(found);
+      continue;
+    }
+    Job &job = *found;
+    job.step_time_estimate =
+        std::max(step_time,
+                 job.step_time_estimate +
+                     ((step_time - job.step_time_estimate) *
+                      kStepTimeEstimateDecay));
+    job.waited_frames = 0;
+    stepped_ids.push_back(job.id);
+  }
+  for (Job &job : jobs_) {
+    if (std::find(stepped_ids.begin(), stepped_ids.end(), job.id) ==
+        stepped_ids.end()) {
+      job.waited_frames++;
+    }
+  }
+  return step_count;
+}
+
+int BackgroundScheduler::pickJob(double time_left) const {
+  int best_index = -1;
+  int best_priority = 0;
+  for (std::size_t i = 0; i < jobs_.size(); i++) {
+    const Job &job = jobs_[i];
+    if (job.step_time_estimate > time_left) {
+      continue;
+    }
+    int priority = job.priority + (job.waited_frames / kAgingFrames);
+    // The earliest added job wins a tie.
+    if (best_index < 0 || priority > best_priority) {
+      best_index = static_cast<int>(i);
+      best_priority = priority;
+    }
+  }
+  return best_index;
+}
+
+int BackgroundScheduler::pickStarvedJob() const {
+  int best_index = -1;
+  int best_waited_frames = kMaxWaitedFrames - 1;
+  for (std::size_t i = 0; i < jobs_.size(); i++) {
+    // The earliest added job wins a tie.
+    if (jobs_[i].waited_frames > best_waited_frames) {
+      best_index = static_cast<int>(i);
+      best_waited_frames = jobs_[i].waited_frames;
+    }
+  }
+  return best_index;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,92 @@
+#ifndef EARTH_WORLD_BACKGROUND_SCHEDULER_H
+#define EARTH_WORLD_BACKGROUND_SCHEDULER_H
+
+#include <functional>
+#include <vector>
+
+namespace earth_world {
+
+/**
+ * Runs heavy work which isn't urgent in the time left over at the end of
+ * each frame, a small step at a time, so that it never pushes a frame past
+ * its deadline.
+ *
+ * Jobs are cooperative: each is a function which takes one small step, and
+ * says once the job is done. Each frame, steps are taken from the job with
+ * the highest priority whose next step is expected to fit in the time left,
+ * going by how long its steps took before, until none fits. Jobs gain
+ * priority for every frame they wait, so that low priority work still gets
+ * its turn under a steady stream of higher priority work. A job which has
+ * waited too long takes a step on a frame with no time to spare, if no other
+ * job did, so that every job makes progress even when frames run long.
+ */
+class BackgroundScheduler {
+ public:
+  /**
+   * Takes one small step of a job.
+   * @return True once the job is done.
+   */
+  typedef std::function<bool()> Step;
+
+  /**
+   * @param target_frame_time The time each frame should take at most, in
+   *     seconds.
+   * @param reserved_time The time to leave at the end of every frame, for
+   *     whatever follows the scheduler, in seconds.
+   */
+  BackgroundScheduler(double target_frame_time, double reserved_time);
+
+  /**
+   * Adds a job.
+   * @param priority How urgent the job is, where higher runs first.
+   * @param step Takes one small step of the job.
+   * @return The job's id, which is never 0.
+   */
+  unsigned long add(int priority, const Step &step);
+
+  /** @return True if the job with the given id has yet to finish. */
+  bool isPending(unsigned long id) const;
+
+  /** Drops a job without finishing it, if still pending. */
+  void cancel(unsigned long id);
+
+  /**
+   * Takes steps of the pending jobs, for as long as the frame has time left.
+   * @param frame_elapsed_time The time since the frame started, in seconds.
+   * @return The number of steps taken.
+   */
+  int run(double frame_elapsed_time);
+
+ protected:
+  struct Job {
+    unsigned long id;
+    int priority;
+    Step step;
+    /** The frames since the job last took a step. */
+    int waited_frames;
+    /** How long the job's next step is expected to take, in seconds. */
+    double step_time_estimate;
+  };
+
+  const double target_frame_time_;
+  const double reserved_time_;
+  unsigned long next_id_;
+  std::vector<Job> jobs_;
+
+  /**
+   * @return The index of the job to take the next step of, or -1 if no job's
+   *     step is expected to fit in the time left.
+   */
+  int pickJob(double time_left) const;
+
+  /**
+   * @return The index of the job which has waited the longest, if for too
+   *     many frames, so that it takes a step however little time is left, or
+   *     -1 if none has.
+   */
+  int pickStarvedJob() const;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_BACKGROUND_SCHEDULER_H
@@ -0,0 +1,313 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "city_static_data.h"
+#include "coast_distance_field.h"
+#include "fleet.h"
+#include "geodesy.h"
+#include "ocean_currents.h"
+#include "panda3d/pnmImage.h"
+#include "sea_route_planner.h"
+
+namespace earth_world {
+namespace benchmark {
+
+/** The number of point pairs each geodesy kernel is timed over. */
+const std::size_t kGeodesyPointCount = 1 << 16;
+/** The number of times each measurement is repeated, keeping the fastest. */
+const int kRepetitions = 20;
+/** The fleet sizes timed, to show how the cost per ship scales. */
+const int kFleetSizes[] = {1000, 10000, 100000};
+/** The size of the made up coast the fleet is timed against. */
+const int kFleetCoastWidth = 1024;
+const int kFleetCoastHeight = 512;
+const float kFleetStepDuration = 1.f / 30;
+/** The size of the made up land mask routes are planned over. */
+const int kRouteMaskWidth = 2048;
+const int kRouteMaskHeight = 1024;
+/** The number of cities routed between, in every pair. */
+const std::size_t kRouteCityCount = 16;
+
+/** @return The fastest time the function took to run, in nanoseconds. */
+static double getFastestTime(const std::function<void()> &function) {
+  double fastest_time = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < kRepetitions; i++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    fastest_time = std::min(fastest_time, elapsed.count());
+  }
+  return fastest_time;
+}
+
+/** Prints the times per element and the worst error of two paths. */
+static void printComparison(std::ostream &output, const std::string &name,
+                            double scalar_time, double batch_time,
+                            std::size_t count, double max_error) {
+  double size = static_cast<double>(count);
+  output << name << ": scalar " << scalar_time / size << " ns, batch "
+         << batch_time / size << " ns, speedup " << scalar_time / batch_time
+         << "x, max error " << max_error << std::endl;
+}
+
+/** @return A point uniformly distributed over the unit sphere. */
+static LVector3 getRandomPoint(std::mt19937 &generator) {
+  std::uniform_real_distribution<float> z_distribution(-1, 1);
+  std::uniform_real_distribution<float> longitude_distribution(
+      0, 2 * static_cast<float>(MathNumbers::pi));
+  float z = z_distribution(generator);
+  float longitude = longitude_distribution(generator);
+  float axis_distance = sqrtf(std::max(0.f, 1 - z * z));
+  return LVector3(axis_distance * cosf(longitude),
+                  axis_distance * sinf(longitude), z);
+}
+
+/** @return The difference between two angles, the short way around. */
+static float getAngleDifference(float a, float b) {
+  float difference = fabsf(a - b);
+  return std::min(difference,
+                  2 * static_cast<float>(MathNumbers::pi) - difference);
+}
+
+/** Compares the batched geodesy kernels against their scalar versions. */
+static int runGeodesy(std::ostream &output) {
+  const std::size_t count = kGeodesyPointCount;
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<float> bearing_distribution(
+      -static_cast<float>(MathNumbers::pi),
+      static_cast<float>(MathNumbers::pi));
+  std::uniform_real_distribution<float> distance_distribution(
+      0, static_cast<float>(MathNumbers::pi));
+  geodesy::Points from;
+  geodesy::Points to;
+  from.resize(count);
+  to.resize(count);
+  std::vector<float> bearings(count);
+  std::vector<float> distances(count);
+  for (std::size_t i = 0; i < count; i++) {
+    from.set(i, getRandomPoint(generator));
+    to.set(i, getRandomPoint(generator));
+    bearings[i] = bearing_distribution(generator);
+    distances[i] = distance_distribution(generator);
+  }
+
+  std::vector<float> scalar_values(count);
+  std::vector<float> batch_values;
+  double scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < count; i++) {
+      scalar_values[i] = geodesy::getDistance(from.get(i), to.get(i));
+    }
+  });
+  double batch_time =
+      getFastestTime([&]() { geodesy::getDistances(from, to, batch_values); });
+  double max_error = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    max_error = std::max(max_error, static_cast<double>(fabsf(
+                                        scalar_values[i] - batch_values[i])));
+  }
+  printComparison(output, "Distance", scalar_time, batch_time, count,
+                  max_error);
+
+  scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < count; i++) {
+      scalar_values[i] = geodesy::getBearing(from.get(i), to.get(i));
+    }
+  });
+  batch_time =
+      getFastestTime([&]() { geodesy::getBearings(from, to, batch_values); });
+  max_error = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    max_error = std::max(max_error, static_cast<double>(getAngleDifference(
+                                        scalar_values[i], batch_values[i])));
+  }
+  printComparison(output, "Bearing", scalar_time, batch_time, count,
+                  max_error);
+
+  std::vector<LVector3> scalar_points(count);
+  geodesy::Points batch_points;
+  scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < count; i++) {
+      scalar_points[i] =
+          geodesy::getDestination(from.get(i), bearings[i], distances[i]);
+    }
+  });
+  batch_time = getFastestTime([&]() {
+    geodesy::getDestinations(from, bearings, distances, batch_points);
+  });
+  max_error = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    max_error = std::max(
+        max_error,
+        static_cast<double>((scalar_points[i] - batch_points.get(i)).length()));
+  }
+  printComparison(output, "Destination", scalar_time, batch_time, count,
+                  max_error);
+
+  scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < count; i++) {
+      scalar_points[i] = geodesy::slerp(from.get(i), to.get(i), 0.25f);
+    }
+  });
+  batch_time = getFastestTime(
+      [&]() { geodesy::slerp(from, to, 0.25f, batch_points); });
+  max_error = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    max_error = std::max(
+        max_error,
+        static_cast<double>((scalar_points[i] - batch_points.get(i)).length()));
+  }
+  printComparison(output, "Slerp", scalar_time, batch_time, count, max_error);
+
+  // The full distance matrix between the default cities.
+  geodesy::Points cities;
+  cities.resize(kDefaultCities.size());
+  for (std::size_t i = 0; i < kDefaultCities.size(); i++) {
+    cities.set(i,
+               LVector3(kDefaultCities[i].getLocation().toCartesian())
+                   .normalized());
+  }
+  std::size_t city_count = cities.size();
+  std::vector<float> scalar_matrix(city_count * city_count);
+  std::vector<float> batch_matrix;
+  scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < city_count; i++) {
+      for (std::size_t j = 0; j < city_count; j++) {
+        scalar_matrix[i * city_count + j] =
+            geodesy::getDistance(cities.get(i), cities.get(j));
+      }
+    }
+  });
+  batch_time = getFastestTime(
+      [&]() { batch_matrix = geodesy::getDistanceMatrix(cities); });
+  max_error = 0;
+  for (std::size_t i = 0; i < scalar_matrix.size(); i++) {
+    max_error = std::max(max_error, static_cast<double>(fabsf(
+                                        scalar_matrix[i] - batch_matrix[i])));
+  }
+  printComparison(output, "City distance matrix", scalar_time, batch_time,
+                  scalar_matrix.size(), max_error);
+  return 0;
+}
+
+/**
+ * @return Whether there is land at the texel of a raster, on made up
+ *     continents from a few overlapping waves, so that timings include coasts
+ *     without needing the globe's textures.
+ */
+static bool isMadeUpLand(int x, int y, int width, int height) {
+  float latitude =
+      static_cast<float>(MathNumbers::pi) * (0.5f - ((y + 0.5f) / height));
+  float longitude =
+      2 * static_cast<float>(MathNumbers::pi) * ((x + 0.5f) / width);
+  float land = sinf(3 * longitude) * cosf(2 * latitude) +
+               0.5f * sinf(7 * longitude + 5 * latitude);
+  return land >= 0.6f;
+}
+
+/** @return The distance field of the made up continents. */
+static CoastDistanceField buildMadeUpCoast() {
+  std::vector<uint8_t> water(
+      static_cast<std::size_t>(kFleetCoastWidth * kFleetCoastHeight));
+  for (int y = 0; y < kFleetCoastHeight; y++) {
+    for (int x = 0; x < kFleetCoastWidth; x++) {
+      water[static_cast<std::size_t>((y * kFleetCoastWidth) + x)] =
+          isMadeUpLand(x, y, kFleetCoastWidth, kFleetCoastHeight) ? 0 : 1;
+    }
+  }
+  return CoastDistanceField(water, kFleetCoastWidth, kFleetCoastHeight);
+}
+
+/** Times a step of the fleet, and filling its transforms, at a few sizes. */
+static int runFleet(std::ostream &output) {
+  CoastDistanceField coast_distance_field = buildMadeUpCoast();
+  OceanCurrentField ocean_currents(/* time= */ 0.0);
+  std::vector<LMatrix4f> transforms;
+  for (int fleet_size : kFleetSizes) {
+    Fleet fleet(coast_distance_field, fleet_size, /* seed= */ 1);
+    double update_time = getFastestTime([&]() {
+      fleet.update(coast_distance_field, ocean_currents, kFleetStepDuration);
+    });
+    double transforms_time =
+        getFastestTime([&]() { fleet.getTransforms(0.5f, 1, transforms); });
+    double size = static_cast<double>(fleet_size);
+    output << "Fleet of " << fleet_size << ": update " << update_time / size
+           << " ns, transforms " << transforms_time / size
+           << " ns per ship, total " << (update_time + transforms_time) / 1e6
+           << " ms" << std::endl;
+  }
+  return 0;
+}
+
+/**
+ * Times the routes between every pair of a spread of cities over the made up
+ * continents, planned one by one, and in a batch across all cores.
+ */
+static int runRoutes(std::ostream &output) {
+  PNMImage land_mask(kRouteMaskWidth, kRouteMaskHeight, 1);
+  for (int y = 0; y < kRouteMaskHeight; y++) {
+    for (int x = 0; x < kRouteMaskWidth; x++) {
+      land_mask.set_bright(
+          x, y, isMadeUpLand(x, y, kRouteMaskWidth, kRouteMaskHeight) ? 0 : 1);
+    }
+  }
+  SeaRoutePlanner planner(land_mask, /* land_mask_cutoff= */ 0.5f);
+  std::vector<LVector3> cities;
+  for (std::size_t i = 0; i < kRouteCityCount; i++) {
+    cities.push_back(kDefaultCities[i * kDefaultCities.size() /
+                                    kRouteCityCount]
+                         .getLocation()
+                         .toCartesian());
+  }
+
+  std::size_t pair_count = kRouteCityCount * (kRouteCityCount - 1) / 2;
+  SeaRoute route;
+  double scalar_time = getFastestTime([&]() {
+    for (std::size_t i = 0; i < kRouteCityCount; i++) {
+      for (std::size_t j = i + 1; j < kRouteCityCount; j++) {
+        planner.findRoute(cities[i], cities[j], route);
+      }
+    }
+  });
+  std::vector<SeaRoute> routes;
+  double batch_time =
+      getFastestTime([&]() { routes = planner.findRoutes(cities); });
+  std::size_t route_count = 0;
+  for (std::size_t i = 0; i < kRouteCityCount; i++) {
+    for (std::size_t j = i + 1; j < kRouteCityCount; j++) {
+      if (!routes[(i * kRouteCityCount) + j].waypoints.empty()) {
+        route_count++;
+      }
+    }
+  }
+  output << "Sea routes between " << pair_count << " pairs of cities: one by "
+         << "one " << scalar_time / 1e6 << " ms, batch " << batch_time / 1e6
+         << " ms, speedup " << scalar_time / batch_time << "x, "
+         << route_count << " connected" << std::endl;
+  return 0;
+}
+
+int run(const std::string &name, std::ostream &output) {
+  if (name == "geodesy") {
+    return runGeodesy(output);
+  }
+  if (name == "fleet") {
+    return runFleet(output);
+  }
+  if (name == "routes") {
+    return runRoutes(output);
+  }
+  output << "Unknown benchmark: " << name << std::endl;
+  return 1;
+}
+
+}  // namespace benchmark
+}  // namespace earth_world
@@ -0,0 +1,30 @@
+#ifndef EARTH_WORLD_BENCHMARK_H
+#define EARTH_WORLD_BENCHMARK_H
+
+#include <ostream>
+#include <string>
+
+namespace earth_world {
+namespace benchmark {
+/**
+ * Benchmarks of the simulation's CPU hot paths, run from the command line
+ * with --benchmark=<name> instead of opening a window. "geodesy" compares
+ * the batched great circle kernels against the plain scalar ones they
+ * replace, for both speed and accuracy, "fleet" times the fleet at a few
+ * sizes, to show how its cost per ship scales, and "routes" compares sea
+ * routes between every pair of a few cities planned one by one against
+ * planned in a batch across all cores.
+ */
+
+/**
+ * Runs the named benchmark, printing its results.
+ * @param name The benchmark's name, "geodesy", "fleet" or "routes".
+ * @param output The stream to print results to.
+ * @return The exit status, nonzero if there is no such benchmark.
+ */
+int run(const std::string &name, std::ostream &output);
+
+}  // namespace benchmark
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_BENCHMARK_H
@@ -0,0 +1,101 @@
+#include "cache.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "filename.h"
+
+namespace earth_world {
+namespace cache {
+
+const uint32_t kMagic = 0x32435745;  // "EWC2"
+
+/** Precedes every entry's contents. */
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t input_hash;
+  uint64_t size;
+};
+
+uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t hashFile(const Filename &filename, uint64_t hash) {
+  std::string path = filename.get_fullpath();
+  int64_t size = static_cast<int64_t>(filename.get_file_size());
+  int64_t timestamp = static_cast<int64_t>(filename.get_timestamp());
+  hash = hashBytes(path.data(), path.size(), hash);
+  hash = hashBytes(&size, sizeof(size), hash);
+  return hashBytes(&timestamp, sizeof(timestamp), hash);
+}
+
+bool read(const std::string &name, uint32_t version,
+          std::vector<unsigned char> &data) {
+  return read(name, version, kNoInputHash, data);
+}
+
+bool read(const std::string &name, uint32_t version, uint64_t input_hash,
+          std::vector<unsigned char> &data) {
+  std::ifstream stream(filename::forCache(name).to_os_specific(),
+                       std::ios::binary | std::ios::ate);
+  std::streamoff file_size = stream.tellg();
+  stream.seekg(0);
+  Header header;
+  if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != kMagic || header.version != version ||
+      header.input_hash != input_hash) {
+    return false;
+  }
+  // The size is only trusted as far as the file backs it up, so that a torn
+  // or corrupt entry can't ask for more memory than it holds.
+  if (header.size != static_cast<uint64_t>(file_size) - sizeof(header)) {
+    return false;
+  }
+  data.resize(static_cast<std::size_t>(header.size));
+  return static_cast<bool>(
+      stream.read(reinterpret_cast<char *>(data.data()),
+                  static_cast<std::streamsize>(header.size)));
+}
+
+bool write(const std::string &name, uint32_t version, const void *data,
+           std::size_t size) {
+  return write(name, version, kNoInputHash, data, size);
+}
+
+bool write(const std::string &name, uint32_t version, uint64_t input_hash,
+           const void *data, std::size_t size) {
+  Filename filename = filename::forCache(name);
+  filename.make_dir();
+  std::ofstream stream(filename.to_os_specific(),
+                       std::ios::binary | std::ios::trunc);
+  Header header{kMagic, version, input_hash, size};
+  stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  stream.write(static_cast<const char *>(data),
+               static_cast<std::streamsize>(size));
+  return static_cast<bool>(stream);
+}
+
+void appendBytes(std::vector<unsigned char> &data, const void *bytes,
+                 std::size_t size) {
+  const unsigned char *begin = static_cast<const unsigned char *>(bytes);
+  data.insert(data.end(), begin, begin + size);
+}
+
+bool readBytes(const std::vector<unsigned char> &data, std::size_t &offset,
+               void *bytes, std::size_t size) {
+  if (data.size() - offset < size) {
+    return false;
+  }
+  std::memcpy(bytes, data.data() + offset, size);
+  offset += size;
+  return true;
+}
+
+}  // namespace cache
+}  // namespace earth_world
@@ -0,0 +1,113 @@
+#ifndef EARTH_WORLD_CACHE_H
+#define EARTH_WORLD_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "panda3d/filename.h"
+
+namespace earth_world {
+namespace cache {
+/**
+ * Stores expensive to compute data on disk between runs, in the cache
+ * directory. Each entry is tagged with a version, and with a hash of the
+ * inputs it was computed from, so that an entry written with a different
+ * version, or from different inputs, is treated as missing.
+ */
+
+/** The hash of no inputs, which inputs are folded into. */
+const uint64_t kNoInputHash = 14695981039346656037ull;
+
+/**
+ * Folds bytes into an input hash, with 64-bit FNV-1a.
+ * @param data The bytes to fold in.
+ * @param size The number of bytes.
+ * @param hash The hash so far.
+ * @return The hash with the bytes folded in.
+ */
+uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash);
+
+/**
+ * Folds a source file into an input hash, by its path, size and
+ * modification time, rather than its contents, which would take as long to
+ * read as some of the entries take to compute.
+ * @param filename The source file.
+ * @param hash The hash so far.
+ * @return The hash with the file folded in.
+ */
+uint64_t hashFile(const Filename &filename, uint64_t hash);
+
+/**
+ * Reads a cache entry which depends on nothing but its version.
+ * @param name The entry's file name, relative to the cache directory.
+ * @param version The version the entry must have been written with.
+ * @param data Filled with the entry's contents.
+ * @return True if the entry existed with the given version.
+ */
+bool read(const std::string &name, uint32_t version,
+          std::vector<unsigned char> &data);
+
+/**
+ * Reads a cache entry.
+ * @param name The entry's file name, relative to the cache directory.
+ * @param version The version the entry must have been written with.
+ * @param input_hash The hash of the inputs the entry must have been
+ *     computed from.
+ * @param data Filled with the entry's contents.
+ * @return True if the entry existed with the given version and input hash,
+ *     and was whole.
+ */
+bool read(const std::string &name, uint32_t version, uint64_t input_hash,
+          std::vector<unsigned char> &data);
+
+/**
+ * Writes a cache entry which depends on nothing but its version, replacing
+ * any existing one.
+ * @param name The entry's file name, relative to the cache directory.
+ * @param version The version to tag the entry with.
+ * @param data The contents to write.
+ * @param size The size of the contents, in bytes.
+ * @return True if the entry was written.
+ */
+bool write(const std::string &name, uint32_t version, const void *data,
+           std::size_t size);
+
+/**
+ * Writes a cache entry, replacing any existing one.
+ * @param name The entry's file name, relative to the cache directory.
+ * @param version The version to tag the entry with.
+ * @param input_hash The hash of the inputs the entry was computed from.
+ * @param data The contents to write.
+ * @param size The size of the contents, in bytes.
+ * @return True if the entry was written.
+ */
+bool write(const std::string &name, uint32_t version, uint64_t input_hash,
+           const void *data, std::size_t size);
+
+/**
+ * Appends raw bytes to the contents of an entry being built.
+ * @param data The contents to append to.
+ * @param bytes The bytes to append.
+ * @param size The number of bytes.
+ */
+void appendBytes(std::vector<unsigned char> &data, const void *bytes,
+                 std::size_t size);
+
+/**
+ * Reads raw bytes from the contents of an entry.
+ * @param data The contents to read from.
+ * @param offset The offset to read at, advanced past the bytes read.
+ * @param bytes Receives the bytes.
+ * @param size The number of bytes.
+ * @return False if the contents are too short, in which case nothing is
+ *     read.
+ */
+bool readBytes(const std::vector<unsigned char> &data, std::size_t &offset,
+               void *bytes, std::size_t size);
+
+}  // namespace cache
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_CACHE_H
@@ -0,0 +1,344 @@
+#include "city_labels_view.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "city.h"
+#include "panda3d/dynamicTextFont.h"
+#include "panda3d/geom.h"
+#include "panda3d/geomTriangles.h"
+#include "panda3d/geomVertexArrayFormat.h"
+#include "panda3d/geomVertexData.h"
+#include "panda3d/geomVertexWriter.h"
+#include "panda3d/internalName.h"
+#include "panda3d/renderState.h"
+#include "panda3d/textEncoder.h"
+#include "panda3d/textGlyph.h"
+#include "panda3d/textProperties.h"
+#include "panda3d/transparencyAttrib.h"
+#include "quaternion.h"
+#include "sphere_point.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+const PN_stdfloat kCityLabelScale = 0.007f;
+const PN_stdfloat kCityLabelOffset = 0.01f / MathNumbers::pi;
+const LColor kCityLabelTextColor(1, 1, 1, 1);
+const LColor kCityLabelShadowColor(0, 0, 0, 1);
+const LVector2 kCityLabelShadowOffset(0.05f, 0.05f);
+const int kGlyphAtlasSize = 1024;
+const PN_stdfloat kGlyphPixelsPerUnit = 40.f;
+/** Each glyph is a shadow quad followed by a text quad. */
+const int kRowsPerGlyph = 8;
+const int kDeclutterCellPx = 16;
+
+CityLabelsView::CityLabelsView(const std::vector<City> &cities)
+    : path_{"CityLabels"},
+      geom_node_{new GeomNode("CityLabels")},
+      grid_size_{0},
+      declutter_pass_{0} {
+  PT<TextFont> font = loadFont();
+
+  // A glyph quad, in the space relative to the globe, waiting to be batched.
+  struct GlyphQuad {
+    LPoint3 text_corners[4];
+    LPoint3 shadow_corners[4];
+    LVecBase4 texcoords;
+  };
+  std::vector<CPT<RenderState>> batch_states;
+  std::vector<std::vector<GlyphQuad>> batch_quads;
+
+  labels_.reserve(cities.size());
+  for (const City &city : cities) {
+    const SpherePoint3 &sphere_position = city.getLocation();
+    LVector3 cartesian_position = sphere_position.toCartesian();
+    LQuaternion rotation =
+        quaternion::fromLookAt(-cartesian_position, LVector3::up());
+
+    // Offset the label a bit up and right of the city.
+    SpherePoint3 label_origin_global =
+        SpherePoint3(sphere_position.get_azimuthal() + kCityLabelOffset,
+                     sphere_position.get_polar() + kCityLabelOffset,
+                     sphere_position.get_radial());
+    LPoint3 label_origin = label_origin_global.toCartesian();
+    auto to_globe = [&](PN_stdfloat x, PN_stdfloat z) {
+      return label_origin +
+             rotation.xform(LVector3(x, 0, z) * kCityLabelScale);
+    };
+
+    Label label{city.getId(), label_origin, label_origin, {}, true};
+    LVecBase4 extents(0, 0, 0, 0);
+    PN_stdfloat pen_x = 0;
+
+    TextEncoder encoder;
+    encoder.set_text(city.getName());
+    for (wchar_t character : encoder.get_wtext()) {
+      CPT<TextGlyph> glyph;
+      if (!font->get_glyph(character, glyph) || glyph == nullptr) {
+        pen_x += font->get_space_advance();
+        continue;
+      }
+      LVecBase4 dimensions;
+      GlyphQuad quad;
+      if (glyph->get_quad(dimensions, quad.texcoords)) {
+        // Dimensions are ordered left, bottom, right, top.
+        PN_stdfloat left = pen_x + dimensions[0];
+        PN_stdfloat right = pen_x + dimensions[2];
+        PN_stdfloat bottom = dimensions[1];
+        PN_stdfloat top = dimensions[3];
+        PN_stdfloat shadow_x = kCityLabelShadowOffset.get_x();
+        PN_stdfloat shadow_z = -kCityLabelShadowOffset.get_y();
+        quad.text_corners[0] = to_globe(left, bottom);
+        quad.text_corners[1] = to_globe(right, bottom);
+        quad.text_corners[2] = to_globe(left, top);
+        quad.text_corners[3] = to_globe(right, top);
+        quad.shadow_corners[0] = to_globe(left + shadow_x, bottom + shadow_z);
+        quad.shadow_corners[1] = to_globe(right + shadow_x, bottom + shadow_z);
+        quad.shadow_corners[2] = to_globe(left + shadow_x, top + shadow_z);
+        quad.shadow_corners[3] = to_globe(right + shadow_x, top + shadow_z);
+        extents.set(std::min(extents[0], left),
+                    std::min(extents[1], bottom + shadow_z),
+                    std::max(extents[2], right + shadow_x),
+                    std::max(extents[3], top));
+
+        // Glyphs on the same atlas page share a state, and thus a batch.
+        CPT<RenderState> state = glyph->get_state();
+        int batch = static_cast<int>(
+            std::find(batch_states.begin(), batch_states.end(), state) -
+            batch_states.begin());
+        if (batch == static_cast<int>(batch_states.size())) {
+          batch_states.push_back(state);
+          batch_quads.emplace_back();
+        }
+        std::vector<GlyphQuad> &quads =
+            batch_quads[static_cast<std::size_t>(batch)];
+        int row = static_cast<int>(quads.size()) * kRowsPerGlyph;
+        if (!label.spans.empty() && label.spans.back().geom_index == batch &&
+            label.spans.back().first_row +
+                    (label.spans.back().glyph_count * kRowsPerGlyph) ==
+                row) {
+          label.spans.back().glyph_count++;
+        } else {
+          label.spans.push_back(LabelSpan{batch, row, 1});
+        }
+        quads.push_back(quad);
+      }
+      pen_x += glyph->get_advance();
+    }
+    label.lower_left = to_globe(extents[0], extents[1]);
+    label.upper_right = to_globe(extents[2], extents[3]);
+    labels_.push_back(std::move(label));
+  }
+
+  // Bake each atlas page's quads into a single geom.
+  CPT<GeomVertexFormat> format = getVertexFormat();
+  for (std::size_t batch = 0; batch < batch_quads.size(); batch++) {
+    const std::vector<GlyphQuad> &quads = batch_quads[batch];
+    PT<GeomVertexData> vertex_data =
+        new GeomVertexData("CityLabels", format, Geom::UH_static);
+    vertex_data->modify_array(1)->set_usage_hint(Geom::UH_dynamic);
+    vertex_data->unclean_set_num_rows(
+        static_cast<int>(quads.size()) * kRowsPerGlyph);
+    GeomVertexWriter vertices(vertex_data, InternalName::get_vertex());
+    GeomVertexWriter uvs(vertex_data, InternalName::get_texcoord());
+    GeomVertexWriter colors(vertex_data, InternalName::get_color());
+    PT<GeomTriangles> triangles = new GeomTriangles(Geom::UH_static);
+    int row = 0;
+    for (const GlyphQuad &quad : quads) {
+      const LVecBase4 &tex = quad.texcoords;
+      for (const LPoint3 *corners : {quad.shadow_corners, quad.text_corners}) {
+        for (int i = 0; i < 4; i++) {
+          vertices.set_data3(corners[i]);
+        }
+        uvs.set_data2(tex[0], tex[1]);
+        uvs.set_data2(tex[2], tex[1]);
+        uvs.set_data2(tex[0], tex[3]);
+        uvs.set_data2(tex[2], tex[3]);
+        LColor color = corners == quad.shadow_corners ? kCityLabelShadowColor
+                                                      : kCityLabelTextColor;
+        for (int i = 0; i < 4; i++) {
+          colors.set_data4(color);
+        }
+        triangles->add_vertices(row + 0, row + 1, row + 2);
+        triangles->add_vertices(row + 2, row + 1, row + 3);
+        row += 4;
+      }
+    }
+    triangles->close_primitive();
+    PT<Geom> geom = new Geom(vertex_data);
+    geom->add_primitive(triangles);
+    geom_node_->add_geom(geom, batch_states[batch]);
+  }
+
+  path_.attach_new_node(geom_node_);
+  path_.set_transparency(TransparencyAttrib::M_alpha);
+  path_.set_depth_write(false);
+  path_.set_depth_test(false);
+  path_.set_bin("fixed", 1);
+}
+
+CityLabelsView::CityLabelsView(CityLabelsView &&other) noexcept
+    : path_{other.path_},
+      geom_node_{std::move(other.geom_node_)},
+      labels_{std::move(other.labels_)},
+      grid_stamps_{std::move(other.grid_stamps_)},
+      grid_size_{other.grid_size_},
+      declutter_pass_{other.declutter_pass_} {
+  other.path_.clear();
+}
+
+CityLabelsView &CityLabelsView::operator=(CityLabelsView &&other) noexcept {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  path_.remove_node();
+  path_ = other.path_;
+  geom_node_ = std::move(other.geom_node_);
+  labels_ = std::move(other.labels_);
+  grid_stamps_ = std::move(other.grid_stamps_);
+  grid_size_ = other.grid_size_;
+  declutter_pass_ = other.declutter_pass_;
+  other.path_.clear();
+  return *this;
+}
+
+CityLabelsView::~CityLabelsView() { path_.remove_node(); }
+
+NodePath CityLabelsView::getPath() const { return path_; }
+
+void CityLabelsView::declutter(const NodePath &camera, const Lens *lens,
+                               const LVector2i &window_size,
+                               const std::vector<uint8_t> &city_visibility) {
+  if (lens == nullptr || window_size.get_x() <= 0 ||
+      window_size.get_y() <= 0) {
+    return;
+  }
+  LVector2i grid_size((window_size.get_x() + kDeclutterCellPx - 1) /
+                          kDeclutterCellPx,
+                      (window_size.get_y() + kDeclutterCellPx - 1) /
+                          kDeclutterCellPx);
+  if (grid_size != grid_size_) {
+    grid_size_ = grid_size;
+    grid_stamps_.assign(
+        static_cast<std::size_t>(grid_size.get_x() * grid_size.get_y()), 0);
+    declutter_pass_ = 0;
+  }
+  // Stamping cells with the pass number avoids clearing the grid every frame.
+  declutter_pass_++;
+  if (declutter_pass_ == 0) {
+    std::fill(grid_stamps_.begin(), grid_stamps_.end(), 0);
+    declutter_pass_ = 1;
+  }
+
+  LMatrix4 globe_to_camera = path_.get_mat(camera);
+  for (Label &label : labels_) {
+    LPoint2 lower_left, upper_right;
+    bool visible =
+        city_visibility[static_cast<std::size_t>(label.city_id)] != 0 &&
+        projectToPixels(globe_to_camera, lens, window_size, label.lower_left,
+                        lower_left) &&
+        projectToPixels(globe_to_camera, lens, window_size, label.upper_right,
+                        upper_right);
+    if (visible) {
+      int min_x = static_cast<int>(
+          std::min(lower_left.get_x(), upper_right.get_x()) / kDeclutterCellPx);
+      int max_x = static_cast<int>(
+          std::max(lower_left.get_x(), upper_right.get_x()) / kDeclutterCellPx);
+      int min_y = static_cast<int>(
+          std::min(lower_left.get_y(), upper_right.get_y()) / kDeclutterCellPx);
+      int max_y = static_cast<int>(
+          std::max(lower_left.get_y(), upper_right.get_y()) / kDeclutterCellPx);
+      min_x = std::max(0, min_x);
+      min_y = std::max(0, min_y);
+      max_x = std::min(grid_size_.get_x() - 1, max_x);
+      max_y = std::min(grid_size_.get_y() - 1, max_y);
+      for (int y = min_y; y <= max_y && visible; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+          if (grid_stamps_[static_cast<std::size_t>(
+                  (y * grid_size_.get_x()) + x)] == declutter_pass_) {
+            visible = false;
+            break;
+          }
+        }
+      }
+      if (visible) {
+        for (int y = min_y; y <= max_y; y++) {
+          for (int x = min_x; x <= max_x; x++) {
+            grid_stamps_[static_cast<std::size_t>((y * grid_size_.get_x()) +
+                                                  x)] = declutter_pass_;
+          }
+        }
+      }
+    }
+    if (visible != label.visible) {
+      setLabelVisible(label, visible);
+    }
+  }
+}
+
+void CityLabelsView::setLabelVisible(Label &label, bool visible) {
+  label.visible = visible;
+  LColor text_color = kCityLabelTextColor;
+  LColor shadow_color = kCityLabelShadowColor;
+  if (!visible) {
+    text_color.set_w(0);
+    shadow_color.set_w(0);
+  }
+  for (const LabelSpan &span : label.spans) {
+    PT<Geom> geom = geom_node_->modify_geom(span.geom_index);
+    PT<GeomVertexData> vertex_data = geom->modify_vertex_data();
+    GeomVertexWriter colors(vertex_data, InternalName::get_color());
+    colors.set_row(span.first_row);
+    for (int glyph = 0; glyph < span.glyph_count; glyph++) {
+      for (int i = 0; i < 4; i++) {
+        colors.set_data4(shadow_color);
+      }
+      for (int i = 0; i < 4; i++) {
+        colors.set_data4(text_color);
+      }
+    }
+  }
+}
+
+bool CityLabelsView::projectToPixels(const LMatrix4 &globe_to_camera,
+                                     const Lens *lens,
+                                     const LVector2i &window_size,
+                                     const LPoint3 &point, LPoint2 &pixel) {
+  LPoint2 film;
+  if (!lens->project(globe_to_camera.xform_point(point), film)) {
+    return false;
+  }
+  // Film coordinates are in [-1, 1], with +Y up.
+  pixel.set((film.get_x() + 1) * 0.5f * window_size.get_x(),
+            (1 - film.get_y()) * 0.5f * window_size.get_y());
+  return true;
+}
+
+PT<TextFont> CityLabelsView::loadFont() {
+  // Only dynamic fonts render their glyphs into a texture atlas; a single
+  // large page keeps every glyph, and so every label, in one batch.
+  PT<TextFont> font = TextProperties::get_default_font()->make_copy();
+  if (font->is_of_type(DynamicTextFont::get_class_type())) {
+    DynamicTextFont *dynamic_font = DCAST(DynamicTextFont, font);
+    dynamic_font->set_page_size(kGlyphAtlasSize, kGlyphAtlasSize);
+    dynamic_font->set_pixels_per_unit(kGlyphPixelsPerUnit);
+  }
+  return font;
+}
+
+CPT<GeomVertexFormat> CityLabelsView::getVertexFormat() {
+  PT<GeomVertexArrayFormat> static_array = new GeomVertexArrayFormat;
+  static_array->add_column(InternalName::get_vertex(), 3, Geom::NT_stdfloat,
+                           Geom::C_point);
+  static_array->add_column(InternalName::get_texcoord(), 2,
+                           Geom::NT_stdfloat, Geom::C_texcoord);
+  PT<GeomVertexArrayFormat> color_array = new GeomVertexArrayFormat(
+      InternalName::get_color(), 4, Geom::NT_uint8, Geom::C_color);
+  PT<GeomVertexFormat> format = new GeomVertexFormat;
+  format->add_array(static_array);
+  format->add_array(color_array);
+  return GeomVertexFormat::register_format(format);
+}
+
+}  // namespace earth_world
@@ -0,0 +1,97 @@
+#ifndef EARTH_WORLD_CITY_LABELS_VIEW_H
+#define EARTH_WORLD_CITY_LABELS_VIEW_H
+
+#include <cstdint>
+#include <vector>
+
+#include "city.h"
+#include "panda3d/aa_luse.h"
+#include "panda3d/geomNode.h"
+#include "panda3d/geomVertexFormat.h"
+#include "panda3d/lens.h"
+#include "panda3d/nodePath.h"
+#include "panda3d/textFont.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * Renders the labels of all cities on the map. Every label's glyph quads are
+ * baked into a handful of shared geoms, one per glyph atlas page, so that the
+ * labels draw in a few calls regardless of how many cities there are.
+ * Overlapping labels are hidden each frame in priority order, where cities
+ * earlier in the list have higher priority.
+ */
+class CityLabelsView {
+ public:
+  /** @param cities The cities to label, indexed by their ids. */
+  explicit CityLabelsView(const std::vector<City> &cities);
+  CityLabelsView(const CityLabelsView &) = delete;
+  CityLabelsView(CityLabelsView &&) noexcept;
+  CityLabelsView &operator=(const CityLabelsView &) = delete;
+  CityLabelsView &operator=(CityLabelsView &&) noexcept;
+  ~CityLabelsView();
+
+  NodePath getPath() const;
+
+  /**
+   * Hides labels which would overlap a higher priority label on screen, and
+   * shows the rest.
+   * @param camera The path of the camera the labels are viewed from.
+   * @param lens The lens of that camera.
+   * @param window_size The pixel dimensions of the window.
+   * @param city_visibility Per city id, 0 if the city is already known to be
+   *     hidden, in which case its label is hidden without being projected.
+   */
+  void declutter(const NodePath &camera, const Lens *lens,
+                 const LVector2i &window_size,
+                 const std::vector<uint8_t> &city_visibility);
+
+ protected:
+  /** The rows a label occupies within one of the batched geoms. */
+  struct LabelSpan {
+    int geom_index;
+    int first_row;
+    int glyph_count;
+  };
+
+  /** The placement and screen state of a single city's label. */
+  struct Label {
+    int city_id;
+    /** The lower left and upper right corners, relative to the globe. */
+    LPoint3 lower_left;
+    LPoint3 upper_right;
+    std::vector<LabelSpan> spans;
+    bool visible;
+  };
+
+  NodePath path_;
+  PT<GeomNode> geom_node_;
+  std::vector<Label> labels_;
+
+  /** Per screen grid cell, the last declutter pass which claimed the cell. */
+  std::vector<uint32_t> grid_stamps_;
+  LVector2i grid_size_;
+  uint32_t declutter_pass_;
+
+  /** Shows or hides the given label by rewriting the alpha of its glyphs. */
+  void setLabelVisible(Label &label, bool visible);
+
+  /** Projects a point relative to the globe into window pixels. */
+  static bool projectToPixels(const LMatrix4 &globe_to_camera,
+                              const Lens *lens, const LVector2i &window_size,
+                              const LPoint3 &point, LPoint2 &pixel);
+
+  /** @return The shared font whose glyph atlas all labels are drawn from. */
+  static PT<TextFont> loadFont();
+
+  /**
+   * @return The vertex format of the batched geoms, which keeps the static
+   *     positions and UVs apart from the colors rewritten when decluttering.
+   */
+  static CPT<GeomVertexFormat> getVertexFormat();
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_CITY_LABELS_VIEW_H
@@ -30,7 +30,6 @@ class CityView {
   int city_id_;
   NodePath path_;
   NodePath icon_path_;
-  NodePath label_path_;
 
   static NodePath buildIconNode();
 };
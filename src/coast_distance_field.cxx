@@ -0,0 +1,514 @@
+#include "coast_distance_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+#include "cache.h"
+#include "geodesy.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+const int kWidth = 4096;
+const int kHeight = 2048;
+const uint32_t kCacheVersion = 1;
+const std::string kCacheName = "coast_distance_4096x2048.bin";
+/** Distances are clamped to this, in radians, which is about 300km. */
+const float kMaxDistance = 0.05f;
+const float kQuantizationScale = 32767.f / kMaxDistance;
+/** The number of points whose raster positions are found at once. */
+const std::size_t kDistanceBatchSize = 256;
+/** The columns each step of a band update covers. */
+const int kBandStepColumns = 256;
+/** The rows each step of a band update covers, once its columns are done. */
+const int kBandStepRows = 2;
+/** The distance from the coast at which a sweep counts as touching it. */
+const PN_stdfloat kContactDistance = 1e-4f;
+/** The most steps a single sweep takes, which bounds its cost. */
+const int kMaxSweepSteps = 8;
+const PN_stdfloat kSweepEpsilon = 1e-6f;
+
+/**
+ * Computes the 1D squared distance transform of f, with samples the given
+ * spacing apart, by Felzenszwalb and Huttenlocher's lower envelope of
+ * parabolas.
+ * @param f The squared distance at each sample, 0 on features.
+ * @param spacing The distance between neighboring samples.
+ * @param d Filled with the squared distance transform of f.
+ */
+static void transform1D(const std::vector<double> &f, double spacing,
+                        std::vector<double> &d) {
+  const double infinity = std::numeric_limits<double>::infinity();
+  std::size_t n = f.size();
+  std::vector<std::size_t> vertices(n);
+  std::vector<double> boundaries(n + 1);
+  std::size_t k = 0;
+  vertices[0] = 0;
+  boundaries[0] = -infinity;
+  boundaries[1] = infinity;
+  for (std::size_t q = 1; q < n; q++) {
+    double position = static_cast<double>(q) * spacing;
+    // The first boundary is at minus infinity, so this always terminates.
+    double intersection;
+    while (true) {
+      double vertex = static_cast<double>(vertices[k]) * spacing;
+      intersection = ((f[q] + (position * position)) -
+                      (f[vertices[k]] + (vertex * vertex))) /
+                     (2 * (position - vertex));
+      if (intersection > boundaries[k]) {
+        break;
+      }
+      k--;
+    }
+    k++;
+    vertices[k] = q;
+    boundaries[k] = intersection;
+    boundaries[k + 1] = infinity;
+  }
+  k = 0;
+  d.resize(n);
+  for (std::size_t q = 0; q < n; q++) {
+    double position = static_cast<double>(q) * spacing;
+    while (boundaries[k + 1] < position) {
+      k++;
+    }
+    double offset = position - (static_cast<double>(vertices[k]) * spacing);
+    d[q] = (offset * offset) + f[vertices[k]];
+  }
+}
+
+/**
+ * Computes the squared distance in radians along a range of columns, from
+ * every texel of a band of rows to the nearest feature texel in its column,
+ * within a window of rows around the band. Rows are spaced evenly in
+ * latitude.
+ * @param features Per texel of the window, row major, whether it is a
+ *     feature.
+ * @param width The width of the window, and of the whole raster.
+ * @param height The height of the whole raster.
+ * @param window_row_count The number of rows in the window.
+ * @param band_offset The first row of the band, within the window.
+ * @param row_count The number of rows in the band.
+ * @param column_begin The first column to compute.
+ * @param column_end One past the last column to compute.
+ * @param distances Per texel of the band, row major, of which the columns in
+ *     range are overwritten.
+ */
+static void transformColumns(const std::vector<uint8_t> &features, int width,
+                             int height, int window_row_count,
+                             int band_offset, int row_count, int column_begin,
+                             int column_end, std::vector<float> &distances) {
+  const double row_spacing = MathNumbers::pi / height;
+  // Large enough that it never wins, yet small enough to add to safely.
+  const double no_feature = 1e20;
+  std::vector<double> f(static_cast<std::size_t>(window_row_count));
+  std::vector<double> d;
+  for (int x = column_begin; x < column_end; x++) {
+    for (int y = 0; y < window_row_count; y++) {
+      f[static_cast<std::size_t>(y)] =
+          features[static_cast<std::size_t>((y * width) + x)] != 0
+              ? 0
+              : no_feature;
+    }
+    transform1D(f, row_spacing, d);
+    // Columns span the whole window, but only the band's rows are kept.
+    for (int y = 0; y < row_count; y++) {
+      distances[static_cast<std::size_t>((y * width) + x)] =
+          static_cast<float>(d[static_cast<std::size_t>(band_offset + y)]);
+    }
+  }
+}
+
+/**
+ * Carries the squared distances along a range of a band's rows, after they
+ * have been carried along every column. Columns are spaced by the cosine of
+ * their row's latitude, wrapping around in longitude.
+ * @param width The width of the band, and of the whole raster.
+ * @param height The height of the whole raster.
+ * @param row_begin The first row of the band within the whole raster.
+ * @param band_row_begin The first row to compute, within the band.
+ * @param band_row_end One past the last row to compute, within the band.
+ * @param distances Per texel of the band, row major, of which the rows in
+ *     range are transformed in place.
+ */
+static void transformRows(int width, int height, int row_begin,
+                          int band_row_begin, int band_row_end,
+                          std::vector<float> &distances) {
+  const double pi = MathNumbers::pi;
+  // Lay each row out three times over, so that distances wrap around.
+  std::size_t row_size = static_cast<std::size_t>(width);
+  std::vector<double> f(3 * row_size);
+  std::vector<double> d;
+  for (int y = band_row_begin; y < band_row_end; y++) {
+    double latitude = (0.5 - ((row_begin + y + 0.5) / height)) * pi;
+    double column_spacing =
+        std::max(1e-4, std::cos(latitude)) * (2 * pi / width);
+    float *row = &distances[static_cast<std::size_t>(y * width)];
+    for (std::size_t x = 0; x < 3 * row_size; x++) {
+      f[x] = row[x % row_size];
+    }
+    transform1D(f, column_spacing, d);
+    for (std::size_t x = 0; x < row_size; x++) {
+      row[x] = static_cast<float>(d[row_size + x]);
+    }
+  }
+}
+
+/**
+ * Combines the squared distances to land and to water into quantized signed
+ * distances, over a range of texels of a band.
+ * @param water Per texel of the band, row major, 1 over water.
+ * @param to_land The squared distance to land, per texel of the band.
+ * @param to_water The squared distance to water, per texel of the band.
+ * @param height The height of the whole raster.
+ * @param begin The first texel to combine.
+ * @param end One past the last texel to combine.
+ * @param distances The signed distances, per texel of the band.
+ */
+static void quantizeDistances(const uint8_t *water,
+                              const std::vector<float> &to_land,
+                              const std::vector<float> &to_water, int height,
+                              std::size_t begin, std::size_t end,
+                              int16_t *distances) {
+  // Texel centers sit half a texel from the coast between them.
+  float half_texel = 0.5f * static_cast<float>(MathNumbers::pi) / height;
+  for (std::size_t i = begin; i < end; i++) {
+    float distance = water[i] != 0 ? sqrtf(to_land[i]) - half_texel
+                                   : half_texel - sqrtf(to_water[i]);
+    distance = std::max(-kMaxDistance, std::min(kMaxDistance, distance));
+    distances[i] =
+        static_cast<int16_t>(std::lround(distance * kQuantizationScale));
+  }
+}
+
+/**
+ * @return How many rows away from a texel its distance can be affected,
+ *     since a row is the shortest step between neighboring rows, and
+ *     distances are clamped.
+ */
+static int getRowReach(int height) {
+  double row_spacing = MathNumbers::pi / height;
+  return static_cast<int>(std::ceil(kMaxDistance / row_spacing)) + 1;
+}
+
+/**
+ * Computes the signed distances of a whole raster from a mask of water,
+ * across all cores.
+ * @param water Per texel, row major, 1 over water.
+ * @param width The width of the raster.
+ * @param height The height of the raster.
+ * @param distances Filled with the distances, row major.
+ */
+static void computeDistances(const std::vector<uint8_t> &water, int width,
+                             int height, int16_t *distances) {
+  std::size_t size = water.size();
+  std::vector<uint8_t> land(size);
+  for (std::size_t i = 0; i < size; i++) {
+    land[i] = water[i] != 0 ? 0 : 1;
+  }
+  std::vector<float> to_land(size);
+  std::vector<float> to_water(size);
+  parallel::forRange(0, width, [&](int column_begin, int column_end) {
+    transformColumns(land, width, height, height, 0, height, column_begin,
+                     column_end, to_land);
+    transformColumns(water, width, height, height, 0, height, column_begin,
+                     column_end, to_water);
+  });
+  parallel::forRange(0, height, [&](int row_begin, int row_end) {
+    transformRows(width, height, 0, row_begin, row_end, to_land);
+    transformRows(width, height, 0, row_begin, row_end, to_water);
+    quantizeDistances(water.data(), to_land, to_water, height,
+                      static_cast<std::size_t>(row_begin * width),
+                      static_cast<std::size_t>(row_end * width), distances);
+  });
+}
+
+CoastDistanceField::CoastDistanceField(const PNMImage &land_mask,
+                                       PN_stdfloat land_mask_cutoff,
+                                       uint64_t source_hash)
+    : width_{kWidth}, height_{kHeight} {
+  std::vector<unsigned char> data;
+  std::size_t size = static_cast<std::size_t>(kWidth * kHeight);
+  if (cache::read(kCacheName, kCacheVersion, source_hash, data) &&
+      data.size() == size * sizeof(int16_t)) {
+    distances_.resize(size);
+    std::memcpy(distances_.data(), data.data(), data.size());
+    return;
+  }
+  distances_ = bake(land_mask, land_mask_cutoff, kWidth, kHeight);
+  cache::write(kCacheName, kCacheVersion, source_hash, distances_.data(),
+               distances_.size() * sizeof(int16_t));
+}
+
+CoastDistanceField::CoastDistanceField(const std::vector<uint8_t> &water,
+                                       int width, int height)
+    : width_{width},
+      height_{height},
+      distances_(static_cast<std::size_t>(width * height)) {
+  computeDistances(water, width, height, distances_.data());
+}
+
+CoastDistanceField::CoastDistanceField()
+    : width_{1},
+      height_{1},
+      distances_(1, static_cast<int16_t>(kMaxDistance * kQuantizationScale)) {
+}
+
+int CoastDistanceField::getWidth() const { return width_; }
+
+int CoastDistanceField::getHeight() const { return height_; }
+
+PN_stdfloat CoastDistanceField::getDistance(const LVector3 &point) const {
+  PN_stdfloat x;
+  PN_stdfloat y;
+  getRasterPosition(point, x, y);
+  return sample(x, y);
+}
+
+void CoastDistanceField::getDistances(const float *xs, const float *ys,
+                                      const float *zs, std::size_t count,
+                                      float *distances) const {
+  // Find the raster positions a batch at a time, with SIMD, then sample them.
+  float longitudes[kDistanceBatchSize];
+  float latitudes[kDistanceBatchSize];
+  for (std::size_t begin = 0; begin < count; begin += kDistanceBatchSize) {
+    std::size_t batch_size = std::min(kDistanceBatchSize, count - begin);
+    geodesy::getLongitudesAndLatitudes(&xs[begin], &ys[begin], &zs[begin],
+                                       batch_size, longitudes, latitudes);
+    for (std::size_t i = 0; i < batch_size; i++) {
+      distances[begin + i] =
+          sample(((longitudes[i] / (2 * MathNumbers::pi)) * width_) - 0.5f,
+                 ((0.5f - (latitudes[i] / MathNumbers::pi)) * height_) -
+                     0.5f);
+    }
+  }
+}
+
+LVector3 CoastDistanceField::getGradient(const LVector3 &point) const {
+  PN_stdfloat x;
+  PN_stdfloat y;
+  getRasterPosition(point, x, y);
+  int x0 = static_cast<int>(std::lround(x));
+  int y0 = static_cast<int>(std::lround(y));
+  // Central differences, in radians per texel.
+  PN_stdfloat d_dx = (getTexel(x0 + 1, y0) - getTexel(x0 - 1, y0)) / 2;
+  PN_stdfloat d_dy = (getTexel(x0, y0 + 1) - getTexel(x0, y0 - 1)) / 2;
+
+  LVector3 direction = point.normalized();
+  PN_stdfloat latitude = asinf(std::max(-1.f, std::min(1.f, direction[2])));
+  PN_stdfloat longitude = atan2f(direction[1], direction[0]);
+  LVector3 east(-sinf(longitude), cosf(longitude), 0);
+  LVector3 north(-sinf(latitude) * cosf(longitude),
+                 -sinf(latitude) * sinf(longitude), cosf(latitude));
+  PN_stdfloat east_texel =
+      std::max(0.01f, cosf(latitude)) * 2 * MathNumbers::pi / width_;
+  PN_stdfloat north_texel = MathNumbers::pi / height_;
+  // Rows run from north to south.
+  LVector3 gradient =
+      (east * (d_dx / east_texel)) - (north * (d_dy / north_texel));
+  PN_stdfloat length = gradient.length();
+  return length > 0 ? gradient / length : LVector3::zero();
+}
+
+LVector3 CoastDistanceField::sweep(const LVector3 &from,
+                                   const LVector3 &displacement,
+                                   PN_stdfloat clearance) const {
+  LVector3 position = from.normalized();
+  LVector3 remaining = displacement - (position * displacement.dot(position));
+  for (int step = 0; step < kMaxSweepSteps; step++) {
+    PN_stdfloat length = remaining.length();
+    if (length < kSweepEpsilon) {
+      break;
+    }
+    PN_stdfloat free_distance = getDistance(position) - clearance;
+    if (free_distance < kContactDistance) {
+      // Touching the coast: back out of it if needed, and drop the part of
+      // the move heading into land, keeping the part sliding along it.
+      LVector3 normal = getGradient(position);
+      if (free_distance < 0) {
+        position = (position - (normal * free_distance)).normalized();
+      }
+      PN_stdfloat into_land = remaining.dot(normal);
+      if (into_land < 0) {
+        remaining -= normal * into_land;
+      }
+      length = remaining.length();
+      if (length < kSweepEpsilon) {
+        break;
+      }
+      // Sliding along the coast keeps about the same distance from it, but
+      // the field here says nothing of the land further along, which may
+      // turn into a headland. So slide a texel at a time, backing out along
+      // the gradient on the next step to follow the coast's curvature.
+      free_distance = static_cast<PN_stdfloat>(MathNumbers::pi) / height_;
+    }
+    // Nothing is nearer than the free distance, or the coast is being slid
+    // along a texel at a time, so it is safe to step.
+    PN_stdfloat advance = std::min(length, free_distance);
+    LVector3 direction = remaining / length;
+    position = (position + (direction * advance)).normalized();
+    remaining = direction * (length - advance);
+    remaining -= position * remaining.dot(position);
+  }
+  PN_stdfloat free_distance = getDistance(position) - clearance;
+  if (free_distance < 0) {
+    position = (position - (getGradient(position) * free_distance))
+                   .normalized();
+  }
+  return position;
+}
+
+int CoastDistanceField::getRowReach() const {
+  return earth_world::getRowReach(height_);
+}
+
+void CoastDistanceField::setRows(int row_begin,
+                                 const std::vector<int16_t> &distances) {
+  std::copy(distances.begin(), distances.end(),
+            distances_.begin() +
+                static_cast<std::ptrdiff_t>(row_begin * width_));
+}
+
+PN_stdfloat CoastDistanceField::getTexel(int x, int y) const {
+  x %= width_;
+  if (x < 0) {
+    x += width_;
+  }
+  y = std::max(0, std::min(height_ - 1, y));
+  return distances_[static_cast<std::size_t>((y * width_) + x)] /
+         kQuantizationScale;
+}
+
+PN_stdfloat CoastDistanceField::sample(PN_stdfloat x, PN_stdfloat y) const {
+  int x0 = static_cast<int>(std::floor(x));
+  int y0 = static_cast<int>(std::floor(y));
+  PN_stdfloat fx = x - x0;
+  PN_stdfloat fy = y - y0;
+  PN_stdfloat top = ((1 - fx) * getTexel(x0, y0)) + (fx * getTexel(x0 + 1, y0));
+  PN_stdfloat bottom =
+      ((1 - fx) * getTexel(x0, y0 + 1)) + (fx * getTexel(x0 + 1, y0 + 1));
+  return ((1 - fy) * top) + (fy * bottom);
+}
+
+void CoastDistanceField::getRasterPosition(const LVector3 &point,
+                                           PN_stdfloat &x,
+                                           PN_stdfloat &y) const {
+  LVector3 direction = point.normalized();
+  PN_stdfloat longitude = atan2f(direction[1], direction[0]);
+  if (longitude < 0) {
+    longitude += 2 * MathNumbers::pi;
+  }
+  PN_stdfloat latitude = asinf(std::max(-1.f, std::min(1.f, direction[2])));
+  x = ((longitude / (2 * MathNumbers::pi)) * width_) - 0.5f;
+  y = ((0.5f - (latitude / MathNumbers::pi)) * height_) - 0.5f;
+}
+
+CoastBandUpdate::CoastBandUpdate(const CoastDistanceField &field,
+                                 const std::vector<uint8_t> &water,
+                                 int water_row_begin, int row_begin,
+                                 int row_end)
+    : width_{field.getWidth()},
+      height_{field.getHeight()},
+      row_begin_{row_begin},
+      row_count_{row_end - row_begin},
+      next_column_{0},
+      next_row_{0} {
+  int reach = field.getRowReach();
+  int window_begin = std::max(0, row_begin - reach);
+  int window_end = std::min(height_, row_end + reach);
+  window_row_count_ = window_end - window_begin;
+  band_offset_ = row_begin - window_begin;
+  std::ptrdiff_t window_offset = (window_begin - water_row_begin) * width_;
+  water_.assign(water.begin() + window_offset,
+                water.begin() + window_offset + (window_row_count_ * width_));
+  land_.resize(water_.size());
+  for (std::size_t i = 0; i < water_.size(); i++) {
+    land_[i] = water_[i] != 0 ? 0 : 1;
+  }
+  std::size_t band_size = static_cast<std::size_t>(row_count_ * width_);
+  to_land_.resize(band_size);
+  to_water_.resize(band_size);
+  distances_.resize(band_size);
+}
+
+CoastBandUpdate::CoastBandUpdate()
+    : width_{0},
+      height_{0},
+      row_begin_{0},
+      row_count_{0},
+      window_row_count_{0},
+      band_offset_{0},
+      next_column_{0},
+      next_row_{0} {}
+
+bool CoastBandUpdate::isFinished() const { return next_row_ >= row_count_; }
+
+bool CoastBandUpdate::step() {
+  if (isFinished()) {
+    return true;
+  }
+  // Carry the distances along every column first, as each row needs all of
+  // its columns to be carried along.
+  if (next_column_ < width_) {
+    int column_end = std::min(width_, next_column_ + kBandStepColumns);
+    parallel::forRange(next_column_, column_end,
+                       [&](int column_begin, int chunk_end) {
+                         transformColumns(land_, width_, height_,
+                                          window_row_count_, band_offset_,
+                                          row_count_, column_begin, chunk_end,
+                                          to_land_);
+                         transformColumns(water_, width_, height_,
+                                          window_row_count_, band_offset_,
+                                          row_count_, column_begin, chunk_end,
+                                          to_water_);
+                       });
+    next_column_ = column_end;
+    return false;
+  }
+  int row_end = std::min(row_count_, next_row_ + kBandStepRows);
+  const uint8_t *band_water =
+      &water_[static_cast<std::size_t>(band_offset_ * width_)];
+  parallel::forRange(next_row_, row_end, [&](int row_begin, int chunk_end) {
+    transformRows(width_, height_, row_begin_, row_begin, chunk_end,
+                  to_land_);
+    transformRows(width_, height_, row_begin_, row_begin, chunk_end,
+                  to_water_);
+    quantizeDistances(band_water, to_land_, to_water_, height_,
+                      static_cast<std::size_t>(row_begin * width_),
+                      static_cast<std::size_t>(chunk_end * width_),
+                      distances_.data());
+  });
+  next_row_ = row_end;
+  return isFinished();
+}
+
+int CoastBandUpdate::getRowBegin() const { return row_begin_; }
+
+int CoastBandUpdate::getRowCount() const { return row_count_; }
+
+const std::vector<int16_t> &CoastBandUpdate::getDistances() const {
+  return distances_;
+}
+
+std::vector<int16_t> CoastDistanceField::bake(const PNMImage &land_mask,
+                                              PN_stdfloat land_mask_cutoff,
+                                              int width, int height) {
+  PNMImage land_mask_level(width, height, 1, land_mask.get_maxval());
+  land_mask_level.box_filter_from(0.5f, land_mask);
+  std::size_t size = static_cast<std::size_t>(width * height);
+  std::vector<uint8_t> water(size);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      bool is_water = land_mask_level.get_bright(x, y) > land_mask_cutoff;
+      water[static_cast<std::size_t>((y * width) + x)] = is_water ? 1 : 0;
+    }
+  }
+  std::vector<int16_t> distances(size);
+  computeDistances(water, width, height, distances.data());
+  return distances;
+}
+
+}  // namespace earth_world
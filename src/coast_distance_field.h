@@ -0,0 +1,201 @@
+#ifndef EARTH_WORLD_COAST_DISTANCE_FIELD_H
+#define EARTH_WORLD_COAST_DISTANCE_FIELD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/pnmImage.h"
+
+namespace earth_world {
+
+/**
+ * The signed distance from every point on the globe to the nearest coast,
+ * in radians, positive over water and negative over land. It is kept as an
+ * equirectangular raster, stored from north to south like the source images,
+ * and clamped to a maximum distance.
+ *
+ * Moving through it by conservative advancement costs a few lookups however
+ * far the move goes, since every lookup says how far is safe to step.
+ */
+class CoastDistanceField {
+ public:
+  /**
+   * Loads the field from the cache, or bakes it across all cores from the
+   * land mask and caches it if missing.
+   * @param land_mask The mask of water, where brighter than the cutoff.
+   * @param land_mask_cutoff The cutoff between land and water.
+   * @param source_hash The hash of the mask's source and the cutoff, which
+   *     the cached field must have been baked from.
+   */
+  CoastDistanceField(const PNMImage &land_mask, PN_stdfloat land_mask_cutoff,
+                     uint64_t source_hash);
+  /**
+   * Bakes the field across all cores from a mask of water, without caching.
+   * @param water Per texel, row major from north, 1 where it is water.
+   * @param width The width of the mask.
+   * @param height The height of the mask.
+   */
+  CoastDistanceField(const std::vector<uint8_t> &water, int width,
+                     int height);
+  /** Creates a field without any coasts, which is all open water. */
+  CoastDistanceField();
+  CoastDistanceField(const CoastDistanceField &) = default;
+  CoastDistanceField(CoastDistanceField &&) noexcept = default;
+  CoastDistanceField &operator=(const CoastDistanceField &) = default;
+  CoastDistanceField &operator=(CoastDistanceField &&) noexcept = default;
+  ~CoastDistanceField() = default;
+
+  int getWidth() const;
+  int getHeight() const;
+
+  /**
+   * @param point A direction from the globe's center.
+   * @return The bilinearly filtered signed distance at the point.
+   */
+  PN_stdfloat getDistance(const LVector3 &point) const;
+
+  /**
+   * Fills the distances at a batch of points, in structure-of-arrays form.
+   * @param xs The points' x coordinates.
+   * @param ys The points' y coordinates.
+   * @param zs The points' z coordinates.
+   * @param count The number of points.
+   * @param distances Filled with the distance at each point.
+   */
+  void getDistances(const float *xs, const float *ys, const float *zs,
+                    std::size_t count, float *distances) const;
+
+  /**
+   * @param point A direction from the globe's center.
+   * @return The unit direction, tangent to the globe, in which the distance
+   *     grows fastest, pointing away from land. Zero where the field is flat.
+   */
+  LVector3 getGradient(const LVector3 &point) const;
+
+  /**
+   * Moves a point across water, stopping at coasts and sliding along them
+   * rather than crossing them.
+   * @param from The unit position to move from.
+   * @param displacement The intended move, tangent to the globe, where its
+   *     length is the angle to move by.
+   * @param clearance How far to keep from the coast, in radians.
+   * @return The unit position the move ends at.
+   */
+  LVector3 sweep(const LVector3 &from, const LVector3 &displacement,
+                 PN_stdfloat clearance) const;
+
+  /**
+   * @return How many rows away from a texel its distance can be affected,
+   *     since distances are clamped. Only the rows within reach of a change
+   *     to the water need recomputing.
+   */
+  int getRowReach() const;
+
+  /**
+   * Overwrites a band of rows.
+   * @param row_begin The first row of the band.
+   * @param distances The band's distances, row major, as stored.
+   */
+  void setRows(int row_begin, const std::vector<int16_t> &distances);
+
+ protected:
+  int width_;
+  int height_;
+  /** The distances, scaled from the maximum distance into 16 bits. */
+  std::vector<int16_t> distances_;
+
+  /** @return The distance at a texel, wrapping x and clamping y. */
+  PN_stdfloat getTexel(int x, int y) const;
+
+  /**
+   * Samples the distance between texels, bilinearly.
+   * @param x The texel column, relative to texel centers.
+   * @param y The texel row, relative to texel centers.
+   */
+  PN_stdfloat sample(PN_stdfloat x, PN_stdfloat y) const;
+
+  /**
+   * Finds the raster position of a direction.
+   * @param point A direction from the globe's center.
+   * @param x Filled with the texel column, relative to texel centers.
+   * @param y Filled with the texel row, relative to texel centers.
+   */
+  void getRasterPosition(const LVector3 &point, PN_stdfloat &x,
+                         PN_stdfloat &y) const;
+
+  /** Bakes the field from the land mask at the given resolution. */
+  static std::vector<int16_t> bake(const PNMImage &land_mask,
+                                   PN_stdfloat land_mask_cutoff, int width,
+                                   int height);
+};
+
+/**
+ * Recomputes a band of rows of a coast distance field from a new mask of
+ * water, a step at a time, so that the work can be spread across frames
+ * while the field is still being read. Each step covers a share of the
+ * columns, and once those are done, a share of the rows.
+ */
+class CoastBandUpdate {
+ public:
+  /**
+   * @param field The field the band belongs to.
+   * @param water Per texel of the rows from water_row_begin on, row major, 1
+   *     where it is under water, covering every row within reach of the
+   *     band.
+   * @param water_row_begin The row the water starts at.
+   * @param row_begin The first row of the band.
+   * @param row_end One past the last row of the band.
+   */
+  CoastBandUpdate(const CoastDistanceField &field,
+                  const std::vector<uint8_t> &water, int water_row_begin,
+                  int row_begin, int row_end);
+  /** Creates an update of no rows, which is already finished. */
+  CoastBandUpdate();
+  CoastBandUpdate(const CoastBandUpdate &) = default;
+  CoastBandUpdate(CoastBandUpdate &&) noexcept = default;
+  CoastBandUpdate &operator=(const CoastBandUpdate &) = default;
+  CoastBandUpdate &operator=(CoastBandUpdate &&) noexcept = default;
+  ~CoastBandUpdate() = default;
+
+  /** @return True once every step has been taken. */
+  bool isFinished() const;
+
+  /**
+   * Takes the next step, across all cores.
+   * @return True once every step has been taken.
+   */
+  bool step();
+
+  int getRowBegin() const;
+  int getRowCount() const;
+
+  /** @return The band's distances, row major, as stored, once finished. */
+  const std::vector<int16_t> &getDistances() const;
+
+ protected:
+  int width_;
+  int height_;
+  int row_begin_;
+  int row_count_;
+  /** The rows within reach of the band, that it is computed from. */
+  int window_row_count_;
+  /** The first row of the band, within the window. */
+  int band_offset_;
+  /** Per texel of the window, 1 where it is land. */
+  std::vector<uint8_t> land_;
+  /** Per texel of the window, 1 where it is water. */
+  std::vector<uint8_t> water_;
+  /** The squared distances to land, per texel of the band. */
+  std::vector<float> to_land_;
+  /** The squared distances to water, per texel of the band. */
+  std::vector<float> to_water_;
+  std::vector<int16_t> distances_;
+  int next_column_;
+  int next_row_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_COAST_DISTANCE_FIELD_H
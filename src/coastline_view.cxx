@@ -0,0 +1,201 @@
+#include "coastline_view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+#include "panda3d/geomLinestrips.h"
+#include "panda3d/geomNode.h"
+#include "panda3d/geomVertexData.h"
+#include "panda3d/geomVertexFormat.h"
+#include "panda3d/geomVertexWriter.h"
+#include "panda3d/lodNode.h"
+#include "panda3d/mathNumbers.h"
+#include "panda3d/pandaNode.h"
+#include "panda3d/shader.h"
+#include "panda3d/transparencyAttrib.h"
+#include "parallel.h"
+#include "shader_cache.h"
+
+namespace earth_world {
+
+const std::string kCoastlineCacheName = "coastline_4096x2048.bin";
+const int kCoastlineGridWidth = 4096;
+const int kCoastlineGridHeight = 2048;
+const int kCoastlineLevelCount = 3;
+/** Per level of detail, how far, in radians, it may stray from the coast. */
+const PN_stdfloat kCoastlineLevelTolerances[kCoastlineLevelCount] = {
+    1e-4f, 6e-4f, 2e-3f};
+/**
+ * Per level of detail, how far from the globe's center, in globe radii, the
+ * camera may be to see it, beyond where the previous level stops.
+ */
+const PN_stdfloat kCoastlineLevelDistances[kCoastlineLevelCount] = {
+    1.5f, 1.8f, 1e6f};
+/**
+ * The finer levels are split into tiles by longitude and latitude, so that
+ * up close only the tiles in view are drawn. The coarsest level is only seen
+ * with the whole globe in view, so it stays in one batch.
+ */
+const int kCoastlineTileColumns = 16;
+const int kCoastlineTileRows = 8;
+/** Lifts the lines just above the water, so they aren't hidden by it. */
+const PN_stdfloat kCoastlineLift = 1.001f;
+const PN_stdfloat kCoastlineThickness = 1.5f;
+const LColor kCoastlineColor(0.2f, 0.15f, 0.1f, 0.8f);
+
+CoastlineView::CoastlineView(Globe &globe) : path_{"Coastline"} {
+  std::vector<isolines::Isoline> coastlines = isolines::loadOrExtract(
+      kCoastlineCacheName, globe.getSourceHash(), globe.getLandMaskImage(),
+      globe.getLandMaskCutoff(), kCoastlineGridWidth, kCoastlineGridHeight,
+      kCoastlineLevelTolerances[0]);
+
+  // Each coarser level is simplified from the finest, across all cores.
+  PT<LODNode> lod_node = new LODNode("CoastlineLevels");
+  NodePath lod_path = path_.attach_new_node(lod_node);
+  std::vector<isolines::Isoline> level_coastlines(coastlines.size());
+  PN_stdfloat near_distance = 0;
+  for (int level = 0; level < kCoastlineLevelCount; level++) {
+    PN_stdfloat tolerance = kCoastlineLevelTolerances[level];
+    auto simplify_lines = [&](int line_begin, int line_end) {
+      for (int line = line_begin; line < line_end; line++) {
+        std::size_t i = static_cast<std::size_t>(line);
+        level_coastlines[i] = isolines::simplify(coastlines[i], tolerance);
+      }
+    };
+    if (level > 0) {
+      parallel::forRange(0, static_cast<int>(coastlines.size()),
+                         simplify_lines);
+    }
+    const std::vector<isolines::Isoline> &lines =
+        level > 0 ? level_coastlines : coastlines;
+    NodePath level_path = lod_path.attach_new_node("CoastlineLevel");
+    if (level == kCoastlineLevelCount - 1) {
+      PT<GeomNode> node = new GeomNode("CoastlineTile");
+      node->add_geom(buildGeom(lines));
+      level_path.attach_new_node(node);
+    } else {
+      for (const std::vector<isolines::Isoline> &tile_lines :
+           splitIntoTiles(lines)) {
+        if (tile_lines.empty()) {
+          continue;
+        }
+        PT<GeomNode> node = new GeomNode("CoastlineTile");
+        node->add_geom(buildGeom(tile_lines));
+        level_path.attach_new_node(node);
+      }
+    }
+    lod_node->add_switch(kCoastlineLevelDistances[level], near_distance);
+    near_distance = kCoastlineLevelDistances[level];
+  }
+
+  PT<Shader> shader = shader_cache::load("coastline.vert", "coastline.frag");
+  path_.set_shader(shader);
+  path_.set_shader_input("u_VisibilityTex", globe.getVisibilityTexture());
+  path_.set_shader_input("u_CoastlineColor", kCoastlineColor);
+  path_.set_render_mode_thickness(kCoastlineThickness);
+  path_.set_transparency(TransparencyAttrib::M_alpha);
+  path_.set_depth_write(false);
+}
+
+CoastlineView::CoastlineView(CoastlineView &&other) noexcept
+    : path_{other.path_} {
+  other.path_.clear();
+}
+
+CoastlineView &CoastlineView::operator=(CoastlineView &&other) noexcept {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  path_.remove_node();
+  path_ = other.path_;
+  other.path_.clear();
+  return *this;
+}
+
+CoastlineView::~CoastlineView() { path_.remove_node(); }
+
+NodePath CoastlineView::getPath() const { return path_; }
+
+int CoastlineView::getTile(const LVector3 &point) {
+  PN_stdfloat longitude = atan2f(point[1], point[0]);
+  PN_stdfloat latitude = asinf(std::max(-1.f, std::min(1.f, point[2])));
+  int column = static_cast<int>(
+      ((longitude / (2 * MathNumbers::pi_f)) + 0.5f) * kCoastlineTileColumns);
+  int row = static_cast<int>(((latitude / MathNumbers::pi_f) + 0.5f) *
+                             kCoastlineTileRows);
+  column = std::max(0, std::min(kCoastlineTileColumns - 1, column));
+  row = std::max(0, std::min(kCoastlineTileRows - 1, row));
+  return (row * kCoastlineTileColumns) + column;
+}
+
+std::vector<std::vector<isolines::Isoline>> CoastlineView::splitIntoTiles(
+    const std::vector<isolines::Isoline> &coastlines) {
+  std::vector<std::vector<isolines::Isoline>> tiles(
+      static_cast<std::size_t>(kCoastlineTileColumns * kCoastlineTileRows));
+  for (const isolines::Isoline &coastline : coastlines) {
+    if (coastline.points.size() < 2) {
+      continue;
+    }
+    // Walk the line, ending a piece wherever it crosses into another tile.
+    // The segment across the border stays with the piece before it.
+    std::size_t point_count =
+        coastline.points.size() + (coastline.closed ? 1 : 0);
+    isolines::Isoline piece{{coastline.points.front()}, false};
+    int tile = getTile(coastline.points.front());
+    for (std::size_t i = 1; i < point_count; i++) {
+      const LVector3 &point = coastline.points[i % coastline.points.size()];
+      piece.points.push_back(point);
+      int point_tile = getTile(point);
+      if (point_tile == tile && i + 1 < point_count) {
+        continue;
+      }
+      tiles[static_cast<std::size_t>(tile)].push_back(std::move(piece));
+      piece = isolines::Isoline{{point}, false};
+      tile = point_tile;
+    }
+  }
+  return tiles;
+}
+
+PT<Geom> CoastlineView::buildGeom(
+    const std::vector<isolines::Isoline> &coastlines) {
+  int vertex_count = 0;
+  for (const isolines::Isoline &coastline : coastlines) {
+    // Lines too short to draw are skipped below, so leave no room for them.
+    if (coastline.points.size() < 2) {
+      continue;
+    }
+    vertex_count += static_cast<int>(coastline.points.size()) +
+                    (coastline.closed ? 1 : 0);
+  }
+  PT<GeomVertexData> vertex_data = new GeomVertexData(
+      "Coastline", GeomVertexFormat::get_v3(), Geom::UH_static);
+  vertex_data->set_num_rows(vertex_count);
+  GeomVertexWriter vertices(vertex_data, "vertex");
+  PT<GeomLinestrips> strips = new GeomLinestrips(Geom::UH_static);
+  int row = 0;
+  for (const isolines::Isoline &coastline : coastlines) {
+    if (coastline.points.size() < 2) {
+      continue;
+    }
+    for (const LVector3 &point : coastline.points) {
+      vertices.add_data3(point * (kGlobeWaterSurfaceHeight * kCoastlineLift));
+    }
+    int strip_size = static_cast<int>(coastline.points.size());
+    if (coastline.closed) {
+      vertices.add_data3(coastline.points.front() *
+                         (kGlobeWaterSurfaceHeight * kCoastlineLift));
+      strip_size++;
+    }
+    strips->add_consecutive_vertices(row, strip_size);
+    strips->close_primitive();
+    row += strip_size;
+  }
+  PT<Geom> geom = new Geom(vertex_data);
+  geom->add_primitive(strips);
+  return geom;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,60 @@
+#ifndef EARTH_WORLD_COASTLINE_VIEW_H
+#define EARTH_WORLD_COASTLINE_VIEW_H
+
+#include <vector>
+
+#include "globe.h"
+#include "isolines.h"
+#include "panda3d/geom.h"
+#include "panda3d/nodePath.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * Draws the coastlines as sharp lines along the water's edge, in place of
+ * the blocky edge of the land mask up close. The lines are traced once and
+ * cached, and kept at a few levels of detail, switched between by the
+ * camera's distance. The finer levels are split into tiles, each a batch of
+ * line strips culled by the view, so that up close only the coasts in view
+ * are drawn. They fade in with the globe's visibility, like the rest of the
+ * map.
+ */
+class CoastlineView {
+ public:
+  /** @param globe The globe whose coastlines to draw. */
+  explicit CoastlineView(Globe &globe);
+  CoastlineView(const CoastlineView &) = delete;
+  CoastlineView(CoastlineView &&) noexcept;
+  CoastlineView &operator=(const CoastlineView &) = delete;
+  CoastlineView &operator=(CoastlineView &&) noexcept;
+  ~CoastlineView();
+
+  /** @return The lines' path, to be parented to the globe's. */
+  NodePath getPath() const;
+
+ protected:
+  NodePath path_;
+
+  /** @return The index of the tile the point on the globe lies in. */
+  static int getTile(const LVector3 &point);
+
+  /**
+   * Splits coastlines into pieces by the tile they lie in.
+   * @param coastlines The coastlines.
+   * @return The open pieces of the coastlines, for each tile.
+   */
+  static std::vector<std::vector<isolines::Isoline>> splitIntoTiles(
+      const std::vector<isolines::Isoline> &coastlines);
+
+  /**
+   * Builds the line strips for a set of coastlines, resting on the water.
+   * @param coastlines The coastlines.
+   * @return The line strips.
+   */
+  static PT<Geom> buildGeom(const std::vector<isolines::Isoline> &coastlines);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_COASTLINE_VIEW_H
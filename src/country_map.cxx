@@ -0,0 +1,301 @@
+#include "country_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+
+#include "cache.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+const int kWidth = 8192;
+const int kHeight = 4096;
+const int kTileSize = 64;
+const int kTileColumns = kWidth / kTileSize;
+const int kTileRows = kHeight / kTileSize;
+const int kTileTexelCount = kTileSize * kTileSize;
+/** Ids are stored in 16 bits, with id 0 for no country. */
+const std::size_t kMaxCountryCount = 65535;
+const uint32_t kCacheVersion = 2;
+const std::string kCacheName = "country_ids_8192x4096.bin";
+
+/** An edge of a country's boundary, in texel coordinates. */
+struct BoundaryEdge {
+  float x0;
+  float y0;
+  float x1;
+  float y1;
+  uint16_t country_id;
+};
+
+/**
+ * Parses the contents of a boundaries file.
+ * @param boundaries The contents.
+ * @param country_names Appended with the name of every country, in order.
+ * @param edges Appended with the edges of every country's rings, which are
+ *     not horizontal, as those never cross a row of texels.
+ */
+static void parseBoundaries(const std::string &boundaries,
+                            std::vector<std::string> &country_names,
+                            std::vector<BoundaryEdge> &edges) {
+  std::vector<std::pair<float, float>> ring;
+  auto close_ring = [&]() {
+    for (std::size_t i = 0; ring.size() >= 3 && i < ring.size(); i++) {
+      const std::pair<float, float> &from = ring[i];
+      const std::pair<float, float> &to = ring[(i + 1) % ring.size()];
+      if (from.second != to.second) {
+        edges.push_back(BoundaryEdge{
+            from.first, from.second, to.first, to.second,
+            static_cast<uint16_t>(country_names.size() - 1)});
+      }
+    }
+    ring.clear();
+  };
+
+  std::istringstream stream(boundaries);
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    if (line.compare(0, 8, "country ") == 0) {
+      close_ring();
+      if (country_names.size() >= kMaxCountryCount) {
+        break;
+      }
+      country_names.push_back(line.substr(8));
+    } else if (line == "ring") {
+      close_ring();
+    } else if (country_names.size() > 1) {
+      std::istringstream point(line);
+      float longitude;
+      float latitude;
+      if (point >> longitude >> latitude) {
+        ring.emplace_back(((longitude + 180.f) / 360.f) * kWidth,
+                          ((90.f - latitude) / 180.f) * kHeight);
+      }
+    }
+  }
+  close_ring();
+}
+
+CountryMap::CountryMap(const Filename &boundaries_filename) {
+  std::ifstream stream(boundaries_filename.to_os_specific(),
+                       std::ios::binary);
+  if (!stream) {
+    clear();
+    return;
+  }
+  std::string boundaries((std::istreambuf_iterator<char>(stream)),
+                         std::istreambuf_iterator<char>());
+  // Tag the cache with the boundaries it was baked from, so that it is baked
+  // again whenever they change.
+  uint64_t boundaries_hash = cache::hashBytes(
+      boundaries.data(), boundaries.size(), cache::kNoInputHash);
+
+  std::vector<unsigned char> data;
+  if (cache::read(kCacheName, kCacheVersion, boundaries_hash, data)) {
+    std::size_t offset = 0;
+    uint32_t counts[2];
+    bool complete = cache::readBytes(data, offset, counts, sizeof(counts));
+    country_names_.clear();
+    for (uint32_t i = 0; complete && i < counts[0]; i++) {
+      uint32_t length;
+      complete = cache::readBytes(data, offset, &length, sizeof(length)) &&
+                 data.size() - offset >= length;
+      if (complete) {
+        country_names_.emplace_back(
+            reinterpret_cast<const char *>(data.data() + offset), length);
+        offset += length;
+      }
+    }
+    if (complete) {
+      tile_run_offsets_.resize(
+          static_cast<std::size_t>((kTileColumns * kTileRows) + 1));
+      runs_.resize(counts[1]);
+      complete =
+          cache::readBytes(data, offset, tile_run_offsets_.data(),
+                           tile_run_offsets_.size() * sizeof(uint32_t)) &&
+          cache::readBytes(data, offset, runs_.data(),
+                           runs_.size() * sizeof(Run)) &&
+          offset == data.size() && !country_names_.empty() &&
+          tile_run_offsets_.back() == runs_.size();
+    }
+    if (complete) {
+      return;
+    }
+  }
+
+  if (!bake(boundaries)) {
+    clear();
+    return;
+  }
+
+  uint32_t counts[2] = {static_cast<uint32_t>(country_names_.size()),
+                        static_cast<uint32_t>(runs_.size())};
+  data.clear();
+  cache::appendBytes(data, counts, sizeof(counts));
+  for (const std::string &name : country_names_) {
+    uint32_t length = static_cast<uint32_t>(name.size());
+    cache::appendBytes(data, &length, sizeof(length));
+    cache::appendBytes(data, name.data(), name.size());
+  }
+  cache::appendBytes(data, tile_run_offsets_.data(),
+                     tile_run_offsets_.size() * sizeof(uint32_t));
+  cache::appendBytes(data, runs_.data(), runs_.size() * sizeof(Run));
+  cache::write(kCacheName, kCacheVersion, boundaries_hash, data.data(),
+               data.size());
+}
+
+int CountryMap::getCountryId(const SpherePoint2 &point) const {
+  LVecBase2 uv = point.toUV();
+  int x = std::min(kWidth - 1,
+                   std::max(0, static_cast<int>(uv.get_x() * kWidth)));
+  int y = std::min(kHeight - 1,
+                   std::max(0, static_cast<int>(uv.get_y() * kHeight)));
+  std::size_t tile = static_cast<std::size_t>(
+      ((y / kTileSize) * kTileColumns) + (x / kTileSize));
+  int texel = ((y % kTileSize) * kTileSize) + (x % kTileSize);
+  // The first run to end past the texel holds it.
+  const Run *begin = runs_.data() + tile_run_offsets_[tile];
+  const Run *end = runs_.data() + tile_run_offsets_[tile + 1];
+  const Run *run = std::upper_bound(
+      begin, end, texel, [](int value, const Run &r) { return value < r.end; });
+  return run->country_id;
+}
+
+const std::string &CountryMap::getCountryName(int country_id) const {
+  if (country_id < 0 || country_id >= getCountryCount()) {
+    return country_names_[0];
+  }
+  return country_names_[static_cast<std::size_t>(country_id)];
+}
+
+int CountryMap::getCountryCount() const {
+  return static_cast<int>(country_names_.size());
+}
+
+void CountryMap::clear() {
+  country_names_.assign(1, std::string());
+  std::size_t tile_count = static_cast<std::size_t>(kTileColumns * kTileRows);
+  tile_run_offsets_.resize(tile_count + 1);
+  for (std::size_t i = 0; i <= tile_count; i++) {
+    tile_run_offsets_[i] = static_cast<uint32_t>(i);
+  }
+  runs_.assign(tile_count, Run{static_cast<uint16_t>(kTileTexelCount), 0});
+}
+
+bool CountryMap::bake(const std::string &boundaries) {
+  country_names_.assign(1, std::string());
+  std::vector<BoundaryEdge> edges;
+  parseBoundaries(boundaries, country_names_, edges);
+  if (country_names_.size() <= 1) {
+    return false;
+  }
+
+  // Sort the edges into the bands of tile rows whose texel centers they
+  // cross, so that each band can be rasterized on its own.
+  std::vector<std::vector<std::size_t>> band_edges(
+      static_cast<std::size_t>(kTileRows));
+  for (std::size_t i = 0; i < edges.size(); i++) {
+    const BoundaryEdge &edge = edges[i];
+    int row_begin = std::max(
+        0, static_cast<int>(std::ceil(std::min(edge.y0, edge.y1) - 0.5f)));
+    int row_end = std::min(
+        kHeight,
+        static_cast<int>(std::ceil(std::max(edge.y0, edge.y1) - 0.5f)));
+    for (int band = row_begin / kTileSize;
+         row_begin < row_end && band * kTileSize < row_end; band++) {
+      band_edges[static_cast<std::size_t>(band)].push_back(i);
+    }
+  }
+
+  // Rasterize a band of texels at a time, by filling the spans between each
+  // country's crossings of every row, then encode the band's tiles.
+  std::vector<std::vector<uint32_t>> band_run_counts(
+      static_cast<std::size_t>(kTileRows));
+  std::vector<std::vector<Run>> band_runs(static_cast<std::size_t>(kTileRows));
+  parallel::forRange(0, kTileRows, [&](int band_begin, int band_end) {
+    std::vector<uint16_t> texels(static_cast<std::size_t>(kWidth * kTileSize));
+    std::vector<std::pair<uint16_t, float>> crossings;
+    for (int band = band_begin; band < band_end; band++) {
+      std::size_t band_index = static_cast<std::size_t>(band);
+      std::fill(texels.begin(), texels.end(), 0);
+      for (int row = 0; row < kTileSize; row++) {
+        float center_y = static_cast<float>((band * kTileSize) + row) + 0.5f;
+        crossings.clear();
+        for (std::size_t edge_index : band_edges[band_index]) {
+          const BoundaryEdge &edge = edges[edge_index];
+          if ((edge.y0 <= center_y) != (edge.y1 <= center_y)) {
+            crossings.emplace_back(
+                edge.country_id,
+                edge.x0 + ((center_y - edge.y0) * (edge.x1 - edge.x0) /
+                           (edge.y1 - edge.y0)));
+          }
+        }
+        std::sort(crossings.begin(), crossings.end());
+        uint16_t *row_texels =
+            &texels[static_cast<std::size_t>(row * kWidth)];
+        std::size_t i = 0;
+        while (i + 1 < crossings.size()) {
+          if (crossings[i].first != crossings[i + 1].first) {
+            // Skip a country left with an odd crossing by a degenerate ring.
+            i++;
+            continue;
+          }
+          int span_begin = std::max(
+              0, static_cast<int>(std::ceil(crossings[i].second - 0.5f)));
+          int span_end = std::min(
+              kWidth,
+              static_cast<int>(std::ceil(crossings[i + 1].second - 0.5f)));
+          for (int x = span_begin; x < span_end; x++) {
+            row_texels[x] = crossings[i].first;
+          }
+          i += 2;
+        }
+      }
+
+      band_run_counts[band_index].assign(
+          static_cast<std::size_t>(kTileColumns), 0);
+      for (int tile_column = 0; tile_column < kTileColumns; tile_column++) {
+        uint32_t run_count = 0;
+        for (int texel = 0; texel < kTileTexelCount; texel++) {
+          uint16_t country_id = texels[static_cast<std::size_t>(
+              ((texel / kTileSize) * kWidth) + (tile_column * kTileSize) +
+              (texel % kTileSize))];
+          if (run_count > 0 &&
+              band_runs[band_index].back().country_id == country_id) {
+            band_runs[band_index].back().end++;
+          } else {
+            band_runs[band_index].push_back(
+                Run{static_cast<uint16_t>(texel + 1), country_id});
+            run_count++;
+          }
+        }
+        band_run_counts[band_index][static_cast<std::size_t>(tile_column)] =
+            run_count;
+      }
+    }
+  });
+
+  tile_run_offsets_.assign(1, 0);
+  runs_.clear();
+  for (int band = 0; band < kTileRows; band++) {
+    std::size_t band_index = static_cast<std::size_t>(band);
+    for (uint32_t run_count : band_run_counts[band_index]) {
+      tile_run_offsets_.push_back(tile_run_offsets_.back() + run_count);
+    }
+    runs_.insert(runs_.end(), band_runs[band_index].begin(),
+                 band_runs[band_index].end());
+  }
+  return true;
+}
+
+}  // namespace earth_world
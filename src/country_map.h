@@ -0,0 +1,82 @@
+#ifndef EARTH_WORLD_COUNTRY_MAP_H
+#define EARTH_WORLD_COUNTRY_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "panda3d/filename.h"
+#include "sphere_point.h"
+
+namespace earth_world {
+
+/**
+ * Which country every point on the globe belongs to, as an equirectangular
+ * raster of country ids aligned with the globe's other layers, stored from
+ * north to south like the source images. Id 0 belongs to no country.
+ *
+ * The raster is split into square tiles, each run-length encoded in row
+ * major order, so that the open sea and the interiors of countries take a
+ * single run per tile. A lookup finds its tile directly, then searches only
+ * that tile's runs.
+ *
+ * The raster is baked from a boundaries file of plain text lines:
+ *   country <name>          Starts the next country, with the next id.
+ *   ring                    Starts the next closed ring of the country.
+ *   <longitude> <latitude>  Adds a point to the ring, in degrees.
+ * Blank lines and lines starting with # are skipped. Rings are filled by the
+ * even-odd rule, so holes are given as rings within rings, and are joined
+ * by straight lines in longitude and latitude, so rings must be split where
+ * they cross the antimeridian.
+ */
+class CountryMap {
+ public:
+  /**
+   * Loads the raster from the cache, or bakes it across all cores from the
+   * boundaries file and caches it if missing or out of date.
+   * @param boundaries_filename The boundaries file. Where it is missing, the
+   *     map has no countries.
+   */
+  explicit CountryMap(const Filename &boundaries_filename);
+  CountryMap(const CountryMap &) = default;
+  CountryMap(CountryMap &&) noexcept = default;
+  CountryMap &operator=(const CountryMap &) = default;
+  CountryMap &operator=(CountryMap &&) noexcept = default;
+  ~CountryMap() = default;
+
+  /** @return The id of the country at the point, or 0 if there is none. */
+  int getCountryId(const SpherePoint2 &point) const;
+
+  /** @return The name of the country with the given id, empty for id 0. */
+  const std::string &getCountryName(int country_id) const;
+
+  /** @return The number of country ids, including id 0. */
+  int getCountryCount() const;
+
+ protected:
+  /** A run of texels within a tile, all of the same country. */
+  struct Run {
+    /** One past the run's last texel, in row major order within its tile. */
+    uint16_t end;
+    uint16_t country_id;
+  };
+
+  /** Per country id, its name, starting with an empty one for id 0. */
+  std::vector<std::string> country_names_;
+  /** Per tile, row major, its first run, followed by the run count. */
+  std::vector<uint32_t> tile_run_offsets_;
+  std::vector<Run> runs_;
+
+  /** Sets every tile to a single run of id 0. */
+  void clear();
+
+  /**
+   * Bakes the raster from the contents of a boundaries file.
+   * @return False if the contents hold no countries.
+   */
+  bool bake(const std::string &boundaries);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_COUNTRY_MAP_H
@@ -3,7 +3,9 @@
 namespace earth_world {
 namespace filename {
 
+Filename const kCacheDirectory = relativeToSourceDirectory("cache");
 Filename const kConfigFilename = relativeToSourceDirectory("config.prc");
+Filename const kDataDirectory = relativeToSourceDirectory("data");
 Filename const kModelsDirectory = relativeToSourceDirectory("models");
 Filename const kShadersDirectory = relativeToSourceDirectory("shaders");
 Filename const kTexturesDirectory = relativeToSourceDirectory("textures");
@@ -18,6 +20,14 @@ Filename relativeToSourceDirectory(std::string relative_filename) {
   return filename;
 }
 
+Filename forCache(std::string relative_filename) {
+  return Filename(kCacheDirectory, relative_filename);
+}
+
+Filename forData(std::string relative_filename) {
+  return Filename(kDataDirectory, relative_filename);
+}
+
 Filename forModel(std::string relative_filename) {
   return Filename(kModelsDirectory, relative_filename);
 }
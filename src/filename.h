@@ -6,7 +6,9 @@
 namespace earth_world {
 namespace filename {
 
+extern Filename const kCacheDirectory;
 extern Filename const kConfigFilename;
+extern Filename const kDataDirectory;
 extern Filename const kModelsDirectory;
 extern Filename const kShadersDirectory;
 extern Filename const kTexturesDirectory;
@@ -14,6 +16,12 @@ extern Filename const kTexturesDirectory;
 /** @return Resolves the given filename relative to the source directory. */
 Filename relativeToSourceDirectory(std::string relative_filename);
 
+/** @return Resolves the given filename relative to the cache directory. */
+Filename forCache(std::string relative_filename);
+
+/** @return Resolves the given filename relative to the data directory. */
+Filename forData(std::string relative_filename);
+
 /** @return Resolves the given filename relative to the models directory. */
 Filename forModel(std::string relative_filename);
 
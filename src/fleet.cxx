@@ -0,0 +1,350 @@
+#include "fleet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace earth_world {
+
+/** The number of ships steered and moved together. */
+const std::size_t kLaneCount = 4;
+/** The slowest and fastest a ship sails, in radians per second. */
+const float kMinSpeed = 0.02f;
+const float kMaxSpeed = 0.05f;
+/** How fast ships turn toward their waypoint, per second. */
+const float kTurnRate = 2.f;
+/** How far ships keep from the coast, in radians. */
+const float kCoastClearance = 0.002f;
+/** How close a ship comes to its waypoint before picking the next. */
+const float kArrivalDistance = 0.005f;
+/** The nearest and farthest a new waypoint lies from its ship, in radians. */
+const float kMinWaypointDistance = 0.05f;
+const float kMaxWaypointDistance = 0.2f;
+/** How many random points are tried for each ship to spawn on water. */
+const int kMaxSpawnAttempts = 64;
+
+/** @return The next number of a xorshift generator, advancing its state. */
+static uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** @return A number uniformly distributed in [0, 1). */
+static float nextUniform(uint32_t &state) {
+  return static_cast<float>(nextRandom(state) >> 8) * (1.f / 16777216.f);
+}
+
+/** @return The unit direction, tangent at from, of the great circle to to. */
+static LVector3 getTangentToward(const LVector3 &from, const LVector3 &to) {
+  LVector3 tangent = to - (from * to.dot(from));
+  if (!tangent.normalize()) {
+    // Any direction will do toward the same or the opposite point.
+    tangent = from.cross(std::fabs(from.get_z()) < 0.9f ? LVector3::up()
+                                                        : LVector3::right());
+    tangent.normalize();
+  }
+  return tangent;
+}
+
+/** @return The lengths of four vectors, kept away from zero. */
+static simd::Float4 getLength(simd::Float4 x, simd::Float4 y,
+                              simd::Float4 z) {
+  simd::Float4 length_squared =
+      simd::add(simd::add(simd::mul(x, x), simd::mul(y, y)), simd::mul(z, z));
+  return simd::max(simd::sqrt(length_squared), simd::splat(1e-12f));
+}
+
+Fleet::Fleet(const CoastDistanceField &coast_distance_field, int size,
+             uint32_t seed)
+    : size_{std::max(0, size)} {
+  std::size_t count = static_cast<std::size_t>(size_);
+  std::size_t padded_count =
+      ((count + kLaneCount - 1) / kLaneCount) * kLaneCount;
+  positions_.resize(padded_count);
+  headings_.resize(padded_count);
+  waypoints_.resize(padded_count);
+  speeds_.resize(padded_count);
+  current_velocities_.resize(padded_count);
+  coast_distances_.resize(padded_count);
+  moved_coast_distances_.resize(padded_count);
+  random_states_.resize(padded_count);
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> z_distribution(-1, 1);
+  std::uniform_real_distribution<float> longitude_distribution(
+      0, 2 * static_cast<float>(MathNumbers::pi));
+  std::uniform_real_distribution<float> speed_distribution(kMinSpeed,
+                                                           kMaxSpeed);
+  for (std::size_t i = 0; i < padded_count; i++) {
+    // The padding copies the first ship, so that it is harmless to move.
+    if (i >= count && count > 0) {
+      positions_.set(i, positions_.get(0));
+      headings_.set(i, headings_.get(0));
+      waypoints_.set(i, waypoints_.get(0));
+      speeds_[i] = speeds_[0];
+      coast_distances_[i] = coast_distances_[0];
+      random_states_[i] = random_states_[0];
+      continue;
+    }
+    LVector3 position;
+    float coast_distance = 0;
+    for (int attempt = 0; attempt < kMaxSpawnAttempts; attempt++) {
+      float z = z_distribution(generator);
+      float longitude = longitude_distribution(generator);
+      float axis_distance = sqrtf(std::max(0.f, 1 - (z * z)));
+      position = LVector3(axis_distance * cosf(longitude),
+                           axis_distance * sinf(longitude), z);
+      coast_distance = coast_distance_field.getDistance(position);
+      if (coast_distance > 2 * kCoastClearance) {
+        break;
+      }
+    }
+    positions_.set(i, position);
+    coast_distances_[i] = coast_distance;
+    speeds_[i] = speed_distribution(generator);
+    // Xorshift generators must never start at zero.
+    random_states_[i] = static_cast<uint32_t>(generator()) | 1;
+    pickWaypoint(i);
+    headings_.set(i, getTangentToward(position, waypoints_.get(i)));
+  }
+  previous_positions_ = positions_;
+  previous_headings_ = headings_;
+}
+
+Fleet::Fleet() : size_{0} {}
+
+int Fleet::getSize() const { return size_; }
+
+void Fleet::update(const CoastDistanceField &coast_distance_field,
+                   const OceanCurrentField &ocean_currents,
+                   float step_duration) {
+  previous_positions_ = positions_;
+  previous_headings_ = headings_;
+  const float arrival_cosine = cosf(kArrivalDistance);
+  int group_count = static_cast<int>(positions_.size() / kLaneCount);
+  parallel::forRange(0, group_count, [&](int group_begin, int group_end) {
+    std::size_t begin = static_cast<std::size_t>(group_begin) * kLaneCount;
+    std::size_t end = static_cast<std::size_t>(group_end) * kLaneCount;
+    ocean_currents.getVelocities(
+        &positions_.xs[begin], &positions_.ys[begin], &positions_.zs[begin],
+        end - begin, &current_velocities_.xs[begin],
+        &current_velocities_.ys[begin], &current_velocities_.zs[begin]);
+    for (std::size_t i = begin; i < end; i += kLaneCount) {
+      moveShips(i, step_duration);
+    }
+    coast_distance_field.getDistances(
+        &positions_.xs[begin], &positions_.ys[begin], &positions_.zs[begin],
+        end - begin, &moved_coast_distances_[begin]);
+
+    for (std::size_t i = begin; i < end; i++) {
+      float coast_distance = moved_coast_distances_[i];
+      // Ships may still slide along the coast, or back out of land left by
+      // a falling sea, but never sail further into it.
+      if (coast_distance < kCoastClearance &&
+          coast_distance < coast_distances_[i]) {
+        LVector3 position = previous_positions_.get(i);
+        positions_.set(i, position);
+        LVector3 away_from_coast = coast_distance_field.getGradient(position);
+        if (away_from_coast != LVector3::zero()) {
+          headings_.set(i, away_from_coast);
+        }
+        pickWaypoint(i);
+        continue;
+      }
+      coast_distances_[i] = coast_distance;
+      if (positions_.get(i).dot(waypoints_.get(i)) > arrival_cosine) {
+        pickWaypoint(i);
+      }
+    }
+  });
+}
+
+void Fleet::getTransforms(float t, float radius,
+                          std::vector<LMatrix4f> &transforms) const {
+  transforms.resize(static_cast<std::size_t>(size_));
+  int group_count = static_cast<int>(positions_.size() / kLaneCount);
+  parallel::forRange(0, group_count, [&](int group_begin, int group_end) {
+    simd::Float4 from_weight = simd::splat(1 - t);
+    simd::Float4 to_weight = simd::splat(t);
+    for (int group = group_begin; group < group_end; group++) {
+      std::size_t first = static_cast<std::size_t>(group) * kLaneCount;
+      // Blend between the steps, and push back onto the sphere.
+      simd::Float4 up_x =
+          simd::add(simd::mul(simd::load(&previous_positions_.xs[first]),
+                              from_weight),
+                    simd::mul(simd::load(&positions_.xs[first]), to_weight));
+      simd::Float4 up_y =
+          simd::add(simd::mul(simd::load(&previous_positions_.ys[first]),
+                              from_weight),
+                    simd::mul(simd::load(&positions_.ys[first]), to_weight));
+      simd::Float4 up_z =
+          simd::add(simd::mul(simd::load(&previous_positions_.zs[first]),
+                              from_weight),
+                    simd::mul(simd::load(&positions_.zs[first]), to_weight));
+      simd::Float4 inverse_length =
+          simd::div(simd::splat(1), getLength(up_x, up_y, up_z));
+      up_x = simd::mul(up_x, inverse_length);
+      up_y = simd::mul(up_y, inverse_length);
+      up_z = simd::mul(up_z, inverse_length);
+
+      // Blend the headings likewise, keeping them tangent to the sphere.
+      simd::Float4 forward_x =
+          simd::add(simd::mul(simd::load(&previous_headings_.xs[first]),
+                              from_weight),
+                    simd::mul(simd::load(&headings_.xs[first]), to_weight));
+      simd::Float4 forward_y =
+          simd::add(simd::mul(simd::load(&previous_headings_.ys[first]),
+                              from_weight),
+                    simd::mul(simd::load(&headings_.ys[first]), to_weight));
+      simd::Float4 forward_z =
+          simd::add(simd::mul(simd::load(&previous_headings_.zs[first]),
+                              from_weight),
+                    simd::mul(simd::load(&headings_.zs[first]), to_weight));
+      simd::Float4 along_up = simd::add(
+          simd::add(simd::mul(forward_x, up_x), simd::mul(forward_y, up_y)),
+          simd::mul(forward_z, up_z));
+      forward_x = simd::sub(forward_x, simd::mul(up_x, along_up));
+      forward_y = simd::sub(forward_y, simd::mul(up_y, along_up));
+      forward_z = simd::sub(forward_z, simd::mul(up_z, along_up));
+      inverse_length =
+          simd::div(simd::splat(1), getLength(forward_x, forward_y, forward_z));
+      forward_x = simd::mul(forward_x, inverse_length);
+      forward_y = simd::mul(forward_y, inverse_length);
+      forward_z = simd::mul(forward_z, inverse_length);
+
+      // Right is forward cross up, as for quaternion::fromLookAt.
+      simd::Float4 right_x =
+          simd::sub(simd::mul(forward_y, up_z), simd::mul(forward_z, up_y));
+      simd::Float4 right_y =
+          simd::sub(simd::mul(forward_z, up_x), simd::mul(forward_x, up_z));
+      simd::Float4 right_z =
+          simd::sub(simd::mul(forward_x, up_y), simd::mul(forward_y, up_x));
+
+      float frames[9][kLaneCount];
+      simd::store(frames[0], right_x);
+      simd::store(frames[1], right_y);
+      simd::store(frames[2], right_z);
+      simd::store(frames[3], forward_x);
+      simd::store(frames[4], forward_y);
+      simd::store(frames[5], forward_z);
+      simd::store(frames[6], up_x);
+      simd::store(frames[7], up_y);
+      simd::store(frames[8], up_z);
+      std::size_t lane_end = std::min(kLaneCount,
+                                      static_cast<std::size_t>(size_) - first);
+      for (std::size_t lane = 0; lane < lane_end; lane++) {
+        transforms[first + lane] = LMatrix4f(
+            frames[0][lane], frames[1][lane], frames[2][lane], 0,
+            frames[3][lane], frames[4][lane], frames[5][lane], 0,
+            frames[6][lane], frames[7][lane], frames[8][lane], 0,
+            frames[6][lane] * radius, frames[7][lane] * radius,
+            frames[8][lane] * radius, 1);
+      }
+    }
+  });
+}
+
+void Fleet::moveShips(std::size_t first, float step_duration) {
+  simd::Float4 position_x = simd::load(&positions_.xs[first]);
+  simd::Float4 position_y = simd::load(&positions_.ys[first]);
+  simd::Float4 position_z = simd::load(&positions_.zs[first]);
+  simd::Float4 heading_x = simd::load(&headings_.xs[first]);
+  simd::Float4 heading_y = simd::load(&headings_.ys[first]);
+  simd::Float4 heading_z = simd::load(&headings_.zs[first]);
+  simd::Float4 waypoint_x = simd::load(&waypoints_.xs[first]);
+  simd::Float4 waypoint_y = simd::load(&waypoints_.ys[first]);
+  simd::Float4 waypoint_z = simd::load(&waypoints_.zs[first]);
+
+  // Find the direction to the waypoint, tangent to the sphere.
+  simd::Float4 along_position = simd::add(
+      simd::add(simd::mul(waypoint_x, position_x),
+                simd::mul(waypoint_y, position_y)),
+      simd::mul(waypoint_z, position_z));
+  simd::Float4 desired_x =
+      simd::sub(waypoint_x, simd::mul(position_x, along_position));
+  simd::Float4 desired_y =
+      simd::sub(waypoint_y, simd::mul(position_y, along_position));
+  simd::Float4 desired_z =
+      simd::sub(waypoint_z, simd::mul(position_z, along_position));
+  simd::Float4 inverse_length =
+      simd::div(simd::splat(1), getLength(desired_x, desired_y, desired_z));
+
+  // Turn part of the way toward it.
+  simd::Float4 turn = simd::splat(std::min(1.f, kTurnRate * step_duration));
+  heading_x = simd::add(
+      heading_x,
+      simd::mul(simd::sub(simd::mul(desired_x, inverse_length), heading_x),
+                turn));
+  heading_y = simd::add(
+      heading_y,
+      simd::mul(simd::sub(simd::mul(desired_y, inverse_length), heading_y),
+                turn));
+  heading_z = simd::add(
+      heading_z,
+      simd::mul(simd::sub(simd::mul(desired_z, inverse_length), heading_z),
+                turn));
+
+  // Move along the heading, drift with the current, and snap back onto the
+  // sphere.
+  simd::Float4 duration = simd::splat(step_duration);
+  simd::Float4 distance = simd::mul(simd::load(&speeds_[first]), duration);
+  position_x = simd::add(
+      position_x,
+      simd::add(simd::mul(heading_x, distance),
+                simd::mul(simd::load(&current_velocities_.xs[first]),
+                          duration)));
+  position_y = simd::add(
+      position_y,
+      simd::add(simd::mul(heading_y, distance),
+                simd::mul(simd::load(&current_velocities_.ys[first]),
+                          duration)));
+  position_z = simd::add(
+      position_z,
+      simd::add(simd::mul(heading_z, distance),
+                simd::mul(simd::load(&current_velocities_.zs[first]),
+                          duration)));
+  inverse_length =
+      simd::div(simd::splat(1), getLength(position_x, position_y, position_z));
+  position_x = simd::mul(position_x, inverse_length);
+  position_y = simd::mul(position_y, inverse_length);
+  position_z = simd::mul(position_z, inverse_length);
+
+  // Keep the heading a unit vector tangent to the sphere where it now is.
+  along_position = simd::add(
+      simd::add(simd::mul(heading_x, position_x),
+                simd::mul(heading_y, position_y)),
+      simd::mul(heading_z, position_z));
+  heading_x = simd::sub(heading_x, simd::mul(position_x, along_position));
+  heading_y = simd::sub(heading_y, simd::mul(position_y, along_position));
+  heading_z = simd::sub(heading_z, simd::mul(position_z, along_position));
+  inverse_length =
+      simd::div(simd::splat(1), getLength(heading_x, heading_y, heading_z));
+  heading_x = simd::mul(heading_x, inverse_length);
+  heading_y = simd::mul(heading_y, inverse_length);
+  heading_z = simd::mul(heading_z, inverse_length);
+
+  simd::store(&positions_.xs[first], position_x);
+  simd::store(&positions_.ys[first], position_y);
+  simd::store(&positions_.zs[first], position_z);
+  simd::store(&headings_.xs[first], heading_x);
+  simd::store(&headings_.ys[first], heading_y);
+  simd::store(&headings_.zs[first], heading_z);
+}
+
+void Fleet::pickWaypoint(std::size_t i) {
+  uint32_t &random_state = random_states_[i];
+  float bearing = (2 * nextUniform(random_state) - 1) *
+                  static_cast<float>(MathNumbers::pi);
+  float distance = kMinWaypointDistance +
+                   (nextUniform(random_state) *
+                    (kMaxWaypointDistance - kMinWaypointDistance));
+  waypoints_.set(i,
+                 geodesy::getDestination(positions_.get(i), bearing, distance));
+}
+
+}  // namespace earth_world
@@ -0,0 +1,98 @@
+#ifndef EARTH_WORLD_FLEET_H
+#define EARTH_WORLD_FLEET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "coast_distance_field.h"
+#include "geodesy.h"
+#include "ocean_currents.h"
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+
+/**
+ * A fleet of ships sailing the globe on their own, each heading for a
+ * waypoint of its own, and picking another once there, or once the coast is
+ * in the way.
+ *
+ * Ships are kept in structure-of-arrays form, padded to a whole number of
+ * groups of four, so that they are steered and moved four at a time with
+ * SIMD, with the groups split across all cores. Each core samples the
+ * currents its ships drift with in one batch, and then tests its ships
+ * against the coast in another. Every ship draws from its own random
+ * generator, so the fleet moves the same way however the work is split.
+ */
+class Fleet {
+ public:
+  /**
+   * Spawns the fleet at random points on open water.
+   * @param coast_distance_field The distance to the coast, to spawn away from.
+   * @param size The number of ships.
+   * @param seed The seed the fleet's random choices follow from.
+   */
+  Fleet(const CoastDistanceField &coast_distance_field, int size,
+        uint32_t seed);
+  /** Creates a fleet without any ships. */
+  Fleet();
+  Fleet(const Fleet &) = default;
+  Fleet(Fleet &&) noexcept = default;
+  Fleet &operator=(const Fleet &) = default;
+  Fleet &operator=(Fleet &&) noexcept = default;
+  ~Fleet() = default;
+
+  int getSize() const;
+
+  /**
+   * Steers and moves every ship by a step, drifting with the currents,
+   * across all cores. Ships that would sail further into the coast stay put,
+   * turn away from it, and pick another waypoint.
+   * @param coast_distance_field The distance to the coast.
+   * @param ocean_currents The currents the ships drift with.
+   * @param step_duration The time the step covers, in seconds.
+   */
+  void update(const CoastDistanceField &coast_distance_field,
+              const OceanCurrentField &ocean_currents, float step_duration);
+
+  /**
+   * Fills the transforms the ships are drawn with, between the last two
+   * steps, across all cores.
+   * @param t The fraction of the way from the previous step to the latest.
+   * @param radius The distance of the ships from the globe's center.
+   * @param transforms Filled with each ship's transform, relative to the
+   *     globe's center, facing along its heading and upright on the globe.
+   */
+  void getTransforms(float t, float radius,
+                     std::vector<LMatrix4f> &transforms) const;
+
+ protected:
+  /** The number of ships, short of the padding. */
+  int size_;
+  /** The ships' positions, as unit vectors from the globe's center. */
+  geodesy::Points positions_;
+  /** The ships' headings, as unit vectors tangent to the globe. */
+  geodesy::Points headings_;
+  geodesy::Points previous_positions_;
+  geodesy::Points previous_headings_;
+  geodesy::Points waypoints_;
+  /** The ships' speeds, in radians per second. */
+  std::vector<float> speeds_;
+  /** The velocities of the currents under the ships, as of the latest step. */
+  geodesy::Points current_velocities_;
+  /** The ships' distances from the coast as of the latest step. */
+  std::vector<float> coast_distances_;
+  /** The ships' distances from the coast after moving, before settling. */
+  std::vector<float> moved_coast_distances_;
+  /** Each ship's random generator state. */
+  std::vector<uint32_t> random_states_;
+
+  /** Steers and moves the four ships starting at the given index. */
+  void moveShips(std::size_t first, float step_duration);
+
+  /** Picks a new waypoint for a ship, at random within reach of it. */
+  void pickWaypoint(std::size_t i);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_FLEET_H
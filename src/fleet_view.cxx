@@ -0,0 +1,133 @@
+#include "fleet_view.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "filename.h"
+#include "panda3d/geomEnums.h"
+#include "panda3d/omniBoundingVolume.h"
+#include "panda3d/pandaFramework.h"
+#include "panda3d/shader.h"
+#include "shader_cache.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/** Each transform is four rows of four floats. */
+const int kTexelsPerTransform = 4;
+/**
+ * The latest transforms fill the first half of the texture, and the
+ * previous ones the second half, so that runs of each are contiguous.
+ */
+const int kTransformsPerInstance = 2;
+
+FleetView::FleetView(PT<WindowFramework> window, int capacity,
+                     PN_stdfloat boat_scale)
+    : path_{loadFlattenedModel(window, boat_scale)},
+      transforms_texture_{new Texture("FleetTransforms")},
+      capacity_{std::max(1, capacity)} {
+  transforms_texture_->setup_buffer_texture(
+      capacity_ * kTransformsPerInstance * kTexelsPerTransform,
+      Texture::T_float, Texture::F_rgba32, GeomEnums::UH_dynamic);
+  transforms_texture_->make_ram_image();
+
+  PT<Shader> shader = shader_cache::load("fleet.vert", "fleet.frag");
+  path_.set_shader(shader);
+  path_.set_shader_input("u_InstanceTransforms", transforms_texture_);
+  setInterpolationFactor(1);
+  path_.set_instance_count(0);
+
+  // Instances are placed by the shader, so the model's own bounds say
+  // nothing about where the fleet is.
+  path_.node()->set_bounds(new OmniBoundingVolume);
+  path_.node()->set_final(true);
+  path_.hide();
+}
+
+FleetView::FleetView(FleetView &&other) noexcept
+    : path_{other.path_},
+      transforms_texture_{std::move(other.transforms_texture_)},
+      capacity_{other.capacity_} {
+  other.path_.clear();
+}
+
+FleetView &FleetView::operator=(FleetView &&other) noexcept {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  path_.remove_node();
+  path_ = other.path_;
+  transforms_texture_ = std::move(other.transforms_texture_);
+  capacity_ = other.capacity_;
+  other.path_.clear();
+  return *this;
+}
+
+FleetView::~FleetView() { path_.remove_node(); }
+
+NodePath FleetView::getPath() const { return path_; }
+
+int FleetView::getCapacity() const { return capacity_; }
+
+void FleetView::update(const std::vector<LMatrix4f> &previous_transforms,
+                       const std::vector<LMatrix4f> &transforms,
+                       const LPoint3 &camera_position,
+                       PN_stdfloat draw_distance) {
+  PTA_uchar image = transforms_texture_->modify_ram_image();
+  unsigned char *destination = image.p();
+  unsigned char *previous_destination =
+      destination + (static_cast<std::size_t>(capacity_) * sizeof(LMatrix4f));
+  std::size_t count =
+      std::min(std::min(previous_transforms.size(), transforms.size()),
+               static_cast<std::size_t>(capacity_));
+  PN_stdfloat draw_distance_squared = draw_distance * draw_distance;
+
+  std::size_t visible_count = 0;
+  std::size_t run_start = 0;
+  for (std::size_t i = 0; i <= count; i++) {
+    bool visible = false;
+    if (i < count) {
+      LVector3 offset = LPoint3(transforms[i].get_row3(3)) - camera_position;
+      visible = offset.length_squared() <= draw_distance_squared;
+    }
+    if (!visible) {
+      if (i > run_start) {
+        std::size_t run_length = i - run_start;
+        std::memcpy(destination + (visible_count * sizeof(LMatrix4f)),
+                    &transforms[run_start], run_length * sizeof(LMatrix4f));
+        std::memcpy(
+            previous_destination + (visible_count * sizeof(LMatrix4f)),
+            &previous_transforms[run_start], run_length * sizeof(LMatrix4f));
+        visible_count += run_length;
+      }
+      run_start = i + 1;
+    }
+  }
+
+  path_.set_instance_count(static_cast<int>(visible_count));
+  if (visible_count == 0) {
+    path_.hide();
+  } else {
+    path_.show();
+  }
+}
+
+void FleetView::setInterpolationFactor(PN_stdfloat t) {
+  path_.set_shader_input("u_InterpolationFactor", LVector2(t, 0));
+}
+
+NodePath FleetView::loadFlattenedModel(PT<WindowFramework> window,
+                                       PN_stdfloat boat_scale) {
+  PandaFramework *framework = window->get_panda_framework();
+  NodePath model = window->load_model(framework->get_models(),
+                                      filename::forModel("boat/S_Boat.bam"));
+  model.detach_node();
+  NodePath path("Fleet");
+  model.reparent_to(path);
+  model.set_scale(boat_scale);
+  // Bake the scale into the vertices, and merge geoms that share a state.
+  path.flatten_strong();
+  return path;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,72 @@
+#ifndef EARTH_WORLD_FLEET_VIEW_H
+#define EARTH_WORLD_FLEET_VIEW_H
+
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/nodePath.h"
+#include "panda3d/texture.h"
+#include "panda3d/windowFramework.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * Renders a fleet of identical boats with a single instanced draw call. The
+ * boat model is flattened once, and each instance's transforms as of the
+ * last two steps are read by the vertex shader from a buffer texture, and
+ * blended between there. The texture is only refilled when the simulation
+ * steps, and frames in between only set the blend.
+ */
+class FleetView {
+ public:
+  /**
+   * @param window The window whose model loader loads the boat.
+   * @param capacity The most boats that can be drawn at once.
+   * @param boat_scale The scale at which the boat model is flattened.
+   */
+  FleetView(PT<WindowFramework> window, int capacity, PN_stdfloat boat_scale);
+  FleetView(const FleetView &) = delete;
+  FleetView(FleetView &&) noexcept;
+  FleetView &operator=(const FleetView &) = delete;
+  FleetView &operator=(FleetView &&) noexcept;
+  ~FleetView();
+
+  NodePath getPath() const;
+  int getCapacity() const;
+
+  /**
+   * Uploads the transforms of the boats to draw, as of the last two steps.
+   * Boats farther than the draw distance from the camera are skipped;
+   * contiguous runs of visible boats are copied with one memcpy each, so a
+   * fully visible fleet costs a single copy per step.
+   * @param previous_transforms The boats' transforms as of the previous
+   *     step, relative to the fleet's parent.
+   * @param transforms The boats' transforms as of the latest step, relative
+   *     to the same.
+   * @param camera_position The camera's position, relative to the same.
+   * @param draw_distance The distance past which boats aren't drawn.
+   */
+  void update(const std::vector<LMatrix4f> &previous_transforms,
+              const std::vector<LMatrix4f> &transforms,
+              const LPoint3 &camera_position, PN_stdfloat draw_distance);
+
+  /**
+   * Sets where the boats are drawn between the last two steps uploaded.
+   * @param t The fraction of the way from the previous step to the latest.
+   */
+  void setInterpolationFactor(PN_stdfloat t);
+
+ protected:
+  NodePath path_;
+  PT<Texture> transforms_texture_;
+  int capacity_;
+
+  /** Loads the boat model, with its geometry flattened into few geoms. */
+  static NodePath loadFlattenedModel(PT<WindowFramework> window,
+                                     PN_stdfloat boat_scale);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_FLEET_VIEW_H
@@ -0,0 +1,214 @@
+#include "flood_map.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "cache.h"
+#include "globe.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+const uint32_t kCacheVersion = 1;
+const std::string kCacheNamePrefix = "flood_heights_";
+/** The width and height of the pyramid's tiles, in texels. */
+const int kTileSize = 32;
+/**
+ * The least depth of the charted sea, so that all of it stays under water at
+ * the charted sea level, however shallow.
+ */
+const float kMinimumDepth = 1e-6f;
+
+FloodMap::FloodMap(const PNMImage &topology, PT<Texture> bathymetry_texture,
+                   const PNMImage &land_mask, PN_stdfloat land_mask_cutoff,
+                   int width, int height, uint64_t source_hash)
+    : width_{width}, height_{height} {
+  std::string cache_name = kCacheNamePrefix + std::to_string(width) + "x" +
+                           std::to_string(height) + ".bin";
+  std::vector<unsigned char> data;
+  std::size_t size = static_cast<std::size_t>(width * height);
+  if (cache::read(cache_name, kCacheVersion, source_hash, data) &&
+      data.size() == size * sizeof(float)) {
+    flood_heights_.resize(size);
+    std::memcpy(flood_heights_.data(), data.data(), data.size());
+  } else {
+    flood_heights_ = bake(topology, bathymetry_texture, land_mask,
+                          land_mask_cutoff, width, height);
+    cache::write(cache_name, kCacheVersion, source_hash,
+                 flood_heights_.data(),
+                 flood_heights_.size() * sizeof(float));
+  }
+  buildPyramid();
+}
+
+FloodMap::FloodMap()
+    : width_{1}, height_{1}, flood_heights_(1, kGlobeSeaFloorHeight) {
+  buildPyramid();
+}
+
+int FloodMap::getWidth() const { return width_; }
+
+int FloodMap::getHeight() const { return height_; }
+
+std::vector<uint8_t> FloodMap::getWater(PN_stdfloat sea_level, int row_begin,
+                                        int row_end) const {
+  std::vector<uint8_t> water(
+      static_cast<std::size_t>((row_end - row_begin) * width_));
+  std::size_t offset = static_cast<std::size_t>(row_begin * width_);
+  parallel::forRange(row_begin, row_end, [&](int band_begin, int band_end) {
+    std::size_t begin = static_cast<std::size_t>(band_begin * width_);
+    std::size_t end = static_cast<std::size_t>(band_end * width_);
+    for (std::size_t i = begin; i < end; i++) {
+      water[i - offset] = flood_heights_[i] < sea_level ? 1 : 0;
+    }
+  });
+  return water;
+}
+
+std::vector<uint8_t> FloodMap::findChangedRows(
+    PN_stdfloat old_sea_level, PN_stdfloat new_sea_level) const {
+  std::vector<uint8_t> changed_rows(static_cast<std::size_t>(height_));
+  // A texel changes if its flood height lies between the two levels, with
+  // the lower one included, as it is under water when below the sea level.
+  float lowest = std::min(old_sea_level, new_sea_level);
+  float highest = std::max(old_sea_level, new_sea_level);
+  if (lowest < highest) {
+    markChangedRows(pyramid_.size() - 1, 0, 0, lowest, highest, changed_rows);
+  }
+  return changed_rows;
+}
+
+void FloodMap::buildPyramid() {
+  pyramid_.clear();
+  pyramid_sizes_.clear();
+  LVector2i size((width_ + kTileSize - 1) / kTileSize,
+                 (height_ + kTileSize - 1) / kTileSize);
+  std::vector<Range> tiles(static_cast<std::size_t>(size.get_x() *
+                                                    size.get_y()));
+  parallel::forRange(0, size.get_y(), [&](int tile_row_begin,
+                                          int tile_row_end) {
+    for (int tile_y = tile_row_begin; tile_y < tile_row_end; tile_y++) {
+      for (int tile_x = 0; tile_x < size.get_x(); tile_x++) {
+        Range range = {std::numeric_limits<float>::infinity(),
+                       -std::numeric_limits<float>::infinity()};
+        int y_end = std::min(height_, (tile_y + 1) * kTileSize);
+        int x_end = std::min(width_, (tile_x + 1) * kTileSize);
+        for (int y = tile_y * kTileSize; y < y_end; y++) {
+          for (int x = tile_x * kTileSize; x < x_end; x++) {
+            float flood_height =
+                flood_heights_[static_cast<std::size_t>((y * width_) + x)];
+            range.lowest = std::min(range.lowest, flood_height);
+            range.highest = std::max(range.highest, flood_height);
+          }
+        }
+        tiles[static_cast<std::size_t>((tile_y * size.get_x()) + tile_x)] =
+            range;
+      }
+    }
+  });
+  pyramid_.push_back(std::move(tiles));
+  pyramid_sizes_.push_back(size);
+
+  // Each block covers up to 2x2 of the blocks in the level below it.
+  while (size.get_x() > 1 || size.get_y() > 1) {
+    const std::vector<Range> &children = pyramid_.back();
+    LVector2i child_size = size;
+    size = LVector2i((child_size.get_x() + 1) / 2,
+                     (child_size.get_y() + 1) / 2);
+    std::vector<Range> blocks(static_cast<std::size_t>(size.get_x() *
+                                                       size.get_y()));
+    for (int y = 0; y < size.get_y(); y++) {
+      for (int x = 0; x < size.get_x(); x++) {
+        Range range = {std::numeric_limits<float>::infinity(),
+                       -std::numeric_limits<float>::infinity()};
+        int child_y_end = std::min(child_size.get_y(), (2 * y) + 2);
+        int child_x_end = std::min(child_size.get_x(), (2 * x) + 2);
+        for (int child_y = 2 * y; child_y < child_y_end; child_y++) {
+          for (int child_x = 2 * x; child_x < child_x_end; child_x++) {
+            const Range &child = children[static_cast<std::size_t>(
+                (child_y * child_size.get_x()) + child_x)];
+            range.lowest = std::min(range.lowest, child.lowest);
+            range.highest = std::max(range.highest, child.highest);
+          }
+        }
+        blocks[static_cast<std::size_t>((y * size.get_x()) + x)] = range;
+      }
+    }
+    pyramid_.push_back(std::move(blocks));
+    pyramid_sizes_.push_back(size);
+  }
+}
+
+void FloodMap::markChangedRows(std::size_t level, int x, int y, float lowest,
+                               float highest,
+                               std::vector<uint8_t> &changed_rows) const {
+  const LVector2i &size = pyramid_sizes_[level];
+  const Range &range =
+      pyramid_[level][static_cast<std::size_t>((y * size.get_x()) + x)];
+  if (range.highest < lowest || range.lowest >= highest) {
+    return;
+  }
+  if (level == 0) {
+    int row_end = std::min(height_, (y + 1) * kTileSize);
+    for (int row = y * kTileSize; row < row_end; row++) {
+      changed_rows[static_cast<std::size_t>(row)] = 1;
+    }
+    return;
+  }
+  const LVector2i &child_size = pyramid_sizes_[level - 1];
+  int child_y_end = std::min(child_size.get_y(), (2 * y) + 2);
+  int child_x_end = std::min(child_size.get_x(), (2 * x) + 2);
+  for (int child_y = 2 * y; child_y < child_y_end; child_y++) {
+    for (int child_x = 2 * x; child_x < child_x_end; child_x++) {
+      markChangedRows(level - 1, child_x, child_y, lowest, highest,
+                      changed_rows);
+    }
+  }
+}
+
+std::vector<float> FloodMap::bake(const PNMImage &topology,
+                                  PT<Texture> bathymetry_texture,
+                                  const PNMImage &land_mask,
+                                  PN_stdfloat land_mask_cutoff, int width,
+                                  int height) {
+  // Resample every height map to the raster the same way the coast distance
+  // field resamples the land mask, so that the two agree on the coast.
+  PNMImage topology_level(width, height, 1, topology.get_maxval());
+  topology_level.box_filter_from(0.5f, topology);
+  PNMImage land_mask_level(width, height, 1, land_mask.get_maxval());
+  land_mask_level.box_filter_from(0.5f, land_mask);
+  // Only the resampled bathymetry is kept, as the full one is large.
+  PNMImage bathymetry;
+  bathymetry_texture->store(bathymetry);
+  PNMImage bathymetry_level(width, height, 1, bathymetry.get_maxval());
+  bathymetry_level.box_filter_from(0.5f, bathymetry);
+  bathymetry.clear();
+
+  const float land_height_range = 1 - kGlobeWaterSurfaceHeight;
+  const float water_depth_range =
+      kGlobeWaterSurfaceHeight - kGlobeSeaFloorHeight;
+  std::vector<float> flood_heights(static_cast<std::size_t>(width * height));
+  parallel::forRange(0, height, [&](int row_begin, int row_end) {
+    for (int y = row_begin; y < row_end; y++) {
+      for (int x = 0; x < width; x++) {
+        float flood_height;
+        if (land_mask_level.get_bright(x, y) > land_mask_cutoff) {
+          float water_depth = 1 - bathymetry_level.get_bright(x, y);
+          flood_height =
+              kGlobeWaterSurfaceHeight -
+              std::max(kMinimumDepth, water_depth * water_depth_range);
+        } else {
+          flood_height = kGlobeWaterSurfaceHeight +
+                         (topology_level.get_bright(x, y) * land_height_range);
+        }
+        flood_heights[static_cast<std::size_t>((y * width) + x)] =
+            flood_height;
+      }
+    }
+  });
+  return flood_heights;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,114 @@
+#ifndef EARTH_WORLD_FLOOD_MAP_H
+#define EARTH_WORLD_FLOOD_MAP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/pnmImage.h"
+#include "panda3d/texture.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * The sea level above which every point on the globe is under water, as an
+ * equirectangular raster stored from north to south like the source images.
+ * Land floods once the sea rises past its ground, and the sea bed is laid
+ * bare once the sea falls to it, so that at the charted sea level the water
+ * is just what the land mask says.
+ *
+ * Over the raster sits a pyramid of the lowest and highest flood heights
+ * within square tiles, and within ever larger blocks of tiles, so that the
+ * tiles where a change of sea level moves the coast are found by descending
+ * only into the blocks whose range the change crosses.
+ */
+class FloodMap {
+ public:
+  /**
+   * Loads the raster from the cache, or bakes it from the height maps and
+   * caches it if missing.
+   * @param topology The heightfield of the land.
+   * @param bathymetry_texture The heightfield of the sea bed, which is only
+   *     read back if the raster needs baking.
+   * @param land_mask The mask of water, where brighter than the cutoff.
+   * @param land_mask_cutoff The cutoff between land and water.
+   * @param width The width of the raster.
+   * @param height The height of the raster.
+   * @param source_hash The hash of the height maps' and mask's sources and
+   *     the cutoff, which the cached raster must have been baked from.
+   */
+  FloodMap(const PNMImage &topology, PT<Texture> bathymetry_texture,
+           const PNMImage &land_mask, PN_stdfloat land_mask_cutoff, int width,
+           int height, uint64_t source_hash);
+  /** Creates a map without any land, which is all deep sea. */
+  FloodMap();
+  FloodMap(const FloodMap &) = default;
+  FloodMap(FloodMap &&) noexcept = default;
+  FloodMap &operator=(const FloodMap &) = default;
+  FloodMap &operator=(FloodMap &&) noexcept = default;
+  ~FloodMap() = default;
+
+  int getWidth() const;
+  int getHeight() const;
+
+  /**
+   * @param sea_level The height of the sea's surface.
+   * @param row_begin The first row to find the water of.
+   * @param row_end One past the last row to find the water of.
+   * @return Per texel of the rows, row major, 1 where it is under water, and
+   *     0 elsewhere.
+   */
+  std::vector<uint8_t> getWater(PN_stdfloat sea_level, int row_begin,
+                                int row_end) const;
+
+  /**
+   * Finds where the coast moves when the sea level changes, to the nearest
+   * tile.
+   * @param old_sea_level The sea level changed from.
+   * @param new_sea_level The sea level changed to.
+   * @return Per row, 1 where some texel in it changes between land and water,
+   *     and 0 elsewhere.
+   */
+  std::vector<uint8_t> findChangedRows(PN_stdfloat old_sea_level,
+                                       PN_stdfloat new_sea_level) const;
+
+ protected:
+  /** The lowest and highest flood heights within a block of texels. */
+  struct Range {
+    float lowest;
+    float highest;
+  };
+
+  int width_;
+  int height_;
+  std::vector<float> flood_heights_;
+  /**
+   * Per level, starting with single tiles and halving in each dimension up
+   * to a single block, the range within each block, row major.
+   */
+  std::vector<std::vector<Range>> pyramid_;
+  /** Per level of the pyramid, its width and height in blocks. */
+  std::vector<LVector2i> pyramid_sizes_;
+
+  /** Builds the pyramid over the flood heights. */
+  void buildPyramid();
+
+  /**
+   * Marks the rows of every tile within a block whose flood heights fall in
+   * [lowest, highest).
+   */
+  void markChangedRows(std::size_t level, int x, int y, float lowest,
+                       float highest, std::vector<uint8_t> &changed_rows) const;
+
+  /** Bakes the flood heights from the height maps. */
+  static std::vector<float> bake(const PNMImage &topology,
+                                 PT<Texture> bathymetry_texture,
+                                 const PNMImage &land_mask,
+                                 PN_stdfloat land_mask_cutoff, int width,
+                                 int height);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_FLOOD_MAP_H
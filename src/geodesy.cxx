@@ -0,0 +1,406 @@
+#include "geodesy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace earth_world {
+namespace geodesy {
+
+/** The side of the square tiles the distance matrix is computed in. */
+const std::size_t kTileSize = 64;
+/**
+ * Below this sine of the angle between two points, slerp falls back to a
+ * lerp, which is as accurate there and doesn't divide by zero.
+ */
+const float kMinSlerpSine = 1e-6f;
+/** Below this distance from the axis, a point is taken to be at a pole. */
+const float kMinAxisDistance = 1e-6f;
+
+const float kPi = static_cast<float>(MathNumbers::pi);
+const float kHalfPi = 0.5f * kPi;
+const float kQuarterPi = 0.25f * kPi;
+const float kTanEighthPi = 0.414213562373095f;
+
+/**
+ * Pi / 2 split into three parts, each exactly representable with enough
+ * trailing zeros that their products with small integers are exact, for
+ * Cody and Waite's argument reduction.
+ */
+const float kHalfPi1 = 1.5703125f;
+const float kHalfPi2 = 4.837512969970703125e-4f;
+const float kHalfPi3 = 7.54978995489188216e-8f;
+
+/** @return atan2(y, x) for four lanes, to within about 1e-7 radians. */
+static simd::Float4 atan2(simd::Float4 y, simd::Float4 x) {
+  simd::Float4 zero = simd::splat(0);
+  simd::Float4 one = simd::splat(1);
+  simd::Float4 abs_x = simd::abs(x);
+  simd::Float4 abs_y = simd::abs(y);
+  // Fold the angle into [0, PI/4] by swapping the axes, then into
+  // [-PI/8, PI/8] about PI/4, where the polynomial below is accurate.
+  simd::Float4 ratio = simd::div(
+      simd::min(abs_x, abs_y),
+      simd::max(simd::max(abs_x, abs_y), simd::splat(1e-30f)));
+  simd::Float4 is_shifted = simd::less(simd::splat(kTanEighthPi), ratio);
+  ratio = simd::select(
+      is_shifted, simd::div(simd::sub(ratio, one), simd::add(ratio, one)),
+      ratio);
+  // The polynomial from Cephes' atanf.
+  simd::Float4 z = simd::mul(ratio, ratio);
+  simd::Float4 polynomial = simd::splat(8.05374449538e-2f);
+  polynomial =
+      simd::add(simd::mul(polynomial, z), simd::splat(-1.38776856032e-1f));
+  polynomial =
+      simd::add(simd::mul(polynomial, z), simd::splat(1.99777106478e-1f));
+  polynomial =
+      simd::add(simd::mul(polynomial, z), simd::splat(-3.33329491539e-1f));
+  simd::Float4 angle =
+      simd::add(ratio, simd::mul(simd::mul(polynomial, z), ratio));
+  angle = simd::add(angle, simd::select(is_shifted, simd::splat(kQuarterPi),
+                                        zero));
+  // Unfold the angle back into its octant.
+  angle = simd::select(simd::less(abs_x, abs_y),
+                       simd::sub(simd::splat(kHalfPi), angle), angle);
+  angle = simd::select(simd::less(x, zero),
+                       simd::sub(simd::splat(kPi), angle), angle);
+  return simd::select(simd::less(y, zero), simd::negate(angle), angle);
+}
+
+/**
+ * Finds the sine and cosine of four lanes, to within about 1e-7, for angles
+ * within a few turns of zero.
+ */
+static void sinCos(simd::Float4 angle, simd::Float4 &sine,
+                   simd::Float4 &cosine) {
+  simd::Float4 one = simd::splat(1);
+  // Reduce the angle to [-PI/4, PI/4], by its nearest multiple of PI/2.
+  simd::Float4 quadrant =
+      simd::round(simd::mul(angle, simd::splat(1 / kHalfPi)));
+  simd::Float4 reduced =
+      simd::sub(angle, simd::mul(quadrant, simd::splat(kHalfPi1)));
+  reduced = simd::sub(reduced, simd::mul(quadrant, simd::splat(kHalfPi2)));
+  reduced = simd::sub(reduced, simd::mul(quadrant, simd::splat(kHalfPi3)));
+  // The polynomials from Cephes' sinf and cosf.
+  simd::Float4 z = simd::mul(reduced, reduced);
+  simd::Float4 sine_polynomial = simd::splat(-1.9515295891e-4f);
+  sine_polynomial = simd::add(simd::mul(sine_polynomial, z),
+                              simd::splat(8.3321608736e-3f));
+  sine_polynomial = simd::add(simd::mul(sine_polynomial, z),
+                              simd::splat(-1.6666654611e-1f));
+  simd::Float4 reduced_sine = simd::add(
+      reduced, simd::mul(simd::mul(sine_polynomial, z), reduced));
+  simd::Float4 cosine_polynomial = simd::splat(2.443315711809948e-5f);
+  cosine_polynomial = simd::add(simd::mul(cosine_polynomial, z),
+                                simd::splat(-1.388731625493765e-3f));
+  cosine_polynomial = simd::add(simd::mul(cosine_polynomial, z),
+                                simd::splat(4.166664568298827e-2f));
+  simd::Float4 reduced_cosine =
+      simd::add(simd::sub(one, simd::mul(simd::splat(0.5f), z)),
+                simd::mul(simd::mul(cosine_polynomial, z), z));
+  // Rotate the results by the quadrant, taken modulo 4 into [0, 4).
+  quadrant = simd::sub(
+      quadrant,
+      simd::mul(simd::splat(4),
+                simd::round(simd::mul(quadrant, simd::splat(0.25f)))));
+  quadrant = simd::select(simd::less(quadrant, simd::splat(0)),
+                          simd::add(quadrant, simd::splat(4)), quadrant);
+  simd::Float4 is_odd = simd::less(
+      simd::abs(simd::sub(simd::abs(simd::sub(quadrant, simd::splat(2))),
+                          one)),
+      simd::splat(0.5f));
+  sine = simd::select(is_odd, reduced_cosine, reduced_sine);
+  cosine = simd::select(is_odd, reduced_sine, reduced_cosine);
+  // The sine is negative in quadrants 2 and 3, the cosine in 1 and 2.
+  sine = simd::select(simd::less(simd::splat(1.5f), quadrant),
+                      simd::negate(sine), sine);
+  cosine = simd::select(
+      simd::less(simd::abs(simd::sub(quadrant, simd::splat(1.5f))), one),
+      simd::negate(cosine), cosine);
+}
+
+/** @return The distances between four pairs of unit vectors. */
+static simd::Float4 getDistances(simd::Float4 from_x, simd::Float4 from_y,
+                                 simd::Float4 from_z, simd::Float4 to_x,
+                                 simd::Float4 to_y, simd::Float4 to_z) {
+  simd::Float4 dot =
+      simd::add(simd::add(simd::mul(from_x, to_x), simd::mul(from_y, to_y)),
+                simd::mul(from_z, to_z));
+  simd::Float4 cross_x =
+      simd::sub(simd::mul(from_y, to_z), simd::mul(from_z, to_y));
+  simd::Float4 cross_y =
+      simd::sub(simd::mul(from_z, to_x), simd::mul(from_x, to_z));
+  simd::Float4 cross_z =
+      simd::sub(simd::mul(from_x, to_y), simd::mul(from_y, to_x));
+  simd::Float4 cross_length = simd::sqrt(simd::add(
+      simd::add(simd::mul(cross_x, cross_x), simd::mul(cross_y, cross_y)),
+      simd::mul(cross_z, cross_z)));
+  return atan2(cross_length, dot);
+}
+
+float getDistance(const LVector3 &from, const LVector3 &to) {
+  return atan2f(from.cross(to).length(), from.dot(to));
+}
+
+float getBearing(const LVector3 &from, const LVector3 &to) {
+  // Project the destination onto the directions east and north of the
+  // origin, each scaled by the origin's distance from the axis.
+  float axis_distance_squared =
+      (from.get_x() * from.get_x()) + (from.get_y() * from.get_y());
+  float east = (from.get_x() * to.get_y()) - (from.get_y() * to.get_x());
+  float north = (to.get_z() * axis_distance_squared) -
+                (from.get_z() * ((from.get_x() * to.get_x()) +
+                                 (from.get_y() * to.get_y())));
+  return atan2f(east, north);
+}
+
+LVector3 getDestination(const LVector3 &from, float bearing, float distance) {
+  float axis_distance = std::max(
+      kMinAxisDistance,
+      sqrtf((from.get_x() * from.get_x()) + (from.get_y() * from.get_y())));
+  LVector3 east = LVector3(-from.get_y(), from.get_x(), 0) / axis_distance;
+  LVector3 north = LVector3(-from.get_z() * from.get_x(),
+                            -from.get_z() * from.get_y(),
+                            axis_distance * axis_distance) /
+                   axis_distance;
+  LVector3 heading = (north * cosf(bearing)) + (east * sinf(bearing));
+  return (from * cosf(distance)) + (heading * sinf(distance));
+}
+
+LVector3 slerp(const LVector3 &from, const LVector3 &to, float t) {
+  // Between unit vectors, the cross product's length is the angle's sine.
+  float sine = from.cross(to).length();
+  if (sine < kMinSlerpSine) {
+    return ((from * (1 - t)) + (to * t)).normalized();
+  }
+  float angle = atan2f(sine, from.dot(to));
+  return ((from * sinf((1 - t) * angle)) + (to * sinf(t * angle))) / sine;
+}
+
+void getDistances(const Points &from, const Points &to,
+                  std::vector<float> &distances) {
+  std::size_t size = std::min(from.size(), to.size());
+  distances.resize(size);
+  std::size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    simd::store(&distances[i],
+                getDistances(simd::load(&from.xs[i]), simd::load(&from.ys[i]),
+                             simd::load(&from.zs[i]), simd::load(&to.xs[i]),
+                             simd::load(&to.ys[i]), simd::load(&to.zs[i])));
+  }
+  for (; i < size; i++) {
+    distances[i] = getDistance(from.get(i), to.get(i));
+  }
+}
+
+void getBearings(const Points &from, const Points &to,
+                 std::vector<float> &bearings) {
+  std::size_t size = std::min(from.size(), to.size());
+  bearings.resize(size);
+  std::size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    simd::Float4 from_x = simd::load(&from.xs[i]);
+    simd::Float4 from_y = simd::load(&from.ys[i]);
+    simd::Float4 from_z = simd::load(&from.zs[i]);
+    simd::Float4 to_x = simd::load(&to.xs[i]);
+    simd::Float4 to_y = simd::load(&to.ys[i]);
+    simd::Float4 to_z = simd::load(&to.zs[i]);
+    simd::Float4 axis_distance_squared =
+        simd::add(simd::mul(from_x, from_x), simd::mul(from_y, from_y));
+    simd::Float4 east =
+        simd::sub(simd::mul(from_x, to_y), simd::mul(from_y, to_x));
+    simd::Float4 north = simd::sub(
+        simd::mul(to_z, axis_distance_squared),
+        simd::mul(from_z, simd::add(simd::mul(from_x, to_x),
+                                    simd::mul(from_y, to_y))));
+    simd::store(&bearings[i], atan2(east, north));
+  }
+  for (; i < size; i++) {
+    bearings[i] = getBearing(from.get(i), to.get(i));
+  }
+}
+
+void getDestinations(const Points &from, const std::vector<float> &bearings,
+                     const std::vector<float> &distances,
+                     Points &destinations) {
+  std::size_t size =
+      std::min(from.size(), std::min(bearings.size(), distances.size()));
+  destinations.resize(size);
+  std::size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    simd::Float4 from_x = simd::load(&from.xs[i]);
+    simd::Float4 from_y = simd::load(&from.ys[i]);
+    simd::Float4 from_z = simd::load(&from.zs[i]);
+    simd::Float4 axis_distance_squared =
+        simd::add(simd::mul(from_x, from_x), simd::mul(from_y, from_y));
+    simd::Float4 inverse_axis_distance = simd::div(
+        simd::splat(1), simd::max(simd::sqrt(axis_distance_squared),
+                                  simd::splat(kMinAxisDistance)));
+    simd::Float4 bearing_sine, bearing_cosine, distance_sine, distance_cosine;
+    sinCos(simd::load(&bearings[i]), bearing_sine, bearing_cosine);
+    sinCos(simd::load(&distances[i]), distance_sine, distance_cosine);
+    // The heading is north * cos(bearing) + east * sin(bearing), where
+    // north and east are scaled by the distance from the axis, undone here.
+    simd::Float4 north_scale = simd::mul(bearing_cosine, inverse_axis_distance);
+    simd::Float4 east_scale = simd::mul(bearing_sine, inverse_axis_distance);
+    simd::Float4 heading_x = simd::sub(
+        simd::negate(simd::mul(simd::mul(from_z, from_x), north_scale)),
+        simd::mul(from_y, east_scale));
+    simd::Float4 heading_y =
+        simd::sub(simd::mul(from_x, east_scale),
+                  simd::mul(simd::mul(from_z, from_y), north_scale));
+    simd::Float4 heading_z = simd::mul(axis_distance_squared, north_scale);
+    simd::store(&destinations.xs[i],
+                simd::add(simd::mul(from_x, distance_cosine),
+                          simd::mul(heading_x, distance_sine)));
+    simd::store(&destinations.ys[i],
+                simd::add(simd::mul(from_y, distance_cosine),
+                          simd::mul(heading_y, distance_sine)));
+    simd::store(&destinations.zs[i],
+                simd::add(simd::mul(from_z, distance_cosine),
+                          simd::mul(heading_z, distance_sine)));
+  }
+  for (; i < size; i++) {
+    destinations.set(i, getDestination(from.get(i), bearings[i], distances[i]));
+  }
+}
+
+void slerp(const Points &from, const Points &to, float t, Points &points) {
+  std::size_t size = std::min(from.size(), to.size());
+  points.resize(size);
+  simd::Float4 from_fraction = simd::splat(1 - t);
+  simd::Float4 to_fraction = simd::splat(t);
+  std::size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    simd::Float4 from_x = simd::load(&from.xs[i]);
+    simd::Float4 from_y = simd::load(&from.ys[i]);
+    simd::Float4 from_z = simd::load(&from.zs[i]);
+    simd::Float4 to_x = simd::load(&to.xs[i]);
+    simd::Float4 to_y = simd::load(&to.ys[i]);
+    simd::Float4 to_z = simd::load(&to.zs[i]);
+    simd::Float4 dot =
+        simd::add(simd::add(simd::mul(from_x, to_x), simd::mul(from_y, to_y)),
+                  simd::mul(from_z, to_z));
+    simd::Float4 cross_x =
+        simd::sub(simd::mul(from_y, to_z), simd::mul(from_z, to_y));
+    simd::Float4 cross_y =
+        simd::sub(simd::mul(from_z, to_x), simd::mul(from_x, to_z));
+    simd::Float4 cross_z =
+        simd::sub(simd::mul(from_x, to_y), simd::mul(from_y, to_x));
+    simd::Float4 sine = simd::sqrt(simd::add(
+        simd::add(simd::mul(cross_x, cross_x), simd::mul(cross_y, cross_y)),
+        simd::mul(cross_z, cross_z)));
+    simd::Float4 angle = atan2(sine, dot);
+    simd::Float4 from_weight, to_weight, unused;
+    sinCos(simd::mul(from_fraction, angle), from_weight, unused);
+    sinCos(simd::mul(to_fraction, angle), to_weight, unused);
+    simd::Float4 inverse_sine = simd::div(
+        simd::splat(1), simd::max(sine, simd::splat(kMinSlerpSine)));
+    simd::Float4 is_small = simd::less(sine, simd::splat(kMinSlerpSine));
+    from_weight = simd::select(is_small, from_fraction,
+                               simd::mul(from_weight, inverse_sine));
+    to_weight =
+        simd::select(is_small, to_fraction, simd::mul(to_weight, inverse_sine));
+    simd::Float4 x =
+        simd::add(simd::mul(from_x, from_weight), simd::mul(to_x, to_weight));
+    simd::Float4 y =
+        simd::add(simd::mul(from_y, from_weight), simd::mul(to_y, to_weight));
+    simd::Float4 z =
+        simd::add(simd::mul(from_z, from_weight), simd::mul(to_z, to_weight));
+    // The lerp needs normalizing, and the slerp is already unit length.
+    simd::Float4 scale = simd::select(
+        is_small,
+        simd::div(simd::splat(1),
+                  simd::sqrt(simd::add(simd::add(simd::mul(x, x),
+                                                 simd::mul(y, y)),
+                                       simd::mul(z, z)))),
+        simd::splat(1));
+    simd::store(&points.xs[i], simd::mul(x, scale));
+    simd::store(&points.ys[i], simd::mul(y, scale));
+    simd::store(&points.zs[i], simd::mul(z, scale));
+  }
+  for (; i < size; i++) {
+    points.set(i, slerp(from.get(i), to.get(i), t));
+  }
+}
+
+void getLongitudesAndLatitudes(const float *xs, const float *ys,
+                               const float *zs, std::size_t count,
+                               float *longitudes, float *latitudes) {
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    simd::Float4 x = simd::load(&xs[i]);
+    simd::Float4 y = simd::load(&ys[i]);
+    simd::Float4 z = simd::load(&zs[i]);
+    simd::Float4 longitude = atan2(y, x);
+    longitude = simd::select(simd::less(longitude, simd::splat(0)),
+                             simd::add(longitude, simd::splat(2 * kPi)),
+                             longitude);
+    simd::Float4 axis_distance =
+        simd::sqrt(simd::add(simd::mul(x, x), simd::mul(y, y)));
+    simd::store(&longitudes[i], longitude);
+    simd::store(&latitudes[i], atan2(z, axis_distance));
+  }
+  for (; i < count; i++) {
+    float longitude = atan2f(ys[i], xs[i]);
+    longitudes[i] = longitude < 0 ? longitude + (2 * kPi) : longitude;
+    latitudes[i] = atan2f(zs[i], sqrtf((xs[i] * xs[i]) + (ys[i] * ys[i])));
+  }
+}
+
+std::vector<float> getDistanceMatrix(const Points &points) {
+  std::size_t size = points.size();
+  std::vector<float> matrix(size * size);
+  // The matrix is symmetric, so only the tiles on and above the diagonal are
+  // computed, each mirrored into its twin below. Every tile writes cells no
+  // other tile does, so they can be split across threads as they are.
+  std::size_t tile_count = (size + kTileSize - 1) / kTileSize;
+  std::vector<std::pair<std::size_t, std::size_t>> tiles;
+  for (std::size_t tile_row = 0; tile_row < tile_count; tile_row++) {
+    for (std::size_t tile_column = tile_row; tile_column < tile_count;
+         tile_column++) {
+      tiles.emplace_back(tile_row * kTileSize, tile_column * kTileSize);
+    }
+  }
+  parallel::forRange(
+      0, static_cast<int>(tiles.size()), [&](int tiles_begin, int tiles_end) {
+        for (int tile = tiles_begin; tile < tiles_end; tile++) {
+          std::size_t row_begin = tiles[static_cast<std::size_t>(tile)].first;
+          std::size_t column_begin =
+              tiles[static_cast<std::size_t>(tile)].second;
+          std::size_t row_end = std::min(size, row_begin + kTileSize);
+          std::size_t column_end = std::min(size, column_begin + kTileSize);
+          for (std::size_t row = row_begin; row < row_end; row++) {
+            simd::Float4 from_x = simd::splat(points.xs[row]);
+            simd::Float4 from_y = simd::splat(points.ys[row]);
+            simd::Float4 from_z = simd::splat(points.zs[row]);
+            float *row_distances = &matrix[row * size];
+            // Within the diagonal tile, only the cells above the diagonal.
+            std::size_t column_start = std::max(column_begin, row);
+            std::size_t column = column_start;
+            for (; column_end - column >= 4; column += 4) {
+              simd::store(
+                  &row_distances[column],
+                  getDistances(from_x, from_y, from_z,
+                               simd::load(&points.xs[column]),
+                               simd::load(&points.ys[column]),
+                               simd::load(&points.zs[column])));
+            }
+            for (; column < column_end; column++) {
+              row_distances[column] =
+                  getDistance(points.get(row), points.get(column));
+            }
+            for (column = column_start; column < column_end; column++) {
+              matrix[(column * size) + row] = row_distances[column];
+            }
+          }
+        }
+      });
+  return matrix;
+}
+
+}  // namespace geodesy
+}  // namespace earth_world
@@ -0,0 +1,106 @@
+#ifndef EARTH_WORLD_GEODESY_H
+#define EARTH_WORLD_GEODESY_H
+
+#include <cstddef>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+namespace geodesy {
+/**
+ * Great circle computations on the unit sphere, for single points, and for
+ * batches of points in structure-of-arrays form four at a time with SIMD.
+ *
+ * Distances are found as atan2(|a x b|, a . b), which stays accurate both for
+ * nearby and for nearly antipodal points, where acos of the dot product does
+ * not. Bearings are in radians clockwise from north, in [-PI, PI]; they are
+ * undefined at the poles and between identical points, where they come out
+ * as 0.
+ *
+ * The batch kernels approximate the trigonometry with polynomials, to within
+ * about 1e-6 radians of the scalar functions, short of slerping between
+ * nearly antipodal points, which is ill conditioned either way.
+ */
+
+/** Points on the unit sphere, in structure-of-arrays form. */
+struct Points {
+  std::vector<float> xs;
+  std::vector<float> ys;
+  std::vector<float> zs;
+
+  std::size_t size() const { return xs.size(); }
+  void resize(std::size_t size) {
+    xs.resize(size);
+    ys.resize(size);
+    zs.resize(size);
+  }
+  void set(std::size_t i, const LVector3 &point) {
+    xs[i] = point.get_x();
+    ys[i] = point.get_y();
+    zs[i] = point.get_z();
+  }
+  LVector3 get(std::size_t i) const { return LVector3(xs[i], ys[i], zs[i]); }
+};
+
+/** @return The great circle distance between two unit vectors, in radians. */
+float getDistance(const LVector3 &from, const LVector3 &to);
+
+/** @return The bearing the great circle between two unit vectors starts in. */
+float getBearing(const LVector3 &from, const LVector3 &to);
+
+/**
+ * @param from The unit vector to start from.
+ * @param bearing The bearing to head off in.
+ * @param distance The distance to travel, in radians.
+ * @return The unit vector reached along the great circle.
+ */
+LVector3 getDestination(const LVector3 &from, float bearing, float distance);
+
+/**
+ * @param from The unit vector at t = 0.
+ * @param to The unit vector at t = 1, not antipodal to the first.
+ * @param t The fraction of the way along the great circle between them.
+ * @return The unit vector at that fraction of the way.
+ */
+LVector3 slerp(const LVector3 &from, const LVector3 &to, float t);
+
+/** Fills the distances between each pair of points at the same index. */
+void getDistances(const Points &from, const Points &to,
+                  std::vector<float> &distances);
+
+/** Fills the bearings between each pair of points at the same index. */
+void getBearings(const Points &from, const Points &to,
+                 std::vector<float> &bearings);
+
+/**
+ * Fills the destinations reached from each point, heading off in the bearing
+ * and travelling the distance at the same index.
+ */
+void getDestinations(const Points &from, const std::vector<float> &bearings,
+                     const std::vector<float> &distances,
+                     Points &destinations);
+
+/** Fills the points a fraction of the way between each pair of points. */
+void slerp(const Points &from, const Points &to, float t, Points &points);
+
+/**
+ * Fills the longitudes, in [0, 2 PI), and latitudes of points given as
+ * arrays of their coordinates, which need not be of unit length.
+ */
+void getLongitudesAndLatitudes(const float *xs, const float *ys,
+                               const float *zs, std::size_t count,
+                               float *longitudes, float *latitudes);
+
+/**
+ * Finds the distance between every pair of points, in square tiles small
+ * enough to stay in cache, split across all cores.
+ * @param points The points.
+ * @return The distance from point i to point j at index (i * size + j).
+ */
+std::vector<float> getDistanceMatrix(const Points &points);
+
+}  // namespace geodesy
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_GEODESY_H
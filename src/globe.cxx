@@ -1,10 +1,15 @@
 #include "globe.h"
 
+#include <algorithm>
+
+#include "cache.h"
 #include "filename.h"
+#include "horizon_map.h"
 #include "panda3d/graphicsEngine.h"
 #include "panda3d/graphicsStateGuardian.h"
 #include "panda3d/nodePath.h"
 #include "panda3d/texturePool.h"
+#include "shader_cache.h"
 #include "sphere_point.h"
 
 namespace earth_world {
@@ -15,12 +20,24 @@ const LVector2i kMainTexSize(16384, 8192);
 const LVector2i kNormalTexSize(16384, 8192);
 const LVector2i kVisibilityTexSize(2048, 1024);
 const LColor kVisibilityClearColor(0);
+const std::string kCountryBoundariesFilename = "country_boundaries.txt";
+/**
+ * The most rows of the coast field recomputed at once. Every band also reads
+ * the rows within reach of it, so wider bands waste less.
+ */
+const int kCoastBandRows = 64;
 
 Globe::Globe(GraphicsOutput *graphics_output)
-    : Globe(graphics_output, loadTex("topology", kMainTexSize, Texture::F_red),
-            loadTex("bathymetry", kMainTexSize, Texture::F_red),
-            loadTex("land_mask", kMainTexSize, Texture::F_red),
-            loadTex("albedo_1", kMainTexSize, Texture::F_rgb),
+    : Globe(graphics_output,
+            loadTex("topology", kMainTexSize, Texture::F_red,
+                    /* mipmap= */ true),
+            loadTex("bathymetry", kMainTexSize, Texture::F_red,
+                    /* mipmap= */ true),
+            // The land mask is only thresholded, and mostly read on the CPU.
+            loadTex("land_mask", kMainTexSize, Texture::F_red,
+                    /* mipmap= */ false),
+            loadTex("albedo_1", kMainTexSize, Texture::F_rgb,
+                    /* mipmap= */ true),
             buildVisibilityTex(kVisibilityTexSize), kLandMaskCutoff) {}
 
 Globe::Globe(GraphicsOutput *graphics_output, PT<Texture> topology_texture,
@@ -35,16 +52,30 @@ Globe::Globe(GraphicsOutput *graphics_output, PT<Texture> topology_texture,
                                      bathymetry_texture, land_mask_texture,
                                      land_mask_cutoff)},
       visibility_texture_{visibility_texture},
+      country_map_{filename::forData(kCountryBoundariesFilename)},
       visibility_compute_{"VisibilityCompute"},
-      land_mask_cutoff_{land_mask_cutoff} {
+      land_mask_cutoff_{land_mask_cutoff},
+      source_hash_{hashSources(topology_texture, bathymetry_texture,
+                               land_mask_texture, land_mask_cutoff)},
+      sea_level_{kGlobeWaterSurfaceHeight},
+      visibility_revision_{0},
+      last_visibility_position_{0} {
   // Load the topology into the CPU for city placement.
   topology_texture->store(topology_image_);
   // Load the land mask into the CPU for collision detection.
   land_mask_texture->store(land_mask_image_);
+  coast_distance_field_ =
+      CoastDistanceField(land_mask_image_, land_mask_cutoff_, source_hash_);
+  flood_map_ = FloodMap(topology_image_, bathymetry_texture, land_mask_image_,
+                        land_mask_cutoff_, coast_distance_field_.getWidth(),
+                        coast_distance_field_.getHeight(), source_hash_);
+  // Bake, or load, the horizon map from the CPU copies of the height maps.
+  horizon_texture_ = horizon_map::loadOrBake(topology_image_, land_mask_image_,
+                                             land_mask_cutoff_, source_hash_);
 
   // Set up recurring shader to update visibility mask.
-  PT<Shader> visibility_shader = Shader::load_compute(
-      Shader::SL_GLSL, filename::forShader("updateVisibility.comp"));
+  PT<Shader> visibility_shader =
+      shader_cache::loadCompute("updateVisibility.comp");
   visibility_compute_.set_shader(visibility_shader);
   visibility_compute_.set_shader_input("u_VisibilityTex", visibility_texture_);
 }
@@ -61,14 +92,111 @@ PT<Texture> Globe::getNormalTexture() { return normal_texture_; }
 
 PT<Texture> Globe::getVisibilityTexture() { return visibility_texture_; }
 
+PT<Texture> Globe::getHorizonTexture() { return horizon_texture_; }
+
 PN_stdfloat Globe::getLandMaskCutoff() const { return land_mask_cutoff_; }
 
+const PNMImage &Globe::getLandMaskImage() const { return land_mask_image_; }
+
+const PNMImage &Globe::getTopologyImage() const { return topology_image_; }
+
+const CountryMap &Globe::getCountryMap() const { return country_map_; }
+
+const CoastDistanceField &Globe::getCoastDistanceField() const {
+  return coast_distance_field_;
+}
+
+uint64_t Globe::getSourceHash() const { return source_hash_; }
+
+PN_stdfloat Globe::getSeaLevel() const { return sea_level_; }
+
+void Globe::setSeaLevel(PN_stdfloat sea_level) {
+  sea_level = std::max(kGlobeSeaFloorHeight, std::min(1.f, sea_level));
+  if (sea_level == sea_level_) {
+    return;
+  }
+  std::vector<uint8_t> changed_rows =
+      flood_map_.findChangedRows(sea_level_, sea_level);
+  sea_level_ = sea_level;
+  // Distances only move within reach of a change.
+  int height = coast_distance_field_.getHeight();
+  int reach = coast_distance_field_.getRowReach();
+  stale_coast_rows_.resize(static_cast<std::size_t>(height));
+  for (int row = 0; row < height; row++) {
+    if (changed_rows[static_cast<std::size_t>(row)] == 0) {
+      continue;
+    }
+    std::fill(stale_coast_rows_.begin() + std::max(0, row - reach),
+              stale_coast_rows_.begin() + std::min(height, row + reach + 1),
+              1);
+  }
+}
+
+bool Globe::isCoastStale() const {
+  return coast_update_.getRowCount() > 0 ||
+         std::find(stale_coast_rows_.begin(), stale_coast_rows_.end(), 1) !=
+             stale_coast_rows_.end();
+}
+
+bool Globe::stepCoastUpdate() {
+  if (coast_update_.getRowCount() > 0) {
+    return coast_update_.step();
+  }
+  std::vector<uint8_t>::iterator first_stale_row =
+      std::find(stale_coast_rows_.begin(), stale_coast_rows_.end(), 1);
+  if (first_stale_row == stale_coast_rows_.end()) {
+    return false;
+  }
+  int height = coast_distance_field_.getHeight();
+  int row_begin =
+      static_cast<int>(first_stale_row - stale_coast_rows_.begin());
+  int row_end = row_begin + 1;
+  while (row_end < height && row_end - row_begin < kCoastBandRows &&
+         stale_coast_rows_[static_cast<std::size_t>(row_end)] != 0) {
+    row_end++;
+  }
+  // Rows which go stale again before the band is applied are marked anew,
+  // and so recomputed once more after it.
+  std::fill(stale_coast_rows_.begin() + row_begin,
+            stale_coast_rows_.begin() + row_end, 0);
+
+  int reach = coast_distance_field_.getRowReach();
+  int water_row_begin = std::max(0, row_begin - reach);
+  std::vector<uint8_t> water = flood_map_.getWater(
+      sea_level_, water_row_begin, std::min(height, row_end + reach));
+  coast_update_ = CoastBandUpdate(coast_distance_field_, water,
+                                  water_row_begin, row_begin, row_end);
+  return false;
+}
+
+void Globe::applyCoastUpdate() {
+  if (coast_update_.getRowCount() == 0 || !coast_update_.isFinished()) {
+    return;
+  }
+  coast_distance_field_.setRows(coast_update_.getRowBegin(),
+                                coast_update_.getDistances());
+  coast_update_ = CoastBandUpdate();
+}
+
+unsigned int Globe::getVisibilityRevision() const {
+  return visibility_revision_;
+}
+
 bool Globe::isLandAtPoint(const SpherePoint2 &point) const {
   if (!kEnableLandCollision) {
     return false;
   }
-  PN_stdfloat land_mask_sample = sampleImage(land_mask_image_, point.toUV());
-  return land_mask_sample <= land_mask_cutoff_;
+  // The coast field is signed, negative over land.
+  return coast_distance_field_.getDistance(point.toCartesian()) < 0;
+}
+
+LVector3 Globe::moveAcrossWater(const LVector3 &from,
+                                const LVector3 &displacement,
+                                PN_stdfloat clearance) const {
+  if (!kEnableLandCollision) {
+    return (from + displacement).normalized();
+  }
+  return coast_distance_field_.sweep(from, displacement, clearance);
 }
 
 PN_stdfloat Globe::getHeightAtPoint(const SpherePoint2 &point) const {
@@ -89,6 +217,18 @@ void Globe::updateVisibility(GraphicsOutput *graphics_output,
     return;
   }
 
+  // Skip the dispatch while the player stays within the same texel, so that
+  // anything derived from the visibility texture can be left as is.
+  LVector3 position = player_position.toCartesian();
+  PN_stdfloat texel_angle =
+      2 * MathNumbers::pi / visibility_texture_->get_x_size();
+  if (visibility_revision_ > 0 &&
+      (position - last_visibility_position_).length() < texel_angle) {
+    return;
+  }
+  last_visibility_position_ = position;
+  visibility_revision_++;
+
   SpherePoint3 coords = player_position.toRadial();
   visibility_compute_.set_shader_input("u_PlayerSphericalCoords", coords);
   CPT<ShaderAttrib> attributes =
@@ -101,7 +241,7 @@ void Globe::updateVisibility(GraphicsOutput *graphics_output,
 
 PT<Texture> Globe::loadTex(const std::string &texture_base_name,
                            const LVector2i &texture_size,
-                           Texture::Format format) {
+                           Texture::Format format, bool mipmap) {
   LoaderOptions loader_options;
   loader_options.set_texture_flags(LoaderOptions::TF_float);
   int channel_count = 1;
@@ -133,6 +273,10 @@ PT<Texture> Globe::loadTex(const std::string &texture_base_name,
   texture->set_format(format);
   texture->set_wrap_u(SamplerState::WM_repeat);
   texture->set_wrap_v(SamplerState::WM_repeat);
+  // Mipmaps let the quality governor trade detail for bandwidth, at a third
+  // more memory, so they're only made for textures drawn minified.
+  texture->set_minfilter(mipmap ? SamplerState::FT_linear_mipmap_linear
+                                : SamplerState::FT_linear);
   texture->set_name(texture_base_name);
   return texture;
 }
@@ -166,8 +310,7 @@ PT<Texture> Globe::buildNormalTex(GraphicsOutput *graphics_output,
   normal_texture->set_wrap_u(SamplerState::WM_repeat);
 
   // Run one off calculate normals compute shader.
-  PT<Shader> shader = Shader::load_compute(
-      Shader::SL_GLSL, filename::forShader("calculateNormals.comp"));
+  PT<Shader> shader = shader_cache::loadCompute("calculateNormals.comp");
   NodePath compute_path("CalculateNormalsCompute");
   compute_path.set_shader(shader);
   compute_path.set_shader_input("u_LandMaskCutoff",
@@ -181,12 +324,28 @@ PT<Texture> Globe::buildNormalTex(GraphicsOutput *graphics_output,
   LVector3i work_groups(
       static_cast<int>(std::ceil(kNormalTexSize.get_x() / 16.0)),
       static_cast<int>(std::ceil(kNormalTexSize.get_y() / 16.0)), 1);
+  // Without a graphics output nothing is drawn, so the normals aren't needed.
+  if (graphics_output == nullptr) {
+    return normal_texture;
+  }
   GraphicsEngine *engine = graphics_output->get_engine();
   GraphicsStateGuardian *state_guardian = graphics_output->get_gsg();
   engine->dispatch_compute(work_groups, attributes, state_guardian);
   return normal_texture;
 }
 
+uint64_t Globe::hashSources(PT<Texture> topology_texture,
+                            PT<Texture> bathymetry_texture,
+                            PT<Texture> land_mask_texture,
+                            PN_stdfloat land_mask_cutoff) {
+  uint64_t hash = cache::kNoInputHash;
+  for (const PT<Texture> &texture :
+       {topology_texture, bathymetry_texture, land_mask_texture}) {
+    hash = cache::hashFile(texture->get_fullpath(), hash);
+  }
+  return cache::hashBytes(&land_mask_cutoff, sizeof(land_mask_cutoff), hash);
+}
+
 PN_stdfloat Globe::sampleImage(const PNMImage &image, const LPoint2 &uv) {
   LPoint2i pixel = LPoint2i(static_cast<int>(image.get_x_size() * uv.get_x()),
                             static_cast<int>(image.get_y_size() * uv.get_y()));
@@ -1,6 +1,12 @@
 #ifndef EARTH_WORLD_GLOBE_H
 #define EARTH_WORLD_GLOBE_H
 
+#include <cstdint>
+#include <vector>
+
+#include "coast_distance_field.h"
+#include "country_map.h"
+#include "flood_map.h"
 #include "panda3d/aa_luse.h"
 #include "panda3d/graphicsOutput.h"
 #include "panda3d/pnmImage.h"
@@ -11,9 +17,14 @@
 namespace earth_world {
 
 const PN_stdfloat kGlobeWaterSurfaceHeight = 0.95f;
+const PN_stdfloat kGlobeSeaFloorHeight = 0.94f;
 
 class Globe {
  public:
+  /**
+   * @param graphics_output The output to run compute shaders on, or null to
+   *     build only the globe's CPU side, with nothing to draw it on.
+   */
   explicit Globe(GraphicsOutput* graphics_output);
   Globe(GraphicsOutput* graphics_output, PT<Texture> topology_texture,
         PT<Texture> bathymetry_texture, PT<Texture> land_mask_texture,
@@ -31,20 +42,77 @@ class Globe {
   PT<Texture> getAlbedoTexture();
   PT<Texture> getNormalTexture();
   PT<Texture> getVisibilityTexture();
+  PT<Texture> getHorizonTexture();
   PN_stdfloat getLandMaskCutoff() const;
+  const PNMImage& getLandMaskImage() const;
+  const PNMImage& getTopologyImage() const;
+  const CountryMap& getCountryMap() const;
+  const CoastDistanceField& getCoastDistanceField() const;
+
+  /**
+   * @return The hash of the height maps' and land mask's source files, and
+   *     the land mask cutoff, for keying cache entries computed from them.
+   */
+  uint64_t getSourceHash() const;
+
+  /** @return The height of the sea's surface, from the globe's center. */
+  PN_stdfloat getSeaLevel() const;
+
+  /**
+   * Raises or lowers the sea, flooding land or laying bare the sea bed. Only
+   * the rows of the coast distance field around the coasts that move go
+   * stale, and collision catches up as they are recomputed.
+   * @param sea_level The height of the sea's surface, from the globe's
+   *     center. Clamped to between the deepest sea bed and the highest land.
+   */
+  void setSeaLevel(PN_stdfloat sea_level);
+
+  /** @return True if the coast distance field lags behind the sea level. */
+  bool isCoastStale() const;
 
   /**
-   * Tests whether there is land at the given unit sphere point.
+   * Takes a small step toward recomputing the next band of stale rows of the
+   * coast distance field, without touching the field itself, so that it may
+   * still be read meanwhile.
+   * @return True once the band is ready to apply.
+   */
+  bool stepCoastUpdate();
+
+  /** Applies the band of rows recomputed by stepCoastUpdate(). */
+  void applyCoastUpdate();
+
+  /**
+   * @return A number which changes whenever the contents of the visibility
+   *     texture change.
+   */
+  unsigned int getVisibilityRevision() const;
+
+  /**
+   * Tests whether there is land at the given unit sphere point, going by the
+   * coast distance field, so that it agrees with the coasts boats collide
+   * with, and follows the sea level as the field catches up with it.
    * @param point The point to test.
    * @return True if the given point rests on land.
    */
   bool isLandAtPoint(const SpherePoint2& point) const;
 
+  /**
+   * Moves a point across water, sliding along any coast in the way rather than
+   * crossing it.
+   * @param from The unit sphere position to move from.
+   * @param displacement The intended move, tangent to the unit sphere.
+   * @param clearance How far to keep from the coast, in radians.
+   * @return The unit sphere position the move ends at.
+   */
+  LVector3 moveAcrossWater(const LVector3& from, const LVector3& displacement,
+                           PN_stdfloat clearance) const;
+
   PN_stdfloat getHeightAtPoint(const SpherePoint2& point) const;
 
   /**
    * Updates the visible area of the globe to include what would be visible at
-   * the given player's spherical position.
+   * the given player's spherical position. Does nothing if the player hasn't
+   * moved by at least a texel of the visibility texture since the last update.
    * @param graphics_output The graphics output to run compute shaders on.
    * @param player_position The unit sphere position the player is currently at.
    */
@@ -58,12 +126,28 @@ class Globe {
   PT<Texture> albedo_texture_;
   PT<Texture> normal_texture_;
   PT<Texture> visibility_texture_;
+  /** The baked terrain horizon angles, for self-shadowing. */
+  PT<Texture> horizon_texture_;
 
   PNMImage topology_image_;
   PNMImage land_mask_image_;
+  /** The distance to the coast, for sweeping moves across water. */
+  CoastDistanceField coast_distance_field_;
+  /** Which country each point belongs to. */
+  CountryMap country_map_;
+  /** The sea level at which each point floods, at the coast field's size. */
+  FloodMap flood_map_;
 
   NodePath visibility_compute_;
   const PN_stdfloat land_mask_cutoff_;
+  const uint64_t source_hash_;
+  PN_stdfloat sea_level_;
+  /** Per row of the coast field, 1 where it lags behind the sea level. */
+  std::vector<uint8_t> stale_coast_rows_;
+  /** The band of the coast field being recomputed, if any. */
+  CoastBandUpdate coast_update_;
+  unsigned int visibility_revision_;
+  LVector3 last_visibility_position_;
 
   /**
    * Loads a texture with the given parameters, with filename
@@ -72,11 +156,13 @@ class Globe {
    * @param texture_size The pixel dimensions of the texture.
    * @param format The texture's format. Only accepts r,g,b,a,rg,rgb, and rgba.
    *     If not in the above, defaults to r.
+   * @param mipmap Whether to sample the texture through mipmaps, for
+   *     textures drawn minified.
    * @return The loaded texture.
    */
   static PT<Texture> loadTex(const std::string& texture_base_name,
                              const LVector2i& texture_size,
-                             Texture::Format format);
+                             Texture::Format format, bool mipmap);
 
   /** Creates the texture used for keeping track of what's visible. */
   static PT<Texture> buildVisibilityTex(const LVector2i& texture_size);
@@ -88,6 +174,12 @@ class Globe {
                                     PT<Texture> land_mask_texture,
                                     PN_stdfloat land_mask_cutoff);
 
+  /** Hashes the source files of the given textures, and the cutoff. */
+  static uint64_t hashSources(PT<Texture> topology_texture,
+                              PT<Texture> bathymetry_texture,
+                              PT<Texture> land_mask_texture,
+                              PN_stdfloat land_mask_cutoff);
+
   /** Samples the intensity of the image at the given point. */
   static PN_stdfloat sampleImage(const PNMImage& image, const LPoint2& uv);
 };
@@ -0,0 +1,318 @@
+#include "globe_picker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "cache.h"
+
+namespace earth_world {
+
+const int kWidth = 2048;
+const int kHeight = 1024;
+const uint32_t kCacheVersion = 1;
+const std::string kCacheName = "globe_picker_2048x1024.bin";
+/** The pyramid stops halving once its cells are this few rows tall. */
+const int kTopLevelHeight = 8;
+const int kMaxSteps = 1024;
+/** How far past a cell's edge the march steps, to land in the next cell. */
+const PN_stdfloat kExitNudge = 1e-5f;
+/** Absorbs rounding, when the ray has been stepped onto a cell's maximum. */
+const PN_stdfloat kRadiusEpsilon = 1e-6f;
+
+/**
+ * Intersects a ray with a sphere about the origin.
+ * @param origin The ray's origin.
+ * @param direction The ray's unit direction.
+ * @param radius The sphere's radius.
+ * @param t_near Filled with the distance along the ray to the first hit.
+ * @param t_far Filled with the distance along the ray to the second hit.
+ * @return True if the ray's line meets the sphere.
+ */
+static bool intersectSphere(const LPoint3 &origin, const LVector3 &direction,
+                            PN_stdfloat radius, PN_stdfloat &t_near,
+                            PN_stdfloat &t_far) {
+  PN_stdfloat b = origin.dot(direction);
+  PN_stdfloat c = origin.length_squared() - (radius * radius);
+  PN_stdfloat discriminant = (b * b) - c;
+  if (discriminant < 0) {
+    return false;
+  }
+  PN_stdfloat root = sqrtf(discriminant);
+  t_near = -b - root;
+  t_far = -b + root;
+  return true;
+}
+
+/**
+ * Finds the nearest point ahead where a ray crosses a cone of constant
+ * latitude, or the plane of the equator.
+ * @param point The ray's current point.
+ * @param direction The ray's unit direction.
+ * @param latitude The cone's latitude.
+ * @param distance Lowered to the distance to the crossing, if nearer.
+ */
+static void crossLatitude(const LPoint3 &point, const LVector3 &direction,
+                          PN_stdfloat latitude, PN_stdfloat &distance) {
+  // Solve z^2 = sin^2(latitude) |p|^2, which includes the opposite cone, so
+  // may stop early but never late. Near the poles this is badly conditioned,
+  // so it is solved in double precision, with the stable quadratic formula.
+  double sin_latitude = std::sin(static_cast<double>(latitude));
+  double sin_squared = sin_latitude * sin_latitude;
+  double z = point.get_z();
+  double dz = direction.get_z();
+  double along = static_cast<double>(point.get_x()) * direction.get_x() +
+                 static_cast<double>(point.get_y()) * direction.get_y() +
+                 (z * dz);
+  double radius_squared =
+      static_cast<double>(point.get_x()) * point.get_x() +
+      static_cast<double>(point.get_y()) * point.get_y() + (z * z);
+  double a = (dz * dz) - sin_squared;
+  double b = 2 * ((z * dz) - (sin_squared * along));
+  double c = (z * z) - (sin_squared * radius_squared);
+  double roots[2];
+  int root_count = 0;
+  double discriminant = (b * b) - (4 * a * c);
+  if (discriminant >= 0) {
+    double q = -0.5 * (b + std::copysign(std::sqrt(discriminant), b));
+    if (a != 0) {
+      roots[root_count++] = q / a;
+    }
+    if (q != 0) {
+      roots[root_count++] = c / q;
+    }
+  }
+  for (int i = 0; i < root_count; i++) {
+    if (roots[i] > 0) {
+      distance = std::min(distance, static_cast<PN_stdfloat>(roots[i]));
+    }
+  }
+}
+
+/**
+ * @return The distance of a point from the plane of a meridian, positive
+ *     towards greater longitudes.
+ */
+static PN_stdfloat getMeridianSide(const LVecBase3 &point,
+                                   PN_stdfloat longitude) {
+  return (point.get_y() * cosf(longitude)) - (point.get_x() * sinf(longitude));
+}
+
+/**
+ * Finds the nearest point ahead where a ray crosses the plane of a meridian.
+ * @param point The ray's current point.
+ * @param direction The ray's unit direction.
+ * @param longitude The meridian's longitude.
+ * @param distance Lowered to the distance to the crossing, if nearer.
+ */
+static void crossLongitude(const LPoint3 &point, const LVector3 &direction,
+                           PN_stdfloat longitude, PN_stdfloat &distance) {
+  PN_stdfloat speed = getMeridianSide(direction, longitude);
+  if (speed == 0) {
+    return;
+  }
+  PN_stdfloat root = -getMeridianSide(point, longitude) / speed;
+  if (root > 0) {
+    distance = std::min(distance, root);
+  }
+}
+
+GlobePicker::GlobePicker(const Globe &globe, const SphereIndex &city_index)
+    : city_index_(city_index) {
+  Level leaves;
+  leaves.width = kWidth;
+  leaves.height = kHeight;
+  std::vector<unsigned char> data;
+  std::size_t size = static_cast<std::size_t>(kWidth * kHeight);
+  if (cache::read(kCacheName, kCacheVersion, globe.getSourceHash(), data) &&
+      data.size() == size * sizeof(float)) {
+    leaves.max_radii.resize(size);
+    std::memcpy(leaves.max_radii.data(), data.data(), data.size());
+  } else {
+    leaves.max_radii = buildRadii(globe, kWidth, kHeight);
+    cache::write(kCacheName, kCacheVersion, globe.getSourceHash(),
+                 leaves.max_radii.data(),
+                 leaves.max_radii.size() * sizeof(float));
+  }
+  min_radius_ = *std::min_element(leaves.max_radii.begin(),
+                                  leaves.max_radii.end());
+  max_radius_ = *std::max_element(leaves.max_radii.begin(),
+                                  leaves.max_radii.end());
+  levels_.push_back(std::move(leaves));
+
+  // Each cell of a level bounds the 2x2 cells beneath it.
+  while (levels_.back().height > kTopLevelHeight) {
+    const Level &below = levels_.back();
+    Level level;
+    level.width = below.width / 2;
+    level.height = below.height / 2;
+    level.max_radii.resize(
+        static_cast<std::size_t>(level.width * level.height));
+    for (int y = 0; y < level.height; y++) {
+      for (int x = 0; x < level.width; x++) {
+        float max_radius = 0;
+        for (int corner = 0; corner < 4; corner++) {
+          int below_x = (2 * x) + (corner & 1);
+          int below_y = (2 * y) + (corner >> 1);
+          max_radius = std::max(
+              max_radius, below.max_radii[static_cast<std::size_t>(
+                              (below_y * below.width) + below_x)]);
+        }
+        level.max_radii[static_cast<std::size_t>((y * level.width) + x)] =
+            max_radius;
+      }
+    }
+    levels_.push_back(std::move(level));
+  }
+}
+
+bool GlobePicker::pick(const LPoint3 &origin, const LVector3 &direction,
+                       PN_stdfloat city_angle, GlobePick &result) const {
+  if (direction.length_squared() == 0) {
+    return false;
+  }
+  LVector3 unit_direction = direction.normalized();
+
+  // Clip the ray to the shell the surface lies within.
+  PN_stdfloat t_enter;
+  PN_stdfloat t_leave;
+  if (!intersectSphere(origin, unit_direction, max_radius_, t_enter,
+                       t_leave) ||
+      t_leave < 0) {
+    return false;
+  }
+  PN_stdfloat t = std::max<PN_stdfloat>(0, t_enter);
+  // Nothing lies below the lowest surface, so a ray reaching it has hit.
+  PN_stdfloat t_floor;
+  PN_stdfloat t_floor_far;
+  bool reaches_floor = intersectSphere(origin, unit_direction, min_radius_,
+                                       t_floor, t_floor_far) &&
+                       t_floor >= t;
+  PN_stdfloat t_end = reaches_floor ? t_floor : t_leave;
+
+  int top_level = static_cast<int>(levels_.size()) - 1;
+  int level = top_level;
+  bool hit = false;
+  for (int step = 0; step < kMaxSteps && t < t_end; step++) {
+    LPoint3 point = origin + (unit_direction * t);
+    PN_stdfloat cell_max_radius;
+    PN_stdfloat cell_exit =
+        getCellExit(point, unit_direction,
+                    levels_[static_cast<std::size_t>(level)], cell_max_radius);
+    if (point.length() <= cell_max_radius + kRadiusEpsilon) {
+      if (level == 0) {
+        // The ray came in through the side of a raised texel.
+        hit = true;
+        break;
+      }
+      level--;
+      continue;
+    }
+
+    // Everything in the cell is below the ray, so skip ahead until the ray
+    // either comes down to the cell's highest surface, or leaves the cell, in
+    // which case step just past its edge so the next cell is looked up.
+    PN_stdfloat t_next = std::min(t_end, t + cell_exit + kExitNudge);
+    PN_stdfloat t_surface;
+    PN_stdfloat t_surface_far;
+    if (intersectSphere(origin, unit_direction, cell_max_radius, t_surface,
+                        t_surface_far) &&
+        t_surface >= t - kRadiusEpsilon && t_surface <= t_next) {
+      t = std::max(t, t_surface);
+      if (level == 0) {
+        hit = true;
+        break;
+      }
+      level--;
+      continue;
+    }
+    t = t_next;
+    level = std::min(level + 1, top_level);
+  }
+  if (!hit) {
+    if (!reaches_floor || t < t_end) {
+      return false;
+    }
+    t = t_floor;
+  }
+
+  LPoint3 hit_point = origin + (unit_direction * t);
+  result.point = SpherePoint2::fromCartesian(hit_point);
+  result.radius = hit_point.length();
+  result.city_id = city_index_.getNearest(hit_point, city_angle);
+  return true;
+}
+
+PN_stdfloat GlobePicker::getCellExit(const LPoint3 &point,
+                                     const LVector3 &direction,
+                                     const Level &level,
+                                     PN_stdfloat &max_radius) const {
+  const PN_stdfloat pi = MathNumbers::pi;
+  PN_stdfloat latitude =
+      asinf(std::max(-1.f, std::min(1.f, point.get_z() / point.length())));
+  PN_stdfloat longitude = atan2f(point.get_y(), point.get_x());
+  if (longitude < 0) {
+    longitude += 2 * pi;
+  }
+  // Rows run from north to south.
+  PN_stdfloat cell_width = 2 * pi / level.width;
+  PN_stdfloat cell_height = pi / level.height;
+  int x = std::max(
+      0, std::min(level.width - 1, static_cast<int>(longitude / cell_width)));
+  int y = std::max(0, std::min(level.height - 1,
+                               static_cast<int>(((pi / 2) - latitude) /
+                                                cell_height)));
+  // Settle which side of the cell's edges the point is on with the same
+  // tests the exits use, since the angles above round differently.
+  if (y > 0 && point.get_z() > point.length() * sinf((pi / 2) -
+                                                      (y * cell_height))) {
+    y--;
+  } else if (y < level.height - 1 &&
+             point.get_z() <
+                 point.length() * sinf((pi / 2) - ((y + 1) * cell_height))) {
+    y++;
+  }
+  if (getMeridianSide(point, x * cell_width) < 0) {
+    x = (x + level.width - 1) % level.width;
+  } else if (getMeridianSide(point, (x + 1) * cell_width) > 0) {
+    x = (x + 1) % level.width;
+  }
+  max_radius =
+      level.max_radii[static_cast<std::size_t>((y * level.width) + x)];
+
+  PN_stdfloat distance = std::numeric_limits<PN_stdfloat>::infinity();
+  crossLatitude(point, direction, (pi / 2) - (y * cell_height), distance);
+  crossLatitude(point, direction, (pi / 2) - ((y + 1) * cell_height),
+                distance);
+  crossLongitude(point, direction, x * cell_width, distance);
+  crossLongitude(point, direction, (x + 1) * cell_width, distance);
+  return distance;
+}
+
+std::vector<float> GlobePicker::buildRadii(const Globe &globe, int width,
+                                           int height) {
+  const PNMImage &topology = globe.getTopologyImage();
+  const PNMImage &land_mask = globe.getLandMaskImage();
+  PNMImage topology_level(width, height, 1, topology.get_maxval());
+  topology_level.box_filter_from(0.5f, topology);
+  PNMImage land_mask_level(width, height, 1, land_mask.get_maxval());
+  land_mask_level.box_filter_from(0.5f, land_mask);
+
+  // Matches positionVertices.comp above water, and the water's surface.
+  std::vector<float> radii(static_cast<std::size_t>(width * height));
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      bool is_water =
+          land_mask_level.get_bright(x, y) > globe.getLandMaskCutoff();
+      float topology_sample = topology_level.get_bright(x, y);
+      radii[static_cast<std::size_t>((y * width) + x)] =
+          is_water ? kGlobeWaterSurfaceHeight
+                   : kGlobeWaterSurfaceHeight +
+                         (topology_sample * (1.f - kGlobeWaterSurfaceHeight));
+    }
+  }
+  return radii;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,92 @@
+#ifndef EARTH_WORLD_GLOBE_PICKER_H
+#define EARTH_WORLD_GLOBE_PICKER_H
+
+#include <vector>
+
+#include "globe.h"
+#include "panda3d/aa_luse.h"
+#include "sphere_index.h"
+#include "sphere_point.h"
+
+namespace earth_world {
+
+/** Where a pick ray met the globe's surface. */
+struct GlobePick {
+  /** The picked point, on the unit sphere. */
+  SpherePoint2 point;
+  /** The surface's distance from the globe's center at the point. */
+  PN_stdfloat radius;
+  /** The id of the nearest city within the pick radius, or -1 if none. */
+  int city_id;
+};
+
+/**
+ * Picks points on the globe's displaced surface by intersecting rays with its
+ * heightfield on the CPU, rather than colliding with the mesh, whose vertices
+ * are only ever displaced on the GPU.
+ *
+ * A ray is clipped to the shell between the lowest and highest surface, then
+ * marched through a pyramid of the maximum heights. While the ray is above a
+ * cell's maximum it can skip the whole cell in one step, so only the cells
+ * near the hit are visited at full resolution.
+ */
+class GlobePicker {
+ public:
+  /**
+   * Loads the heightfield from the cache, or builds it from the globe's CPU
+   * copies of its maps and caches it if missing.
+   * @param globe The globe to pick on.
+   * @param city_index Finds the cities near a picked point, by their ids.
+   */
+  GlobePicker(const Globe &globe, const SphereIndex &city_index);
+  GlobePicker(const GlobePicker &) = delete;
+  GlobePicker(GlobePicker &&) = delete;
+  GlobePicker &operator=(const GlobePicker &) = delete;
+  GlobePicker &operator=(GlobePicker &&) = delete;
+  ~GlobePicker() = default;
+
+  /**
+   * Intersects a ray with the globe's surface.
+   * @param origin The ray's origin, relative to the unit globe.
+   * @param direction The ray's direction, relative to the unit globe.
+   * @param city_angle The farthest a city may be from the hit, in radians.
+   * @param result Filled with where the ray hit, if it did.
+   * @return True if the ray hit the globe.
+   */
+  bool pick(const LPoint3 &origin, const LVector3 &direction,
+            PN_stdfloat city_angle, GlobePick &result) const;
+
+ protected:
+  /** The maximum radius of every cell at one level of the pyramid. */
+  struct Level {
+    int width;
+    int height;
+    std::vector<float> max_radii;
+  };
+
+  /** Level 0 holds the surface radius of every texel, north first. */
+  std::vector<Level> levels_;
+  float min_radius_;
+  float max_radius_;
+  const SphereIndex &city_index_;
+
+  /**
+   * Finds where a ray leaves the cell it is in, at one level of the pyramid.
+   * @param point The ray's current point, relative to the globe's center.
+   * @param direction The ray's unit direction.
+   * @param level The pyramid level to step through.
+   * @param max_radius Filled with the cell's maximum radius.
+   * @return The distance along the ray to the cell's edge. It may fall short
+   *     of the true edge, but never beyond it.
+   */
+  PN_stdfloat getCellExit(const LPoint3 &point, const LVector3 &direction,
+                          const Level &level, PN_stdfloat &max_radius) const;
+
+  /** Builds the surface radius of every texel, north first. */
+  static std::vector<float> buildRadii(const Globe &globe, int width,
+                                       int height);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_GLOBE_PICKER_H
@@ -27,13 +27,14 @@
 #include "panda3d/textureStage.h"
 #include "panda3d/windowFramework.h"
 #include "quaternion.h"
+#include "shader_cache.h"
 #include "typedefs.h"
 
 namespace earth_world {
 
 GlobeView::GlobeView(PT<GraphicsOutput> graphics_output, Globe& globe,
                      int vertices_per_edge)
-    : path_{"Globe"} {
+    : path_{"Globe"}, vertices_per_edge_{vertices_per_edge} {
   // Build the texture used to denote unexplored terrain.
   LoaderOptions loader_options;
   loader_options.set_texture_flags(LoaderOptions::TF_float);
@@ -47,13 +48,12 @@ GlobeView::GlobeView(PT<GraphicsOutput> graphics_output, Globe& globe,
   incognita_texture->set_name("incognita");
 
   // Build the material shader and apply all texture stages.
-  PT<Shader> material_shader =
-      Shader::load(Shader::SL_GLSL, filename::forShader("globe.vert"),
-                   filename::forShader("globe.frag"));
+  PT<Shader> material_shader = shader_cache::load("globe.vert", "globe.frag");
   mesh_path_ = buildGeometry(graphics_output, globe, vertices_per_edge);
   mesh_path_.set_shader(material_shader);
   mesh_path_.set_shader_input("u_LandMaskCutoff",
                              LVector2(globe.getLandMaskCutoff(), 0));
+  mesh_path_.set_shader_input("u_SeaLevel", LVector2(globe.getSeaLevel(), 0));
   setTextureStage(mesh_path_, globe.getTopologyTexture(), /* prio= */ 0);
   setTextureStage(mesh_path_, globe.getBathymetryTexture(), /* prio= */ 1);
   setTextureStage(mesh_path_, globe.getLandMaskTexture(), /* prio= */ 2);
@@ -61,11 +61,14 @@ GlobeView::GlobeView(PT<GraphicsOutput> graphics_output, Globe& globe,
   setTextureStage(mesh_path_, globe.getNormalTexture(), /* prio= */ 4);
   setTextureStage(mesh_path_, globe.getVisibilityTexture(), /* prio= */ 5);
   setTextureStage(mesh_path_, incognita_texture, /* prio= */ 6);
+  mesh_path_.set_shader_input("u_HorizonTex", globe.getHorizonTexture());
   mesh_path_.reparent_to(path_);
 }
 
 GlobeView::GlobeView(GlobeView&& other) noexcept
-    : path_{other.path_}, mesh_path_{other.mesh_path_} {
+    : path_{other.path_},
+      mesh_path_{other.mesh_path_},
+      vertices_per_edge_{other.vertices_per_edge_} {
   other.path_.clear();
   other.mesh_path_.clear();
 }
@@ -77,6 +80,7 @@ GlobeView& GlobeView::operator=(GlobeView&& other) noexcept {
   path_.remove_node();
   path_ = other.path_;
   mesh_path_ = other.mesh_path_;
+  vertices_per_edge_ = other.vertices_per_edge_;
   other.path_.clear();
   other.mesh_path_.clear();
   return *this;
@@ -88,6 +92,21 @@ NodePath GlobeView::getPath() const { return path_; }
 
 NodePath GlobeView::getMeshPath() const { return mesh_path_; }
 
+void GlobeView::setVerticesPerEdge(PT<GraphicsOutput> graphics_output,
+                                   Globe& globe, int vertices_per_edge) {
+  if (vertices_per_edge == vertices_per_edge_) {
+    return;
+  }
+  vertices_per_edge_ = vertices_per_edge;
+  // Swap the geoms and vertex buffer into the existing node, so that its
+  // shader, textures and lights carry over.
+  NodePath geometry = buildGeometry(graphics_output, globe, vertices_per_edge);
+  GeomNode *node = DCAST(GeomNode, mesh_path_.node());
+  node->remove_all_geoms();
+  node->add_geoms_from(DCAST(GeomNode, geometry.node()));
+  mesh_path_.set_shader_input(geometry.get_shader_input("u_VertexBuffer"));
+}
+
 NodePath GlobeView::buildGeometry(PT<GraphicsOutput> graphics_output,
                                   Globe& globe, int vertices_per_edge) {
   // Among the most important is the fact that arrays of types are not
@@ -145,8 +164,8 @@ NodePath GlobeView::buildGeometry(PT<GraphicsOutput> graphics_output,
   node->set_bounds_type(BoundingVolume::BT_box);
 
   // Run one off position vertices compute shader.
-  PT<Shader> position_vertices_shader = Shader::load_compute(
-      Shader::SL_GLSL, filename::forShader("positionVertices.comp"));
+  PT<Shader> position_vertices_shader =
+      shader_cache::loadCompute("positionVertices.comp");
   NodePath position_vertices("PositionVerticesCompute");
   position_vertices.set_shader(position_vertices_shader);
   position_vertices.set_shader_input("u_VerticesPerEdge",
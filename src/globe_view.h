@@ -35,9 +35,21 @@ class GlobeView {
   NodePath getPath() const;
   NodePath getMeshPath() const;
 
+  /**
+   * Rebuilds the globe's geometry at a different density, keeping the
+   * mesh's render state.
+   * @param graphics_output The output in which this globe is viewed.
+   * @param globe The globe model being rendered.
+   * @param vertices_per_edge The new number of vertices for each edge of the
+   *     sphere-cube.
+   */
+  void setVerticesPerEdge(PT<GraphicsOutput> graphics_output, Globe &globe,
+                          int vertices_per_edge);
+
  protected:
   NodePath path_;
   NodePath mesh_path_;
+  int vertices_per_edge_;
 
   /** Helper function to build a node containing the globe's geometry. */
   static NodePath buildGeometry(PT<GraphicsOutput> graphics_output,
@@ -0,0 +1,132 @@
+#include "headless.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "city_static_data.h"
+#include "globe.h"
+#include "horizon_culler.h"
+#include "input_log.h"
+#include "simulation.h"
+#include "sphere_index.h"
+#include "sphere_point.h"
+
+namespace earth_world {
+namespace headless {
+
+/** The simulated time the scripted boat takes to steer full circle. */
+const double kSteeringPeriod = 40;
+
+/**
+ * @param time The simulated time, in seconds.
+ * @return The scripted input, which steers the boat around in a slow circle
+ *     while zooming in and out.
+ */
+static LVector3 getScriptedInput(double time) {
+  double angle = 2 * MathNumbers::pi * time / kSteeringPeriod;
+  return LVector3(static_cast<PN_stdfloat>(std::cos(angle)),
+                  static_cast<PN_stdfloat>(std::sin(angle)),
+                  static_cast<PN_stdfloat>(std::sin(angle / 2)));
+}
+
+/**
+ * Steps the simulation, along with the CPU queries made each frame, and
+ * prints what happened.
+ * @param step_count The number of steps to take.
+ * @param input_log The input to replay, or null to follow the script.
+ * @return The exit status, nonzero if the boat ever ended up on land.
+ */
+static int runSteps(long step_count, const InputLog *input_log,
+                    std::ostream &output) {
+  std::chrono::steady_clock::time_point load_start =
+      std::chrono::steady_clock::now();
+  Globe globe(nullptr);
+  std::vector<LVector3> city_positions;
+  city_positions.reserve(kDefaultCities.size());
+  for (const CityStaticData &city : kDefaultCities) {
+    city_positions.push_back(city.getLocation().toCartesian());
+  }
+  SphereIndex city_index(city_positions);
+  HorizonCuller city_horizon_culler(city_positions, kGlobeWaterSurfaceHeight);
+  Simulation simulation(globe, kSimulationStepDuration, kFleetSize);
+  std::chrono::duration<double, std::milli> load_time =
+      std::chrono::steady_clock::now() - load_start;
+  output << "Loaded in " << load_time.count() << " ms" << std::endl;
+
+  int last_city_id = -1;
+  int reached_city_count = 0;
+  long land_step_count = 0;
+  double visible_city_total = 0;
+  std::chrono::steady_clock::time_point run_start =
+      std::chrono::steady_clock::now();
+  for (long step = 0; step < step_count; step++) {
+    if (input_log != nullptr) {
+      simulation.advance(globe, kSimulationStepDuration, *input_log);
+    } else {
+      simulation.setInput(getScriptedInput(static_cast<double>(step) *
+                                           kSimulationStepDuration));
+      simulation.advance(globe, kSimulationStepDuration);
+    }
+    const SimulationState &state = simulation.getState();
+
+    // The same queries the app makes each frame, but for drawing.
+    if (globe.isLandAtPoint(
+            SpherePoint2::fromCartesian(state.boat_unit_position))) {
+      land_step_count++;
+    }
+    int city_id = city_index.getNearest(
+        state.boat_unit_position,
+        kCityReachDistance / (globe.getSeaLevel() * kGlobeScale));
+    if (city_id >= 0 && city_id != last_city_id) {
+      reached_city_count++;
+    }
+    last_city_id = city_id;
+    LPoint3 camera_position =
+        (globe.getSeaLevel() + (state.camera_distance / kGlobeScale)) *
+        state.boat_unit_position;
+    city_horizon_culler.update(camera_position);
+    for (uint8_t visible : city_horizon_culler.getVisibility()) {
+      visible_city_total += visible;
+    }
+  }
+  std::chrono::duration<double, std::milli> run_time =
+      std::chrono::steady_clock::now() - run_start;
+
+  double steps = static_cast<double>(std::max(1L, step_count));
+  SpherePoint2 boat_point =
+      SpherePoint2::fromCartesian(simulation.getState().boat_unit_position);
+  output << "Simulated "
+         << static_cast<double>(step_count) * kSimulationStepDuration
+         << " s in " << step_count
+         << " steps, taking " << run_time.count() << " ms, "
+         << run_time.count() / steps << " ms per step" << std::endl;
+  output << "Reached " << reached_city_count << " cities, with "
+         << visible_city_total / steps << " of " << city_positions.size()
+         << " above the horizon on average" << std::endl;
+  output << "Ended at " << boat_point.getLatitude() << ", "
+         << boat_point.getLongitude()
+         << ", on land for " << land_step_count << " steps" << std::endl;
+  return land_step_count > 0 ? 1 : 0;
+}
+
+int run(double duration, std::ostream &output) {
+  return runSteps(std::lround(duration / kSimulationStepDuration), nullptr,
+                  output);
+}
+
+int replay(const Filename &filename, std::ostream &output) {
+  InputLog input_log(kSimulationStepDuration);
+  if (!input_log.read(filename)) {
+    output << "Could not read input log from " << filename << "."
+           << std::endl;
+    return 1;
+  }
+  return runSteps(static_cast<long>(input_log.getEndStep()), &input_log,
+                  output);
+}
+
+}  // namespace headless
+}  // namespace earth_world
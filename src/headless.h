@@ -0,0 +1,46 @@
+#ifndef EARTH_WORLD_HEADLESS_H
+#define EARTH_WORLD_HEADLESS_H
+
+#include <ostream>
+
+#include "panda3d/filename.h"
+
+namespace earth_world {
+namespace headless {
+/**
+ * Runs the simulation with no display, from the command line with
+ * --headless[=<seconds>] instead of opening a window, for soak tests and
+ * simulation on hosts without a GPU. The globe is loaded without a graphics
+ * output, so only its CPU side is built, and the boat is steered by a fixed
+ * script, so that every run takes the same course. Steps are taken as fast
+ * as they can be, rather than in real time. A recorded voyage can be
+ * replayed in place of the script, with --replay-fast=<file>.
+ *
+ * The globe's explored area isn't updated, as Globe::updateVisibility runs
+ * compute shaders, so the cost of that bookkeeping is left out of the
+ * reported step times.
+ */
+
+/**
+ * Steps the simulation through the given simulated time, along with the
+ * CPU queries made each frame, and prints what happened.
+ * @param duration The simulated time to run for, in seconds.
+ * @param output The stream to print results to.
+ * @return The exit status, nonzero if the boat ever ended up on land.
+ */
+int run(double duration, std::ostream &output);
+
+/**
+ * Replays recorded input, as fast as it can be, along with the CPU queries
+ * made each frame, and prints what happened.
+ * @param filename The input log to replay.
+ * @param output The stream to print results to.
+ * @return The exit status, nonzero if the log couldn't be read or the boat
+ *     ever ended up on land.
+ */
+int replay(const Filename &filename, std::ostream &output);
+
+}  // namespace headless
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_HEADLESS_H
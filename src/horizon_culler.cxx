@@ -0,0 +1,76 @@
+#include "horizon_culler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+
+namespace earth_world {
+
+HorizonCuller::HorizonCuller(const std::vector<LVector3> &positions,
+                             PN_stdfloat occluder_radius)
+    : occluder_radius_{occluder_radius} {
+  // Pad to a multiple of the SIMD width so the loop needs no scalar tail.
+  std::size_t padded_size = (positions.size() + 3) & ~std::size_t{3};
+  xs_.assign(padded_size, 0);
+  ys_.assign(padded_size, 0);
+  zs_.assign(padded_size, 0);
+  lift_cosines_.assign(padded_size, 1);
+  lift_sines_.assign(padded_size, 0);
+  visibility_.assign(positions.size(), 1);
+  for (std::size_t i = 0; i < positions.size(); i++) {
+    LVector3 direction = positions[i].normalized();
+    xs_[i] = direction.get_x();
+    ys_[i] = direction.get_y();
+    zs_[i] = direction.get_z();
+    // Points at or below the occluder can only be seen up to the horizon.
+    PN_stdfloat lift_cosine =
+        std::min(1.f, occluder_radius_ / positions[i].length());
+    lift_cosines_[i] = lift_cosine;
+    lift_sines_[i] = sqrtf(1 - (lift_cosine * lift_cosine));
+  }
+}
+
+bool HorizonCuller::update(const LPoint3 &camera_position) {
+  PN_stdfloat camera_distance = camera_position.length();
+  if (camera_distance <= occluder_radius_) {
+    return false;
+  }
+  // A point at radius r peeks over the occluder while its angle from the
+  // camera's direction is within acos(R / d) + acos(R / r). Both angles are
+  // at most a right angle, so comparing cosines instead, the threshold is
+  // cos(a) * cos(b) - sin(a) * sin(b), with the point's own terms kept.
+  PN_stdfloat horizon_cosine = occluder_radius_ / camera_distance;
+  PN_stdfloat horizon_sine = sqrtf(1 - (horizon_cosine * horizon_cosine));
+  LVector3 camera_direction = camera_position / camera_distance;
+
+  simd::Float4 camera_x = simd::splat(camera_direction.get_x());
+  simd::Float4 camera_y = simd::splat(camera_direction.get_y());
+  simd::Float4 camera_z = simd::splat(camera_direction.get_z());
+  simd::Float4 horizon_cosines = simd::splat(horizon_cosine);
+  simd::Float4 horizon_sines = simd::splat(horizon_sine);
+  bool changed = false;
+  for (std::size_t i = 0; i < visibility_.size(); i += 4) {
+    simd::Float4 dot = simd::add(
+        simd::add(simd::mul(simd::load(&xs_[i]), camera_x),
+                  simd::mul(simd::load(&ys_[i]), camera_y)),
+        simd::mul(simd::load(&zs_[i]), camera_z));
+    simd::Float4 thresholds =
+        simd::sub(simd::mul(horizon_cosines, simd::load(&lift_cosines_[i])),
+                  simd::mul(horizon_sines, simd::load(&lift_sines_[i])));
+    int mask = simd::moveMask(simd::greaterEqual(dot, thresholds));
+    std::size_t lanes = std::min<std::size_t>(4, visibility_.size() - i);
+    for (std::size_t lane = 0; lane < lanes; lane++) {
+      uint8_t visible = static_cast<uint8_t>((mask >> lane) & 1);
+      changed = changed || visible != visibility_[i + lane];
+      visibility_[i + lane] = visible;
+    }
+  }
+  return changed;
+}
+
+const std::vector<uint8_t> &HorizonCuller::getVisibility() const {
+  return visibility_;
+}
+
+}  // namespace earth_world
@@ -0,0 +1,59 @@
+#ifndef EARTH_WORLD_HORIZON_CULLER_H
+#define EARTH_WORLD_HORIZON_CULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+
+/**
+ * Determines which of a fixed set of points on or above the globe's surface
+ * can be seen from the camera, or are hidden behind the horizon. Positions are
+ * kept as a structure-of-arrays copy of unit directions, along with how far
+ * past the horizon each point's height lets it be seen, so the whole set is
+ * tested with one dot product per point, four points at a time.
+ */
+class HorizonCuller {
+ public:
+  /**
+   * @param positions The positions to test, relative to the globe's center.
+   * @param occluder_radius The radius of the sphere that hides points, the
+   *     surface the camera sees over.
+   */
+  HorizonCuller(const std::vector<LVector3> &positions,
+                PN_stdfloat occluder_radius);
+  HorizonCuller(const HorizonCuller &) = default;
+  HorizonCuller(HorizonCuller &&) noexcept = default;
+  HorizonCuller &operator=(const HorizonCuller &) = default;
+  HorizonCuller &operator=(HorizonCuller &&) noexcept = default;
+  ~HorizonCuller() = default;
+
+  /**
+   * Re-tests every point against the horizon as seen from the given camera.
+   * @param camera_position The camera's position, relative to the globe.
+   * @return True if the visibility of any point changed.
+   */
+  bool update(const LPoint3 &camera_position);
+
+  /** @return Per point, 1 if above the horizon, and 0 if hidden behind it. */
+  const std::vector<uint8_t> &getVisibility() const;
+
+ protected:
+  std::vector<float> xs_;
+  std::vector<float> ys_;
+  std::vector<float> zs_;
+  /**
+   * Per point, the cosine and sine of the angle past the horizon from which
+   * it still peeks over the occluder, acos(R / r) for a point at radius r.
+   */
+  std::vector<float> lift_cosines_;
+  std::vector<float> lift_sines_;
+  std::vector<uint8_t> visibility_;
+  PN_stdfloat occluder_radius_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_HORIZON_CULLER_H
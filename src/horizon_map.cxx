@@ -0,0 +1,145 @@
+#include "horizon_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cache.h"
+#include "globe.h"
+#include "parallel.h"
+
+namespace earth_world {
+namespace horizon_map {
+
+const int kWidth = 2048;
+const int kHeight = 1024;
+const int kPageCount = 2;
+const uint32_t kCacheVersion = 1;
+const std::string kCacheName = "horizon_map_2048x1024.bin";
+/** The farthest away, in radians, terrain can cast a shadow from. */
+const float kMaxShadowDistance = 0.04f;
+const int kStepsPerDirection = 16;
+/** Panda keeps 8-bit RGBA texels in BGRA order. */
+const int kChannelByteOffsets[4] = {2, 1, 0, 3};
+
+/** A heightfield in texture row order, from south to north. */
+struct Heightfield {
+  std::vector<float> radii;
+
+  float sample(float longitude, float latitude) const {
+    float u = longitude / (2 * static_cast<float>(MathNumbers::pi));
+    float v = (latitude / static_cast<float>(MathNumbers::pi)) + 0.5f;
+    int x = static_cast<int>(std::floor(u * kWidth)) % kWidth;
+    if (x < 0) {
+      x += kWidth;
+    }
+    int y = std::min(kHeight - 1,
+                     std::max(0, static_cast<int>(std::floor(v * kHeight))));
+    return radii[static_cast<std::size_t>((y * kWidth) + x)];
+  }
+};
+
+/**
+ * Filters the source images down to the bake resolution, and turns them into
+ * radii from the globe's center, matching positionVertices.comp above water.
+ */
+static Heightfield buildHeightfield(const PNMImage &topology,
+                                    const PNMImage &land_mask,
+                                    PN_stdfloat land_mask_cutoff) {
+  PNMImage topology_level(kWidth, kHeight, 1, topology.get_maxval());
+  topology_level.box_filter_from(0.5f, topology);
+  PNMImage land_mask_level(kWidth, kHeight, 1, land_mask.get_maxval());
+  land_mask_level.box_filter_from(0.5f, land_mask);
+
+  Heightfield heightfield;
+  heightfield.radii.resize(static_cast<std::size_t>(kWidth * kHeight));
+  for (int y = 0; y < kHeight; y++) {
+    // Images are stored from north to south, textures the other way.
+    int image_y = kHeight - 1 - y;
+    for (int x = 0; x < kWidth; x++) {
+      bool is_water = land_mask_level.get_bright(x, image_y) > land_mask_cutoff;
+      float topology_sample = topology_level.get_bright(x, image_y);
+      heightfield.radii[static_cast<std::size_t>((y * kWidth) + x)] =
+          is_water ? kGlobeWaterSurfaceHeight
+                   : kGlobeWaterSurfaceHeight +
+                         (topology_sample * (1.f - kGlobeWaterSurfaceHeight));
+    }
+  }
+  return heightfield;
+}
+
+/** Bakes the given rows of both pages of the horizon map. */
+static void bakeRows(const Heightfield &heightfield, int row_begin,
+                     int row_end, std::vector<unsigned char> &image) {
+  const float pi = static_cast<float>(MathNumbers::pi);
+  std::size_t page_size = static_cast<std::size_t>(kWidth * kHeight * 4);
+  for (int y = row_begin; y < row_end; y++) {
+    float latitude = (((y + 0.5f) / kHeight) - 0.5f) * pi;
+    float longitude_scale = 1.f / std::max(0.01f, cosf(latitude));
+    for (int x = 0; x < kWidth; x++) {
+      float longitude = ((x + 0.5f) / kWidth) * 2 * pi;
+      float radius = heightfield.radii[static_cast<std::size_t>(
+          (y * kWidth) + x)];
+      for (int direction = 0; direction < kDirectionCount; direction++) {
+        float azimuth = direction * 2 * pi / kDirectionCount;
+        float east = cosf(azimuth);
+        float north = sinf(azimuth);
+        // March outwards with growing steps, since nearby terrain matters
+        // most, and keep the steepest elevation angle seen.
+        float horizon = 0;
+        for (int step = 1; step <= kStepsPerDirection; step++) {
+          float t = static_cast<float>(step) / kStepsPerDirection;
+          float distance = kMaxShadowDistance * t * t;
+          float other_radius = heightfield.sample(
+              longitude + (distance * east * longitude_scale),
+              latitude + (distance * north));
+          // Account for the curvature of the globe.
+          float rise = (other_radius * cosf(distance)) - radius;
+          float run = other_radius * sinf(distance);
+          horizon = std::max(horizon, atan2f(rise, run));
+        }
+        int page = direction / 4;
+        int channel = direction % 4;
+        std::size_t offset =
+            (static_cast<std::size_t>(page) * page_size) +
+            (static_cast<std::size_t>((y * kWidth) + x) * 4) +
+            static_cast<std::size_t>(kChannelByteOffsets[channel]);
+        image[offset] = static_cast<unsigned char>(
+            std::min(255.f, (horizon / (pi / 2)) * 255.f + 0.5f));
+      }
+    }
+  }
+}
+
+PT<Texture> loadOrBake(const PNMImage &topology, const PNMImage &land_mask,
+                       PN_stdfloat land_mask_cutoff, uint64_t source_hash) {
+  std::vector<unsigned char> image;
+  std::size_t image_size =
+      static_cast<std::size_t>(kWidth * kHeight * 4 * kPageCount);
+  if (!cache::read(kCacheName, kCacheVersion, source_hash, image) ||
+      image.size() != image_size) {
+    Heightfield heightfield =
+        buildHeightfield(topology, land_mask, land_mask_cutoff);
+    image.assign(image_size, 0);
+    parallel::forRange(0, kHeight, [&](int row_begin, int row_end) {
+      bakeRows(heightfield, row_begin, row_end, image);
+    });
+    cache::write(kCacheName, kCacheVersion, source_hash, image.data(),
+                 image.size());
+  }
+
+  PT<Texture> texture = new Texture("HorizonMap");
+  texture->setup_2d_texture_array(kWidth, kHeight, kPageCount,
+                                  Texture::T_unsigned_byte, Texture::F_rgba8);
+  PTA_uchar ram_image = PTA_uchar::empty_array(image.size());
+  std::copy(image.begin(), image.end(), ram_image.begin());
+  texture->set_ram_image(ram_image);
+  texture->set_wrap_u(SamplerState::WM_repeat);
+  texture->set_wrap_v(SamplerState::WM_clamp);
+  texture->set_minfilter(SamplerState::FT_linear);
+  texture->set_magfilter(SamplerState::FT_linear);
+  return texture;
+}
+
+}  // namespace horizon_map
+}  // namespace earth_world
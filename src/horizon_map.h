@@ -0,0 +1,43 @@
+#ifndef EARTH_WORLD_HORIZON_MAP_H
+#define EARTH_WORLD_HORIZON_MAP_H
+
+#include <cstdint>
+
+#include "panda3d/pnmImage.h"
+#include "panda3d/texture.h"
+#include "typedefs.h"
+
+namespace earth_world {
+namespace horizon_map {
+/**
+ * Bakes, for every texel of the globe's heightfield, the elevation angle of
+ * the terrain's horizon in a fixed set of azimuth directions, so that the
+ * globe's shader can tell whether the sun is hidden behind terrain with a
+ * couple of fetches.
+ *
+ * The result is a two page 2D texture array: page 0 holds the directions
+ * east, north east, north, north west in its r, g, b, a channels, and page 1
+ * holds west, south west, south, south east. Angles are in [0, PI/2], scaled
+ * to [0, 1].
+ */
+
+/** The number of azimuth directions baked. */
+const int kDirectionCount = 8;
+
+/**
+ * Loads the horizon map from the cache, or bakes it across all cores and
+ * caches it if missing.
+ * @param topology The heightfield of the land.
+ * @param land_mask The mask of water, where brighter than the cutoff.
+ * @param land_mask_cutoff The cutoff between land and water.
+ * @param source_hash The hash of the sources of the images and the cutoff,
+ *     which the cached map must have been baked from.
+ * @return The horizon map texture.
+ */
+PT<Texture> loadOrBake(const PNMImage &topology, const PNMImage &land_mask,
+                       PN_stdfloat land_mask_cutoff, uint64_t source_hash);
+
+}  // namespace horizon_map
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_HORIZON_MAP_H
@@ -0,0 +1,97 @@
+#include "input_log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace earth_world {
+
+const uint32_t kMagic = 0x4C495745;  // "EWIL"
+/** Bumped whenever the layout of the log changes. */
+const uint32_t kVersion = 1;
+
+/** Precedes every log's entries. */
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  double step_duration;
+  uint64_t end_step;
+  uint64_t entry_count;
+};
+
+/** @return The given axis of the input, as stored in an entry. */
+static int8_t toEntryAxis(PN_stdfloat axis) {
+  return static_cast<int8_t>(std::lround(axis));
+}
+
+InputLog::InputLog(double step_duration)
+    : step_duration_{step_duration}, end_step_{0} {}
+
+void InputLog::record(unsigned long step, const LVector3 &input) {
+  Entry entry{static_cast<uint32_t>(step), toEntryAxis(input.get_x()),
+              toEntryAxis(input.get_y()), toEntryAxis(input.get_z()), 0};
+  if (!entries_.empty()) {
+    const Entry &last = entries_.back();
+    if (last.x == entry.x && last.y == entry.y && last.z == entry.z) {
+      return;
+    }
+    // A later change on the same step replaces the earlier one.
+    if (last.step == entry.step) {
+      entries_.pop_back();
+    }
+  }
+  entries_.push_back(entry);
+  end_step_ = std::max(end_step_, step);
+}
+
+LVector3 InputLog::getInput(unsigned long step) const {
+  // Find the last change on or before the step.
+  std::vector<Entry>::const_iterator next =
+      std::upper_bound(entries_.begin(), entries_.end(), step,
+                       [](unsigned long value, const Entry &entry) {
+                         return value < entry.step;
+                       });
+  if (next == entries_.begin()) {
+    return LVector3(0);
+  }
+  const Entry &entry = *(next - 1);
+  return LVector3(entry.x, entry.y, entry.z);
+}
+
+void InputLog::setEndStep(unsigned long end_step) { end_step_ = end_step; }
+
+unsigned long InputLog::getEndStep() const { return end_step_; }
+
+double InputLog::getStepDuration() const { return step_duration_; }
+
+bool InputLog::read(const Filename &filename) {
+  std::ifstream stream(filename.to_os_specific(), std::ios::binary);
+  Header header;
+  if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != kMagic || header.version != kVersion ||
+      header.step_duration != step_duration_) {
+    return false;
+  }
+  std::vector<Entry> entries(static_cast<std::size_t>(header.entry_count));
+  if (!stream.read(reinterpret_cast<char *>(entries.data()),
+                   static_cast<std::streamsize>(entries.size() *
+                                                sizeof(Entry)))) {
+    return false;
+  }
+  end_step_ = static_cast<unsigned long>(header.end_step);
+  entries_.swap(entries);
+  return true;
+}
+
+bool InputLog::write(const Filename &filename) const {
+  std::ofstream stream(filename.to_os_specific(),
+                       std::ios::binary | std::ios::trunc);
+  Header header{kMagic, kVersion, step_duration_, end_step_,
+                entries_.size()};
+  stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  stream.write(reinterpret_cast<const char *>(entries_.data()),
+               static_cast<std::streamsize>(entries_.size() * sizeof(Entry)));
+  return static_cast<bool>(stream);
+}
+
+}  // namespace earth_world
@@ -0,0 +1,85 @@
+#ifndef EARTH_WORLD_INPUT_LOG_H
+#define EARTH_WORLD_INPUT_LOG_H
+
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/filename.h"
+
+namespace earth_world {
+
+/**
+ * The user's input over a run, as the steps of the simulation it took effect
+ * on, so that the same voyage can be sailed again exactly. As the simulation
+ * is deterministic, the same input on the same steps always leads to the
+ * same states.
+ *
+ * Only changes to the input are kept, which makes for a compact log, as the
+ * input only changes on key presses. Changes to the sea level aren't kept,
+ * so a replay only follows a run which left the sea level alone.
+ */
+class InputLog {
+ public:
+  /** @param step_duration The simulated time each step covers, in seconds. */
+  explicit InputLog(double step_duration);
+
+  /**
+   * Records the input taking effect from the given step, if it differs from
+   * the input before.
+   * @param step The step the input takes effect on, no earlier than any
+   *     recorded before.
+   * @param input The user's input, where the X axis is horizontal motion,
+   *     the Y axis is vertical motion, the Z axis is zoom level.
+   */
+  void record(unsigned long step, const LVector3 &input);
+
+  /** @return The input in effect on the given step. */
+  LVector3 getInput(unsigned long step) const;
+
+  /** Sets the step the log ends on, once recorded up to it. */
+  void setEndStep(unsigned long end_step);
+
+  /** @return The step the log ends on. */
+  unsigned long getEndStep() const;
+
+  /** @return The simulated time each step covers, in seconds. */
+  double getStepDuration() const;
+
+  /**
+   * Reads a log, replacing this one's contents.
+   * @param filename The file to read the log from.
+   * @return True if the log was read, and was recorded with the same step
+   *     duration as this one.
+   */
+  bool read(const Filename &filename);
+
+  /**
+   * Writes the log, replacing any existing file.
+   * @param filename The file to write the log to.
+   * @return True if the log was written.
+   */
+  bool write(const Filename &filename) const;
+
+ protected:
+  /**
+   * One change to the input. The input's axes are each -1, 0 or 1, as the
+   * sum of the keys held, so they're stored as bytes.
+   */
+  struct Entry {
+    uint32_t step;
+    int8_t x;
+    int8_t y;
+    int8_t z;
+    int8_t unused;
+  };
+
+  double step_duration_;
+  unsigned long end_step_;
+  /** In order of step. */
+  std::vector<Entry> entries_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_INPUT_LOG_H
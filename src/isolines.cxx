@@ -0,0 +1,371 @@
+#include "isolines.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+
+#include "cache.h"
+#include "parallel.h"
+#include "sphere_point.h"
+
+namespace earth_world {
+namespace isolines {
+
+/** The side of the square tiles of cells traced on their own. */
+const int kTileSize = 256;
+const uint32_t kCacheVersion = 1;
+
+/**
+ * Per marching squares case, the segments through the cell, each from one
+ * edge to another, oriented so that the corners above the level are on the
+ * right. Corners are numbered clockwise from the north west, and the edges
+ * after the corner they start at, so the bits of a case are the corners
+ * above the level. -1 ends a case's list.
+ */
+const int kSegments[16][5] = {
+    {-1},        {0, 3, -1},        {1, 0, -1}, {1, 3, -1},
+    {2, 1, -1},  {0, 3, 2, 1, -1},  {2, 0, -1}, {2, 3, -1},
+    {3, 2, -1},  {0, 2, -1},        {1, 0, 3, 2, -1}, {1, 2, -1},
+    {3, 1, -1},  {0, 1, -1},        {3, 0, -1}, {-1},
+};
+/** The saddle cases' segments instead, where the cell's center is above. */
+const int kSaddleSegments[2][5] = {{0, 1, 2, 3, -1}, {3, 0, 1, 2, -1}};
+
+/**
+ * A piece of a line, between two crossings of the grid's edges, which are
+ * identified by a key unique to the edge.
+ */
+struct Chain {
+  int64_t first_key;
+  int64_t last_key;
+  std::vector<LVector3> points;
+};
+
+/**
+ * Links pieces of lines into longer ones, wherever one ends at the crossing
+ * another starts at.
+ * @param chains The pieces, which are consumed.
+ * @return The linked lines, where a closed line starts and ends at the same
+ *     crossing.
+ */
+static std::vector<Chain> linkChains(std::vector<Chain> &chains) {
+  std::unordered_map<int64_t, std::size_t> chains_by_first_key;
+  std::unordered_map<int64_t, std::size_t> chains_by_last_key;
+  chains_by_first_key.reserve(chains.size());
+  chains_by_last_key.reserve(chains.size());
+  for (std::size_t i = 0; i < chains.size(); i++) {
+    chains_by_first_key[chains[i].first_key] = i;
+    chains_by_last_key[chains[i].last_key] = i;
+  }
+
+  std::vector<Chain> linked;
+  std::vector<uint8_t> visited(chains.size(), 0);
+  auto follow = [&](std::size_t start) {
+    visited[start] = 1;
+    Chain chain = std::move(chains[start]);
+    while (true) {
+      auto next = chains_by_first_key.find(chain.last_key);
+      if (next == chains_by_first_key.end() || visited[next->second]) {
+        break;
+      }
+      visited[next->second] = 1;
+      const Chain &next_chain = chains[next->second];
+      // The chains share the crossing they meet at.
+      chain.points.insert(chain.points.end(), next_chain.points.begin() + 1,
+                          next_chain.points.end());
+      chain.last_key = next_chain.last_key;
+    }
+    linked.push_back(std::move(chain));
+  };
+  // Start open lines from their beginnings, then whatever is left is loops.
+  for (std::size_t i = 0; i < chains.size(); i++) {
+    if (!visited[i] &&
+        chains_by_last_key.find(chains[i].first_key) ==
+            chains_by_last_key.end()) {
+      follow(i);
+    }
+  }
+  for (std::size_t i = 0; i < chains.size(); i++) {
+    if (!visited[i]) {
+      follow(i);
+    }
+  }
+  return linked;
+}
+
+/**
+ * @return The sine of the angle from a unit vector to the great circle arc
+ *     between two others, or the distance to the nearest end of the arc
+ *     where the vector is beyond them.
+ */
+static PN_stdfloat getArcDistance(const LVector3 &point, const LVector3 &from,
+                                  const LVector3 &to) {
+  LVector3 normal = from.cross(to);
+  PN_stdfloat normal_length = normal.length();
+  if (normal_length < 1e-9f || from.cross(point).dot(normal) < 0 ||
+      point.cross(to).dot(normal) < 0) {
+    return std::min((point - from).length(), (point - to).length());
+  }
+  return std::abs(point.dot(normal)) / normal_length;
+}
+
+std::vector<Isoline> extract(const PNMImage &image, PN_stdfloat level,
+                             int width, int height, PN_stdfloat tolerance) {
+  // Resample the image to the grid, then sample the grid at every corner.
+  PNMImage grid_image(width, height, 1, image.get_maxval());
+  grid_image.box_filter_from(0.5f, image);
+  std::vector<float> values(static_cast<std::size_t>(width * height));
+  parallel::forRange(0, height, [&](int row_begin, int row_end) {
+    for (int y = row_begin; y < row_end; y++) {
+      for (int x = 0; x < width; x++) {
+        values[static_cast<std::size_t>((y * width) + x)] =
+            grid_image.get_bright(x, y) - level;
+      }
+    }
+  });
+  auto get_value = [&](int x, int y) {
+    return values[static_cast<std::size_t>((y * width) + (x % width))];
+  };
+  // Keys are even for edges running east from a corner, and odd for edges
+  // running south from it.
+  auto get_key = [&](int x, int y, int edge) {
+    int corner_x = edge == 1 ? x + 1 : x;
+    int corner_y = edge == 2 ? y + 1 : y;
+    int64_t corner =
+        (static_cast<int64_t>(corner_y) * width) + (corner_x % width);
+    return (corner * 2) + (edge % 2);
+  };
+  auto get_crossing = [&](int x, int y, int edge) {
+    PN_stdfloat grid_x = static_cast<PN_stdfloat>(x);
+    PN_stdfloat grid_y = static_cast<PN_stdfloat>(y);
+    if (edge % 2 == 0) {
+      int corner_y = edge == 2 ? y + 1 : y;
+      PN_stdfloat west = get_value(x, corner_y);
+      grid_x += west / (west - get_value(x + 1, corner_y));
+      grid_y = static_cast<PN_stdfloat>(corner_y);
+    } else {
+      int corner_x = edge == 1 ? x + 1 : x;
+      PN_stdfloat north = get_value(corner_x, y);
+      grid_y += north / (north - get_value(corner_x, y + 1));
+      grid_x = static_cast<PN_stdfloat>(corner_x);
+    }
+    SpherePoint2 point(
+        ((grid_x + 0.5f) / width) * 2 * MathNumbers::pi,
+        (0.5f - ((grid_y + 0.5f) / height)) * MathNumbers::pi);
+    return LVector3(point.toCartesian());
+  };
+
+  // Trace every tile on its own, linking the segments within it. The grid
+  // wraps around east to west, but not north to south.
+  int cell_rows = height - 1;
+  int tile_columns = (width + kTileSize - 1) / kTileSize;
+  int tile_rows = (cell_rows + kTileSize - 1) / kTileSize;
+  std::vector<std::vector<Chain>> tile_chains(
+      static_cast<std::size_t>(tile_columns * tile_rows));
+  parallel::forRange(
+      0, tile_columns * tile_rows, [&](int tile_begin, int tile_end) {
+        for (int tile = tile_begin; tile < tile_end; tile++) {
+          int x_begin = (tile % tile_columns) * kTileSize;
+          int y_begin = (tile / tile_columns) * kTileSize;
+          int x_end = std::min(width, x_begin + kTileSize);
+          int y_end = std::min(cell_rows, y_begin + kTileSize);
+          std::vector<Chain> segments;
+          for (int y = y_begin; y < y_end; y++) {
+            for (int x = x_begin; x < x_end; x++) {
+              int index = (get_value(x, y) > 0 ? 1 : 0) |
+                          (get_value(x + 1, y) > 0 ? 2 : 0) |
+                          (get_value(x + 1, y + 1) > 0 ? 4 : 0) |
+                          (get_value(x, y + 1) > 0 ? 8 : 0);
+              const int *edges = kSegments[index];
+              if ((index == 5 || index == 10) &&
+                  get_value(x, y) + get_value(x + 1, y) +
+                          get_value(x + 1, y + 1) + get_value(x, y + 1) >
+                      0) {
+                edges = kSaddleSegments[index == 5 ? 0 : 1];
+              }
+              for (int i = 0; edges[i] >= 0; i += 2) {
+                segments.push_back(
+                    Chain{get_key(x, y, edges[i]),
+                          get_key(x, y, edges[i + 1]),
+                          {get_crossing(x, y, edges[i]),
+                           get_crossing(x, y, edges[i + 1])}});
+              }
+            }
+          }
+          tile_chains[static_cast<std::size_t>(tile)] = linkChains(segments);
+        }
+      });
+
+  // Stitch the tiles' pieces into whole lines.
+  std::vector<Chain> chains;
+  for (std::vector<Chain> &pieces : tile_chains) {
+    std::move(pieces.begin(), pieces.end(), std::back_inserter(chains));
+  }
+  std::vector<Chain> linked = linkChains(chains);
+
+  std::vector<Isoline> isolines(linked.size());
+  parallel::forRange(
+      0, static_cast<int>(linked.size()), [&](int line_begin, int line_end) {
+        for (int line = line_begin; line < line_end; line++) {
+          Chain &chain = linked[static_cast<std::size_t>(line)];
+          Isoline isoline{std::move(chain.points),
+                          chain.first_key == chain.last_key};
+          if (isoline.closed) {
+            isoline.points.pop_back();
+          }
+          isolines[static_cast<std::size_t>(line)] =
+              simplify(isoline, tolerance);
+        }
+      });
+  return isolines;
+}
+
+std::vector<Isoline> loadOrExtract(const std::string &cache_name,
+                                   uint64_t source_hash,
+                                   const PNMImage &image, PN_stdfloat level,
+                                   int width, int height,
+                                   PN_stdfloat tolerance) {
+  // The parameters lead the entry, so that changing any of them retraces.
+  float parameters[2] = {level, tolerance};
+  int32_t size[2] = {width, height};
+  std::vector<unsigned char> data;
+  if (cache::read(cache_name, kCacheVersion, source_hash, data)) {
+    std::size_t offset = 0;
+    float cached_parameters[2];
+    int32_t cached_size[2];
+    uint32_t counts[2];
+    bool complete =
+        cache::readBytes(data, offset, cached_parameters,
+                         sizeof(cached_parameters)) &&
+        cache::readBytes(data, offset, cached_size, sizeof(cached_size)) &&
+        std::memcmp(parameters, cached_parameters, sizeof(parameters)) == 0 &&
+        std::memcmp(size, cached_size, sizeof(size)) == 0 &&
+        cache::readBytes(data, offset, counts, sizeof(counts));
+    std::vector<uint32_t> point_counts;
+    std::vector<uint8_t> closed;
+    std::vector<float> coordinates;
+    if (complete) {
+      point_counts.resize(counts[0]);
+      closed.resize(counts[0]);
+      coordinates.resize(static_cast<std::size_t>(counts[1]) * 3);
+      complete =
+          cache::readBytes(data, offset, point_counts.data(),
+                           point_counts.size() * sizeof(uint32_t)) &&
+          cache::readBytes(data, offset, closed.data(), closed.size()) &&
+          cache::readBytes(data, offset, coordinates.data(),
+                           coordinates.size() * sizeof(float)) &&
+          offset == data.size();
+    }
+    if (complete) {
+      std::vector<Isoline> isolines(counts[0]);
+      std::size_t coordinate = 0;
+      for (std::size_t i = 0; complete && i < isolines.size(); i++) {
+        complete = coordinates.size() - coordinate >= point_counts[i] * 3;
+        for (uint32_t j = 0; complete && j < point_counts[i]; j++) {
+          isolines[i].points.emplace_back(coordinates[coordinate],
+                                          coordinates[coordinate + 1],
+                                          coordinates[coordinate + 2]);
+          coordinate += 3;
+        }
+        isolines[i].closed = closed[i] != 0;
+      }
+      if (complete) {
+        return isolines;
+      }
+    }
+  }
+
+  std::vector<Isoline> isolines =
+      extract(image, level, width, height, tolerance);
+
+  std::vector<uint32_t> point_counts;
+  std::vector<uint8_t> closed;
+  std::vector<float> coordinates;
+  for (const Isoline &isoline : isolines) {
+    point_counts.push_back(static_cast<uint32_t>(isoline.points.size()));
+    closed.push_back(isoline.closed ? 1 : 0);
+    for (const LVector3 &point : isoline.points) {
+      coordinates.push_back(point.get_x());
+      coordinates.push_back(point.get_y());
+      coordinates.push_back(point.get_z());
+    }
+  }
+  uint32_t counts[2] = {static_cast<uint32_t>(isolines.size()),
+                        static_cast<uint32_t>(coordinates.size() / 3)};
+  data.clear();
+  cache::appendBytes(data, parameters, sizeof(parameters));
+  cache::appendBytes(data, size, sizeof(size));
+  cache::appendBytes(data, counts, sizeof(counts));
+  cache::appendBytes(data, point_counts.data(),
+                     point_counts.size() * sizeof(uint32_t));
+  cache::appendBytes(data, closed.data(), closed.size());
+  cache::appendBytes(data, coordinates.data(),
+                     coordinates.size() * sizeof(float));
+  cache::write(cache_name, kCacheVersion, source_hash, data.data(),
+               data.size());
+  return isolines;
+}
+
+Isoline simplify(const Isoline &isoline, PN_stdfloat tolerance) {
+  const std::vector<LVector3> &points = isoline.points;
+  std::size_t size = points.size();
+  if (size < 3) {
+    return isoline;
+  }
+  // Spans are between indices of kept points, where the index of the size
+  // stands for the first point again, closing the line.
+  std::vector<uint8_t> kept(size, 0);
+  std::vector<std::pair<std::size_t, std::size_t>> spans;
+  kept[0] = 1;
+  if (isoline.closed) {
+    // Split a closed line at its point farthest from the first, as no arc
+    // can stand in for a whole loop.
+    std::size_t farthest = 1;
+    for (std::size_t i = 2; i < size; i++) {
+      if (points[i].dot(points[0]) < points[farthest].dot(points[0])) {
+        farthest = i;
+      }
+    }
+    kept[farthest] = 1;
+    spans.emplace_back(0, farthest);
+    spans.emplace_back(farthest, size);
+  } else {
+    kept[size - 1] = 1;
+    spans.emplace_back(0, size - 1);
+  }
+  while (!spans.empty()) {
+    std::pair<std::size_t, std::size_t> span = spans.back();
+    spans.pop_back();
+    const LVector3 &from = points[span.first];
+    const LVector3 &to = points[span.second % size];
+    PN_stdfloat max_distance = 0;
+    std::size_t farthest = span.first;
+    for (std::size_t i = span.first + 1; i < span.second; i++) {
+      PN_stdfloat distance = getArcDistance(points[i], from, to);
+      if (distance > max_distance) {
+        max_distance = distance;
+        farthest = i;
+      }
+    }
+    if (max_distance > tolerance) {
+      kept[farthest] = 1;
+      spans.emplace_back(span.first, farthest);
+      spans.emplace_back(farthest, span.second);
+    }
+  }
+
+  Isoline simplified{{}, isoline.closed};
+  for (std::size_t i = 0; i < size; i++) {
+    if (kept[i]) {
+      simplified.points.push_back(points[i]);
+    }
+  }
+  return simplified;
+}
+
+}  // namespace isolines
+}  // namespace earth_world
@@ -0,0 +1,71 @@
+#ifndef EARTH_WORLD_ISOLINES_H
+#define EARTH_WORLD_ISOLINES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/pnmImage.h"
+
+namespace earth_world {
+namespace isolines {
+/**
+ * Traces the lines along which an image over the globe crosses a level, such
+ * as the coast in the land mask, or a depth in the bathymetry, as polylines.
+ *
+ * The image is traced by marching squares over a grid of tiles, each traced
+ * on its own across all cores, and the pieces that cross the tiles' borders
+ * are then stitched into whole lines, including across the antimeridian.
+ * Every line is oriented the same way, so that the side above the level is
+ * always on its right when seen from outside the globe.
+ */
+
+/** A line along which an image crosses a level. */
+struct Isoline {
+  /** The line's points, as unit vectors from the globe's center. */
+  std::vector<LVector3> points;
+  /** Whether the last point joins back up with the first. */
+  bool closed;
+};
+
+/**
+ * Traces the lines along which an image crosses a level, across all cores.
+ * @param image An equirectangular image over the globe, north first.
+ * @param level The level to trace, in the image's brightness.
+ * @param width The width of the grid the image is resampled to and traced.
+ * @param height The height of the grid the image is resampled to and traced.
+ * @param tolerance How far, in radians, the lines may be simplified.
+ * @return The lines.
+ */
+std::vector<Isoline> extract(const PNMImage &image, PN_stdfloat level,
+                             int width, int height, PN_stdfloat tolerance);
+
+/**
+ * Loads the lines from the cache, or traces them across all cores and caches
+ * them if missing, or traced from a different image or with different
+ * parameters.
+ * @param cache_name The name of the cache entry.
+ * @param source_hash The hash of the image's source, which the cached lines
+ *     must have been traced from.
+ * @see extract
+ */
+std::vector<Isoline> loadOrExtract(const std::string &cache_name,
+                                   uint64_t source_hash,
+                                   const PNMImage &image, PN_stdfloat level,
+                                   int width, int height,
+                                   PN_stdfloat tolerance);
+
+/**
+ * Simplifies a line by the Douglas-Peucker algorithm, dropping every point
+ * which is within the tolerance of the great circle arcs that replace it.
+ * @param isoline The line to simplify.
+ * @param tolerance How far, in radians, the simplified line may stray.
+ * @return The simplified line.
+ */
+Isoline simplify(const Isoline &isoline, PN_stdfloat tolerance);
+
+}  // namespace isolines
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_ISOLINES_H
@@ -1,26 +1,105 @@
+#include <cstdlib>
 #include <string>
 
 #include "app.h"
+#include "benchmark.h"
 #include "filename.h"
+#include "headless.h"
 #include "panda3d/load_prc_file.h"
 #include "panda3d/pStatClient.h"
 #include "panda3d/pandaFramework.h"
 #include "panda3d/windowFramework.h"
+#include "shader_cache.h"
 #include "typedefs.h"
 
 std::string const kWindowTitle("Earth World");
 LVector2i const kWindowSizeInitial(800, 600);
+std::string const kBenchmarkFlag("--benchmark=");
+std::string const kHeadlessFlag("--headless");
+std::string const kOffscreenFlag("--offscreen=");
+std::string const kRecordFlag("--record=");
+std::string const kReplayFlag("--replay=");
+std::string const kReplayFastFlag("--replay-fast=");
+/** The simulated time a headless run takes without one given, in seconds. */
+double const kHeadlessDurationDefault = 60;
+Filename const kOffscreenScreenshotFilename("offscreen.png");
 
-int run_app(PT<WindowFramework> window);
+int run_app(PT<WindowFramework> window, int frame_count,
+            const std::string &record_filename,
+            const std::string &replay_filename);
 
-int run_app(PT<WindowFramework> window) {
+/**
+ * @param frame_count The number of frames to draw before saving the last, or
+ *     0 to run until the window is closed.
+ * @param record_filename Where to record the input to, or empty to not.
+ * @param replay_filename The input log to replay, or empty to not.
+ */
+int run_app(PT<WindowFramework> window, int frame_count,
+            const std::string &record_filename,
+            const std::string &replay_filename) {
+  earth_world::shader_cache::open(window->get_graphics_output()->get_gsg());
   earth_world::App app(window);
+  earth_world::shader_cache::finishStartup(std::cout);
+  if (!record_filename.empty()) {
+    app.record(Filename::from_os_specific(record_filename));
+  }
+  if (!replay_filename.empty()) {
+    if (!app.replay(Filename::from_os_specific(replay_filename))) {
+      std::cout << "Could not read input log from " << replay_filename << "."
+                << std::endl;
+      return 1;
+    }
+  }
+  if (frame_count > 0) {
+    return app.runFrames(frame_count, kOffscreenScreenshotFilename);
+  }
   return app.run();
 }
 
 int main(int argc, char *argv[]) {
+  // Benchmarks run on the CPU alone, so they need neither config nor window.
+  for (int i = 1; i < argc; i++) {
+    std::string argument(argv[i]);
+    if (argument.compare(0, kBenchmarkFlag.size(), kBenchmarkFlag) == 0) {
+      return earth_world::benchmark::run(
+          argument.substr(kBenchmarkFlag.size()), std::cout);
+    }
+  }
+
   load_prc_file(earth_world::filename::kConfigFilename);
 
+  // Headless runs and fast replays open no window, and need no graphics pipe
+  // at all.
+  int offscreen_frame_count = 0;
+  std::string record_filename;
+  std::string replay_filename;
+  for (int i = 1; i < argc; i++) {
+    std::string argument(argv[i]);
+    if (argument.compare(0, kReplayFastFlag.size(), kReplayFastFlag) == 0) {
+      return earth_world::headless::replay(
+          Filename::from_os_specific(argument.substr(kReplayFastFlag.size())),
+          std::cout);
+    }
+    if (argument == kHeadlessFlag) {
+      return earth_world::headless::run(kHeadlessDurationDefault, std::cout);
+    }
+    if (argument.compare(0, kHeadlessFlag.size() + 1, kHeadlessFlag + "=") ==
+        0) {
+      return earth_world::headless::run(
+          std::atof(argument.c_str() + kHeadlessFlag.size() + 1), std::cout);
+    }
+    if (argument.compare(0, kOffscreenFlag.size(), kOffscreenFlag) == 0) {
+      offscreen_frame_count =
+          std::atoi(argument.c_str() + kOffscreenFlag.size());
+    }
+    if (argument.compare(0, kRecordFlag.size(), kRecordFlag) == 0) {
+      record_filename = argument.substr(kRecordFlag.size());
+    }
+    if (argument.compare(0, kReplayFlag.size(), kReplayFlag) == 0) {
+      replay_filename = argument.substr(kReplayFlag.size());
+    }
+  }
+
   if (PStatClient::is_connected()) {
     PStatClient::disconnect();
   }
@@ -28,6 +107,9 @@ int main(int argc, char *argv[]) {
     std::cout << "Could not connect to PStat server." << std::endl;
   }
 
+  // Drivers read their cache location once, when the first context is made.
+  earth_world::shader_cache::configureDriverCache();
+
   PandaFramework framework;
   framework.open_framework(argc, argv);
 
@@ -35,10 +117,19 @@ int main(int argc, char *argv[]) {
   window_properties.set_title(kWindowTitle);
   window_properties.set_size(kWindowSizeInitial);
   window_properties.set_fixed_size(false);
-  int flags = GraphicsPipe::BF_require_window;
+  // Render tests draw to an offscreen buffer, so they run without a display.
+  int flags = offscreen_frame_count > 0 ? GraphicsPipe::BF_refuse_window
+                                        : GraphicsPipe::BF_require_window;
   PT<WindowFramework> window = framework.open_window(window_properties, flags);
-  window->enable_keyboard();
+  if (window.is_null()) {
+    std::cout << "Could not open a graphics output." << std::endl;
+    return 1;
+  }
+  if (offscreen_frame_count == 0) {
+    window->enable_keyboard();
+  }
 
-  int exit_code = run_app(window);
+  int exit_code = run_app(window, offscreen_frame_count, record_filename,
+                          replay_filename);
   return exit_code;
 }
@@ -0,0 +1,73 @@
+#ifndef EARTH_WORLD_MIN_HEAP_H
+#define EARTH_WORLD_MIN_HEAP_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace earth_world {
+
+/**
+ * A priority queue popping the least value first, as a binary heap in a
+ * vector, for best first searches.
+ *
+ * It stands in for std::priority_queue, whose heap is indexed by signed
+ * distances, which -Wstrict-overflow rejects once inlined. Here every index
+ * is unsigned, and children are only computed once known to be in range.
+ */
+template <typename T>
+class MinHeap {
+ public:
+  MinHeap() = default;
+  MinHeap(const MinHeap &) = default;
+  MinHeap(MinHeap &&) noexcept = default;
+  MinHeap &operator=(const MinHeap &) = default;
+  MinHeap &operator=(MinHeap &&) noexcept = default;
+  ~MinHeap() = default;
+
+  bool empty() const { return values_.empty(); }
+
+  /** @return The least value. Only to be called when not empty. */
+  const T &top() const { return values_.front(); }
+
+  void push(const T &value) {
+    std::size_t index = values_.size();
+    values_.push_back(value);
+    while (index > 0) {
+      std::size_t parent = (index - 1) / 2;
+      if (!(values_[index] < values_[parent])) {
+        break;
+      }
+      std::swap(values_[index], values_[parent]);
+      index = parent;
+    }
+  }
+
+  /** Removes the least value. Only to be called when not empty. */
+  void pop() {
+    values_.front() = std::move(values_.back());
+    values_.pop_back();
+    std::size_t size = values_.size();
+    std::size_t index = 0;
+    // A child exists while the index is below half the size, and computing
+    // it then can't wrap.
+    while (index < size / 2) {
+      std::size_t child = (2 * index) + 1;
+      if (child + 1 < size && values_[child + 1] < values_[child]) {
+        child++;
+      }
+      if (!(values_[child] < values_[index])) {
+        break;
+      }
+      std::swap(values_[index], values_[child]);
+      index = child;
+    }
+  }
+
+ protected:
+  std::vector<T> values_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_MIN_HEAP_H
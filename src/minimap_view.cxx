@@ -1,15 +1,21 @@
 #include "minimap_view.h"
 
 #include "filename.h"
+#include "panda3d/camera.h"
+#include "panda3d/displayRegion.h"
 #include "panda3d/geom.h"
 #include "panda3d/geomNode.h"
 #include "panda3d/geomTriangles.h"
 #include "panda3d/geomVertexData.h"
 #include "panda3d/geomVertexFormat.h"
 #include "panda3d/geomVertexWriter.h"
+#include "panda3d/graphicsEngine.h"
 #include "panda3d/nodePath.h"
+#include "panda3d/orthographicLens.h"
+#include "panda3d/pnmImage.h"
 #include "panda3d/shader.h"
 #include "panda3d/texturePool.h"
+#include "shader_cache.h"
 #include "typedefs.h"
 
 namespace earth_world {
@@ -19,9 +25,28 @@ const PN_stdfloat kScreenMarginPct = 0.01f;
 const PN_stdfloat kBorderWidthPx = 2.f;
 const PN_stdfloat kAspectRatio = 2.f;
 const LColor kBorderColor(0.4, 0.2, 0.1, 1);
+const int kLandMaskLevelMinWidth = 64;
+const int kLandMaskLevelMaxWidth = 4096;
+const std::string kLandMaskStageName = "land_mask_stage";
 
-MinimapView::MinimapView(Globe &globe) : path_{"Minimap"} {
-  map_path_ = buildMapNode(globe);
+MinimapView::MinimapView(PT<GraphicsOutput> graphics_output, Globe &globe)
+    : path_{"Minimap"},
+      host_output_{graphics_output},
+      map_texture_{new Texture("MinimapTexture")},
+      map_scene_{"MinimapScene"},
+      map_size_{0},
+      drawn_visibility_revision_{0} {
+  map_texture_->set_wrap_u(SamplerState::WM_clamp);
+  map_texture_->set_wrap_v(SamplerState::WM_clamp);
+
+  map_scene_quad_ = buildMapSceneNode(globe);
+  map_scene_quad_.reparent_to(map_scene_);
+  map_scene_quad_.set_y(5);
+  map_scene_.set_depth_test(false);
+  map_scene_.set_depth_write(false);
+
+  map_path_ = buildQuad("MinimapMap");
+  map_path_.set_texture(map_texture_);
   border_path_ = buildBorderNode();
 
   border_path_.reparent_to(path_);
@@ -31,27 +56,57 @@ MinimapView::MinimapView(Globe &globe) : path_{"Minimap"} {
 MinimapView::MinimapView(MinimapView &&other)
     : path_{other.path_},
       map_path_{other.map_path_},
-      border_path_{other.border_path_} {
+      border_path_{other.border_path_},
+      host_output_{std::move(other.host_output_)},
+      map_buffer_{std::move(other.map_buffer_)},
+      map_texture_{std::move(other.map_texture_)},
+      map_scene_{other.map_scene_},
+      map_scene_quad_{other.map_scene_quad_},
+      map_camera_{other.map_camera_},
+      map_size_{other.map_size_},
+      land_mask_level_{std::move(other.land_mask_level_)},
+      drawn_visibility_revision_{other.drawn_visibility_revision_} {
   other.path_.clear();
   other.map_path_.clear();
   other.border_path_.clear();
+  other.map_scene_.clear();
+  other.map_scene_quad_.clear();
+  other.map_camera_.clear();
 }
 
 MinimapView &MinimapView::operator=(MinimapView &&other) {
   if (path_ == other.path_) {
     return *this;
   }
+  removeMapBuffer();
   path_.remove_node();
+  map_scene_.remove_node();
   path_ = other.path_;
   map_path_ = other.map_path_;
   border_path_ = other.border_path_;
+  host_output_ = std::move(other.host_output_);
+  map_buffer_ = std::move(other.map_buffer_);
+  map_texture_ = std::move(other.map_texture_);
+  map_scene_ = other.map_scene_;
+  map_scene_quad_ = other.map_scene_quad_;
+  map_camera_ = other.map_camera_;
+  map_size_ = other.map_size_;
+  land_mask_level_ = std::move(other.land_mask_level_);
+  drawn_visibility_revision_ = other.drawn_visibility_revision_;
   other.path_.clear();
   other.map_path_.clear();
   other.border_path_.clear();
+  other.map_scene_.clear();
+  other.map_scene_quad_.clear();
+  other.map_camera_.clear();
   return *this;
 }
 
-MinimapView::~MinimapView() { path_.remove_node(); }
+MinimapView::~MinimapView() {
+  removeMapBuffer();
+  map_scene_.remove_node();
+  path_.remove_node();
+}
 
 NodePath MinimapView::getPath() const { return path_; }
 
@@ -73,12 +128,82 @@ void MinimapView::onWindowResize(LVector2i new_window_size) {
 
   map_path_.set_pos(frame_x, 1, frame_y);
   map_path_.set_scale(map_width, 1, map_height);
+
+  // The map buffer itself is resized on the next update.
+  map_size_.set(std::max(1, static_cast<int>(std::ceil(map_width))),
+                std::max(1, static_cast<int>(std::ceil(map_height))));
+}
+
+void MinimapView::update(const Globe &globe) {
+  if (map_size_.get_x() <= 0 || map_size_.get_y() <= 0) {
+    return;
+  }
+  bool resized = map_buffer_ == nullptr ||
+                 map_buffer_->get_x_size() != map_size_.get_x() ||
+                 map_buffer_->get_y_size() != map_size_.get_y();
+  if (resized) {
+    resizeMapBuffer(globe, map_size_);
+  }
+  unsigned int revision = globe.getVisibilityRevision();
+  if (resized || revision != drawn_visibility_revision_) {
+    drawn_visibility_revision_ = revision;
+    redraw();
+  }
 }
 
-NodePath MinimapView::buildMapNode(Globe &globe) {
+void MinimapView::resizeMapBuffer(const Globe &globe,
+                                  const LVector2i &map_size) {
+  removeMapBuffer();
+  if (host_output_ == nullptr) {
+    return;
+  }
+  map_buffer_ = host_output_->make_texture_buffer(
+      "MinimapBuffer", map_size.get_x(), map_size.get_y(), map_texture_,
+      /* to_ram= */ false);
+  if (map_buffer_ == nullptr) {
+    return;
+  }
+  map_buffer_->set_clear_color_active(false);
+
+  PT<OrthographicLens> lens = new OrthographicLens;
+  lens->set_film_size(1, 1);
+  lens->set_near_far(1, 10);
+  PT<Camera> camera = new Camera("MinimapCamera", lens);
+  map_camera_ = map_scene_.attach_new_node(camera);
+  DisplayRegion *display_region = map_buffer_->make_display_region();
+  display_region->set_camera(map_camera_);
+
+  // Only sample as much of the land mask as the map can show.
+  int level_width = getLandMaskLevelWidth(map_size.get_x());
+  if (land_mask_level_ == nullptr ||
+      land_mask_level_->get_x_size() != level_width) {
+    land_mask_level_ = buildLandMaskLevel(globe, level_width);
+    TextureStage *stage =
+        map_scene_quad_.find_texture_stage(kLandMaskStageName);
+    map_scene_quad_.set_texture(stage, land_mask_level_, /* prio= */ 0);
+  }
+}
+
+void MinimapView::removeMapBuffer() {
+  if (map_buffer_ != nullptr) {
+    map_buffer_->get_engine()->remove_window(map_buffer_);
+    map_buffer_ = nullptr;
+  }
+  map_camera_.remove_node();
+}
+
+void MinimapView::redraw() {
+  if (map_buffer_ == nullptr) {
+    return;
+  }
+  map_buffer_->set_active(true);
+  map_buffer_->set_one_shot(true);
+}
+
+NodePath MinimapView::buildQuad(const std::string &name) {
   PT<GeomTriangles> triangles = new GeomTriangles(Geom::UH_static);
   PT<GeomVertexData> vertex_data = new GeomVertexData(
-      "MinimapMap", GeomVertexFormat::get_v3t2(), Geom::UH_static);
+      name, GeomVertexFormat::get_v3t2(), Geom::UH_static);
   vertex_data->set_num_rows(4);
   GeomVertexWriter vertices(vertex_data, "vertex");
   GeomVertexWriter uvs(vertex_data, "texcoord");
@@ -95,17 +220,20 @@ NodePath MinimapView::buildMapNode(Globe &globe) {
   triangles->close_primitive();
   PT<Geom> geom = new Geom(vertex_data);
   geom->add_primitive(triangles);
-  PT<GeomNode> geom_node = new GeomNode("MinimapMap");
+  PT<GeomNode> geom_node = new GeomNode(name);
   geom_node->add_geom(geom);
+  return NodePath(geom_node);
+}
 
-  NodePath path = NodePath(geom_node);
+NodePath MinimapView::buildMapSceneNode(Globe &globe) {
+  NodePath path = buildQuad("MinimapMap");
   PT<Shader> minimap_shader =
-      Shader::load(Shader::SL_GLSL, filename::forShader("minimap.vert"),
-                   filename::forShader("minimap.frag"));
+      shader_cache::load("minimap.vert", "minimap.frag");
   path.set_shader(minimap_shader);
   path.set_shader_input("u_LandMaskCutoff",
                         LVector2(globe.getLandMaskCutoff(), 0));
 
+  // Until the map is sized, sample the full land mask.
   PT<Texture> land_mask_tex = globe.getLandMaskTexture();
   PT<Texture> visibility_tex = globe.getVisibilityTexture();
   LoaderOptions loader_options;
@@ -117,9 +245,11 @@ NodePath MinimapView::buildMapNode(Globe &globe) {
   incognita_tex->set_format(Texture::F_rgb);
   incognita_tex->set_wrap_u(SamplerState::WM_repeat);
   incognita_tex->set_wrap_v(SamplerState::WM_repeat);
+  // The paper is heavily minified on the map, so let the driver mipmap it.
+  incognita_tex->set_minfilter(SamplerState::FT_linear_mipmap_linear);
   incognita_tex->set_name("incognita");
 
-  path.set_texture(new TextureStage("land_mask_stage"), land_mask_tex,
+  path.set_texture(new TextureStage(kLandMaskStageName), land_mask_tex,
                    /* prio= */ 0);
   path.set_texture(new TextureStage("visibility_stage"), visibility_tex,
                    /* prio= */ 1);
@@ -155,4 +285,29 @@ NodePath MinimapView::buildBorderNode() {
   return path;
 }
 
+int MinimapView::getLandMaskLevelWidth(int map_width) {
+  int width = kLandMaskLevelMinWidth;
+  while (width < map_width && width < kLandMaskLevelMaxWidth) {
+    width <<= 1;
+  }
+  return width;
+}
+
+PT<Texture> MinimapView::buildLandMaskLevel(const Globe &globe, int width) {
+  const PNMImage &land_mask = globe.getLandMaskImage();
+  int height = std::max(
+      1, width * land_mask.get_y_size() / std::max(1, land_mask.get_x_size()));
+  PNMImage level(width, height, /* num_channels= */ 1,
+                 land_mask.get_maxval());
+  level.box_filter_from(0.5f, land_mask);
+
+  PT<Texture> texture = new Texture("land_mask_level");
+  texture->load(level);
+  texture->set_wrap_u(SamplerState::WM_repeat);
+  texture->set_wrap_v(SamplerState::WM_clamp);
+  texture->set_minfilter(SamplerState::FT_linear);
+  texture->set_magfilter(SamplerState::FT_linear);
+  return texture;
+}
+
 }  // namespace earth_world
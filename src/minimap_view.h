@@ -2,16 +2,26 @@
 #define EARTH_WORLD_MINIMAP_H
 
 #include "globe.h"
+#include "panda3d/graphicsOutput.h"
 #include "panda3d/nodePath.h"
+#include "panda3d/texture.h"
 #include "panda3d/windowFramework.h"
 #include "typedefs.h"
 
 namespace earth_world {
 
-/** Visualizes a minimap in the corner of the screen. */
+/**
+ * Visualizes a minimap in the corner of the screen. The map is rendered into
+ * an offscreen texture, which is only redrawn when the globe's visibility
+ * changes or the window is resized, and otherwise shown as is.
+ */
 class MinimapView {
  public:
-  MinimapView(Globe &globe);
+  /**
+   * @param graphics_output The output which hosts the offscreen map buffer.
+   * @param globe The globe to map.
+   */
+  MinimapView(PT<GraphicsOutput> graphics_output, Globe &globe);
   MinimapView(const MinimapView &) = delete;
   MinimapView(MinimapView &&);
   MinimapView &operator=(const MinimapView &) = delete;
@@ -22,16 +32,60 @@ class MinimapView {
 
   void onWindowResize(LVector2i new_window_size);
 
+  /**
+   * Redraws the map texture if the globe's visibility has changed since it
+   * was last drawn.
+   * @param globe The globe being mapped.
+   */
+  void update(const Globe &globe);
+
  protected:
   NodePath path_;
   NodePath map_path_;
   NodePath border_path_;
 
-  /** Builds the node for rendering the map. */
-  static NodePath buildMapNode(Globe &globe);
+  PT<GraphicsOutput> host_output_;
+  PT<GraphicsOutput> map_buffer_;
+  PT<Texture> map_texture_;
+  /** The scene rendered into the map texture. */
+  NodePath map_scene_;
+  NodePath map_scene_quad_;
+  NodePath map_camera_;
+  LVector2i map_size_;
+  /** The land mask, filtered down to the map's resolution. */
+  PT<Texture> land_mask_level_;
+  /** The globe's visibility revision when the map was last drawn. */
+  unsigned int drawn_visibility_revision_;
+
+  /**
+   * Recreates the offscreen buffer and land mask level for the given map
+   * pixel size.
+   */
+  void resizeMapBuffer(const Globe &globe, const LVector2i &map_size);
+
+  /** Releases the offscreen buffer, if there is one. */
+  void removeMapBuffer();
+
+  /** Schedules the map texture to be rendered once, on the next frame. */
+  void redraw();
+
+  /** Builds a unit quad in the XZ plane, centered on the origin. */
+  static NodePath buildQuad(const std::string &name);
+
+  /** Builds the node which draws the map into the map texture. */
+  static NodePath buildMapSceneNode(Globe &globe);
 
   /** Builds the node for rendering the border frame behind the map. */
   static NodePath buildBorderNode();
+
+  /**
+   * @return The smallest power of two width at least as large as the given
+   *     map width, within the supported range of land mask levels.
+   */
+  static int getLandMaskLevelWidth(int map_width);
+
+  /** Filters the land mask down to the given width, keeping its aspect. */
+  static PT<Texture> buildLandMaskLevel(const Globe &globe, int width);
 };
 
 }  // namespace earth_world
@@ -0,0 +1,342 @@
+#include "ocean_currents.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "geodesy.h"
+#include "simd.h"
+
+namespace earth_world {
+
+/**
+ * The raster's size, which is coarse, as currents vary slowly in space. The
+ * width and the tile size are powers of two, so that texels are found with
+ * masks and shifts.
+ */
+const int kWidth = 128;
+const int kHeight = 64;
+/** The width and height of a tile, in texels. */
+const int kTileSize = 8;
+const int kTilesAcross = kWidth / kTileSize;
+/** Velocities are clamped to this, in radians per second. */
+const float kMaxSpeed = 0.01f;
+const float kQuantizationScale = 32767.f / kMaxSpeed;
+const float kDequantizationScale = kMaxSpeed / 32767.f;
+/** The number of points whose raster positions are found at once. */
+const std::size_t kVelocityBatchSize = 256;
+/** The number of points sampled together. */
+const std::size_t kLaneCount = 4;
+/**
+ * The least distance from the globe's axis that east and north are found
+ * at, below which velocities fade to nothing.
+ */
+const float kMinAxisDistance = 1e-6f;
+/** The simulated time each advection covers, in seconds. */
+const double kAdvanceInterval = 1;
+/** How long the currents take to settle toward the driven ones. */
+const double kRelaxationTime = 30;
+/** The simulated time the driven currents take to vary full circle. */
+const double kDriftPeriod = 600;
+/**
+ * The least width of a texel toward the poles, relative to the equator, so
+ * that water traced back across a pole doesn't go around it many times.
+ */
+const float kMinTexelWidth = 0.01f;
+
+/** @return The latitude of a row's texel centers. */
+static float getRowLatitude(int y) {
+  return static_cast<float>(MathNumbers::pi) *
+         (0.5f - ((static_cast<float>(y) + 0.5f) / kHeight));
+}
+
+/** @return The longitude of a column's texel centers. */
+static float getColumnLongitude(int x) {
+  return 2 * static_cast<float>(MathNumbers::pi) *
+         ((static_cast<float>(x) + 0.5f) / kWidth);
+}
+
+/**
+ * Finds the velocity the winds drive at a point: westward along the equator
+ * under the trade winds, eastward at mid latitudes under the westerlies, and
+ * meandering with waves which drift east over time.
+ * @param longitude The point's longitude.
+ * @param latitude The point's latitude.
+ * @param time The simulated time, in seconds.
+ * @param east Filled with the eastward velocity.
+ * @param north Filled with the northward velocity.
+ */
+static void getDrivenVelocity(float longitude, float latitude, double time,
+                              float &east, float &north) {
+  float phase = static_cast<float>(2 * MathNumbers::pi *
+                                   std::fmod(time / kDriftPeriod, 1.0));
+  // Fade out toward the poles, where east and north are ill defined.
+  float scale = kMaxSpeed * cosf(latitude);
+  east = scale * ((-0.6f * cosf(4 * latitude)) +
+                  (0.3f * sinf((3 * longitude) + (2 * latitude) - phase)));
+  north = scale * 0.3f * cosf((3 * longitude) - phase);
+}
+
+/**
+ * Blends four values per lane bilinearly, and scales them back from 16 bits.
+ * @param corners The top left, top right, bottom left and bottom right
+ *     values of each lane.
+ * @param fx The fraction of the way from left to right.
+ * @param fy The fraction of the way from top to bottom.
+ */
+static simd::Float4 bilerp(const float corners[4][kLaneCount],
+                           simd::Float4 fx, simd::Float4 fy) {
+  simd::Float4 top_left = simd::load(corners[0]);
+  simd::Float4 bottom_left = simd::load(corners[2]);
+  simd::Float4 top = simd::add(
+      top_left, simd::mul(simd::sub(simd::load(corners[1]), top_left), fx));
+  simd::Float4 bottom = simd::add(
+      bottom_left,
+      simd::mul(simd::sub(simd::load(corners[3]), bottom_left), fx));
+  return simd::mul(simd::add(top, simd::mul(simd::sub(bottom, top), fy)),
+                   simd::splat(kDequantizationScale));
+}
+
+OceanCurrentField::OceanCurrentField()
+    : texels_(static_cast<std::size_t>(kWidth * kHeight), Texel{0, 0}) {}
+
+OceanCurrentField::OceanCurrentField(double time) : OceanCurrentField() {
+  for (int y = 0; y < kHeight; y++) {
+    float latitude = getRowLatitude(y);
+    for (int x = 0; x < kWidth; x++) {
+      float east;
+      float north;
+      getDrivenVelocity(getColumnLongitude(x), latitude, time, east, north);
+      setTexel(getIndex(x, y), east, north);
+    }
+  }
+}
+
+LVector3 OceanCurrentField::getVelocity(const LVector3 &point) const {
+  LVector3 direction = point.normalized();
+  PN_stdfloat longitude = atan2f(direction[1], direction[0]);
+  if (longitude < 0) {
+    longitude += 2 * MathNumbers::pi;
+  }
+  PN_stdfloat latitude = asinf(std::max(-1.f, std::min(1.f, direction[2])));
+  float east;
+  float north;
+  sample(((longitude / (2 * MathNumbers::pi)) * kWidth) - 0.5f,
+         ((0.5f - (latitude / MathNumbers::pi)) * kHeight) - 0.5f, east,
+         north);
+  LVector3 east_direction(-sinf(longitude), cosf(longitude), 0);
+  LVector3 north_direction(-sinf(latitude) * cosf(longitude),
+                           -sinf(latitude) * sinf(longitude), cosf(latitude));
+  return (east_direction * east) + (north_direction * north);
+}
+
+void OceanCurrentField::getVelocities(const float *xs, const float *ys,
+                                      const float *zs, std::size_t count,
+                                      float *velocity_xs, float *velocity_ys,
+                                      float *velocity_zs) const {
+  // Find the raster positions a batch at a time, with SIMD, then sample them
+  // four at a time, gathering only the texels one by one.
+  const simd::Float4 texels_per_longitude =
+      simd::splat(kWidth / (2 * static_cast<float>(MathNumbers::pi)));
+  const simd::Float4 rows_per_latitude =
+      simd::splat(kHeight / static_cast<float>(MathNumbers::pi));
+  const simd::Float4 half = simd::splat(0.5f);
+  const simd::Float4 row_center = simd::splat((kHeight / 2.f) - 0.5f);
+  float longitudes[kVelocityBatchSize];
+  float latitudes[kVelocityBatchSize];
+  for (std::size_t begin = 0; begin < count; begin += kVelocityBatchSize) {
+    std::size_t batch_size = std::min(kVelocityBatchSize, count - begin);
+    geodesy::getLongitudesAndLatitudes(&xs[begin], &ys[begin], &zs[begin],
+                                       batch_size, longitudes, latitudes);
+    std::size_t group_end = batch_size - (batch_size % kLaneCount);
+    for (std::size_t i = 0; i < group_end; i += kLaneCount) {
+      simd::Float4 x = simd::sub(
+          simd::mul(simd::load(&longitudes[i]), texels_per_longitude), half);
+      simd::Float4 y = simd::sub(
+          row_center, simd::mul(simd::load(&latitudes[i]), rows_per_latitude));
+      // Rounding down by rounding to nearest, where a tie picks either
+      // neighbor, with a weight of 0 or 1 on it.
+      simd::Float4 x0 = simd::round(simd::sub(x, half));
+      simd::Float4 y0 = simd::round(simd::sub(y, half));
+      simd::Float4 fx = simd::sub(x, x0);
+      simd::Float4 fy = simd::sub(y, y0);
+      float columns[kLaneCount];
+      float rows[kLaneCount];
+      simd::store(columns, x0);
+      simd::store(rows, y0);
+      float easts[4][kLaneCount];
+      float norths[4][kLaneCount];
+      for (std::size_t lane = 0; lane < kLaneCount; lane++) {
+        int column = static_cast<int>(columns[lane]);
+        int row = static_cast<int>(rows[lane]);
+        std::size_t left = getColumnOffset(column);
+        std::size_t right = getColumnOffset(column + 1);
+        std::size_t top = getRowOffset(row);
+        std::size_t bottom = getRowOffset(row + 1);
+        const std::size_t corners[4] = {top + left, top + right,
+                                        bottom + left, bottom + right};
+        for (std::size_t corner = 0; corner < 4; corner++) {
+          const Texel &texel = texels_[corners[corner]];
+          easts[corner][lane] = texel.east;
+          norths[corner][lane] = texel.north;
+        }
+      }
+      simd::Float4 east = bilerp(easts, fx, fy);
+      simd::Float4 north = bilerp(norths, fx, fy);
+
+      // East and north follow from the points themselves, without
+      // trigonometry, and fade to nothing at the poles.
+      std::size_t j = begin + i;
+      simd::Float4 point_x = simd::load(&xs[j]);
+      simd::Float4 point_y = simd::load(&ys[j]);
+      simd::Float4 point_z = simd::load(&zs[j]);
+      simd::Float4 axis_distance = simd::max(
+          simd::sqrt(simd::add(simd::mul(point_x, point_x),
+                               simd::mul(point_y, point_y))),
+          simd::splat(kMinAxisDistance));
+      simd::Float4 east_scale = simd::div(east, axis_distance);
+      simd::Float4 north_scale =
+          simd::mul(simd::div(north, axis_distance), point_z);
+      simd::store(&velocity_xs[j],
+                  simd::negate(simd::add(simd::mul(point_y, east_scale),
+                                         simd::mul(point_x, north_scale))));
+      simd::store(&velocity_ys[j],
+                  simd::sub(simd::mul(point_x, east_scale),
+                            simd::mul(point_y, north_scale)));
+      simd::store(&velocity_zs[j], simd::mul(axis_distance, north));
+    }
+    for (std::size_t i = group_end; i < batch_size; i++) {
+      LVector3 velocity = getVelocity(
+          LVector3(xs[begin + i], ys[begin + i], zs[begin + i]));
+      velocity_xs[begin + i] = velocity.get_x();
+      velocity_ys[begin + i] = velocity.get_y();
+      velocity_zs[begin + i] = velocity.get_z();
+    }
+  }
+}
+
+OceanCurrentField OceanCurrentField::advance(double time,
+                                             double duration) const {
+  OceanCurrentField advanced;
+  float step_duration = static_cast<float>(duration);
+  float relaxation =
+      static_cast<float>(std::min(1.0, duration / kRelaxationTime));
+  const float texels_per_radian_east =
+      kWidth / (2 * static_cast<float>(MathNumbers::pi));
+  const float texels_per_radian_north =
+      kHeight / static_cast<float>(MathNumbers::pi);
+  for (int y = 0; y < kHeight; y++) {
+    float latitude = getRowLatitude(y);
+    float texel_width = std::max(kMinTexelWidth, cosf(latitude));
+    for (int x = 0; x < kWidth; x++) {
+      float east;
+      float north;
+      sample(static_cast<float>(x), static_cast<float>(y), east, north);
+      // Carry along the velocity of the water which flows in, tracing back
+      // to where it was a step ago. Rows run from north to south.
+      float carried_east;
+      float carried_north;
+      sample(static_cast<float>(x) - (east * step_duration *
+                                       texels_per_radian_east / texel_width),
+             static_cast<float>(y) +
+                 (north * step_duration * texels_per_radian_north),
+             carried_east, carried_north);
+      float driven_east;
+      float driven_north;
+      getDrivenVelocity(getColumnLongitude(x), latitude, time + duration,
+                        driven_east, driven_north);
+      advanced.setTexel(
+          getIndex(x, y),
+          carried_east + ((driven_east - carried_east) * relaxation),
+          carried_north + ((driven_north - carried_north) * relaxation));
+    }
+  }
+  return advanced;
+}
+
+std::size_t OceanCurrentField::getIndex(int x, int y) {
+  return getColumnOffset(x) + getRowOffset(y);
+}
+
+std::size_t OceanCurrentField::getColumnOffset(int x) {
+  // The width is a power of two, so masking wraps negative columns too.
+  int column = x & (kWidth - 1);
+  return static_cast<std::size_t>(
+      ((column / kTileSize) * kTileSize * kTileSize) + (column % kTileSize));
+}
+
+std::size_t OceanCurrentField::getRowOffset(int y) {
+  int row = std::max(0, std::min(kHeight - 1, y));
+  return static_cast<std::size_t>(
+      ((row / kTileSize) * kTilesAcross * kTileSize * kTileSize) +
+      ((row % kTileSize) * kTileSize));
+}
+
+void OceanCurrentField::sample(float x, float y, float &east,
+                               float &north) const {
+  int x0 = static_cast<int>(std::floor(x));
+  int y0 = static_cast<int>(std::floor(y));
+  float fx = x - static_cast<float>(x0);
+  float fy = y - static_cast<float>(y0);
+  // Texel indices are separable into a column and a row part.
+  std::size_t left = getColumnOffset(x0);
+  std::size_t right = getColumnOffset(x0 + 1);
+  std::size_t top = getRowOffset(y0);
+  std::size_t bottom = getRowOffset(y0 + 1);
+  const Texel &top_left = texels_[top + left];
+  const Texel &top_right = texels_[top + right];
+  const Texel &bottom_left = texels_[bottom + left];
+  const Texel &bottom_right = texels_[bottom + right];
+  float top_east = ((1 - fx) * top_left.east) + (fx * top_right.east);
+  float bottom_east =
+      ((1 - fx) * bottom_left.east) + (fx * bottom_right.east);
+  float top_north = ((1 - fx) * top_left.north) + (fx * top_right.north);
+  float bottom_north =
+      ((1 - fx) * bottom_left.north) + (fx * bottom_right.north);
+  east = (((1 - fy) * top_east) + (fy * bottom_east)) * kDequantizationScale;
+  north =
+      (((1 - fy) * top_north) + (fy * bottom_north)) * kDequantizationScale;
+}
+
+void OceanCurrentField::setTexel(std::size_t index, float east, float north) {
+  Texel &texel = texels_[index];
+  texel.east = static_cast<int16_t>(
+      std::lround(std::max(-kMaxSpeed, std::min(kMaxSpeed, east)) *
+                  kQuantizationScale));
+  texel.north = static_cast<int16_t>(
+      std::lround(std::max(-kMaxSpeed, std::min(kMaxSpeed, north)) *
+                  kQuantizationScale));
+}
+
+OceanCurrents::OceanCurrents()
+    : field_{std::make_shared<const OceanCurrentField>(0.0)},
+      time_{0},
+      time_until_next_{kAdvanceInterval} {
+  startNext();
+}
+
+const OceanCurrentField &OceanCurrents::getField() const { return *field_; }
+
+void OceanCurrents::step(double duration) {
+  time_until_next_ -= duration;
+  if (time_until_next_ > 0) {
+    return;
+  }
+  parallel::wait(next_job_);
+  field_ = next_field_;
+  time_ += kAdvanceInterval;
+  time_until_next_ += kAdvanceInterval;
+  startNext();
+}
+
+void OceanCurrents::startNext() {
+  std::shared_ptr<const OceanCurrentField> field = field_;
+  std::shared_ptr<OceanCurrentField> next_field =
+      std::make_shared<OceanCurrentField>();
+  double time = time_;
+  next_job_ = parallel::spawn([field, next_field, time] {
+    *next_field = field->advance(time, kAdvanceInterval);
+  });
+  next_field_ = next_field;
+}
+
+}  // namespace earth_world
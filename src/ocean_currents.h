@@ -0,0 +1,144 @@
+#ifndef EARTH_WORLD_OCEAN_CURRENTS_H
+#define EARTH_WORLD_OCEAN_CURRENTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+/**
+ * The velocity of the ocean's surface at every point on the globe, tangent
+ * to it, in radians per second. It is kept as a coarse equirectangular
+ * raster of eastward and northward velocities in 16 bits each, laid out in
+ * square tiles, so that the four texels of a bilinear lookup mostly share a
+ * cache line, and the whole field stays in cache while a fleet samples it.
+ */
+class OceanCurrentField {
+ public:
+  /** Creates a field of still water. */
+  OceanCurrentField();
+  /**
+   * Creates the currents the winds drive at the given time, which advected
+   * fields are eased toward.
+   * @param time The simulated time, in seconds.
+   */
+  explicit OceanCurrentField(double time);
+  OceanCurrentField(const OceanCurrentField &) = default;
+  OceanCurrentField(OceanCurrentField &&) noexcept = default;
+  OceanCurrentField &operator=(const OceanCurrentField &) = default;
+  OceanCurrentField &operator=(OceanCurrentField &&) noexcept = default;
+  ~OceanCurrentField() = default;
+
+  /**
+   * @param point A direction from the globe's center.
+   * @return The bilinearly filtered velocity at the point, tangent to the
+   *     globe, in radians per second.
+   */
+  LVector3 getVelocity(const LVector3 &point) const;
+
+  /**
+   * Fills the velocities at a batch of points, in structure-of-arrays form.
+   * @param xs The points' x coordinates, as unit vectors.
+   * @param ys The points' y coordinates, as unit vectors.
+   * @param zs The points' z coordinates, as unit vectors.
+   * @param count The number of points.
+   * @param velocity_xs Filled with the x coordinate of each velocity.
+   * @param velocity_ys Filled with the y coordinate of each velocity.
+   * @param velocity_zs Filled with the z coordinate of each velocity.
+   */
+  void getVelocities(const float *xs, const float *ys, const float *zs,
+                     std::size_t count, float *velocity_xs,
+                     float *velocity_ys, float *velocity_zs) const;
+
+  /**
+   * Advects the field by a semi-Lagrangian step, carrying every texel's
+   * velocity along by itself, then eases it toward the driven currents.
+   * @param time The simulated time the field is at, in seconds.
+   * @param duration The simulated time to advance by, in seconds.
+   * @return The field as of the given time plus the duration.
+   */
+  OceanCurrentField advance(double time, double duration) const;
+
+ protected:
+  struct Texel {
+    int16_t east;
+    int16_t north;
+  };
+
+  /** The texels, tile by tile, and row major within each tile. */
+  std::vector<Texel> texels_;
+
+  /** @return The index of a texel, wrapping x and clamping y. */
+  static std::size_t getIndex(int x, int y);
+
+  /** @return The part of a texel's index given by its column, wrapped. */
+  static std::size_t getColumnOffset(int x);
+
+  /** @return The part of a texel's index given by its row, clamped. */
+  static std::size_t getRowOffset(int y);
+
+  /**
+   * Samples the velocity between texels, bilinearly.
+   * @param x The texel column, relative to texel centers.
+   * @param y The texel row, relative to texel centers.
+   * @param east Filled with the eastward velocity.
+   * @param north Filled with the northward velocity.
+   */
+  void sample(float x, float y, float &east, float &north) const;
+
+  /** Stores a velocity in the texel at the given index, clamped to fit. */
+  void setTexel(std::size_t index, float east, float north);
+};
+
+/**
+ * The ocean currents as they drift over simulated time, double buffered.
+ * Steps read the current field, while the next one is advected by a job on
+ * the pool in the background. The next field is swapped in once the
+ * simulated time it is advected to comes around, waiting on it only if it
+ * isn't done by then, so that the currents change the same way however
+ * the work happens to be timed.
+ *
+ * Copies share the field being advected, so only one of them may step.
+ */
+class OceanCurrents {
+ public:
+  /** Starts the currents as the winds drive them at time 0. */
+  OceanCurrents();
+  OceanCurrents(const OceanCurrents &) = default;
+  OceanCurrents(OceanCurrents &&) noexcept = default;
+  OceanCurrents &operator=(const OceanCurrents &) = default;
+  OceanCurrents &operator=(OceanCurrents &&) noexcept = default;
+  ~OceanCurrents() = default;
+
+  /** @return The field as of the latest advection. */
+  const OceanCurrentField &getField() const;
+
+  /**
+   * Moves the currents forward in time, swapping in the next field once its
+   * time has come.
+   * @param duration The simulated time to move forward by, in seconds.
+   */
+  void step(double duration);
+
+ protected:
+  std::shared_ptr<const OceanCurrentField> field_;
+  /** The field being advected in the background, from the current one. */
+  std::shared_ptr<OceanCurrentField> next_field_;
+  parallel::JobHandle next_job_;
+  /** The simulated time the current field is at, in seconds. */
+  double time_;
+  /** The simulated time until the next field is due, in seconds. */
+  double time_until_next_;
+
+  /** Spawns the job advecting the next field from the current one. */
+  void startNext();
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_OCEAN_CURRENTS_H
@@ -0,0 +1,231 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace earth_world {
+namespace parallel {
+
+/**
+ * The chunks each thread's share of a range is split into, so that threads
+ * which finish early can steal some of the rest.
+ */
+const int kChunksPerThread = 4;
+
+class Job {
+ public:
+  std::function<void()> function;
+  /** The dependencies yet to finish, plus one until the job is spawned. */
+  std::atomic<int> pending_count{0};
+  std::atomic<bool> finished{false};
+  /** Guards the jobs depending on this one, against it finishing. */
+  std::mutex mutex;
+  std::vector<JobHandle> dependents;
+};
+
+/** The jobs queued by one thread, which others steal from the front of. */
+struct JobQueue {
+  std::mutex mutex;
+  std::deque<JobHandle> jobs;
+};
+
+/**
+ * The threads which run jobs, each with a queue of its own. Threads outside
+ * of the pool share one more queue.
+ */
+class Pool {
+ public:
+  Pool() : queued_count_{0}, stopping_{false} {
+    // Threads waiting on jobs help out, but one worker is always there, so
+    // that jobs nobody waits on still run.
+    std::size_t queue_count =
+        static_cast<std::size_t>(std::max(2, getThreadCount()));
+    for (std::size_t i = 0; i < queue_count; i++) {
+      queues_.emplace_back(new JobQueue());
+    }
+    for (std::size_t i = 1; i < queue_count; i++) {
+      workers_.emplace_back(&Pool::work, this, i);
+    }
+  }
+  Pool(const Pool &) = delete;
+  Pool(Pool &&) = delete;
+  Pool &operator=(const Pool &) = delete;
+  Pool &operator=(Pool &&) = delete;
+  ~Pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  /** Queues a job whose dependencies have all finished. */
+  void push(JobHandle job) {
+    JobQueue &queue = *queues_[current_queue_];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(std::move(job));
+    }
+    queued_count_++;
+    {
+      // Taken so that a worker can't miss the job between checking for work
+      // and going to sleep.
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+  }
+
+  /**
+   * Runs the latest job queued by this thread, or otherwise the earliest one
+   * queued by any other.
+   * @return False if there were none to run.
+   */
+  bool runOne() {
+    JobHandle job = take();
+    if (job == nullptr) {
+      return false;
+    }
+    queued_count_--;
+    job->function();
+    job->function = nullptr;
+
+    std::vector<JobHandle> dependents;
+    {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->finished.store(true);
+      dependents.swap(job->dependents);
+    }
+    for (JobHandle &dependent : dependents) {
+      if (dependent->pending_count.fetch_sub(1) == 1) {
+        push(std::move(dependent));
+      }
+    }
+    return true;
+  }
+
+ protected:
+  /** The queue of the current thread, where 0 is the shared one. */
+  static thread_local std::size_t current_queue_;
+
+  std::vector<std::unique_ptr<JobQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<int> queued_count_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stopping_;
+
+  JobHandle take() {
+    for (std::size_t i = 0; i < queues_.size(); i++) {
+      JobQueue &queue = *queues_[(current_queue_ + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.jobs.empty()) {
+        continue;
+      }
+      JobHandle job;
+      if (i == 0) {
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+      } else {
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+      }
+      return job;
+    }
+    return nullptr;
+  }
+
+  void work(std::size_t queue) {
+    current_queue_ = queue;
+    while (true) {
+      if (runOne()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_count_ > 0; });
+      if (stopping_) {
+        return;
+      }
+    }
+  }
+};
+
+thread_local std::size_t Pool::current_queue_ = 0;
+
+/** @return The pool, started on first use, and stopped on exit. */
+static Pool &getPool() {
+  static Pool pool;
+  return pool;
+}
+
+int getThreadCount() {
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+JobHandle spawn(std::function<void()> function) {
+  return spawn(std::move(function), std::vector<JobHandle>());
+}
+
+JobHandle spawn(std::function<void()> function,
+                const std::vector<JobHandle> &dependencies) {
+  JobHandle job = std::make_shared<Job>();
+  job->function = std::move(function);
+  job->pending_count.store(static_cast<int>(dependencies.size()) + 1);
+  for (const JobHandle &dependency : dependencies) {
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->finished.load()) {
+      job->pending_count--;
+    } else {
+      dependency->dependents.push_back(job);
+    }
+  }
+  if (job->pending_count.fetch_sub(1) == 1) {
+    getPool().push(job);
+  }
+  return job;
+}
+
+bool isFinished(const JobHandle &job) { return job->finished.load(); }
+
+void wait(const JobHandle &job) {
+  Pool &pool = getPool();
+  while (!job->finished.load()) {
+    if (!pool.runOne()) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void forRange(int begin, int end,
+              const std::function<void(int, int)> &function) {
+  int count = end - begin;
+  if (count <= 0) {
+    return;
+  }
+  int chunk_count = std::min(getThreadCount() * kChunksPerThread, count);
+  int chunk_size = (count + chunk_count - 1) / chunk_count;
+  std::vector<JobHandle> jobs;
+  jobs.reserve(static_cast<std::size_t>(chunk_count));
+  for (int chunk_begin = begin + chunk_size; chunk_begin < end;
+       chunk_begin += chunk_size) {
+    int chunk_end = std::min(end, chunk_begin + chunk_size);
+    jobs.push_back(spawn([&function, chunk_begin, chunk_end] {
+      function(chunk_begin, chunk_end);
+    }));
+  }
+  // The calling thread takes the first chunk, then helps with the rest.
+  function(begin, std::min(end, begin + chunk_size));
+  for (const JobHandle &job : jobs) {
+    wait(job);
+  }
+}
+
+}  // namespace parallel
+}  // namespace earth_world
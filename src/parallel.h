@@ -0,0 +1,66 @@
+#ifndef EARTH_WORLD_PARALLEL_H
+#define EARTH_WORLD_PARALLEL_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace earth_world {
+namespace parallel {
+/**
+ * Utilities for splitting work across all cores, on a pool of threads which
+ * each keep a queue of jobs of their own, and steal from each other's once
+ * their own runs dry. Threads which wait on jobs run others meanwhile.
+ */
+
+/** A unit of work, which may depend on others. */
+class Job;
+
+/** Refers to a spawned job, to wait on it, or to make others depend on it. */
+typedef std::shared_ptr<Job> JobHandle;
+
+/** @return The number of threads that parallel work is split across. */
+int getThreadCount();
+
+/**
+ * Hands a function to the pool, to be run on any thread.
+ * @param function The work to do.
+ * @return The spawned job.
+ */
+JobHandle spawn(std::function<void()> function);
+
+/**
+ * Hands a function to the pool, to be run on any thread once all of the
+ * given jobs have finished.
+ * @param function The work to do.
+ * @param dependencies The jobs which must finish first.
+ * @return The spawned job.
+ */
+JobHandle spawn(std::function<void()> function,
+                const std::vector<JobHandle> &dependencies);
+
+/** @return True if the job has finished. */
+bool isFinished(const JobHandle &job);
+
+/**
+ * Waits for a job to finish, running any other jobs meanwhile, rather than
+ * idling.
+ */
+void wait(const JobHandle &job);
+
+/**
+ * Splits the range [begin, end) into a few contiguous chunks per thread,
+ * calls the given function on each chunk, and waits for all of them to
+ * finish.
+ * @param begin The first index of the range.
+ * @param end One past the last index of the range.
+ * @param function Called with the first and one past the last index of each
+ *     chunk. May be called from any thread, including the calling one.
+ */
+void forRange(int begin, int end,
+              const std::function<void(int, int)> &function);
+
+}  // namespace parallel
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_PARALLEL_H
@@ -0,0 +1,115 @@
+#include "quality_governor.h"
+
+#include <algorithm>
+
+namespace earth_world {
+
+const std::vector<QualityTier> kQualityTiers = {
+    {/* globe_vertices_per_edge= */ 48, /* lod_bias= */ 1.5f,
+     /* visibility_update_interval= */ 4, /* render_scale= */ 0.5f},
+    {/* globe_vertices_per_edge= */ 72, /* lod_bias= */ 0.75f,
+     /* visibility_update_interval= */ 2, /* render_scale= */ 0.75f},
+    {/* globe_vertices_per_edge= */ 100, /* lod_bias= */ 0.f,
+     /* visibility_update_interval= */ 1, /* render_scale= */ 1.f},
+    {/* globe_vertices_per_edge= */ 160, /* lod_bias= */ -0.5f,
+     /* visibility_update_interval= */ 1, /* render_scale= */ 1.f},
+};
+/** The number of frames the percentile is taken over. */
+const int kSampleWindow = 120;
+const double kPercentile = 0.9;
+/** Step down when the percentile runs this far over the target. */
+const double kDowngradeRatio = 1.15;
+/** Step up when the percentile stays this far under the target. */
+const double kUpgradeRatio = 0.7;
+/** Frames longer than this are stalls, such as loading, and are ignored. */
+const double kStallFrameTime = 0.5;
+/** An upgrade undone within this many windows counts as a failed one. */
+const int kFailedUpgradeWindows = 3;
+const int kMaxUpgradeHoldWindows = 16;
+
+QualityGovernor::QualityGovernor(double target_frame_time, int initial_tier)
+    : target_frame_time_{target_frame_time},
+      tier_index_{std::max(0, std::min(getTierCount() - 1, initial_tier))},
+      samples_(kSampleWindow, 0),
+      next_sample_{0},
+      sample_count_{0},
+      percentile_{0},
+      frames_since_change_{0},
+      last_change_was_upgrade_{false},
+      upgrade_hold_windows_{1} {}
+
+bool QualityGovernor::update(double frame_time) {
+  // Frames are only counted as far as any hold looks, so they can't wrap.
+  if (frames_since_change_ < kMaxUpgradeHoldWindows * kSampleWindow) {
+    frames_since_change_++;
+  }
+  // An upgrade which has held is forgiven any earlier failures.
+  if (last_change_was_upgrade_ &&
+      frames_since_change_ >= kFailedUpgradeWindows * kSampleWindow) {
+    upgrade_hold_windows_ = 1;
+  }
+  if (frame_time <= 0 || frame_time > kStallFrameTime) {
+    return false;
+  }
+  samples_[static_cast<std::size_t>(next_sample_)] = frame_time;
+  next_sample_ = (next_sample_ + 1) % kSampleWindow;
+  // Wait for the window to fill, counting up to it.
+  if (sample_count_ < kSampleWindow - 1) {
+    sample_count_++;
+    return false;
+  }
+  sample_count_ = kSampleWindow;
+
+  std::vector<double> sorted(samples_);
+  std::vector<double>::iterator nth =
+      sorted.begin() + static_cast<std::ptrdiff_t>(kPercentile *
+                                                   (kSampleWindow - 1));
+  std::nth_element(sorted.begin(), nth, sorted.end());
+  percentile_ = *nth;
+
+  if (percentile_ > kDowngradeRatio * target_frame_time_ && tier_index_ > 0) {
+    // Back off from upgrades which didn't hold for long.
+    if (last_change_was_upgrade_ &&
+        frames_since_change_ < kFailedUpgradeWindows * kSampleWindow) {
+      upgrade_hold_windows_ =
+          std::min(kMaxUpgradeHoldWindows, upgrade_hold_windows_ * 2);
+    }
+    last_change_was_upgrade_ = false;
+    changeTier(tier_index_ - 1);
+    return true;
+  }
+  if (percentile_ < kUpgradeRatio * target_frame_time_ &&
+      tier_index_ < getTierCount() - 1 &&
+      frames_since_change_ >= upgrade_hold_windows_ * kSampleWindow) {
+    last_change_was_upgrade_ = true;
+    changeTier(tier_index_ + 1);
+    return true;
+  }
+  return false;
+}
+
+int QualityGovernor::getTierIndex() const { return tier_index_; }
+
+const QualityTier &QualityGovernor::getTier() const {
+  return getPresetTier(tier_index_);
+}
+
+double QualityGovernor::getFrameTimePercentile() const { return percentile_; }
+
+int QualityGovernor::getTierCount() {
+  return static_cast<int>(kQualityTiers.size());
+}
+
+const QualityTier &QualityGovernor::getPresetTier(int index) {
+  return kQualityTiers[static_cast<std::size_t>(
+      std::max(0, std::min(getTierCount() - 1, index)))];
+}
+
+void QualityGovernor::changeTier(int tier_index) {
+  tier_index_ = tier_index;
+  sample_count_ = 0;
+  next_sample_ = 0;
+  frames_since_change_ = 0;
+}
+
+}  // namespace earth_world
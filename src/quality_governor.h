@@ -0,0 +1,80 @@
+#ifndef EARTH_WORLD_QUALITY_GOVERNOR_H
+#define EARTH_WORLD_QUALITY_GOVERNOR_H
+
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+
+/** The settings of a single quality preset. */
+struct QualityTier {
+  /** The vertices on each edge of the globe's sphere-cube. */
+  int globe_vertices_per_edge;
+  /** Added to the mip level the globe's textures are sampled at. */
+  PN_stdfloat lod_bias;
+  /** The number of frames between updates of the visible area. */
+  int visibility_update_interval;
+  /** The scene's resolution, relative to the window's. */
+  PN_stdfloat render_scale;
+};
+
+/**
+ * Picks a quality tier that holds a target frame time. Watches a rolling
+ * percentile of recent frame times, and steps down a tier when it runs over
+ * budget, or up a tier when there is plenty of headroom. After every change
+ * a full window of frames is measured again before the next, and upgrades
+ * which are quickly undone are held off for longer each time, so that the
+ * tier settles rather than oscillating.
+ */
+class QualityGovernor {
+ public:
+  /**
+   * @param target_frame_time The frame time to hold, in seconds.
+   * @param initial_tier The index of the tier to start at.
+   */
+  QualityGovernor(double target_frame_time, int initial_tier);
+
+  /**
+   * Records the last frame's time, and changes the tier if needed.
+   * @param frame_time The time the last frame took, in seconds.
+   * @return True if the tier changed.
+   */
+  bool update(double frame_time);
+
+  int getTierIndex() const;
+  const QualityTier &getTier() const;
+
+  /** @return The measured frame time percentile, in seconds. */
+  double getFrameTimePercentile() const;
+
+  /** @return The number of preset tiers, from lowest to highest quality. */
+  static int getTierCount();
+
+  /** @return The preset tier at the given index. */
+  static const QualityTier &getPresetTier(int index);
+
+ protected:
+  const double target_frame_time_;
+  int tier_index_;
+
+  /** A ring buffer of the most recent frame times. */
+  std::vector<double> samples_;
+  int next_sample_;
+  int sample_count_;
+  double percentile_;
+
+  /** The frames since the tier last changed. */
+  int frames_since_change_;
+  /** Whether the last change was an upgrade. */
+  bool last_change_was_upgrade_;
+  /** How many windows of headroom an upgrade waits for. */
+  int upgrade_hold_windows_;
+
+  /** Moves to the given tier, and starts measuring afresh. */
+  void changeTier(int tier_index);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_QUALITY_GOVERNOR_H
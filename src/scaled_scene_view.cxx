@@ -0,0 +1,129 @@
+#include "scaled_scene_view.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "panda3d/cardMaker.h"
+#include "panda3d/frameBufferProperties.h"
+#include "panda3d/graphicsEngine.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+const int kSceneBufferSort = -10;
+
+ScaledSceneView::ScaledSceneView(PT<WindowFramework> window)
+    : host_output_{window->get_graphics_output()},
+      window_region_{window->get_display_region_3d()},
+      scene_texture_{new Texture("SceneTexture")},
+      render_scale_{1},
+      window_size_{0} {
+  scene_texture_->set_wrap_u(SamplerState::WM_clamp);
+  scene_texture_->set_wrap_v(SamplerState::WM_clamp);
+  scene_texture_->set_minfilter(SamplerState::FT_linear);
+  scene_texture_->set_magfilter(SamplerState::FT_linear);
+
+  CardMaker card_maker("ScaledScene");
+  card_maker.set_frame(-1, 1, -1, 1);
+  path_ = NodePath(card_maker.generate());
+  path_.set_texture(scene_texture_);
+  // Draw behind all other 2D elements.
+  path_.set_bin("background", 0);
+  path_.set_depth_test(false);
+  path_.set_depth_write(false);
+  path_.hide();
+}
+
+ScaledSceneView::ScaledSceneView(ScaledSceneView &&other)
+    : path_{other.path_},
+      host_output_{std::move(other.host_output_)},
+      window_region_{std::move(other.window_region_)},
+      scene_buffer_{std::move(other.scene_buffer_)},
+      scene_texture_{std::move(other.scene_texture_)},
+      render_scale_{other.render_scale_},
+      window_size_{other.window_size_} {
+  other.path_.clear();
+}
+
+ScaledSceneView &ScaledSceneView::operator=(ScaledSceneView &&other) {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  removeSceneBuffer();
+  path_.remove_node();
+  path_ = other.path_;
+  host_output_ = std::move(other.host_output_);
+  window_region_ = std::move(other.window_region_);
+  scene_buffer_ = std::move(other.scene_buffer_);
+  scene_texture_ = std::move(other.scene_texture_);
+  render_scale_ = other.render_scale_;
+  window_size_ = other.window_size_;
+  other.path_.clear();
+  return *this;
+}
+
+ScaledSceneView::~ScaledSceneView() {
+  removeSceneBuffer();
+  path_.remove_node();
+}
+
+NodePath ScaledSceneView::getPath() const { return path_; }
+
+void ScaledSceneView::onWindowResize(LVector2i new_window_size) {
+  window_size_ = new_window_size;
+  rebuildSceneBuffer();
+}
+
+void ScaledSceneView::setRenderScale(PN_stdfloat render_scale) {
+  if (render_scale == render_scale_) {
+    return;
+  }
+  render_scale_ = render_scale;
+  rebuildSceneBuffer();
+}
+
+void ScaledSceneView::rebuildSceneBuffer() {
+  removeSceneBuffer();
+  if (render_scale_ >= 1 || host_output_ == nullptr ||
+      window_region_ == nullptr || window_size_.get_x() <= 0 ||
+      window_size_.get_y() <= 0) {
+    return;
+  }
+  int width = std::max(
+      1, static_cast<int>(std::lround(window_size_.get_x() * render_scale_)));
+  int height = std::max(
+      1, static_cast<int>(std::lround(window_size_.get_y() * render_scale_)));
+  FrameBufferProperties properties;
+  properties.set_rgb_color(true);
+  properties.set_depth_bits(24);
+  scene_buffer_ = host_output_->make_texture_buffer(
+      "SceneBuffer", width, height, scene_texture_, /* to_ram= */ false,
+      &properties);
+  if (scene_buffer_ == nullptr) {
+    return;
+  }
+  // Render before the window, which shows the result.
+  scene_buffer_->set_sort(kSceneBufferSort);
+  scene_buffer_->set_clear_color_active(true);
+  scene_buffer_->set_clear_color(window_region_->get_clear_color());
+  DisplayRegion *display_region = scene_buffer_->make_display_region();
+  display_region->set_camera(window_region_->get_camera());
+
+  window_region_->set_active(false);
+  path_.show();
+}
+
+void ScaledSceneView::removeSceneBuffer() {
+  if (scene_buffer_ != nullptr) {
+    scene_buffer_->get_engine()->remove_window(scene_buffer_);
+    scene_buffer_ = nullptr;
+  }
+  if (window_region_ != nullptr) {
+    window_region_->set_active(true);
+  }
+  if (!path_.is_empty()) {
+    path_.hide();
+  }
+}
+
+}  // namespace earth_world
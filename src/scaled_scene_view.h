@@ -0,0 +1,62 @@
+#ifndef EARTH_WORLD_SCALED_SCENE_VIEW_H
+#define EARTH_WORLD_SCALED_SCENE_VIEW_H
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/displayRegion.h"
+#include "panda3d/graphicsOutput.h"
+#include "panda3d/nodePath.h"
+#include "panda3d/texture.h"
+#include "panda3d/windowFramework.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * Renders the 3D scene at a fraction of the window's resolution. Below full
+ * scale, the window's 3D display region is swapped for an offscreen buffer
+ * of the scaled size, which is stretched over the window by a fullscreen
+ * card in the 2D scene.
+ */
+class ScaledSceneView {
+ public:
+  /** @param window The window whose 3D scene to scale. */
+  explicit ScaledSceneView(PT<WindowFramework> window);
+  ScaledSceneView(const ScaledSceneView &) = delete;
+  ScaledSceneView(ScaledSceneView &&);
+  ScaledSceneView &operator=(const ScaledSceneView &) = delete;
+  ScaledSceneView &operator=(ScaledSceneView &&);
+  ~ScaledSceneView();
+
+  /** @return The fullscreen card, to be placed in the 2D scene. */
+  NodePath getPath() const;
+
+  void onWindowResize(LVector2i new_window_size);
+
+  /**
+   * @param render_scale The scene's resolution relative to the window's.
+   *     Anything at or above 1 renders straight into the window.
+   */
+  void setRenderScale(PN_stdfloat render_scale);
+
+ protected:
+  NodePath path_;
+  PT<GraphicsOutput> host_output_;
+  PT<DisplayRegion> window_region_;
+  PT<GraphicsOutput> scene_buffer_;
+  PT<Texture> scene_texture_;
+  PN_stdfloat render_scale_;
+  LVector2i window_size_;
+
+  /** Recreates the offscreen buffer for the current scale and size. */
+  void rebuildSceneBuffer();
+
+  /**
+   * Releases the offscreen buffer, if there is one, and renders into the
+   * window again.
+   */
+  void removeSceneBuffer();
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SCALED_SCENE_VIEW_H
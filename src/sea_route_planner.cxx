@@ -0,0 +1,706 @@
+#include "sea_route_planner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+#include "cache.h"
+#include "min_heap.h"
+#include "parallel.h"
+
+namespace earth_world {
+
+const int kGridWidth = 2048;
+const int kGridHeight = 1024;
+const int kClusterSize = 32;
+const int kClusterColumns = kGridWidth / kClusterSize;
+const int kClusterRows = kGridHeight / kClusterSize;
+/** Open borders at least this long get an entrance at either end. */
+const int kLongEntranceLength = 6;
+/** How far, in cells, a point may be from the sea to start a route. */
+const int kMaxSnapCells = 16;
+const uint32_t kCacheVersion = 1;
+const std::string kCacheName = "sea_routes_2048x1024.bin";
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+/** A node to visit next, ordered so the queue pops the cheapest. */
+typedef std::pair<float, int> QueueEntry;
+typedef MinHeap<QueueEntry> Queue;
+
+/**
+ * Adds entrances along one open border between two clusters: one in the
+ * middle of every short run of open water, or one at either end of a long
+ * run, so that routes are not forced through a single point.
+ * @param border Per position along the border, the cells on either side, or
+ *     -1 where either side is land.
+ * @param crossings Appended with the pairs of cells the entrances join.
+ */
+static void addEntrances(const std::vector<std::pair<int, int>> &border,
+                         std::vector<std::pair<int, int>> &crossings) {
+  int size = static_cast<int>(border.size());
+  int run_begin = -1;
+  for (int i = 0; i <= size; i++) {
+    bool open = i < size && border[static_cast<std::size_t>(i)].first >= 0;
+    if (open && run_begin < 0) {
+      run_begin = i;
+    } else if (!open && run_begin >= 0) {
+      int length = i - run_begin;
+      if (length < kLongEntranceLength) {
+        crossings.push_back(
+            border[static_cast<std::size_t>(run_begin + (length / 2))]);
+      } else {
+        crossings.push_back(border[static_cast<std::size_t>(run_begin)]);
+        crossings.push_back(border[static_cast<std::size_t>(i - 1)]);
+      }
+      run_begin = -1;
+    }
+  }
+}
+
+SeaRoutePlanner::SeaRoutePlanner(const PNMImage &land_mask,
+                                 PN_stdfloat land_mask_cutoff,
+                                 uint64_t source_hash) {
+  std::size_t cell_count = static_cast<std::size_t>(kGridWidth * kGridHeight);
+  std::vector<unsigned char> data;
+  if (cache::read(kCacheName, kCacheVersion, source_hash, data)) {
+    std::size_t offset = 0;
+    int32_t counts[2];
+    bool complete =
+        cache::readBytes(data, offset, counts, sizeof(counts)) &&
+        counts[0] >= 0 && counts[1] >= 0;
+    if (complete) {
+      navigable_.resize(cell_count);
+      node_cells_.resize(static_cast<std::size_t>(counts[0]));
+      cluster_node_offsets_.resize(
+          static_cast<std::size_t>((kClusterColumns * kClusterRows) + 1));
+      edge_offsets_.resize(static_cast<std::size_t>(counts[0] + 1));
+      edges_.resize(static_cast<std::size_t>(counts[1]));
+      complete =
+          cache::readBytes(data, offset, navigable_.data(),
+                           navigable_.size()) &&
+          cache::readBytes(data, offset, node_cells_.data(),
+                           node_cells_.size() * sizeof(int)) &&
+          cache::readBytes(data, offset, cluster_node_offsets_.data(),
+                           cluster_node_offsets_.size() * sizeof(int)) &&
+          cache::readBytes(data, offset, edge_offsets_.data(),
+                           edge_offsets_.size() * sizeof(int)) &&
+          cache::readBytes(data, offset, edges_.data(),
+                           edges_.size() * sizeof(Edge)) &&
+          offset == data.size();
+    }
+    if (complete) {
+      return;
+    }
+  }
+
+  rasterize(land_mask, land_mask_cutoff);
+  build();
+
+  int32_t counts[2] = {static_cast<int32_t>(node_cells_.size()),
+                       static_cast<int32_t>(edges_.size())};
+  data.clear();
+  cache::appendBytes(data, counts, sizeof(counts));
+  cache::appendBytes(data, navigable_.data(), navigable_.size());
+  cache::appendBytes(data, node_cells_.data(),
+                     node_cells_.size() * sizeof(int));
+  cache::appendBytes(data, cluster_node_offsets_.data(),
+                     cluster_node_offsets_.size() * sizeof(int));
+  cache::appendBytes(data, edge_offsets_.data(),
+                     edge_offsets_.size() * sizeof(int));
+  cache::appendBytes(data, edges_.data(), edges_.size() * sizeof(Edge));
+  cache::write(kCacheName, kCacheVersion, source_hash, data.data(),
+               data.size());
+}
+
+SeaRoutePlanner::SeaRoutePlanner(const PNMImage &land_mask,
+                                 PN_stdfloat land_mask_cutoff) {
+  rasterize(land_mask, land_mask_cutoff);
+  build();
+}
+
+bool SeaRoutePlanner::findRoute(const LVector3 &from, const LVector3 &to,
+                                SeaRoute &route) const {
+  int start_cell = findNearestNavigableCell(from);
+  int goal_cell = findNearestNavigableCell(to);
+  if (start_cell < 0 || goal_cell < 0) {
+    return false;
+  }
+
+  // Join the start and goal into the abstract graph, through the entrances
+  // of their clusters, without changing the shared graph.
+  int node_count = static_cast<int>(node_cells_.size());
+  int start_node = node_count;
+  int goal_node = node_count + 1;
+  int start_cluster = getCluster(start_cell);
+  int goal_cluster = getCluster(goal_cell);
+  Bounds start_bounds = getClusterBounds(start_cell);
+  Bounds goal_bounds = getClusterBounds(goal_cell);
+  std::vector<float> start_costs;
+  std::vector<float> goal_costs;
+  findCosts(start_cell, start_bounds, start_costs);
+  findCosts(goal_cell, goal_bounds, goal_costs);
+  auto get_local_index = [](int cell, const Bounds &bounds) {
+    int x = cell % kGridWidth;
+    int y = cell / kGridWidth;
+    return static_cast<std::size_t>(
+        ((y - bounds.y_begin) * (bounds.x_end - bounds.x_begin)) +
+        (x - bounds.x_begin));
+  };
+
+  std::vector<Edge> start_edges;
+  int start_node_begin =
+      cluster_node_offsets_[static_cast<std::size_t>(start_cluster)];
+  int start_node_end =
+      cluster_node_offsets_[static_cast<std::size_t>(start_cluster + 1)];
+  for (int node = start_node_begin; node < start_node_end; node++) {
+    float cost = start_costs[get_local_index(
+        node_cells_[static_cast<std::size_t>(node)], start_bounds)];
+    if (cost < kInfinity) {
+      start_edges.push_back(Edge{node, cost});
+    }
+  }
+  if (start_cluster == goal_cluster) {
+    float cost = start_costs[get_local_index(goal_cell, start_bounds)];
+    if (cost < kInfinity) {
+      start_edges.push_back(Edge{goal_node, cost});
+    }
+  }
+
+  // Search the abstract graph by A*, towards the goal as the crow flies.
+  LVector3 goal_direction = getCellDirection(goal_cell);
+  std::vector<float> costs(static_cast<std::size_t>(node_count + 2),
+                           kInfinity);
+  std::vector<int> parents(static_cast<std::size_t>(node_count + 2), -1);
+  std::vector<uint8_t> closed(static_cast<std::size_t>(node_count + 2), 0);
+  Queue queue;
+  costs[static_cast<std::size_t>(start_node)] = 0;
+  queue.push(QueueEntry(0, start_node));
+  auto relax = [&](int node, int next_node, float cost) {
+    float next_cost = costs[static_cast<std::size_t>(node)] + cost;
+    if (next_cost >= costs[static_cast<std::size_t>(next_node)]) {
+      return;
+    }
+    costs[static_cast<std::size_t>(next_node)] = next_cost;
+    parents[static_cast<std::size_t>(next_node)] = node;
+    float heuristic =
+        next_node == goal_node
+            ? 0
+            : getDistance(getCellDirection(node_cells_[static_cast<std::size_t>(
+                              next_node)]),
+                          goal_direction);
+    queue.push(QueueEntry(next_cost + heuristic, next_node));
+  };
+  while (!queue.empty()) {
+    int node = queue.top().second;
+    queue.pop();
+    if (node == goal_node) {
+      break;
+    }
+    if (closed[static_cast<std::size_t>(node)] != 0) {
+      continue;
+    }
+    closed[static_cast<std::size_t>(node)] = 1;
+    if (node == start_node) {
+      for (const Edge &edge : start_edges) {
+        relax(node, edge.node, edge.cost);
+      }
+      continue;
+    }
+    for (int i = edge_offsets_[static_cast<std::size_t>(node)];
+         i < edge_offsets_[static_cast<std::size_t>(node + 1)]; i++) {
+      const Edge &edge = edges_[static_cast<std::size_t>(i)];
+      relax(node, edge.node, edge.cost);
+    }
+    int cell = node_cells_[static_cast<std::size_t>(node)];
+    if (getCluster(cell) == goal_cluster) {
+      float cost = goal_costs[get_local_index(cell, goal_bounds)];
+      if (cost < kInfinity) {
+        relax(node, goal_node, cost);
+      }
+    }
+  }
+  if (parents[static_cast<std::size_t>(goal_node)] < 0) {
+    return false;
+  }
+
+  // Refine the abstract route into cells, one cluster at a time.
+  std::vector<int> abstract_cells{goal_cell};
+  for (int node = parents[static_cast<std::size_t>(goal_node)];
+       node != start_node; node = parents[static_cast<std::size_t>(node)]) {
+    abstract_cells.push_back(node_cells_[static_cast<std::size_t>(node)]);
+  }
+  abstract_cells.push_back(start_cell);
+  std::reverse(abstract_cells.begin(), abstract_cells.end());
+  std::vector<int> path{start_cell};
+  for (std::size_t i = 1; i < abstract_cells.size(); i++) {
+    int from_cell = abstract_cells[i - 1];
+    int to_cell = abstract_cells[i];
+    if (getCluster(from_cell) == getCluster(to_cell)) {
+      findPath(from_cell, to_cell, getClusterBounds(from_cell), path);
+    } else {
+      // Entrances on either side of a border are neighbors.
+      path.push_back(to_cell);
+    }
+  }
+
+  std::vector<int> turns = straightenPath(path);
+  route.waypoints.clear();
+  route.waypoints.reserve(turns.size());
+  route.length = 0;
+  for (int cell : turns) {
+    LVector3 waypoint = getCellDirection(cell);
+    if (!route.waypoints.empty()) {
+      route.length += getDistance(route.waypoints.back(), waypoint);
+    }
+    route.waypoints.push_back(waypoint);
+  }
+  return true;
+}
+
+std::vector<SeaRoute> SeaRoutePlanner::findRoutes(
+    const std::vector<LVector3> &points) const {
+  std::size_t size = points.size();
+  std::vector<std::pair<std::size_t, std::size_t>> pairs;
+  pairs.reserve(size * size / 2);
+  for (std::size_t i = 0; i < size; i++) {
+    for (std::size_t j = i + 1; j < size; j++) {
+      pairs.push_back(std::make_pair(i, j));
+    }
+  }
+
+  // Routes are symmetric, so each pair is searched once and mirrored.
+  std::vector<SeaRoute> routes(size * size, SeaRoute{{}, 0});
+  parallel::forRange(
+      0, static_cast<int>(pairs.size()), [&](int pair_begin, int pair_end) {
+        for (int pair = pair_begin; pair < pair_end; pair++) {
+          std::size_t i = pairs[static_cast<std::size_t>(pair)].first;
+          std::size_t j = pairs[static_cast<std::size_t>(pair)].second;
+          SeaRoute &route = routes[(i * size) + j];
+          if (!findRoute(points[i], points[j], route)) {
+            continue;
+          }
+          SeaRoute &reverse_route = routes[(j * size) + i];
+          reverse_route.waypoints.assign(route.waypoints.rbegin(),
+                                         route.waypoints.rend());
+          reverse_route.length = route.length;
+        }
+      });
+  return routes;
+}
+
+void SeaRoutePlanner::rasterize(const PNMImage &land_mask,
+                                PN_stdfloat land_mask_cutoff) {
+  PNMImage land_mask_level(kGridWidth, kGridHeight, 1,
+                           land_mask.get_maxval());
+  land_mask_level.box_filter_from(0.5f, land_mask);
+  navigable_.resize(static_cast<std::size_t>(kGridWidth * kGridHeight));
+  for (int y = 0; y < kGridHeight; y++) {
+    for (int x = 0; x < kGridWidth; x++) {
+      navigable_[static_cast<std::size_t>((y * kGridWidth) + x)] =
+          land_mask_level.get_bright(x, y) > land_mask_cutoff ? 1 : 0;
+    }
+  }
+}
+
+void SeaRoutePlanner::build() {
+  // 1. Place entrances along every border with open water on both sides.
+  std::vector<std::pair<int, int>> crossings;
+  std::vector<std::pair<int, int>> border(
+      static_cast<std::size_t>(kClusterSize));
+  auto get_crossing = [&](int x, int y, int other_x, int other_y) {
+    int cell = (y * kGridWidth) + x;
+    int other_cell = (other_y * kGridWidth) + other_x;
+    if (navigable_[static_cast<std::size_t>(cell)] == 0 ||
+        navigable_[static_cast<std::size_t>(other_cell)] == 0) {
+      return std::make_pair(-1, -1);
+    }
+    return std::make_pair(cell, other_cell);
+  };
+  for (int cluster_y = 0; cluster_y < kClusterRows; cluster_y++) {
+    for (int cluster_x = 0; cluster_x < kClusterColumns; cluster_x++) {
+      // The eastern border, which wraps around the globe.
+      int x = (cluster_x * kClusterSize) + kClusterSize - 1;
+      for (int i = 0; i < kClusterSize; i++) {
+        int y = (cluster_y * kClusterSize) + i;
+        border[static_cast<std::size_t>(i)] =
+            get_crossing(x, y, (x + 1) % kGridWidth, y);
+      }
+      addEntrances(border, crossings);
+
+      // The southern border, unless at the south pole.
+      if (cluster_y < kClusterRows - 1) {
+        int y = (cluster_y * kClusterSize) + kClusterSize - 1;
+        for (int i = 0; i < kClusterSize; i++) {
+          int border_x = (cluster_x * kClusterSize) + i;
+          border[static_cast<std::size_t>(i)] =
+              get_crossing(border_x, y, border_x, y + 1);
+        }
+        addEntrances(border, crossings);
+      }
+    }
+  }
+
+  // 2. Give every entrance cell a node, sorted by cluster.
+  node_cells_.clear();
+  for (const std::pair<int, int> &crossing : crossings) {
+    node_cells_.push_back(crossing.first);
+    node_cells_.push_back(crossing.second);
+  }
+  std::sort(node_cells_.begin(), node_cells_.end(), [](int a, int b) {
+    int cluster_a = getCluster(a);
+    int cluster_b = getCluster(b);
+    return cluster_a != cluster_b ? cluster_a < cluster_b : a < b;
+  });
+  node_cells_.erase(std::unique(node_cells_.begin(), node_cells_.end()),
+                    node_cells_.end());
+  std::unordered_map<int, int> cell_nodes;
+  cluster_node_offsets_.assign(
+      static_cast<std::size_t>((kClusterColumns * kClusterRows) + 1), 0);
+  for (std::size_t node = 0; node < node_cells_.size(); node++) {
+    cell_nodes[node_cells_[node]] = static_cast<int>(node);
+    cluster_node_offsets_[static_cast<std::size_t>(
+        getCluster(node_cells_[node]) + 1)]++;
+  }
+  for (std::size_t i = 1; i < cluster_node_offsets_.size(); i++) {
+    cluster_node_offsets_[i] += cluster_node_offsets_[i - 1];
+  }
+
+  // 3. Join the entrances across each border.
+  std::vector<std::vector<Edge>> node_edges(node_cells_.size());
+  for (const std::pair<int, int> &crossing : crossings) {
+    int dx = (crossing.second % kGridWidth) - (crossing.first % kGridWidth);
+    int dy = (crossing.second / kGridWidth) - (crossing.first / kGridWidth);
+    // Undo the wrap around the globe.
+    dx = dx > 1 ? -1 : dx < -1 ? 1 : dx;
+    float cost = getStepCost(crossing.first, dx, dy);
+    int node = cell_nodes[crossing.first];
+    int other_node = cell_nodes[crossing.second];
+    node_edges[static_cast<std::size_t>(node)].push_back(
+        Edge{other_node, cost});
+    node_edges[static_cast<std::size_t>(other_node)].push_back(
+        Edge{node, cost});
+  }
+
+  // 4. Join the entrances within each cluster, where connected, across all
+  // cores. Each cluster only touches the edges of its own nodes.
+  parallel::forRange(
+      0, kClusterColumns * kClusterRows, [&](int cluster_begin,
+                                             int cluster_end) {
+        std::vector<float> costs;
+        for (int cluster = cluster_begin; cluster < cluster_end; cluster++) {
+          int node_begin =
+              cluster_node_offsets_[static_cast<std::size_t>(cluster)];
+          int node_end =
+              cluster_node_offsets_[static_cast<std::size_t>(cluster + 1)];
+          for (int node = node_begin; node < node_end; node++) {
+            int cell = node_cells_[static_cast<std::size_t>(node)];
+            Bounds bounds = getClusterBounds(cell);
+            findCosts(cell, bounds, costs);
+            for (int other_node = node_begin; other_node < node_end;
+                 other_node++) {
+              int other_cell =
+                  node_cells_[static_cast<std::size_t>(other_node)];
+              float cost = costs[static_cast<std::size_t>(
+                  (((other_cell / kGridWidth) - bounds.y_begin) *
+                   kClusterSize) +
+                  ((other_cell % kGridWidth) - bounds.x_begin))];
+              if (other_node != node && cost < kInfinity) {
+                node_edges[static_cast<std::size_t>(node)].push_back(
+                    Edge{other_node, cost});
+              }
+            }
+          }
+        }
+      });
+
+  // 5. Pack the edges together.
+  edge_offsets_.assign(node_cells_.size() + 1, 0);
+  edges_.clear();
+  for (std::size_t node = 0; node < node_cells_.size(); node++) {
+    edges_.insert(edges_.end(), node_edges[node].begin(),
+                  node_edges[node].end());
+    edge_offsets_[node + 1] = static_cast<int>(edges_.size());
+  }
+}
+
+int SeaRoutePlanner::findNearestNavigableCell(const LVector3 &point) const {
+  LVector3 direction = point.normalized();
+  int cell = getCell(direction);
+  int cell_x = cell % kGridWidth;
+  int cell_y = cell / kGridWidth;
+  int nearest_cell = -1;
+  float nearest_distance = kInfinity;
+  // The rows within reach, found without adding to the row and comparing
+  // the sum, which would rely on it not overflowing.
+  int y_begin = cell_y < kMaxSnapCells ? 0 : cell_y - kMaxSnapCells;
+  int y_end = cell_y >= kGridHeight - kMaxSnapCells
+                  ? kGridHeight
+                  : cell_y + kMaxSnapCells + 1;
+  for (int y = y_begin; y < y_end; y++) {
+    for (int dx = -kMaxSnapCells; dx <= kMaxSnapCells; dx++) {
+      int x = (cell_x + dx + kGridWidth) % kGridWidth;
+      int other_cell = (y * kGridWidth) + x;
+      if (navigable_[static_cast<std::size_t>(other_cell)] == 0) {
+        continue;
+      }
+      float distance = getDistance(getCellDirection(other_cell), direction);
+      if (distance < nearest_distance) {
+        nearest_distance = distance;
+        nearest_cell = other_cell;
+      }
+    }
+  }
+  return nearest_cell;
+}
+
+void SeaRoutePlanner::findCosts(int start, const Bounds &bounds,
+                                std::vector<float> &costs) const {
+  int bounds_width = bounds.x_end - bounds.x_begin;
+  auto get_local_index = [&](int cell) {
+    return static_cast<std::size_t>(
+        (((cell / kGridWidth) - bounds.y_begin) * bounds_width) +
+        ((cell % kGridWidth) - bounds.x_begin));
+  };
+  costs.assign(
+      static_cast<std::size_t>(bounds_width * (bounds.y_end - bounds.y_begin)),
+      kInfinity);
+  Queue queue;
+  costs[get_local_index(start)] = 0;
+  queue.push(QueueEntry(0, start));
+  while (!queue.empty()) {
+    float cost = queue.top().first;
+    int cell = queue.top().second;
+    queue.pop();
+    if (cost > costs[get_local_index(cell)]) {
+      continue;
+    }
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        int next_cell = getNavigableNeighbor(cell, dx, dy);
+        if ((dx == 0 && dy == 0) || next_cell < 0) {
+          continue;
+        }
+        int x = next_cell % kGridWidth;
+        int y = next_cell / kGridWidth;
+        if (x < bounds.x_begin || x >= bounds.x_end || y < bounds.y_begin ||
+            y >= bounds.y_end) {
+          continue;
+        }
+        float next_cost = cost + getStepCost(cell, dx, dy);
+        float &best_cost = costs[get_local_index(next_cell)];
+        if (next_cost < best_cost) {
+          best_cost = next_cost;
+          queue.push(QueueEntry(next_cost, next_cell));
+        }
+      }
+    }
+  }
+}
+
+bool SeaRoutePlanner::findPath(int start, int goal, const Bounds &bounds,
+                               std::vector<int> &path) const {
+  if (start == goal) {
+    return true;
+  }
+  int bounds_width = bounds.x_end - bounds.x_begin;
+  std::size_t area =
+      static_cast<std::size_t>(bounds_width * (bounds.y_end - bounds.y_begin));
+  auto get_local_index = [&](int cell) {
+    return static_cast<std::size_t>(
+        (((cell / kGridWidth) - bounds.y_begin) * bounds_width) +
+        ((cell % kGridWidth) - bounds.x_begin));
+  };
+  std::vector<float> costs(area, kInfinity);
+  std::vector<int> parents(area, -1);
+  LVector3 goal_direction = getCellDirection(goal);
+  Queue queue;
+  costs[get_local_index(start)] = 0;
+  queue.push(QueueEntry(getDistance(getCellDirection(start), goal_direction),
+                        start));
+  bool found = false;
+  while (!queue.empty()) {
+    int cell = queue.top().second;
+    queue.pop();
+    if (cell == goal) {
+      found = true;
+      break;
+    }
+    float cost = costs[get_local_index(cell)];
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        int next_cell = getNavigableNeighbor(cell, dx, dy);
+        if ((dx == 0 && dy == 0) || next_cell < 0) {
+          continue;
+        }
+        int x = next_cell % kGridWidth;
+        int y = next_cell / kGridWidth;
+        if (x < bounds.x_begin || x >= bounds.x_end || y < bounds.y_begin ||
+            y >= bounds.y_end) {
+          continue;
+        }
+        float next_cost = cost + getStepCost(cell, dx, dy);
+        std::size_t next_index = get_local_index(next_cell);
+        if (next_cost < costs[next_index]) {
+          costs[next_index] = next_cost;
+          parents[next_index] = cell;
+          queue.push(QueueEntry(
+              next_cost +
+                  getDistance(getCellDirection(next_cell), goal_direction),
+              next_cell));
+        }
+      }
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  std::size_t path_size = path.size();
+  for (int cell = goal; cell != start;
+       cell = parents[get_local_index(cell)]) {
+    path.push_back(cell);
+  }
+  std::reverse(path.begin() + static_cast<std::ptrdiff_t>(path_size),
+               path.end());
+  return true;
+}
+
+std::vector<int> SeaRoutePlanner::straightenPath(
+    const std::vector<int> &path) const {
+  std::vector<int> turns{path.front()};
+  std::size_t last = path.size() - 1;
+  std::size_t turn = 0;
+  while (turn < last) {
+    // Gallop ahead while the way stays clear, then narrow down to the
+    // farthest cell in sight between the last clear and first blocked ones.
+    std::size_t clear = turn + 1;
+    std::size_t blocked = last + 1;
+    std::size_t stride = 1;
+    while (clear < last) {
+      std::size_t next = std::min(last, clear + stride);
+      if (!isArcNavigable(path[turn], path[next])) {
+        blocked = next;
+        break;
+      }
+      clear = next;
+      stride *= 2;
+    }
+    while (blocked - clear > 1) {
+      std::size_t middle = clear + ((blocked - clear) / 2);
+      if (isArcNavigable(path[turn], path[middle])) {
+        clear = middle;
+      } else {
+        blocked = middle;
+      }
+    }
+    turns.push_back(path[clear]);
+    turn = clear;
+  }
+  return turns;
+}
+
+bool SeaRoutePlanner::isArcNavigable(int from_cell, int to_cell) const {
+  LVector3 from = getCellDirection(from_cell);
+  LVector3 to = getCellDirection(to_cell);
+  float angle = getDistance(from, to);
+  // Near antipodal arcs have no well defined great circle.
+  if (angle > MathNumbers::pi - 1e-3) {
+    return false;
+  }
+  float sin_angle = sinf(angle);
+  if (sin_angle < 1e-6f) {
+    return true;
+  }
+  // Sample every half a cell along the arc.
+  int sample_count = static_cast<int>(
+      std::ceil(angle / (0.5f * static_cast<float>(MathNumbers::pi) /
+                         kGridHeight)));
+  for (int i = 1; i < sample_count; i++) {
+    float t = static_cast<float>(i) / sample_count;
+    LVector3 point = (from * (sinf((1 - t) * angle) / sin_angle)) +
+                     (to * (sinf(t * angle) / sin_angle));
+    if (navigable_[static_cast<std::size_t>(getCell(point))] == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int SeaRoutePlanner::getNavigableNeighbor(int cell, int dx, int dy) const {
+  int x = cell % kGridWidth;
+  int y = cell / kGridWidth;
+  int next_x = (x + dx + kGridWidth) % kGridWidth;
+  int next_y = y + dy;
+  if (next_y < 0 || next_y >= kGridHeight) {
+    return -1;
+  }
+  int next_cell = (next_y * kGridWidth) + next_x;
+  if (navigable_[static_cast<std::size_t>(next_cell)] == 0) {
+    return -1;
+  }
+  if (dx != 0 && dy != 0 &&
+      (navigable_[static_cast<std::size_t>((y * kGridWidth) + next_x)] == 0 ||
+       navigable_[static_cast<std::size_t>((next_y * kGridWidth) + x)] ==
+           0)) {
+    return -1;
+  }
+  return next_cell;
+}
+
+SeaRoutePlanner::Bounds SeaRoutePlanner::getClusterBounds(int cell) {
+  int x_begin = ((cell % kGridWidth) / kClusterSize) * kClusterSize;
+  int y_begin = ((cell / kGridWidth) / kClusterSize) * kClusterSize;
+  return Bounds{x_begin, x_begin + kClusterSize, y_begin,
+                y_begin + kClusterSize};
+}
+
+int SeaRoutePlanner::getCluster(int cell) {
+  int cluster_x = (cell % kGridWidth) / kClusterSize;
+  int cluster_y = (cell / kGridWidth) / kClusterSize;
+  return (cluster_y * kClusterColumns) + cluster_x;
+}
+
+int SeaRoutePlanner::getCell(const LVector3 &point) {
+  const float pi = static_cast<float>(MathNumbers::pi);
+  float longitude = atan2f(point.get_y(), point.get_x());
+  if (longitude < 0) {
+    longitude += 2 * pi;
+  }
+  float latitude = asinf(
+      std::max(-1.f, std::min(1.f, point.get_z() / point.length())));
+  int x = std::min(kGridWidth - 1,
+                   static_cast<int>(longitude / (2 * pi) * kGridWidth));
+  // Rows run from north to south.
+  int y = std::max(0, std::min(kGridHeight - 1,
+                               static_cast<int>((0.5f - (latitude / pi)) *
+                                                kGridHeight)));
+  return (y * kGridWidth) + x;
+}
+
+LVector3 SeaRoutePlanner::getCellDirection(int cell) {
+  const float pi = static_cast<float>(MathNumbers::pi);
+  float longitude =
+      ((static_cast<float>(cell % kGridWidth) + 0.5f) / kGridWidth) * 2 * pi;
+  float latitude =
+      (0.5f - ((static_cast<float>(cell / kGridWidth) + 0.5f) / kGridHeight)) *
+      pi;
+  return LVector3(cosf(latitude) * cosf(longitude),
+                  cosf(latitude) * sinf(longitude), sinf(latitude));
+}
+
+float SeaRoutePlanner::getStepCost(int cell, int dx, int dy) {
+  const float pi = static_cast<float>(MathNumbers::pi);
+  // Measure east-west steps along the parallel halfway through the step.
+  float row = static_cast<float>(cell / kGridWidth) + 0.5f + (0.5f * dy);
+  float latitude = (0.5f - (row / kGridHeight)) * pi;
+  float east = cosf(latitude) * (2 * pi / kGridWidth) * static_cast<float>(dx);
+  float north = (pi / kGridHeight) * static_cast<float>(dy);
+  return sqrtf((east * east) + (north * north));
+}
+
+float SeaRoutePlanner::getDistance(const LVector3 &from, const LVector3 &to) {
+  return atan2f(from.cross(to).length(), from.dot(to));
+}
+
+}  // namespace earth_world
@@ -0,0 +1,176 @@
+#ifndef EARTH_WORLD_SEA_ROUTE_PLANNER_H
+#define EARTH_WORLD_SEA_ROUTE_PLANNER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/pnmImage.h"
+
+namespace earth_world {
+
+/** A navigable route across the sea. */
+struct SeaRoute {
+  /** The route's turning points on the unit sphere, joined by great circles. */
+  std::vector<LVector3> waypoints;
+  /** The route's length, in radians. */
+  PN_stdfloat length;
+};
+
+/**
+ * Plans the shortest routes across the sea, over a grid of navigable cells
+ * downsampled from the land mask.
+ *
+ * Searching the grid directly would touch millions of cells per route, so in
+ * the style of HPA* the grid is split into square clusters. Wherever two
+ * neighboring clusters share open water along their border, an entrance is
+ * placed on either side, and the cost between every pair of entrances within
+ * a cluster is precomputed. A route is first found over this abstract graph,
+ * then refined into cells one cluster at a time, and finally straightened
+ * into great circles wherever there is open water between its turns.
+ *
+ * The grid follows the charted coasts, at the charted sea level, so routes
+ * don't change as the sea rises or falls.
+ */
+class SeaRoutePlanner {
+ public:
+  /**
+   * Loads the abstract graph from the cache, or builds it across all cores
+   * from the land mask and caches it if missing.
+   * @param land_mask The mask of water, where brighter than the cutoff.
+   * @param land_mask_cutoff The cutoff between land and water.
+   * @param source_hash The hash of the mask's source and the cutoff, which
+   *     the cached graph must have been built from.
+   */
+  SeaRoutePlanner(const PNMImage &land_mask, PN_stdfloat land_mask_cutoff,
+                  uint64_t source_hash);
+  /**
+   * Builds the abstract graph across all cores from the land mask, without
+   * caching it.
+   * @param land_mask The mask of water, where brighter than the cutoff.
+   * @param land_mask_cutoff The cutoff between land and water.
+   */
+  SeaRoutePlanner(const PNMImage &land_mask, PN_stdfloat land_mask_cutoff);
+  SeaRoutePlanner(const SeaRoutePlanner &) = default;
+  SeaRoutePlanner(SeaRoutePlanner &&) noexcept = default;
+  SeaRoutePlanner &operator=(const SeaRoutePlanner &) = default;
+  SeaRoutePlanner &operator=(SeaRoutePlanner &&) noexcept = default;
+  ~SeaRoutePlanner() = default;
+
+  /**
+   * Finds the shortest route across the sea between two points, starting and
+   * ending at the open water nearest each, such as for coastal cities.
+   * @param from The point to start from, relative to the globe's center.
+   * @param to The point to end at, relative to the globe's center.
+   * @param route Filled with the route, if there is one.
+   * @return True if there is a route, false if either point is too far from
+   *     the sea or the two are on unconnected waters.
+   */
+  bool findRoute(const LVector3 &from, const LVector3 &to,
+                 SeaRoute &route) const;
+
+  /**
+   * Finds the routes between every pair of points, across all cores.
+   * @param points The points, relative to the globe's center.
+   * @return The route from point i to point j at index (i * size + j), with
+   *     no waypoints where there is no route.
+   */
+  std::vector<SeaRoute> findRoutes(const std::vector<LVector3> &points) const;
+
+ protected:
+  /** An edge of the abstract graph. */
+  struct Edge {
+    int node;
+    float cost;
+  };
+
+  /** Cells a search may visit, as a half open rectangle of the grid. */
+  struct Bounds {
+    int x_begin;
+    int x_end;
+    int y_begin;
+    int y_end;
+  };
+
+  /** Per cell, north first, 1 where the sea is navigable. */
+  std::vector<uint8_t> navigable_;
+  /** Per abstract node, the cell it sits on, sorted by cluster. */
+  std::vector<int> node_cells_;
+  /** Per cluster, the first of its nodes, followed by the node count. */
+  std::vector<int> cluster_node_offsets_;
+  /** Per node, the first of its edges, followed by the edge count. */
+  std::vector<int> edge_offsets_;
+  std::vector<Edge> edges_;
+
+  /** Finds the navigable cells, by downsampling the land mask. */
+  void rasterize(const PNMImage &land_mask, PN_stdfloat land_mask_cutoff);
+
+  /** Builds the abstract graph over the navigable cells. */
+  void build();
+
+  /** @return The nearest navigable cell to a point, or -1 if none is near. */
+  int findNearestNavigableCell(const LVector3 &point) const;
+
+  /**
+   * Finds the cost from a cell to every other cell within bounds, by
+   * Dijkstra's algorithm.
+   * @param start The cell to start from.
+   * @param bounds The cells the search may visit.
+   * @param costs Filled with the cost to each cell within bounds, indexed
+   *     relative to the bounds, and infinite where unreachable.
+   */
+  void findCosts(int start, const Bounds &bounds,
+                 std::vector<float> &costs) const;
+
+  /**
+   * Finds the shortest path between two cells within bounds, by A*.
+   * @param start The cell to start from.
+   * @param goal The cell to end at.
+   * @param bounds The cells the search may visit.
+   * @param path Appended with the path's cells after the start.
+   * @return True if there is a path.
+   */
+  bool findPath(int start, int goal, const Bounds &bounds,
+                std::vector<int> &path) const;
+
+  /**
+   * Straightens a path of cells, by skipping every turn which has open water
+   * along the great circle past it.
+   * @return The cells the straightened path turns at.
+   */
+  std::vector<int> straightenPath(const std::vector<int> &path) const;
+
+  /** @return True if the great circle between two cells is all navigable. */
+  bool isArcNavigable(int from_cell, int to_cell) const;
+
+  /**
+   * @param cell A cell.
+   * @param dx The step in x, which wraps around.
+   * @param dy The step in y.
+   * @return The cell a step away, or -1 if the step leaves the grid or runs
+   *     aground, including by cutting a corner of land.
+   */
+  int getNavigableNeighbor(int cell, int dx, int dy) const;
+
+  /** @return The bounds of the cluster a cell belongs to. */
+  static Bounds getClusterBounds(int cell);
+
+  /** @return The index of the cluster a cell belongs to. */
+  static int getCluster(int cell);
+
+  /** @return The cell a point falls in. */
+  static int getCell(const LVector3 &point);
+
+  /** @return The unit direction through the center of a cell. */
+  static LVector3 getCellDirection(int cell);
+
+  /** @return The cost of a step from a cell, by the given amounts. */
+  static float getStepCost(int cell, int dx, int dy);
+
+  /** @return The great circle distance between two unit vectors. */
+  static float getDistance(const LVector3 &from, const LVector3 &to);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SEA_ROUTE_PLANNER_H
@@ -0,0 +1,219 @@
+#include "shader_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "cache.h"
+#include "filename.h"
+#include "panda3d/executionEnvironment.h"
+#include "panda3d/graphicsEngine.h"
+
+namespace earth_world {
+namespace shader_cache {
+
+const uint32_t kManifestVersion = 2;
+const std::string kManifestName = "shader_manifest.txt";
+const std::string kDriverCacheName = "shaders";
+const std::string kIncludeDirective = "#pragma include";
+
+struct State {
+  GraphicsStateGuardian *state_guardian = nullptr;
+  /** The driver's vendor, renderer and version, folded into every key. */
+  std::string driver;
+  /**
+   * The hash of every shader's sources and the driver it was compiled for,
+   * as of the previous run.
+   */
+  std::map<std::string, uint64_t> manifest;
+  /** How long compiling took the last time any shader changed. */
+  double cold_milliseconds = 0;
+  int compiled_count = 0;
+  /** The number of shaders unchanged since the previous run. */
+  int unchanged_count = 0;
+};
+
+static State &getState() {
+  static State state;
+  return state;
+}
+
+/**
+ * Appends the given shader's source to the output, expanding its includes
+ * the same way Panda does, where each file is only included once.
+ */
+static void appendExpandedSource(const std::string &name,
+                                 std::set<std::string> &included,
+                                 std::string &output) {
+  if (!included.insert(name).second) {
+    return;
+  }
+  std::ifstream stream(filename::forShader(name).to_os_specific());
+  std::string line;
+  while (std::getline(stream, line)) {
+    std::string::size_type directive = line.find(kIncludeDirective);
+    std::string::size_type open_quote = line.find('"');
+    std::string::size_type close_quote = line.rfind('"');
+    if (directive != std::string::npos && open_quote != std::string::npos &&
+        close_quote > open_quote) {
+      appendExpandedSource(
+          line.substr(open_quote + 1, close_quote - open_quote - 1), included,
+          output);
+    } else {
+      output += line;
+      output += '\n';
+    }
+  }
+}
+
+/** @return The cache key for the program made of the given shaders. */
+static uint64_t getKey(const std::vector<std::string> &names) {
+  const std::string &driver = getState().driver;
+  uint64_t key =
+      cache::hashBytes(driver.data(), driver.size(), cache::kNoInputHash);
+  for (const std::string &name : names) {
+    std::set<std::string> included;
+    std::string source;
+    appendExpandedSource(name, included, source);
+    key = cache::hashBytes(source.data(), source.size(), key);
+  }
+  return key;
+}
+
+/**
+ * Queues the shader to be compiled on the GSG with the next frame, rather
+ * than when first drawn. The GL context belongs to the draw thread, so the
+ * shader can't be compiled right away from the app thread.
+ */
+static void compile(const std::string &name, PT<Shader> shader,
+                    uint64_t key) {
+  State &state = getState();
+  if (state.state_guardian == nullptr || shader.is_null()) {
+    return;
+  }
+  shader->prepare(state.state_guardian->get_prepared_objects());
+  state.compiled_count++;
+
+  std::map<std::string, uint64_t>::iterator entry = state.manifest.find(name);
+  if (entry != state.manifest.end() && entry->second == key) {
+    state.unchanged_count++;
+  } else {
+    // The source or the driver changed, so whatever the driver had cached
+    // was of no use.
+    state.manifest[name] = key;
+  }
+}
+
+/**
+ * Sets an environment variable for the driver to read, unless the user has
+ * already set it. Goes through Panda, as setenv isn't available everywhere.
+ */
+static void setDefaultVariable(const std::string &name,
+                               const std::string &value) {
+  if (!ExecutionEnvironment::has_environment_variable(name)) {
+    ExecutionEnvironment::set_environment_variable(name, value);
+  }
+}
+
+void configureDriverCache() {
+  Filename directory = filename::forCache(kDriverCacheName);
+  directory.make_dir();
+  directory.mkdir();
+  std::string path = directory.to_os_specific();
+  // Mesa.
+  setDefaultVariable("MESA_SHADER_CACHE_DIR", path);
+  // NVIDIA.
+  setDefaultVariable("__GL_SHADER_DISK_CACHE", "1");
+  setDefaultVariable("__GL_SHADER_DISK_CACHE_PATH", path);
+  setDefaultVariable("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+}
+
+void open(GraphicsStateGuardian *state_guardian) {
+  State &state = getState();
+  state.state_guardian = state_guardian;
+  if (state_guardian != nullptr) {
+    state.driver = state_guardian->get_driver_vendor() + "\n" +
+                   state_guardian->get_driver_renderer() + "\n" +
+                   state_guardian->get_driver_version();
+  }
+
+  std::vector<unsigned char> data;
+  if (!cache::read(kManifestName, kManifestVersion, data)) {
+    return;
+  }
+  std::istringstream stream(std::string(data.begin(), data.end()));
+  stream >> state.cold_milliseconds;
+  std::string name;
+  uint64_t key;
+  while (stream >> name >> key) {
+    state.manifest[name] = key;
+  }
+}
+
+PT<Shader> load(const std::string &vertex_name,
+                const std::string &fragment_name) {
+  PT<Shader> shader =
+      Shader::load(Shader::SL_GLSL, filename::forShader(vertex_name),
+                   filename::forShader(fragment_name));
+  compile(vertex_name + "+" + fragment_name, shader,
+          getKey({vertex_name, fragment_name}));
+  return shader;
+}
+
+PT<Shader> loadCompute(const std::string &compute_name) {
+  PT<Shader> shader = Shader::load_compute(
+      Shader::SL_GLSL, filename::forShader(compute_name));
+  compile(compute_name, shader, getKey({compute_name}));
+  return shader;
+}
+
+void finishStartup(std::ostream &out) {
+  State &state = getState();
+  if (state.state_guardian == nullptr) {
+    return;
+  }
+  // The queued shaders are compiled as the first frame is drawn, which is
+  // timed as a whole, waiting for the draw thread to be done with it.
+  GraphicsEngine *engine = state.state_guardian->get_engine();
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  engine->render_frame();
+  engine->sync_frame();
+  double milliseconds = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  bool cold = state.unchanged_count < state.compiled_count ||
+              state.cold_milliseconds <= 0;
+  if (cold) {
+    state.cold_milliseconds = milliseconds;
+  }
+
+  std::ostringstream manifest;
+  manifest << state.cold_milliseconds << "\n";
+  for (const std::pair<const std::string, uint64_t> &entry : state.manifest) {
+    manifest << entry.first << " " << entry.second << "\n";
+  }
+  std::string manifest_data = manifest.str();
+  cache::write(kManifestName, kManifestVersion, manifest_data.data(),
+               manifest_data.size());
+
+  out << "Compiled " << state.compiled_count << " shaders with the first frame"
+      << " in " << milliseconds << " ms, " << state.unchanged_count
+      << " unchanged since the last run";
+  if (cold) {
+    out << "." << std::endl;
+  } else {
+    // Anything else that changed between the runs counts too, so this is
+    // only an estimate of what the driver's cache saved.
+    out << ", an estimated "
+        << std::max(0.0, state.cold_milliseconds - milliseconds)
+        << " ms faster than the last cold start." << std::endl;
+  }
+}
+
+}  // namespace shader_cache
+}  // namespace earth_world
@@ -0,0 +1,69 @@
+#ifndef EARTH_WORLD_SHADER_CACHE_H
+#define EARTH_WORLD_SHADER_CACHE_H
+
+#include <ostream>
+#include <string>
+
+#include "panda3d/graphicsStateGuardian.h"
+#include "panda3d/shader.h"
+#include "typedefs.h"
+
+namespace earth_world {
+namespace shader_cache {
+/**
+ * Loads shaders and compiles them upfront, keeping the compiled programs on
+ * disk between runs.
+ *
+ * Panda doesn't expose GL program binaries, so the binaries themselves are
+ * left to the driver's own disk cache, which is pointed into the cache
+ * directory. Whether the driver actually hits its cache can't be seen from
+ * here. A manifest keys every shader by a hash of its include-expanded
+ * sources and the driver's vendor, renderer and version, so that a changed
+ * source or driver is recognized as a cold compile. The time saved is only
+ * estimated, from how much faster startup compiled than the last cold one.
+ */
+
+/**
+ * Points the driver's shader disk cache into the cache directory. Must be
+ * called before the first window is opened, and leaves any cache location
+ * the user has configured themselves alone.
+ */
+void configureDriverCache();
+
+/**
+ * Starts queueing shaders to be compiled on the given graphics state
+ * guardian, and reads the manifest of previous runs.
+ * @param state_guardian The GSG to compile shaders on. If null, shaders are
+ *     only loaded, and compiled by Panda when first used.
+ */
+void open(GraphicsStateGuardian *state_guardian);
+
+/**
+ * Loads and compiles a GLSL shader program.
+ * @param vertex_name The vertex shader, relative to the shaders directory.
+ * @param fragment_name The fragment shader, relative to the shaders
+ *     directory.
+ * @return The loaded shader.
+ */
+PT<Shader> load(const std::string &vertex_name,
+                const std::string &fragment_name);
+
+/**
+ * Loads and compiles a GLSL compute shader.
+ * @param compute_name The compute shader, relative to the shaders directory.
+ * @return The loaded shader.
+ */
+PT<Shader> loadCompute(const std::string &compute_name);
+
+/**
+ * Draws the first frame, which compiles the queued shaders on the draw
+ * thread, then writes the manifest for the next run, and reports how long
+ * compiling took, and an estimate of how much of that the cache saved.
+ * @param out The stream to report to.
+ */
+void finishStartup(std::ostream &out);
+
+}  // namespace shader_cache
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SHADER_CACHE_H
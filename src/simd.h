@@ -0,0 +1,144 @@
+#ifndef EARTH_WORLD_SIMD_H
+#define EARTH_WORLD_SIMD_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#include <cmath>
+#endif
+
+namespace earth_world {
+namespace simd {
+/**
+ * A thin wrapper over four packed floats, for loops over structure-of-arrays
+ * data. Uses SSE2 when available, and otherwise falls back to plain scalar
+ * code with the same semantics.
+ */
+
+#if defined(__SSE2__)
+struct Float4 {
+  __m128 v;
+};
+
+inline Float4 load(const float *p) { return Float4{_mm_loadu_ps(p)}; }
+inline void store(float *p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 splat(float a) { return Float4{_mm_set1_ps(a)}; }
+inline Float4 add(Float4 a, Float4 b) { return Float4{_mm_add_ps(a.v, b.v)}; }
+inline Float4 sub(Float4 a, Float4 b) { return Float4{_mm_sub_ps(a.v, b.v)}; }
+inline Float4 mul(Float4 a, Float4 b) { return Float4{_mm_mul_ps(a.v, b.v)}; }
+inline Float4 div(Float4 a, Float4 b) { return Float4{_mm_div_ps(a.v, b.v)}; }
+inline Float4 min(Float4 a, Float4 b) { return Float4{_mm_min_ps(a.v, b.v)}; }
+inline Float4 max(Float4 a, Float4 b) { return Float4{_mm_max_ps(a.v, b.v)}; }
+inline Float4 sqrt(Float4 a) { return Float4{_mm_sqrt_ps(a.v)}; }
+
+/** @return A lane mask of all ones where a >= b, and zeros elsewhere. */
+inline Float4 greaterEqual(Float4 a, Float4 b) {
+  return Float4{_mm_cmpge_ps(a.v, b.v)};
+}
+
+/** @return A lane mask of all ones where a < b, and zeros elsewhere. */
+inline Float4 less(Float4 a, Float4 b) {
+  return Float4{_mm_cmplt_ps(a.v, b.v)};
+}
+
+/** @return The lanes of a where the mask is set, and of b elsewhere. */
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+  return Float4{_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+
+inline Float4 abs(Float4 a) {
+  return Float4{_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)};
+}
+inline Float4 negate(Float4 a) {
+  return Float4{_mm_xor_ps(_mm_set1_ps(-0.f), a.v)};
+}
+
+/** @return Each lane rounded to the nearest integer, with ties to even. */
+inline Float4 round(Float4 a) {
+  return Float4{_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))};
+}
+
+/** @return The sign bit of each lane, with lane 0 as the lowest bit. */
+inline int moveMask(Float4 a) { return _mm_movemask_ps(a.v); }
+#else
+struct Float4 {
+  float v[4];
+};
+
+inline Float4 load(const float *p) { return Float4{{p[0], p[1], p[2], p[3]}}; }
+inline void store(float *p, Float4 a) {
+  for (int i = 0; i < 4; i++) p[i] = a.v[i];
+}
+inline Float4 splat(float a) { return Float4{{a, a, a, a}}; }
+
+#define EARTH_WORLD_SIMD_LANEWISE(name, expression)      \
+  inline Float4 name(Float4 a, Float4 b) {              \
+    Float4 r;                                           \
+    for (int i = 0; i < 4; i++) r.v[i] = (expression); \
+    return r;                                           \
+  }
+EARTH_WORLD_SIMD_LANEWISE(add, a.v[i] + b.v[i])
+EARTH_WORLD_SIMD_LANEWISE(sub, a.v[i] - b.v[i])
+EARTH_WORLD_SIMD_LANEWISE(mul, a.v[i] * b.v[i])
+EARTH_WORLD_SIMD_LANEWISE(div, a.v[i] / b.v[i])
+EARTH_WORLD_SIMD_LANEWISE(min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+EARTH_WORLD_SIMD_LANEWISE(max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef EARTH_WORLD_SIMD_LANEWISE
+
+inline Float4 sqrt(Float4 a) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = sqrtf(a.v[i]);
+  return r;
+}
+
+/** @return A lane mask of all ones where a >= b, and zeros elsewhere. */
+inline Float4 greaterEqual(Float4 a, Float4 b) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i] >= b.v[i] ? -1.f : 0.f;
+  return r;
+}
+
+/** @return A lane mask of all ones where a < b, and zeros elsewhere. */
+inline Float4 less(Float4 a, Float4 b) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? -1.f : 0.f;
+  return r;
+}
+
+/** @return The lanes of a where the mask is set, and of b elsewhere. */
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i];
+  return r;
+}
+
+inline Float4 abs(Float4 a) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = fabsf(a.v[i]);
+  return r;
+}
+inline Float4 negate(Float4 a) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = -a.v[i];
+  return r;
+}
+
+/** @return Each lane rounded to the nearest integer, with ties to even. */
+inline Float4 round(Float4 a) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = nearbyintf(a.v[i]);
+  return r;
+}
+
+/** @return The sign bit of each lane, with lane 0 as the lowest bit. */
+inline int moveMask(Float4 a) {
+  int mask = 0;
+  for (int i = 0; i < 4; i++) mask |= (a.v[i] < 0 ? 1 : 0) << i;
+  return mask;
+}
+#endif
+
+}  // namespace simd
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SIMD_H
@@ -0,0 +1,140 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "geodesy.h"
+#include "quaternion.h"
+
+namespace earth_world {
+
+const PN_stdfloat kBoatSpeed = 0.07f;
+/** How far the boat keeps from the coast, in radians. */
+const PN_stdfloat kBoatCoastClearance = 0.002f;
+const PN_stdfloat kCameraDistanceMin = 7.f;
+const PN_stdfloat kCameraDistanceMax = 20.f;
+const PN_stdfloat kCameraZoomSpeed = 5.f;
+/** The most steps taken at once, beyond which the simulation falls behind. */
+const int kMaxStepsPerAdvance = 8;
+/** The seed of the fleet's random choices, so that it sails the same way. */
+const uint32_t kFleetSeed = 1;
+
+Simulation::Simulation(const Globe &globe, double step_duration,
+                       int fleet_size)
+    : step_duration_{step_duration},
+      accumulated_time_{0},
+      step_count_{0},
+      input_{0},
+      previous_state_{
+          LVector3(SpherePoint2(/* azimuthal= */ 0, /* polar= */ 0)
+                       .toCartesian()),
+          0.f, kCameraDistanceMin},
+      state_{previous_state_},
+      fleet_{globe.getCoastDistanceField(), fleet_size, kFleetSeed} {}
+
+void Simulation::setInput(const LVector3 &input) { input_ = input; }
+
+int Simulation::advance(const Globe &globe, double elapsed_time) {
+  return takeSteps(globe, elapsed_time, nullptr);
+}
+
+int Simulation::advance(const Globe &globe, double elapsed_time,
+                        const InputLog &input_log) {
+  return takeSteps(globe, elapsed_time, &input_log);
+}
+
+const SimulationState &Simulation::getState() const { return state_; }
+
+PN_stdfloat Simulation::getInterpolationFactor() const {
+  return static_cast<PN_stdfloat>(accumulated_time_ / step_duration_);
+}
+
+SimulationState Simulation::getInterpolatedState(PN_stdfloat t) const {
+  SimulationState interpolated_state;
+  interpolated_state.boat_unit_position = geodesy::slerp(
+      previous_state_.boat_unit_position, state_.boat_unit_position, t);
+  // Turn the short way around.
+  PN_stdfloat turn = state_.boat_heading - previous_state_.boat_heading;
+  turn -= 2 * MathNumbers::pi *
+          std::round(turn / (2 * static_cast<PN_stdfloat>(MathNumbers::pi)));
+  interpolated_state.boat_heading = previous_state_.boat_heading + (t * turn);
+  interpolated_state.camera_distance =
+      previous_state_.camera_distance +
+      (t * (state_.camera_distance - previous_state_.camera_distance));
+  return interpolated_state;
+}
+
+double Simulation::getStepDuration() const { return step_duration_; }
+
+const Fleet &Simulation::getFleet() const { return fleet_; }
+
+unsigned long Simulation::getStepCount() const { return step_count_; }
+
+int Simulation::takeSteps(const Globe &globe, double elapsed_time,
+                          const InputLog *input_log) {
+  accumulated_time_ += std::max(0.0, elapsed_time);
+  int step_count = 0;
+  while (accumulated_time_ >= step_duration_) {
+    if (step_count == kMaxStepsPerAdvance) {
+      // Drop whatever time is left, rather than trying to catch up on it.
+      accumulated_time_ = std::fmod(accumulated_time_, step_duration_);
+      break;
+    }
+    if (input_log != nullptr) {
+      input_ = input_log->getInput(step_count_);
+    }
+    step(globe);
+    accumulated_time_ -= step_duration_;
+    step_count++;
+  }
+  return step_count;
+}
+
+void Simulation::step(const Globe &globe) {
+  previous_state_ = state_;
+  step_count_++;
+  PN_stdfloat step_duration = static_cast<PN_stdfloat>(step_duration_);
+
+  // Determine the velocity, by using the input in the basis of the camera,
+  // which looks straight down at the boat.
+  LQuaternion camera_rotation =
+      quaternion::fromLookAt(-state_.boat_unit_position, LVector3::up());
+  LVector3 camera_right = camera_rotation.get_right();
+  LVector3 camera_up = camera_rotation.get_up();
+  LVector3 heading =
+      (camera_right * input_.get_x()) + (camera_up * input_.get_y());
+  heading.normalize();
+  LVector3 position_delta =
+      (heading * kBoatSpeed * step_duration) +
+      (ocean_currents_.getField().getVelocity(state_.boat_unit_position) *
+       step_duration);
+
+  // Sweep the boat across the water, sliding along any coast in the way.
+  state_.boat_unit_position = globe.moveAcrossWater(
+      state_.boat_unit_position, position_delta, kBoatCoastClearance);
+
+  // Update the heading if the input was non zero.
+  if (!IS_NEARLY_ZERO(input_.get_x()) || !IS_NEARLY_ZERO(input_.get_y())) {
+    LVector2 normalized_input = input_.get_xy().normalized();
+    PN_stdfloat new_heading =
+        atan2f(normalized_input.get_y(), normalized_input.get_x());
+    if (new_heading < 0) {
+      new_heading += 2 * MathNumbers::pi;
+    }
+    state_.boat_heading = new_heading;
+  }
+
+  // Update the camera distance.
+  PN_stdfloat camera_distance_delta =
+      input_.get_z() * step_duration * kCameraZoomSpeed;
+  state_.camera_distance =
+      std::max(kCameraDistanceMin,
+               std::min(kCameraDistanceMax,
+                        state_.camera_distance + camera_distance_delta));
+
+  fleet_.update(globe.getCoastDistanceField(), ocean_currents_.getField(),
+                step_duration);
+  ocean_currents_.step(step_duration_);
+}
+
+}  // namespace earth_world
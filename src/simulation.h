@@ -0,0 +1,132 @@
+#ifndef EARTH_WORLD_SIMULATION_H
+#define EARTH_WORLD_SIMULATION_H
+
+#include "fleet.h"
+#include "globe.h"
+#include "input_log.h"
+#include "ocean_currents.h"
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+
+/** The simulated time per step, independent of the frame rate. */
+const double kSimulationStepDuration = 1.0 / 30;
+/** The number of ships in the fleet. */
+const int kFleetSize = 4096;
+/** The globe's radius in render units. */
+const PN_stdfloat kGlobeScale = 20.f;
+/** How close, in render units, the boat must come to a city to reach it. */
+const PN_stdfloat kCityReachDistance = 0.27f;
+
+/** Everything the simulation moves, as of one of its steps. */
+struct SimulationState {
+  /** The boat's position, as a unit vector from the globe's center. */
+  LVector3 boat_unit_position;
+  /** The boat's heading, counter-clockwise from the camera's right. */
+  PN_stdfloat boat_heading;
+  /** How far the camera floats above the boat. */
+  PN_stdfloat camera_distance;
+};
+
+/**
+ * Moves the boat, the camera and the fleet in fixed steps, independent of
+ * the frame rate, so that the same input always leads to the same states,
+ * and the step rate can be set apart from the frame rate.
+ *
+ * Real time is accumulated across frames and spent a whole step at a time,
+ * carrying the remainder over to the next frame. Frames are drawn between
+ * the last two states, at the fraction of a step left over, so that motion
+ * stays smooth however few steps are taken per frame.
+ */
+class Simulation {
+ public:
+  /**
+   * @param globe The globe the boats sail on.
+   * @param step_duration The simulated time each step covers, in seconds.
+   * @param fleet_size The number of ships in the fleet.
+   */
+  Simulation(const Globe &globe, double step_duration, int fleet_size);
+  Simulation(const Simulation &) = default;
+  Simulation(Simulation &&) noexcept = default;
+  Simulation &operator=(const Simulation &) = default;
+  Simulation &operator=(Simulation &&) noexcept = default;
+  ~Simulation() = default;
+
+  /**
+   * Sets the input the following steps apply.
+   * @param input The user's input, where the X axis is horizontal motion,
+   *     the Y axis is vertical motion, the Z axis is zoom level.
+   */
+  void setInput(const LVector3 &input);
+
+  /**
+   * Takes as many steps as fit in the real time elapsed, along with what
+   * was left over before. Falls behind rather than taking more than a few
+   * steps at once, so that a long stall can't snowball into longer ones.
+   * @param globe The globe the boat sails on.
+   * @param elapsed_time The real time since the last call, in seconds.
+   * @return The number of steps taken.
+   */
+  int advance(const Globe &globe, double elapsed_time);
+
+  /**
+   * Takes as many steps as fit in the real time elapsed, as advance() does,
+   * but with the input recorded for each step in place of the one set.
+   * @param globe The globe the boat sails on.
+   * @param elapsed_time The real time since the last call, in seconds.
+   * @param input_log The input to replay, recorded with the same step
+   *     duration.
+   * @return The number of steps taken.
+   */
+  int advance(const Globe &globe, double elapsed_time,
+              const InputLog &input_log);
+
+  /** @return The state as of the latest step. */
+  const SimulationState &getState() const;
+
+  /**
+   * @return The fraction of a step left over, which the current frame is
+   *     drawn at between the last two steps.
+   */
+  PN_stdfloat getInterpolationFactor() const;
+
+  /**
+   * @param t The fraction of the way from the previous step to the latest.
+   * @return The state between the last two steps.
+   */
+  SimulationState getInterpolatedState(PN_stdfloat t) const;
+
+  /** @return The simulated time each step covers, in seconds. */
+  double getStepDuration() const;
+
+  const Fleet &getFleet() const;
+
+  /** @return The number of steps taken so far. */
+  unsigned long getStepCount() const;
+
+ protected:
+  double step_duration_;
+  /** The real time not yet spent on steps, in seconds. */
+  double accumulated_time_;
+  unsigned long step_count_;
+  LVector3 input_;
+  SimulationState previous_state_;
+  SimulationState state_;
+  Fleet fleet_;
+  /** The currents the boat and the fleet drift with. */
+  OceanCurrents ocean_currents_;
+
+  /**
+   * Takes as many steps as fit in the real time elapsed.
+   * @param input_log The input to replay, or null to apply the one set.
+   */
+  int takeSteps(const Globe &globe, double elapsed_time,
+                const InputLog *input_log);
+
+  /** Moves the state forward by a single step. */
+  void step(const Globe &globe);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SIMULATION_H
@@ -0,0 +1,128 @@
+#include "simulation_thread.h"
+
+#include <algorithm>
+
+namespace earth_world {
+
+SimulationThread::SimulationThread(const Globe &globe,
+                                   const Simulation &simulation)
+    : globe_(globe),
+      simulation_{simulation},
+      snapshots_{SimulationSnapshot{
+          simulation, std::chrono::steady_clock::now(), true}},
+      input_{0},
+      recording_{false},
+      replaying_{false},
+      input_log_{simulation.getStepDuration()},
+      stopping_{false} {}
+
+SimulationThread::~SimulationThread() {
+  stopping_.store(true);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void SimulationThread::start() {
+  thread_ = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::advance(double elapsed_time) {
+  std::lock_guard<std::mutex> step_lock(step_mutex_);
+  advanceLocked(elapsed_time, std::chrono::steady_clock::now(),
+                /* real_time= */ false);
+}
+
+void SimulationThread::record() { recording_ = true; }
+
+void SimulationThread::replay(const InputLog &input_log) {
+  replaying_ = true;
+  input_log_ = input_log;
+}
+
+InputLog SimulationThread::getRecording() {
+  std::lock_guard<std::mutex> lock(step_mutex_);
+  if (!recording_) {
+    return InputLog(simulation_.getStepDuration());
+  }
+  InputLog recording = input_log_;
+  recording.setEndStep(simulation_.getStepCount());
+  return recording;
+}
+
+void SimulationThread::setInput(const LVector3 &input) {
+  std::lock_guard<std::mutex> lock(input_mutex_);
+  input_ = input;
+}
+
+void SimulationThread::pause() { step_mutex_.lock(); }
+
+void SimulationThread::resume() { step_mutex_.unlock(); }
+
+const SimulationSnapshot &SimulationThread::read() {
+  return snapshots_.read();
+}
+
+PN_stdfloat SimulationThread::getInterpolationFactor(
+    const SimulationSnapshot &snapshot) {
+  double elapsed_time = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - snapshot.time)
+                            .count();
+  double t = snapshot.simulation.getInterpolationFactor();
+  if (snapshot.real_time) {
+    t += elapsed_time / snapshot.simulation.getStepDuration();
+  }
+  // Hold at the latest step, rather than overshoot it, if the simulation
+  // falls behind.
+  return static_cast<PN_stdfloat>(std::min(1.0, t));
+}
+
+void SimulationThread::run() {
+  std::chrono::steady_clock::time_point last_time =
+      std::chrono::steady_clock::now();
+  while (!stopping_.load()) {
+    {
+      std::lock_guard<std::mutex> step_lock(step_mutex_);
+      std::chrono::steady_clock::time_point time =
+          std::chrono::steady_clock::now();
+      double elapsed_time =
+          std::chrono::duration<double>(time - last_time).count();
+      last_time = time;
+      advanceLocked(elapsed_time, time, /* real_time= */ true);
+    }
+    // Sleep until the next step is due.
+    double time_until_step = (1 - simulation_.getInterpolationFactor()) *
+                             simulation_.getStepDuration();
+    std::this_thread::sleep_for(std::chrono::duration<double>(time_until_step));
+  }
+}
+
+void SimulationThread::advanceLocked(
+    double elapsed_time, std::chrono::steady_clock::time_point time,
+    bool real_time) {
+  {
+    std::lock_guard<std::mutex> input_lock(input_mutex_);
+    simulation_.setInput(input_);
+    if (recording_) {
+      input_log_.record(simulation_.getStepCount(), input_);
+    }
+  }
+  int step_count;
+  if (replaying_ && simulation_.getStepCount() < input_log_.getEndStep()) {
+    step_count = simulation_.advance(globe_, elapsed_time, input_log_);
+  } else {
+    step_count = simulation_.advance(globe_, elapsed_time);
+  }
+  // In real time, frames carry on between the published steps by
+  // themselves, so only new steps need publishing. Otherwise, every advance
+  // moves the drawn time along.
+  if (step_count > 0 || !real_time) {
+    SimulationSnapshot &snapshot = snapshots_.getBack();
+    snapshot.simulation = simulation_;
+    snapshot.time = time;
+    snapshot.real_time = real_time;
+    snapshots_.publish();
+  }
+}
+
+}  // namespace earth_world
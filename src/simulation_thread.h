@@ -0,0 +1,146 @@
+#ifndef EARTH_WORLD_SIMULATION_THREAD_H
+#define EARTH_WORLD_SIMULATION_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "globe.h"
+#include "input_log.h"
+#include "panda3d/aa_luse.h"
+#include "simulation.h"
+#include "triple_buffer.h"
+
+namespace earth_world {
+
+/** The simulation as of one of its steps, as handed over for drawing. */
+struct SimulationSnapshot {
+  Simulation simulation;
+  /** When the simulation was last advanced. */
+  std::chrono::steady_clock::time_point time;
+  /**
+   * Whether frames carry on from the snapshot in real time, or draw it as
+   * of when it was last advanced.
+   */
+  bool real_time;
+};
+
+/**
+ * Runs the simulation on a thread of its own, so that its steps don't hold
+ * up culling and drawing, nor the other way around.
+ *
+ * After every advance, the whole simulation is copied into a triple buffer,
+ * from which frames read the latest copy without ever waiting on the
+ * simulation thread.
+ */
+class SimulationThread {
+ public:
+  /**
+   * @param globe The globe the boats sail on, which must outlive the thread.
+   * @param simulation The simulation to run, as of its first step.
+   */
+  SimulationThread(const Globe &globe, const Simulation &simulation);
+  SimulationThread(const SimulationThread &) = delete;
+  SimulationThread(SimulationThread &&) = delete;
+  SimulationThread &operator=(const SimulationThread &) = delete;
+  SimulationThread &operator=(SimulationThread &&) = delete;
+  /** Stops the thread, after the step in progress. */
+  ~SimulationThread();
+
+  /** Starts stepping the simulation, in real time from now on. */
+  void start();
+
+  /**
+   * Advances the simulation by a fixed time on the calling thread, in place
+   * of starting the thread, so that a run drawing a fixed number of frames
+   * comes out the same every time, however long its frames take.
+   * @param elapsed_time The simulated time to advance by, in seconds.
+   */
+  void advance(double elapsed_time);
+
+  /**
+   * Records the input every step takes, for replaying later. Only to be
+   * called before starting.
+   */
+  void record();
+
+  /**
+   * Replays recorded input in place of the input set, until the log ends,
+   * then goes back to the input set. Only to be called before starting.
+   * @param input_log The input to replay, recorded with the simulation's
+   *     step duration.
+   */
+  void replay(const InputLog &input_log);
+
+  /**
+   * @return The input recorded so far, ending at the latest step, or an
+   *     empty log if not recording.
+   */
+  InputLog getRecording();
+
+  /**
+   * Sets the input the following steps apply.
+   * @param input The user's input, where the X axis is horizontal motion,
+   *     the Y axis is vertical motion, the Z axis is zoom level.
+   */
+  void setInput(const LVector3 &input);
+
+  /**
+   * Waits for the step in progress to finish, then holds off any more until
+   * resumed, so that the globe may be changed meanwhile.
+   */
+  void pause();
+
+  /** Lets the simulation step again, catching up on the time paused. */
+  void resume();
+
+  /**
+   * Reads the latest snapshot, without waiting. Only to be called from one
+   * thread.
+   * @return The latest snapshot, which stays put until the next call.
+   */
+  const SimulationSnapshot &read();
+
+  /**
+   * @param snapshot A snapshot from read().
+   * @return The fraction of the way from the snapshot's previous step to its
+   *     latest, that a frame drawn now lies at.
+   */
+  static PN_stdfloat getInterpolationFactor(const SimulationSnapshot &snapshot);
+
+ protected:
+  const Globe &globe_;
+  /** Only ever touched by the simulation thread, once started. */
+  Simulation simulation_;
+  TripleBuffer<SimulationSnapshot> snapshots_;
+
+  std::mutex input_mutex_;
+  LVector3 input_;
+  bool recording_;
+  bool replaying_;
+  /** The input recorded or being replayed, guarded by the step mutex. */
+  InputLog input_log_;
+  /** Held for the duration of every step, and while paused. */
+  std::mutex step_mutex_;
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+
+  /** Advances the simulation in real time, until stopped. */
+  void run();
+
+  /**
+   * Applies the input, takes as many steps as fit in the elapsed time, and
+   * publishes the result. Only to be called with the step mutex held.
+   * @param elapsed_time The time to advance by, in seconds.
+   * @param time When the advance happens.
+   * @param real_time Whether frames carry on from the result in real time.
+   */
+  void advanceLocked(double elapsed_time,
+                     std::chrono::steady_clock::time_point time,
+                     bool real_time);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SIMULATION_THREAD_H
@@ -0,0 +1,260 @@
+#include "sphere_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "min_heap.h"
+
+namespace earth_world {
+
+/** The deepest quadtree level, where cells are about a meter across. */
+const int kMaxLevel = 24;
+const int kFaceShift = 2 * kMaxLevel;
+/** Cells with no more points than this are scanned instead of split. */
+const std::size_t kScanThreshold = 8;
+
+/**
+ * Maps a face coordinate in [0, 1] to the cube face in [-1, 1], with S2's
+ * quadratic transform, which evens out cell areas between face centers and
+ * corners.
+ */
+static PN_stdfloat faceFromCellCoordinate(PN_stdfloat s) {
+  return s >= 0.5f ? (1.f / 3) * ((4 * s * s) - 1)
+                   : (1.f / 3) * (1 - (4 * (1 - s) * (1 - s)));
+}
+
+/** The inverse of faceFromCellCoordinate. */
+static PN_stdfloat cellFromFaceCoordinate(PN_stdfloat u) {
+  return u >= 0 ? 0.5f * sqrtf(1 + (3 * u))
+                : 1 - (0.5f * sqrtf(1 - (3 * u)));
+}
+
+/**
+ * @return The direction through the given face coordinates, where faces
+ *     0 to 5 are +X, -X, +Y, -Y, +Z and -Z.
+ */
+static LVector3 directionFromFace(int face, PN_stdfloat u, PN_stdfloat v) {
+  PN_stdfloat sign = (face % 2) == 0 ? 1.f : -1.f;
+  switch (face / 2) {
+    case 0:
+      return LVector3(sign, u, v).normalized();
+    case 1:
+      return LVector3(u, sign, v).normalized();
+    default:
+      return LVector3(u, v, sign).normalized();
+  }
+}
+
+/** Spreads the low 24 bits of a value out to the even bits. */
+static uint64_t spreadBits(uint32_t value) {
+  uint64_t bits = value;
+  bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFu;
+  bits = (bits | (bits << 8)) & 0x00FF00FF00FF00FFu;
+  bits = (bits | (bits << 4)) & 0x0F0F0F0F0F0F0F0Fu;
+  bits = (bits | (bits << 2)) & 0x3333333333333333u;
+  bits = (bits | (bits << 1)) & 0x5555555555555555u;
+  return bits;
+}
+
+SphereIndex::SphereIndex(const std::vector<LVector3> &points) {
+  std::vector<std::pair<uint64_t, int>> sorted;
+  sorted.reserve(points.size());
+  for (std::size_t i = 0; i < points.size(); i++) {
+    sorted.emplace_back(getLeafCellId(points[i]), static_cast<int>(i));
+  }
+  std::sort(sorted.begin(), sorted.end());
+  ids_.reserve(sorted.size());
+  directions_.reserve(sorted.size());
+  indices_.reserve(sorted.size());
+  for (const std::pair<uint64_t, int> &entry : sorted) {
+    ids_.push_back(entry.first);
+    directions_.push_back(
+        points[static_cast<std::size_t>(entry.second)].normalized());
+    indices_.push_back(entry.second);
+  }
+}
+
+int SphereIndex::getNearest(const LVector3 &point,
+                            PN_stdfloat max_angle) const {
+  std::vector<int> nearest = getKNearest(point, 1, max_angle);
+  return nearest.empty() ? -1 : nearest[0];
+}
+
+std::vector<int> SphereIndex::getKNearest(const LVector3 &point, int count,
+                                          PN_stdfloat max_angle) const {
+  // Best first search, over a queue of both cells, keyed by the nearest any
+  // of their points could be, and points, keyed by their exact distance.
+  // Whenever a point is popped, nothing left in the queue can be nearer.
+  struct Candidate {
+    PN_stdfloat angle;
+    /** The sorted index of a point, or -1 for a cell. */
+    long long point;
+    Cell cell;
+    bool operator<(const Candidate &other) const {
+      return angle < other.angle;
+    }
+  };
+  std::vector<int> result;
+  if (count <= 0 || ids_.empty()) {
+    return result;
+  }
+  LVector3 direction = point.normalized();
+  MinHeap<Candidate> queue;
+  for (int face = 0; face < 6; face++) {
+    queue.push(Candidate{0, -1, Cell{face, 0, 0, 0}});
+  }
+  while (!queue.empty() && static_cast<int>(result.size()) < count) {
+    Candidate candidate = queue.top();
+    queue.pop();
+    if (candidate.angle > max_angle) {
+      break;
+    }
+    if (candidate.point >= 0) {
+      result.push_back(indices_[static_cast<std::size_t>(candidate.point)]);
+      continue;
+    }
+    std::size_t begin;
+    std::size_t end;
+    getCellRange(candidate.cell, begin, end);
+    if (begin == end) {
+      continue;
+    }
+    if (end - begin <= kScanThreshold || candidate.cell.level == kMaxLevel) {
+      for (std::size_t i = begin; i < end; i++) {
+        queue.push(Candidate{getAngle(direction, directions_[i]),
+                             static_cast<long long>(i), candidate.cell});
+      }
+      continue;
+    }
+    Cell children[4];
+    getChildren(candidate.cell, children);
+    for (const Cell &child : children) {
+      LVector3 center;
+      PN_stdfloat radius;
+      getBoundingCap(child, center, radius);
+      queue.push(Candidate{
+          std::max(0.f, getAngle(direction, center) - radius), -1, child});
+    }
+  }
+  return result;
+}
+
+std::vector<int> SphereIndex::getWithinRadius(const LVector3 &point,
+                                              PN_stdfloat angle) const {
+  std::vector<int> result;
+  LVector3 direction = point.normalized();
+  std::vector<Cell> stack;
+  for (int face = 0; face < 6; face++) {
+    stack.push_back(Cell{face, 0, 0, 0});
+  }
+  while (!stack.empty()) {
+    Cell cell = stack.back();
+    stack.pop_back();
+    std::size_t begin;
+    std::size_t end;
+    getCellRange(cell, begin, end);
+    if (begin == end) {
+      continue;
+    }
+    LVector3 center;
+    PN_stdfloat radius;
+    getBoundingCap(cell, center, radius);
+    if (getAngle(direction, center) > angle + radius) {
+      continue;
+    }
+    if (end - begin <= kScanThreshold || cell.level == kMaxLevel) {
+      for (std::size_t i = begin; i < end; i++) {
+        if (getAngle(direction, directions_[i]) <= angle) {
+          result.push_back(indices_[i]);
+        }
+      }
+      continue;
+    }
+    Cell children[4];
+    getChildren(cell, children);
+    stack.insert(stack.end(), children, children + 4);
+  }
+  return result;
+}
+
+uint64_t SphereIndex::getLeafCellId(const LVector3 &point) {
+  PN_stdfloat abs_x = std::fabs(point.get_x());
+  PN_stdfloat abs_y = std::fabs(point.get_y());
+  PN_stdfloat abs_z = std::fabs(point.get_z());
+  int face;
+  PN_stdfloat u;
+  PN_stdfloat v;
+  if (abs_x >= abs_y && abs_x >= abs_z) {
+    face = point.get_x() >= 0 ? 0 : 1;
+    u = point.get_y() / abs_x;
+    v = point.get_z() / abs_x;
+  } else if (abs_y >= abs_z) {
+    face = point.get_y() >= 0 ? 2 : 3;
+    u = point.get_x() / abs_y;
+    v = point.get_z() / abs_y;
+  } else {
+    face = point.get_z() >= 0 ? 4 : 5;
+    u = point.get_x() / std::max(abs_z, 1e-30f);
+    v = point.get_y() / std::max(abs_z, 1e-30f);
+  }
+  const PN_stdfloat cell_count = static_cast<PN_stdfloat>(1 << kMaxLevel);
+  uint32_t i = static_cast<uint32_t>(std::min(
+      cell_count - 1,
+      std::max(0.f, std::floor(cellFromFaceCoordinate(u) * cell_count))));
+  uint32_t j = static_cast<uint32_t>(std::min(
+      cell_count - 1,
+      std::max(0.f, std::floor(cellFromFaceCoordinate(v) * cell_count))));
+  return (static_cast<uint64_t>(face) << kFaceShift) | spreadBits(i) |
+         (spreadBits(j) << 1);
+}
+
+void SphereIndex::getCellRange(const Cell &cell, std::size_t &begin,
+                               std::size_t &end) const {
+  int shift = 2 * (kMaxLevel - cell.level);
+  uint64_t first = (static_cast<uint64_t>(cell.face) << kFaceShift) |
+                   ((spreadBits(cell.i) | (spreadBits(cell.j) << 1)) << shift);
+  uint64_t last = first + (uint64_t{1} << shift);
+  begin = static_cast<std::size_t>(
+      std::lower_bound(ids_.begin(), ids_.end(), first) - ids_.begin());
+  end = static_cast<std::size_t>(
+      std::lower_bound(ids_.begin() + static_cast<std::ptrdiff_t>(begin),
+                       ids_.end(), last) -
+      ids_.begin());
+}
+
+void SphereIndex::getChildren(const Cell &cell, Cell children[4]) {
+  for (uint32_t child = 0; child < 4; child++) {
+    children[child] = Cell{cell.face, cell.level + 1,
+                           (cell.i << 1) | (child & 1),
+                           (cell.j << 1) | (child >> 1)};
+  }
+}
+
+void SphereIndex::getBoundingCap(const Cell &cell, LVector3 &center,
+                                 PN_stdfloat &radius) {
+  // Cell edges are great circle arcs, so a cap around the corners holds the
+  // whole cell.
+  PN_stdfloat size = 1.f / static_cast<PN_stdfloat>(1 << cell.level);
+  LVector3 corners[4];
+  for (int corner = 0; corner < 4; corner++) {
+    corners[corner] = directionFromFace(
+        cell.face,
+        faceFromCellCoordinate(
+            (static_cast<PN_stdfloat>(cell.i) + (corner & 1)) * size),
+        faceFromCellCoordinate(
+            (static_cast<PN_stdfloat>(cell.j) + (corner >> 1)) * size));
+  }
+  center = (corners[0] + corners[1] + corners[2] + corners[3]).normalized();
+  radius = 0;
+  for (const LVector3 &corner : corners) {
+    radius = std::max(radius, getAngle(center, corner));
+  }
+  // Pad for rounding, so that points on an edge are never missed.
+  radius += 1e-6f;
+}
+
+PN_stdfloat SphereIndex::getAngle(const LVector3 &a, const LVector3 &b) {
+  return atan2f(a.cross(b).length(), a.dot(b));
+}
+
+}  // namespace earth_world
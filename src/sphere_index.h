@@ -0,0 +1,100 @@
+#ifndef EARTH_WORLD_SPHERE_INDEX_H
+#define EARTH_WORLD_SPHERE_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "panda3d/aa_luse.h"
+
+namespace earth_world {
+
+/**
+ * A static spatial index over points on the sphere, for nearest, k-nearest
+ * and radius queries.
+ *
+ * In the style of S2, the sphere is projected onto the six faces of a cube,
+ * and each face is split as a quadtree whose cells are numbered along a
+ * Z-order curve. Every point gets the 64-bit id of the leaf cell it falls in,
+ * so any cell's points are a contiguous range of the points sorted by id, and
+ * a query descends only into the cells near it, taking O(log n) per cell
+ * visited rather than touching every point.
+ */
+class SphereIndex {
+ public:
+  /**
+   * @param points The points to index, relative to the sphere's center. Only
+   *     their directions matter. Queries return indices into this list.
+   */
+  explicit SphereIndex(const std::vector<LVector3> &points);
+  SphereIndex(const SphereIndex &) = default;
+  SphereIndex(SphereIndex &&) noexcept = default;
+  SphereIndex &operator=(const SphereIndex &) = default;
+  SphereIndex &operator=(SphereIndex &&) noexcept = default;
+  ~SphereIndex() = default;
+
+  /**
+   * @param point The query point, relative to the sphere's center.
+   * @param max_angle The farthest a point may be, in radians.
+   * @return The index of the nearest point, or -1 if none is in range.
+   */
+  int getNearest(const LVector3 &point, PN_stdfloat max_angle) const;
+
+  /**
+   * @param point The query point, relative to the sphere's center.
+   * @param count The number of points to find.
+   * @param max_angle The farthest a point may be, in radians.
+   * @return The indices of up to count points in range, nearest first.
+   */
+  std::vector<int> getKNearest(const LVector3 &point, int count,
+                               PN_stdfloat max_angle) const;
+
+  /**
+   * @param point The query point, relative to the sphere's center.
+   * @param angle The radius of the query, in radians.
+   * @return The indices of all points within the radius, in no order.
+   */
+  std::vector<int> getWithinRadius(const LVector3 &point,
+                                   PN_stdfloat angle) const;
+
+  /** @return The id of the leaf cell the given direction falls in. */
+  static uint64_t getLeafCellId(const LVector3 &point);
+
+ protected:
+  /** A cell of one face's quadtree. */
+  struct Cell {
+    int face;
+    int level;
+    uint32_t i;
+    uint32_t j;
+  };
+
+  /** The leaf cell ids of the points, sorted. */
+  std::vector<uint64_t> ids_;
+  /** The unit directions of the points, in the same order as the ids. */
+  std::vector<LVector3> directions_;
+  /** The caller's index of each point, in the same order as the ids. */
+  std::vector<int> indices_;
+
+  /** @return The first and one past the last sorted point within a cell. */
+  void getCellRange(const Cell &cell, std::size_t &begin,
+                    std::size_t &end) const;
+
+  /** @return The four children of a cell, on the next level. */
+  static void getChildren(const Cell &cell, Cell children[4]);
+
+  /**
+   * Finds a cap which contains the cell.
+   * @param cell The cell to bound.
+   * @param center Filled with the cap's unit center.
+   * @param radius Filled with the cap's angular radius.
+   */
+  static void getBoundingCap(const Cell &cell, LVector3 &center,
+                             PN_stdfloat &radius);
+
+  /** @return The angle between two unit vectors, accurate at all scales. */
+  static PN_stdfloat getAngle(const LVector3 &a, const LVector3 &b);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_SPHERE_INDEX_H
@@ -53,4 +53,12 @@ SpherePoint2 SpherePoint2::fromLatitudeAndLongitude(PN_stdfloat latitude,
                       (latitude / 180.f) * MathNumbers::pi);
 }
 
+PN_stdfloat SpherePoint2::getLatitude() const {
+  return (get_polar() / MathNumbers::pi) * 180.f;
+}
+
+PN_stdfloat SpherePoint2::getLongitude() const {
+  return ((get_azimuthal() / MathNumbers::pi) * 180.f) - 180.f;
+}
+
 }  // namespace earth_world
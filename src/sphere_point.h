@@ -78,6 +78,12 @@ class SpherePoint2 : public LVecBase2 {
 
   static SpherePoint2 fromLatitudeAndLongitude(PN_stdfloat latitude,
                                                PN_stdfloat longitude);
+
+  /** @return The latitude, in degrees, the inverse of the above. */
+  PN_stdfloat getLatitude() const;
+
+  /** @return The longitude, in degrees, the inverse of the above. */
+  PN_stdfloat getLongitude() const;
 };
 
 }  // namespace earth_world
@@ -0,0 +1,31 @@
+#include "status_view.h"
+
+namespace earth_world {
+
+/** The height of a line of text, in pixels. */
+const PN_stdfloat kStatusTextSize = 16.f;
+/** The offset of the first line's baseline from the corner, in pixels. */
+const LVector3 kStatusTextOffset(8.f, 0.f, -24.f);
+const LColor kStatusTextColor(1, 1, 1, 1);
+const LColor kStatusShadowColor(0, 0, 0, 0.8f);
+const PN_stdfloat kStatusShadowOffset = 0.06f;
+
+StatusView::StatusView()
+    : path_{"Status"}, text_node_{new TextNode("StatusText")} {
+  text_node_->set_text_color(kStatusTextColor);
+  text_node_->set_shadow(kStatusShadowOffset, kStatusShadowOffset);
+  text_node_->set_shadow_color(kStatusShadowColor);
+  NodePath text_path = path_.attach_new_node(text_node_);
+  text_path.set_scale(kStatusTextSize);
+  text_path.set_pos(kStatusTextOffset);
+}
+
+StatusView::~StatusView() { path_.remove_node(); }
+
+NodePath StatusView::getPath() const { return path_; }
+
+void StatusView::setText(const std::string &text) {
+  text_node_->set_text(text);
+}
+
+}  // namespace earth_world
@@ -0,0 +1,37 @@
+#ifndef EARTH_WORLD_STATUS_VIEW_H
+#define EARTH_WORLD_STATUS_VIEW_H
+
+#include <string>
+
+#include "panda3d/nodePath.h"
+#include "panda3d/textNode.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * A few lines of text in the top left corner of the screen, telling what was
+ * last picked or reached. Meant to be parented to the pixel 2D scene.
+ */
+class StatusView {
+ public:
+  StatusView();
+  StatusView(const StatusView &) = delete;
+  StatusView(StatusView &&) = delete;
+  StatusView &operator=(const StatusView &) = delete;
+  StatusView &operator=(StatusView &&) = delete;
+  ~StatusView();
+
+  NodePath getPath() const;
+
+  /** Shows the given text, replacing whatever was shown before. */
+  void setText(const std::string &text);
+
+ protected:
+  NodePath path_;
+  PT<TextNode> text_node_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_STATUS_VIEW_H
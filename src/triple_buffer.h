@@ -0,0 +1,75 @@
+#ifndef EARTH_WORLD_TRIPLE_BUFFER_H
+#define EARTH_WORLD_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace earth_world {
+
+/**
+ * Passes values from one writing thread to one reading thread, without
+ * either ever waiting on the other.
+ *
+ * The writer fills a back slot and swaps it with the middle one, and the
+ * reader swaps the middle slot with its front one whenever it holds a value
+ * the reader hasn't yet seen. So the reader always sees the latest complete
+ * value, and the writer never touches the slot being read.
+ */
+template <typename T>
+class TripleBuffer {
+ public:
+  /** @param initial The value all slots start with, until the first write. */
+  explicit TripleBuffer(const T &initial)
+      : slots_{initial, initial, initial},
+        front_{0},
+        middle_{1},
+        back_{2} {}
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer(TripleBuffer &&) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(TripleBuffer &&) = delete;
+  ~TripleBuffer() = default;
+
+  /**
+   * @return The slot to fill with the next value, which holds an older one.
+   *     Only to be called from the writing thread.
+   */
+  T &getBack() { return slots_[back_]; }
+
+  /**
+   * Hands the filled back slot over to the reader. Only to be called from
+   * the writing thread.
+   */
+  void publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+            kIndexMask;
+  }
+
+  /**
+   * @return The latest published value, which stays put until the next
+   *     call. Only to be called from the reading thread.
+   */
+  const T &read() {
+    if ((middle_.load(std::memory_order_relaxed) & kFresh) != 0) {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) &
+               kIndexMask;
+    }
+    return slots_[front_];
+  }
+
+ protected:
+  /** Marks the middle slot as holding a value the reader hasn't yet seen. */
+  static const unsigned int kFresh = 4;
+  static const unsigned int kIndexMask = 3;
+
+  T slots_[3];
+  /** The slot being read, only ever touched by the reader. */
+  unsigned int front_;
+  /** The slot being handed over, along with whether it is fresh. */
+  std::atomic<unsigned int> middle_;
+  /** The slot being written, only ever touched by the writer. */
+  unsigned int back_;
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_TRIPLE_BUFFER_H
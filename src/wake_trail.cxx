@@ -0,0 +1,113 @@
+#include "wake_trail.h"
+
+#include <algorithm>
+
+#include "panda3d/geomLines.h"
+#include "panda3d/geomNode.h"
+#include "panda3d/geomVertexData.h"
+#include "panda3d/geomVertexFormat.h"
+#include "panda3d/geomVertexWriter.h"
+#include "panda3d/omniBoundingVolume.h"
+#include "panda3d/shader.h"
+#include "panda3d/transparencyAttrib.h"
+#include "shader_cache.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+const LColor kWakeColor(0.9f, 0.95f, 1, 0.6f);
+const PN_stdfloat kWakeThickness = 2.f;
+
+WakeTrail::WakeTrail(int capacity, PN_stdfloat min_spacing)
+    : path_{"WakeTrail"},
+      capacity_{std::max(1, capacity)},
+      min_spacing_{min_spacing},
+      head_{0},
+      count_{0},
+      segment_start_{0},
+      segment_end_{0} {
+  PT<GeomVertexData> vertex_data = new GeomVertexData(
+      "WakeTrail", GeomVertexFormat::get_v3(), Geom::UH_stream);
+  vertex_data->set_num_rows(2 * capacity_);
+  PT<GeomLines> lines = new GeomLines(Geom::UH_static);
+  lines->add_consecutive_vertices(0, 2 * capacity_);
+  lines->close_primitive();
+  geom_ = new Geom(vertex_data);
+  geom_->add_primitive(lines);
+  // Keep the bounds fixed, so that updates never walk every vertex.
+  geom_->set_bounds(new OmniBoundingVolume);
+  PT<GeomNode> node = new GeomNode("WakeTrail");
+  node->add_geom(geom_);
+  path_.attach_new_node(node);
+
+  PT<Shader> shader = shader_cache::load("wake.vert", "wake.frag");
+  path_.set_shader(shader);
+  path_.set_shader_input("u_WakeColor", kWakeColor);
+  path_.set_shader_input("u_TrailState", LVecBase3i(head_, count_, capacity_));
+  path_.set_render_mode_thickness(kWakeThickness);
+  path_.set_transparency(TransparencyAttrib::M_alpha);
+  path_.set_depth_write(false);
+}
+
+WakeTrail::WakeTrail(WakeTrail &&other) noexcept
+    : path_{other.path_},
+      geom_{std::move(other.geom_)},
+      capacity_{other.capacity_},
+      min_spacing_{other.min_spacing_},
+      head_{other.head_},
+      count_{other.count_},
+      segment_start_{other.segment_start_},
+      segment_end_{other.segment_end_} {
+  other.path_.clear();
+}
+
+WakeTrail &WakeTrail::operator=(WakeTrail &&other) noexcept {
+  if (path_ == other.path_) {
+    return *this;
+  }
+  path_.remove_node();
+  path_ = other.path_;
+  geom_ = std::move(other.geom_);
+  capacity_ = other.capacity_;
+  min_spacing_ = other.min_spacing_;
+  head_ = other.head_;
+  count_ = other.count_;
+  segment_start_ = other.segment_start_;
+  segment_end_ = other.segment_end_;
+  other.path_.clear();
+  return *this;
+}
+
+WakeTrail::~WakeTrail() { path_.remove_node(); }
+
+NodePath WakeTrail::getPath() const { return path_; }
+
+void WakeTrail::update(const LPoint3 &position) {
+  if (count_ == 0) {
+    // Start with a degenerate segment at the boat.
+    segment_start_ = position;
+    count_ = 1;
+  } else if (position == segment_end_) {
+    return;
+  } else if ((segment_end_ - segment_start_).length() >= min_spacing_) {
+    // The newest segment is long enough, so it stays put and a new one starts
+    // from its end, reusing the oldest slot once the buffer is full.
+    head_ = (head_ + 1) % capacity_;
+    count_ = std::min(count_ + 1, capacity_);
+    segment_start_ = segment_end_;
+  }
+  segment_end_ = position;
+  writeSegment(head_, segment_start_, segment_end_);
+  path_.set_shader_input("u_TrailState", LVecBase3i(head_, count_, capacity_));
+}
+
+void WakeTrail::writeSegment(int slot, const LPoint3 &start,
+                             const LPoint3 &end) {
+  PT<GeomVertexData> vertex_data = geom_->modify_vertex_data();
+  GeomVertexWriter vertices(vertex_data, "vertex");
+  vertices.set_row(2 * slot);
+  vertices.set_data3(start);
+  vertices.set_data3(end);
+}
+
+}  // namespace earth_world
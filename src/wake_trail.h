@@ -0,0 +1,58 @@
+#ifndef EARTH_WORLD_WAKE_TRAIL_H
+#define EARTH_WORLD_WAKE_TRAIL_H
+
+#include "panda3d/aa_luse.h"
+#include "panda3d/geom.h"
+#include "panda3d/nodePath.h"
+#include "typedefs.h"
+
+namespace earth_world {
+
+/**
+ * A fading trail left behind a boat. The recent path is kept as a fixed
+ * capacity ring buffer of line segments in a streamed vertex array, so each
+ * frame only rewrites the newest segment and never reallocates. The shader
+ * derives every segment's age from its slot and fades the oldest out.
+ */
+class WakeTrail {
+ public:
+  /**
+   * @param capacity The number of segments kept before the oldest is reused.
+   * @param min_spacing The length a segment grows to before a new one starts.
+   */
+  WakeTrail(int capacity, PN_stdfloat min_spacing);
+  WakeTrail(const WakeTrail &) = delete;
+  WakeTrail(WakeTrail &&) noexcept;
+  WakeTrail &operator=(const WakeTrail &) = delete;
+  WakeTrail &operator=(WakeTrail &&) noexcept;
+  ~WakeTrail();
+
+  NodePath getPath() const;
+
+  /**
+   * Extends the trail to the given position, either by stretching the
+   * newest segment, or by starting a new one once it is long enough.
+   * @param position The boat's position, relative to the trail's parent.
+   */
+  void update(const LPoint3 &position);
+
+ protected:
+  NodePath path_;
+  PT<Geom> geom_;
+  int capacity_;
+  PN_stdfloat min_spacing_;
+  /** The slot of the newest segment. */
+  int head_;
+  /** The number of segments written so far, up to the capacity. */
+  int count_;
+  /** Where the newest segment starts and ends. */
+  LPoint3 segment_start_;
+  LPoint3 segment_end_;
+
+  /** Writes the given segment into its slot of the ring buffer. */
+  void writeSegment(int slot, const LPoint3 &start, const LPoint3 &end);
+};
+
+}  // namespace earth_world
+
+#endif  // EARTH_WORLD_WAKE_TRAIL_H